@@ -2,6 +2,27 @@
 //  simply #include all the headers of the header-only library to build a
 //  shared library
 
+#include "r2_adc.h"
+#include "r2_adc_filter.h"
+#include "r2_adc_iio.h"
+#include "r2_adc_lcm.h"
+#include "r2_attitude_filter.h"
+#include "r2_attitude_series.h"
+#include "r2_capture.h"
+#include "r2_capture_compress.h"
 #include "r2_epoch.h"
+#include "r2_epoch_format.h"
+#include "r2_epoch_sync.h"
+#include "r2_nmea.h"
+#include "r2_number.h"
 #include "r2_quaternion.h"
+#include "r2_quaternion_algebra.h"
+#include "r2_quaternion_batch.h"
+#include "r2_quaternion_fixed.h"
+#include "r2_replay.h"
+#include "r2_serial_lcm.h"
+#include "r2_shm_ring.h"
 #include "r2_timerfd.h"
+#include "r2_timerfd_set.h"
+#include "r2_timer_wheel.h"
+#include "r2_transport.h"
@@ -0,0 +1,360 @@
+// r2_adc.h
+// Read lines of integer samples from an ADC, scaled to floating point
+//
+// Each line (terminated by \n; a \r before it is ignored) holds one sample
+// of every channel as decimal or hexadecimal integers, separated by any
+// other characters (spaces, commas, tabs, labels without digits). Lines
+// accumulate in an r2_buffer and are parsed in place, a word at a time:
+// eight characters are loaded into a 64-bit integer, the run of digits is
+// found with a few bitwise operations and converted with three multiplies
+// (SWAR, SIMD within a register, with the primitives of r2_number.h), so
+// there is no per-character loop and no strtol. The integer samples are
+// then scaled and offset per channel into float or double arrays by a loop
+// the compiler vectorizes.
+//
+// Decimal values may be negative ('-' just before the digits) and
+// saturate at the int32_t range. Hexadecimal values, with or without a 0x
+// prefix, keep their low 32 bits as two's complement, so FFFFFFFF is -1.
+//
+// Lines with a different number of values than there are channels are
+// dropped and counted; blank lines are skipped.
+
+#ifndef R2_ADC_H
+#define R2_ADC_H
+
+#include <inttypes.h> // for int32_t, uint64_t
+#include <stddef.h> // for size_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memchr
+
+#include "r2_buffer.h"
+#include "r2_fastmath.h"
+#include "r2_number.h"
+
+// Rows parsed per batch before scaling.
+#ifndef R2_ADC_ROWS
+#define R2_ADC_ROWS 64
+#endif
+
+struct r2_adc {
+    struct r2_buffer * buffer;
+    size_t channels;
+    int base; // 10 or 16
+    double * scale; // per channel
+    double * offset;
+    float * scale_f; // the same, in single precision
+    float * offset_f;
+    int32_t * raw; // R2_ADC_ROWS rows of samples being scaled
+    size_t rows; // rows read so far
+    size_t dropped; // lines dropped
+};
+
+/*  Create a reader for lines of channels integers in base 10 or 16, with
+ *  room to buffer size bytes.
+ *
+ *  Every channel starts with scale 1 and offset 0.
+ */
+struct r2_adc * r2_adc_create( const size_t channels, const int base,
+        const size_t size );
+
+void r2_adc_destroy( struct r2_adc * self );
+
+/*  Set the output of a channel to raw * scale + offset.
+ */
+void r2_adc_set_scale( struct r2_adc * self, const size_t channel,
+        const double scale, const double offset );
+
+/*  Read whatever is available on fd into the buffer.
+ *
+ *  Returns the number of bytes read, as r2_buffer_fill.
+ */
+size_t r2_adc_fill( struct r2_adc * self, int fd );
+
+/*  Parse up to max_rows complete lines from the buffer into raw, channels
+ *  values per row, and remove them from the buffer.
+ *
+ *  Returns the number of rows stored.
+ */
+size_t r2_adc_get_raw( struct r2_adc * self, int32_t * raw,
+        const size_t max_rows );
+
+/*  Parse up to max_rows complete lines from the buffer and store them
+ *  scaled in out, channels values per row.
+ *
+ *  Returns the number of rows stored.
+ */
+size_t r2_adc_get_float( struct r2_adc * self, float * out,
+        const size_t max_rows );
+
+size_t r2_adc_get_double( struct r2_adc * self, double * out,
+        const size_t max_rows );
+
+/*  Parse the integers in line[0..length) in base 10 or 16, storing up to
+ *  max of them in values.
+ *
+ *  R2_NUMBER_PADDING bytes past the end of the line must be readable.
+ *  Returns the number of integers in the line, which may be more than max.
+ */
+size_t r2_adc_parse( const char * line, const size_t length, const int base,
+        int32_t * values, const size_t max );
+
+/*  out = raw * scale + offset for rows of channels samples, with scale and
+ *  offset per channel.
+ */
+void r2_adc_scale_f( const int32_t * restrict raw, const size_t rows,
+        const size_t channels, const float * restrict scale,
+        const float * restrict offset, float * restrict out );
+
+void r2_adc_scale_d( const int32_t * restrict raw, const size_t rows,
+        const size_t channels, const double * restrict scale,
+        const double * restrict offset, double * restrict out );
+
+#endif // R2_ADC_H
+
+#ifndef R2_ADC_I
+#define R2_ADC_I
+
+struct r2_adc * r2_adc_create( const size_t channels, const int base,
+        const size_t size )
+{
+    if( 0 == channels || ( 10 != base && 16 != base ) ) {
+        fprintf( stderr, "r2_adc needs channels and a base of 10 or 16\n" );
+        return NULL;
+    }
+    struct r2_adc * self = calloc( 1, sizeof( struct r2_adc ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_adc\n" );
+        return NULL;
+    }
+    self->channels = channels;
+    self->base = base;
+    self->scale = calloc( channels, sizeof( double ) );
+    self->offset = calloc( channels, sizeof( double ) );
+    self->scale_f = calloc( channels, sizeof( float ) );
+    self->offset_f = calloc( channels, sizeof( float ) );
+    self->raw = calloc( channels * R2_ADC_ROWS, sizeof( int32_t ) );
+    self->buffer = r2_number_buffer_create( size );
+    if( NULL == self->scale || NULL == self->offset || NULL == self->scale_f
+            || NULL == self->offset_f || NULL == self->raw
+            || NULL == self->buffer ) {
+        fprintf( stderr, "could not allocate r2_adc\n" );
+        r2_adc_destroy( self );
+        return NULL;
+    }
+    size_t c;
+    for( c = 0; c < channels; c++ )
+        r2_adc_set_scale( self, c, 1, 0 );
+    return self;
+}
+
+void r2_adc_destroy( struct r2_adc * self )
+{
+    if( self ) {
+        r2_number_buffer_destroy( self->buffer );
+        free( self->raw );
+        free( self->offset_f );
+        free( self->scale_f );
+        free( self->offset );
+        free( self->scale );
+        free( self );
+    }
+}
+
+void r2_adc_set_scale( struct r2_adc * self, const size_t channel,
+        const double scale, const double offset )
+{
+    self->scale[channel] = scale;
+    self->offset[channel] = offset;
+    self->scale_f[channel] = (float)scale;
+    self->offset_f[channel] = (float)offset;
+}
+
+size_t r2_adc_fill( struct r2_adc * self, int fd )
+{
+    return r2_buffer_fill( self->buffer, fd );
+}
+
+// 0x80 in each digit of x in base 10 or 16, else 0.
+uint64_t r2_adc_digits( const uint64_t x, const int base )
+{
+    uint64_t d = r2_number_between( x, '0', '9' );
+    if( 16 == base )
+        d |= r2_number_between( x | ( 0x20 * R2_NUMBER_ONES ), 'a', 'f' );
+    return d;
+}
+
+// Parse the digits starting at p (there is at least one), up to end, eight
+// at a time. Returns the end of the digits.
+const char * r2_adc_parse_digits( const char * p, const char * end,
+        const int base, uint64_t * value )
+{
+    static const uint64_t power[9] = { 1, 10, 100, 1000, 10000, 100000,
+        1000000, 10000000, 100000000 };
+    uint64_t v = 0;
+    for( ;; ) {
+        uint64_t x = r2_number_load( p );
+        size_t n = r2_number_run( r2_adc_digits( x, base ) );
+        size_t left = end - p;
+        n = n < left ? n : left;
+        if( 0 == n )
+            break;
+        // shift the digits to the top, behind leading zeros
+        int shift = 8 * ( 8 - (int)n );
+        if( 16 == base ) {
+            v = v << ( 4 * n ) | r2_number_eight_hex( x << shift );
+        } else {
+            v = v * power[n]
+                + r2_number_eight_digits(
+                        ( x - '0' * R2_NUMBER_ONES ) << shift );
+            v = v < ( 1ULL << 32 ) ? v : ( 1ULL << 32 ); // saturate
+        }
+        p += n;
+        if( n < 8 )
+            break;
+    }
+    *value = v;
+    return p;
+}
+
+size_t r2_adc_parse( const char * line, const size_t length, const int base,
+        int32_t * values, const size_t max )
+{
+    const char * p = line;
+    const char * end = line + length;
+    size_t n = 0;
+    while( p < end ) {
+        // skip to the next digit
+        uint64_t d = r2_adc_digits( r2_number_load( p ), base );
+        if( 0 == d ) {
+            p += 8;
+            continue;
+        }
+        p += __builtin_ctzll( d ) >> 3;
+        if( p >= end )
+            break;
+
+        uint64_t v;
+        int64_t value;
+        if( 16 == base ) {
+            if( '0' == p[0] && end - p > 2 && 'x' == ( p[1] | 0x20 )
+                    && r2_adc_digits( r2_number_load( p + 2 ), 16 ) & 0x80 )
+                p += 2;
+            p = r2_adc_parse_digits( p, end, 16, &v );
+            value = (int64_t)( v & 0xffffffff );
+            value = value > INT32_MAX ? value - ( 1LL << 32 ) : value;
+        } else {
+            int negative = p > line && '-' == p[-1];
+            p = r2_adc_parse_digits( p, end, 10, &v );
+            value = negative ? -(int64_t)v : (int64_t)v;
+            value = value > INT32_MAX ? INT32_MAX
+                : ( value < INT32_MIN ? INT32_MIN : value );
+        }
+        if( n < max )
+            values[n] = (int32_t)value;
+        n++;
+    }
+    return n;
+}
+
+size_t r2_adc_get_raw( struct r2_adc * self, int32_t * raw,
+        const size_t max_rows )
+{
+    struct r2_buffer * b = self->buffer;
+    size_t used = 0;
+    size_t rows = 0;
+    while( rows < max_rows ) {
+        char * line = b->data + used;
+        char * eol = memchr( line, '\n', b->position - used );
+        if( NULL == eol )
+            break;
+        size_t n = r2_adc_parse( line, eol - line, self->base,
+                raw + rows * self->channels, self->channels );
+        if( n == self->channels )
+            rows++;
+        else if( n )
+            self->dropped++;
+        used = eol + 1 - b->data;
+    }
+    if( 0 == used && b->position == b->size ) {
+        fprintf( stderr,
+                "r2_adc buffer filled without any lines -- clearing\n" );
+        self->dropped++;
+        used = b->position;
+    }
+    r2_buffer_drop( b, used );
+    self->rows += rows;
+    return rows;
+}
+
+size_t r2_adc_get_float( struct r2_adc * self, float * out,
+        const size_t max_rows )
+{
+    size_t rows = 0;
+    while( rows < max_rows ) {
+        size_t left = max_rows - rows;
+        size_t n = r2_adc_get_raw( self, self->raw,
+                left < R2_ADC_ROWS ? left : R2_ADC_ROWS );
+        if( 0 == n )
+            break;
+        r2_adc_scale_f( self->raw, n, self->channels, self->scale_f,
+                self->offset_f, out + rows * self->channels );
+        rows += n;
+    }
+    return rows;
+}
+
+size_t r2_adc_get_double( struct r2_adc * self, double * out,
+        const size_t max_rows )
+{
+    size_t rows = 0;
+    while( rows < max_rows ) {
+        size_t left = max_rows - rows;
+        size_t n = r2_adc_get_raw( self, self->raw,
+                left < R2_ADC_ROWS ? left : R2_ADC_ROWS );
+        if( 0 == n )
+            break;
+        r2_adc_scale_d( self->raw, n, self->channels, self->scale,
+                self->offset, out + rows * self->channels );
+        rows += n;
+    }
+    return rows;
+}
+
+// The channels of each row go through blocks of R2_FASTMATH_BLOCK, which
+// the compiler vectorizes, then one at a time.
+R2_TARGET_CLONES
+void r2_adc_scale_f( const int32_t * restrict raw, const size_t rows,
+        const size_t channels, const float * restrict scale,
+        const float * restrict offset, float * restrict out )
+{
+    size_t r, c, m;
+    for( r = 0; r < rows; r++ ) {
+        const int32_t * restrict x = raw + r * channels;
+        float * restrict y = out + r * channels;
+        for( c = 0; c + R2_FASTMATH_BLOCK <= channels; c += R2_FASTMATH_BLOCK )
+            for( m = c; m < c + R2_FASTMATH_BLOCK; m++ )
+                y[m] = (float)x[m] * scale[m] + offset[m];
+        for( m = c; m < channels; m++ )
+            y[m] = (float)x[m] * scale[m] + offset[m];
+    }
+}
+
+R2_TARGET_CLONES
+void r2_adc_scale_d( const int32_t * restrict raw, const size_t rows,
+        const size_t channels, const double * restrict scale,
+        const double * restrict offset, double * restrict out )
+{
+    size_t r, c, m;
+    for( r = 0; r < rows; r++ ) {
+        const int32_t * restrict x = raw + r * channels;
+        double * restrict y = out + r * channels;
+        for( c = 0; c + R2_FASTMATH_BLOCK <= channels; c += R2_FASTMATH_BLOCK )
+            for( m = c; m < c + R2_FASTMATH_BLOCK; m++ )
+                y[m] = (double)x[m] * scale[m] + offset[m];
+        for( m = c; m < channels; m++ )
+            y[m] = (double)x[m] * scale[m] + offset[m];
+    }
+}
+
+#endif // R2_ADC_I
@@ -0,0 +1,343 @@
+// r2_adc_filter.h
+// Low-pass and decimate multi-channel ADC samples
+//
+// Two stages, which can be chained (e.g. CIC by 25, then FIR by 4 to go
+// from 10 kHz to 100 Hz):
+//
+// r2_adc_fir is a decimating FIR filter. Only the kept outputs are
+// computed (the polyphase form), each as a dot product of the taps with
+// the window of input rows, run across a block of R2_FASTMATH_BLOCK
+// channels at a time so the inner loop vectorizes. r2_adc_fir_lowpass
+// designs the taps.
+//
+// r2_adc_cic is a cascaded integrator-comb decimator (Hogenauer): order
+// integrators at the input rate, order combs at the output rate, and no
+// multiplies, which suits large decimation factors. It works on raw
+// integer samples with wrapping 64-bit arithmetic, so it is exact however
+// long it runs, and divides by its gain, factor^order, on output.
+//
+// Samples are rows of one value per channel, as r2_adc_get_float and
+// r2_adc_get_raw produce them. Both stages accept any number of rows per
+// call and carry their state across calls, in memory fixed at creation.
+
+#ifndef R2_ADC_FILTER_H
+#define R2_ADC_FILTER_H
+
+#include <inttypes.h> // for int32_t, uint64_t
+#include <math.h> // for cos, sin, log2
+#include <stddef.h> // for size_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memcpy, memmove, memset
+
+#include "r2_fastmath.h"
+
+// Input rows buffered at a time by r2_adc_fir.
+#ifndef R2_ADC_FILTER_CHUNK
+#define R2_ADC_FILTER_CHUNK 256
+#endif
+
+struct r2_adc_fir {
+    size_t channels;
+    size_t taps;
+    size_t factor; // decimation
+    float * g; // taps, reversed
+    float * history; // ( taps + R2_ADC_FILTER_CHUNK ) rows
+    size_t fill; // rows in history
+    size_t window; // row in history where the next output's window starts
+};
+
+struct r2_adc_cic {
+    size_t channels;
+    unsigned order;
+    size_t factor; // decimation
+    double gain; // factor^order
+    uint64_t * integrator; // order rows
+    uint64_t * comb; // order rows, the previous input of each comb
+    size_t phase; // rows since the last output
+};
+
+/*  Create a FIR filter of taps coefficients h that keeps one output row
+ *  out of factor.
+ */
+struct r2_adc_fir * r2_adc_fir_create( const size_t channels,
+        const float * h, const size_t taps, const size_t factor );
+
+void r2_adc_fir_destroy( struct r2_adc_fir * self );
+
+/*  Clear the filter's history, as if it had only seen zeros.
+ */
+void r2_adc_fir_reset( struct r2_adc_fir * self );
+
+/*  Filter rows of input, storing the output rows that fall due in out
+ *  (at most rows / factor + 1 of them).
+ *
+ *  Returns the number of output rows.
+ */
+size_t r2_adc_fir_process( struct r2_adc_fir * self, const float * in,
+        const size_t rows, float * out );
+
+/*  Design a linear-phase low-pass filter: a windowed sinc (Blackman) with
+ *  cutoff in cycles per input sample (e.g. 0.4 / factor) and unit gain at
+ *  DC.
+ *
+ *  The stopband is about 74 dB down, from cutoff + 5.5 / taps on.
+ */
+void r2_adc_fir_lowpass( float * h, const size_t taps, const double cutoff );
+
+/*  Create a CIC decimator of the given order (typically 3 to 5) keeping
+ *  one output row out of factor.
+ *
+ *  The growth of order * log2( factor ) bits must fit in 32 bits on top of
+ *  the int32_t input; returns NULL if it does not.
+ */
+struct r2_adc_cic * r2_adc_cic_create( const size_t channels,
+        const unsigned order, const size_t factor );
+
+void r2_adc_cic_destroy( struct r2_adc_cic * self );
+
+void r2_adc_cic_reset( struct r2_adc_cic * self );
+
+/*  Filter rows of raw input, storing the output rows that fall due in out
+ *  (at most rows / factor + 1 of them), divided by the gain.
+ *
+ *  Returns the number of output rows.
+ */
+size_t r2_adc_cic_process( struct r2_adc_cic * self, const int32_t * in,
+        const size_t rows, float * out );
+
+#endif // R2_ADC_FILTER_H
+
+#ifndef R2_ADC_FILTER_I
+#define R2_ADC_FILTER_I
+
+struct r2_adc_fir * r2_adc_fir_create( const size_t channels,
+        const float * h, const size_t taps, const size_t factor )
+{
+    if( 0 == channels || 0 == taps || 0 == factor ) {
+        fprintf( stderr, "r2_adc_fir needs channels, taps and a factor\n" );
+        return NULL;
+    }
+    struct r2_adc_fir * self = calloc( 1, sizeof( struct r2_adc_fir ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_adc_fir\n" );
+        return NULL;
+    }
+    self->channels = channels;
+    self->taps = taps;
+    self->factor = factor;
+    self->g = calloc( taps, sizeof( float ) );
+    self->history = calloc( ( taps + R2_ADC_FILTER_CHUNK ) * channels,
+            sizeof( float ) );
+    if( NULL == self->g || NULL == self->history ) {
+        fprintf( stderr, "could not allocate r2_adc_fir\n" );
+        r2_adc_fir_destroy( self );
+        return NULL;
+    }
+    size_t k;
+    for( k = 0; k < taps; k++ )
+        self->g[k] = h[taps - 1 - k];
+    r2_adc_fir_reset( self );
+    return self;
+}
+
+void r2_adc_fir_destroy( struct r2_adc_fir * self )
+{
+    if( self ) {
+        free( self->history );
+        free( self->g );
+        free( self );
+    }
+}
+
+void r2_adc_fir_reset( struct r2_adc_fir * self )
+{
+    // the first output sees taps - 1 rows of zeros before the input
+    memset( self->history, 0, ( self->taps - 1 ) * self->channels
+            * sizeof( float ) );
+    self->fill = self->taps - 1;
+    self->window = 0;
+}
+
+// y = sum over k of g[k] * x[k], for rows x[k] of channels values.
+R2_TARGET_CLONES
+void r2_adc_fir_dot( const float * restrict g, const size_t taps,
+        const float * restrict x, const size_t channels, float * restrict y )
+{
+    size_t c, k, m;
+    for( c = 0; c + R2_FASTMATH_BLOCK <= channels; c += R2_FASTMATH_BLOCK ) {
+        float acc[R2_FASTMATH_BLOCK] = { 0 };
+        for( k = 0; k < taps; k++ )
+            for( m = 0; m < R2_FASTMATH_BLOCK; m++ )
+                acc[m] += g[k] * x[k * channels + c + m];
+        for( m = 0; m < R2_FASTMATH_BLOCK; m++ )
+            y[c + m] = acc[m];
+    }
+    for( ; c < channels; c++ ) {
+        float acc = 0;
+        for( k = 0; k < taps; k++ )
+            acc += g[k] * x[k * channels + c];
+        y[c] = acc;
+    }
+}
+
+size_t r2_adc_fir_process( struct r2_adc_fir * self, const float * in,
+        const size_t rows, float * out )
+{
+    const size_t channels = self->channels;
+    const size_t capacity = self->taps + R2_ADC_FILTER_CHUNK;
+    size_t used = 0, n = 0;
+    while( used < rows ) {
+        size_t take = capacity - self->fill;
+        take = take < rows - used ? take : rows - used;
+        memcpy( self->history + self->fill * channels, in + used * channels,
+                take * channels * sizeof( float ) );
+        self->fill += take;
+        used += take;
+
+        while( self->window + self->taps <= self->fill ) {
+            r2_adc_fir_dot( self->g, self->taps,
+                    self->history + self->window * channels, channels,
+                    out + n * channels );
+            self->window += self->factor;
+            n++;
+        }
+
+        // keep only the rows that later windows need
+        if( self->window >= self->fill ) {
+            self->window -= self->fill;
+            self->fill = 0;
+        } else {
+            self->fill -= self->window;
+            memmove( self->history, self->history + self->window * channels,
+                    self->fill * channels * sizeof( float ) );
+            self->window = 0;
+        }
+    }
+    return n;
+}
+
+void r2_adc_fir_lowpass( float * h, const size_t taps, const double cutoff )
+{
+    double sum = 0;
+    size_t k;
+    for( k = 0; k < taps; k++ ) {
+        double t = k - ( taps - 1 ) / 2.0;
+        double sinc = 0 == t ? 2 * cutoff
+            : sin( 2 * M_PI * cutoff * t ) / ( M_PI * t );
+        double a = taps > 1 ? 2 * M_PI * k / ( taps - 1 ) : 0;
+        double window = 0.42 - 0.5 * cos( a ) + 0.08 * cos( 2 * a );
+        h[k] = (float)( sinc * window );
+        sum += h[k];
+    }
+    for( k = 0; k < taps; k++ )
+        h[k] = (float)( h[k] / sum );
+}
+
+struct r2_adc_cic * r2_adc_cic_create( const size_t channels,
+        const unsigned order, const size_t factor )
+{
+    if( 0 == channels || 0 == order || 0 == factor
+            || order * log2( (double)factor ) > 32 ) {
+        fprintf( stderr, "r2_adc_cic: bad channels, order or factor\n" );
+        return NULL;
+    }
+    struct r2_adc_cic * self = calloc( 1, sizeof( struct r2_adc_cic ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_adc_cic\n" );
+        return NULL;
+    }
+    self->channels = channels;
+    self->order = order;
+    self->factor = factor;
+    self->gain = pow( (double)factor, order );
+    self->integrator = calloc( order * channels, sizeof( uint64_t ) );
+    self->comb = calloc( order * channels, sizeof( uint64_t ) );
+    if( NULL == self->integrator || NULL == self->comb ) {
+        fprintf( stderr, "could not allocate r2_adc_cic\n" );
+        r2_adc_cic_destroy( self );
+        return NULL;
+    }
+    return self;
+}
+
+void r2_adc_cic_destroy( struct r2_adc_cic * self )
+{
+    if( self ) {
+        free( self->comb );
+        free( self->integrator );
+        free( self );
+    }
+}
+
+void r2_adc_cic_reset( struct r2_adc_cic * self )
+{
+    memset( self->integrator, 0,
+            self->order * self->channels * sizeof( uint64_t ) );
+    memset( self->comb, 0, self->order * self->channels * sizeof( uint64_t ) );
+    self->phase = 0;
+}
+
+// b += a for a block of channels (rows of different stages, which do not
+// overlap).
+static R2_ALWAYS_INLINE void r2_adc_cic_accumulate( uint64_t * restrict b,
+        const uint64_t * restrict a )
+{
+    size_t m;
+    for( m = 0; m < R2_FASTMATH_BLOCK; m++ )
+        b[m] += a[m];
+}
+
+// Run the integrators over one row of input.
+R2_TARGET_CLONES
+void r2_adc_cic_integrate( uint64_t * restrict integrator,
+        const unsigned order, const int32_t * restrict x,
+        const size_t channels )
+{
+    size_t c, m;
+    unsigned s;
+    for( c = 0; c + R2_FASTMATH_BLOCK <= channels; c += R2_FASTMATH_BLOCK ) {
+        uint64_t * restrict i = integrator + c;
+        for( m = 0; m < R2_FASTMATH_BLOCK; m++ )
+            i[m] += (uint64_t)(int64_t)x[c + m];
+        for( s = 1; s < order; s++ )
+            r2_adc_cic_accumulate( i + s * channels, i + ( s - 1 ) * channels );
+    }
+    for( ; c < channels; c++ ) {
+        integrator[c] += (uint64_t)(int64_t)x[c];
+        for( s = 1; s < order; s++ )
+            integrator[s * channels + c]
+                += integrator[( s - 1 ) * channels + c];
+    }
+}
+
+size_t r2_adc_cic_process( struct r2_adc_cic * self, const int32_t * in,
+        const size_t rows, float * out )
+{
+    const size_t channels = self->channels;
+    const unsigned order = self->order;
+    size_t r, c, n = 0;
+    unsigned s;
+    for( r = 0; r < rows; r++ ) {
+        r2_adc_cic_integrate( self->integrator, order, in + r * channels,
+                channels );
+        if( ++self->phase < self->factor )
+            continue;
+        self->phase = 0;
+        for( c = 0; c < channels; c++ ) {
+            uint64_t v = self->integrator[( order - 1 ) * channels + c];
+            for( s = 0; s < order; s++ ) {
+                uint64_t d = v - self->comb[s * channels + c];
+                self->comb[s * channels + c] = v;
+                v = d;
+            }
+            // back to signed without converting an out-of-range value
+            double y = v >> 63 ? -(double)( ~v + 1 ) : (double)v;
+            out[n * channels + c] = (float)( y / self->gain );
+        }
+        n++;
+    }
+    return n;
+}
+
+#endif // R2_ADC_FILTER_I
@@ -0,0 +1,469 @@
+// r2_adc_iio.h
+// Read ADC samples in bulk from a Linux IIO device in buffered mode
+//
+// Instead of reading sysfs in_voltageN_raw files one value per syscall,
+// the device streams binary scan records (one sample of every enabled
+// channel) through its character device, /dev/iio:deviceN, and each read
+// returns as many whole scans as are ready. The record layout is decoded
+// from the scan_elements directory in sysfs: the enabled channels in index
+// order, each stored as "le:s12/16>>4" (endianness, sign, real bits,
+// storage bits, shift; see the kernel's sysfs-bus-iio ABI) and aligned to
+// its own size.
+//
+// Scans accumulate in an r2_buffer. They are decoded channel by channel
+// into int32_t samples, and scaled with the kernels of r2_adc.h using the
+// channel's scale and offset from sysfs (processed = (raw + offset) *
+// scale, as in the ABI). The in_timestamp channel is returned separately,
+// in nanoseconds; other 64-bit channels are samples like any other.
+//
+// Typical use, with the channels and trigger already set up:
+//
+//     struct r2_adc_iio * adc = r2_adc_iio_create(
+//             "/sys/bus/iio/devices/iio:device0", 1 << 16 );
+//     r2_adc_iio_enable( adc, 1024, 1 );
+//     int fd = open( "/dev/iio:device0", O_RDONLY );
+//     for( ;; ) {
+//         r2_adc_iio_fill( adc, fd );
+//         n = r2_adc_iio_get_float( adc, samples, timestamps, max );
+//     }
+
+#ifndef R2_ADC_IIO_H
+#define R2_ADC_IIO_H
+
+#include <dirent.h> // for opendir, readdir
+#include <fcntl.h> // for open
+#include <inttypes.h> // for int32_t, int64_t
+#include <stdio.h> // for fprintf, snprintf, sscanf
+#include <stdlib.h> // for calloc, free, qsort, strtod
+#include <string.h> // for strlen, strcmp, strdup
+#include <unistd.h> // for read, write, close
+
+#include "r2_adc.h"
+#include "r2_buffer.h"
+
+#define R2_ADC_IIO_NAME 64
+
+struct r2_adc_iio_channel {
+    char name[R2_ADC_IIO_NAME]; // e.g. in_voltage0
+    int index; // position in the scan
+    int is_signed;
+    int big_endian;
+    unsigned bits; // significant bits
+    unsigned storage; // bits stored
+    unsigned shift; // right shift to the significant bits
+    unsigned repeat; // elements (columns) in the channel
+    size_t offset; // bytes from the start of a scan
+};
+
+struct r2_adc_iio {
+    char * device; // sysfs directory
+    struct r2_buffer * buffer;
+    struct r2_adc_iio_channel * channel; // enabled, in scan order
+    size_t count; // enabled channels
+    size_t channels; // sample columns (repeats counted, timestamp not)
+    size_t record; // bytes per scan
+    int timestamp; // index in channel of the timestamp, or -1
+    double * scale; // per column
+    double * offset;
+    float * scale_f; // the same, in single precision
+    float * offset_f;
+    int32_t * raw; // R2_ADC_ROWS scans of samples being scaled
+    size_t scans; // scans read so far
+};
+
+/*  Create a reader for the IIO device with the given sysfs directory,
+ *  with room to buffer about size bytes of scans.
+ *
+ *  Reads the layout of the enabled channels and their scale and offset,
+ *  so set those up first. Returns NULL on error, or if no channel is
+ *  enabled.
+ */
+struct r2_adc_iio * r2_adc_iio_create( const char * device,
+        const size_t size );
+
+void r2_adc_iio_destroy( struct r2_adc_iio * self );
+
+/*  Set the length of the device buffer (in scans; 0 to leave it) and
+ *  enable or disable it.
+ *
+ *  Returns 0, or -1 on error.
+ */
+int r2_adc_iio_enable( struct r2_adc_iio * self, const size_t length,
+        const int enable );
+
+/*  Read the scans available on fd (the character device) into the buffer.
+ *
+ *  Returns the number of bytes read, as r2_buffer_fill.
+ */
+size_t r2_adc_iio_fill( struct r2_adc_iio * self, int fd );
+
+/*  Decode up to max_scans complete scans from the buffer into raw, channels
+ *  values per scan, and remove them from the buffer. If timestamp is not
+ *  NULL and there is a timestamp channel, store the timestamps there.
+ *
+ *  Returns the number of scans stored.
+ */
+size_t r2_adc_iio_get_raw( struct r2_adc_iio * self, int32_t * raw,
+        int64_t * timestamp, const size_t max_scans );
+
+/*  As r2_adc_iio_get_raw, but storing scaled samples.
+ */
+size_t r2_adc_iio_get_float( struct r2_adc_iio * self, float * out,
+        int64_t * timestamp, const size_t max_scans );
+
+size_t r2_adc_iio_get_double( struct r2_adc_iio * self, double * out,
+        int64_t * timestamp, const size_t max_scans );
+
+#endif // R2_ADC_IIO_H
+
+#ifndef R2_ADC_IIO_I
+#define R2_ADC_IIO_I
+
+// Read a small sysfs file into text; returns its length, or -1.
+ssize_t r2_adc_iio_read_file( const char * dir, const char * name,
+        char * text, const size_t size )
+{
+    char path[512];
+    snprintf( path, sizeof( path ), "%s/%s", dir, name );
+    int fd = open( path, O_RDONLY );
+    if( -1 == fd )
+        return -1;
+    ssize_t n = read( fd, text, size - 1 );
+    close( fd );
+    if( n < 0 )
+        return -1;
+    text[n] = '\0';
+    return n;
+}
+
+int r2_adc_iio_write_file( const char * dir, const char * name,
+        const char * text )
+{
+    char path[512];
+    snprintf( path, sizeof( path ), "%s/%s", dir, name );
+    int fd = open( path, O_WRONLY | O_TRUNC );
+    if( -1 == fd ) {
+        perror( "r2_adc_iio open()" );
+        return -1;
+    }
+    ssize_t n = write( fd, text, strlen( text ) );
+    close( fd );
+    if( n != (ssize_t)strlen( text ) ) {
+        perror( "r2_adc_iio write()" );
+        return -1;
+    }
+    return 0;
+}
+
+// Read a number from the channel's own attribute (in_voltage0_scale), or
+// the one shared by its type (in_voltage_scale, also for modified channels
+// such as in_accel_x); returns fallback if there is neither.
+double r2_adc_iio_attribute( const char * dir, const char * channel,
+        const char * attribute, const double fallback )
+{
+    char name[R2_ADC_IIO_NAME];
+    char file[2 * R2_ADC_IIO_NAME];
+    char text[64];
+    int pass;
+    snprintf( name, sizeof( name ), "%s", channel );
+    for( pass = 0; pass < 3; pass++ ) {
+        snprintf( file, sizeof( file ), "%s_%s", name, attribute );
+        if( r2_adc_iio_read_file( dir, file, text, sizeof( text ) ) > 0 )
+            return strtod( text, NULL );
+        size_t n = strlen( name );
+        if( 0 == pass ) {
+            while( n > 0 && name[n - 1] >= '0' && name[n - 1] <= '9' )
+                name[--n] = '\0';
+        } else {
+            char * modifier = strrchr( name, '_' );
+            if( NULL == modifier || modifier - name < 3 )
+                break;
+            *modifier = '\0';
+        }
+    }
+    return fallback;
+}
+
+int r2_adc_iio_compare( const void * a, const void * b )
+{
+    const struct r2_adc_iio_channel * x = a;
+    const struct r2_adc_iio_channel * y = b;
+    return ( x->index > y->index ) - ( x->index < y->index );
+}
+
+// Read the enabled channels from scan_elements; returns their number, or
+// -1 on error.
+ssize_t r2_adc_iio_scan_elements( struct r2_adc_iio * self )
+{
+    char dir[512];
+    snprintf( dir, sizeof( dir ), "%s/scan_elements", self->device );
+    DIR * d = opendir( dir );
+    if( NULL == d ) {
+        perror( "r2_adc_iio opendir()" );
+        return -1;
+    }
+    struct dirent * e;
+    size_t size = 0;
+    self->count = 0;
+    while( NULL != ( e = readdir( d ) ) ) {
+        size_t n = strlen( e->d_name );
+        char text[64], file[2 * R2_ADC_IIO_NAME];
+        if( n < 4 || n - 3 >= R2_ADC_IIO_NAME
+                || strcmp( e->d_name + n - 3, "_en" ) )
+            continue;
+        if( r2_adc_iio_read_file( dir, e->d_name, text, sizeof( text ) ) <= 0
+                || '1' != text[0] )
+            continue;
+        if( self->count == size ) {
+            size = size ? 2 * size : 8;
+            struct r2_adc_iio_channel * c = realloc( self->channel,
+                    size * sizeof( struct r2_adc_iio_channel ) );
+            if( NULL == c ) {
+                fprintf( stderr, "could not allocate r2_adc_iio channels\n" );
+                closedir( d );
+                return -1;
+            }
+            self->channel = c;
+        }
+        struct r2_adc_iio_channel * c = &self->channel[self->count];
+        memset( c, 0, sizeof( *c ) );
+        memcpy( c->name, e->d_name, n - 3 );
+
+        snprintf( file, sizeof( file ), "%s_index", c->name );
+        if( r2_adc_iio_read_file( dir, file, text, sizeof( text ) ) <= 0 ) {
+            fprintf( stderr, "r2_adc_iio: no %s\n", file );
+            closedir( d );
+            return -1;
+        }
+        c->index = atoi( text );
+
+        // e.g. le:s12/16>>4, or be:u16/16X2>>0 for a repeated channel
+        char endian, sign;
+        snprintf( file, sizeof( file ), "%s_type", c->name );
+        c->repeat = 1;
+        if( r2_adc_iio_read_file( dir, file, text, sizeof( text ) ) <= 0
+                || ( 6 != sscanf( text, "%ce:%c%u/%uX%u>>%u", &endian, &sign,
+                            &c->bits, &c->storage, &c->repeat, &c->shift )
+                    && 5 != sscanf( text, "%ce:%c%u/%u>>%u", &endian, &sign,
+                            &c->bits, &c->storage, &c->shift ) )
+                || 0 == c->bits || c->storage % 8 || c->storage > 64
+                || c->bits + c->shift > c->storage || 0 == c->repeat ) {
+            fprintf( stderr, "r2_adc_iio: bad %s\n", file );
+            closedir( d );
+            return -1;
+        }
+        c->big_endian = 'b' == endian;
+        c->is_signed = 's' == sign;
+        self->count++;
+    }
+    closedir( d );
+    return self->count;
+}
+
+// Lay out the scan as the kernel does: each channel aligned to its own
+// size, and the whole scan to the largest.
+void r2_adc_iio_layout( struct r2_adc_iio * self )
+{
+    size_t m, bytes = 0, largest = 1;
+    qsort( self->channel, self->count, sizeof( struct r2_adc_iio_channel ),
+            r2_adc_iio_compare );
+    self->channels = 0;
+    self->timestamp = -1;
+    for( m = 0; m < self->count; m++ ) {
+        struct r2_adc_iio_channel * c = &self->channel[m];
+        size_t length = c->storage / 8 * c->repeat;
+        bytes = ( bytes + length - 1 ) / length * length;
+        c->offset = bytes;
+        bytes += length;
+        largest = length > largest ? length : largest;
+        if( 0 == strcmp( c->name, "in_timestamp" ) && 64 == c->storage
+                && 1 == c->repeat )
+            self->timestamp = m;
+        else
+            self->channels += c->repeat;
+    }
+    self->record = ( bytes + largest - 1 ) / largest * largest;
+}
+
+struct r2_adc_iio * r2_adc_iio_create( const char * device,
+        const size_t size )
+{
+    struct r2_adc_iio * self = calloc( 1, sizeof( struct r2_adc_iio ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_adc_iio\n" );
+        return NULL;
+    }
+    self->device = strdup( device );
+    if( NULL == self->device || r2_adc_iio_scan_elements( self ) <= 0 ) {
+        fprintf( stderr, "r2_adc_iio: no enabled channels in %s\n", device );
+        r2_adc_iio_destroy( self );
+        return NULL;
+    }
+    r2_adc_iio_layout( self );
+    size_t columns = self->channels ? self->channels : 1;
+    self->scale = calloc( columns, sizeof( double ) );
+    self->offset = calloc( columns, sizeof( double ) );
+    self->scale_f = calloc( columns, sizeof( float ) );
+    self->offset_f = calloc( columns, sizeof( float ) );
+    self->raw = calloc( columns * R2_ADC_ROWS, sizeof( int32_t ) );
+    // reads return whole scans only, so keep the space a whole number
+    size_t scans = size / self->record ? size / self->record : 1;
+    self->buffer = r2_buffer_create( scans * self->record );
+    if( NULL == self->scale || NULL == self->offset || NULL == self->scale_f
+            || NULL == self->offset_f || NULL == self->raw
+            || NULL == self->buffer || NULL == self->buffer->data ) {
+        fprintf( stderr, "could not allocate r2_adc_iio\n" );
+        r2_adc_iio_destroy( self );
+        return NULL;
+    }
+
+    size_t m, k, column = 0;
+    for( m = 0; m < self->count; m++ ) {
+        if( (int)m == self->timestamp )
+            continue;
+        const char * name = self->channel[m].name;
+        double scale = r2_adc_iio_attribute( self->device, name, "scale", 1 );
+        double offset = r2_adc_iio_attribute( self->device, name, "offset", 0 );
+        for( k = 0; k < self->channel[m].repeat; k++, column++ ) {
+            self->scale[column] = scale;
+            self->offset[column] = offset * scale;
+            self->scale_f[column] = (float)scale;
+            self->offset_f[column] = (float)( offset * scale );
+        }
+    }
+    return self;
+}
+
+void r2_adc_iio_destroy( struct r2_adc_iio * self )
+{
+    if( self ) {
+        if( self->buffer ) {
+            // not r2_buffer_destroy, which does not free yet
+            free( self->buffer->data );
+            free( self->buffer );
+        }
+        free( self->raw );
+        free( self->offset_f );
+        free( self->scale_f );
+        free( self->offset );
+        free( self->scale );
+        free( self->channel );
+        free( self->device );
+        free( self );
+    }
+}
+
+int r2_adc_iio_enable( struct r2_adc_iio * self, const size_t length,
+        const int enable )
+{
+    char text[32];
+    if( length ) {
+        snprintf( text, sizeof( text ), "%zu", length );
+        if( -1 == r2_adc_iio_write_file( self->device, "buffer/length", text ) )
+            return -1;
+    }
+    return r2_adc_iio_write_file( self->device, "buffer/enable",
+            enable ? "1" : "0" );
+}
+
+size_t r2_adc_iio_fill( struct r2_adc_iio * self, int fd )
+{
+    return r2_buffer_fill( self->buffer, fd );
+}
+
+// Load an element of n bytes.
+uint64_t r2_adc_iio_load( const unsigned char * p, const unsigned n,
+        const int big_endian )
+{
+    uint64_t x = 0;
+    unsigned b;
+    for( b = 0; b < n; b++ )
+        x |= (uint64_t)p[big_endian ? n - 1 - b : b] << ( 8 * b );
+    return x;
+}
+
+// Decode one channel of n scans into every stride-th element of out.
+void r2_adc_iio_decode( const struct r2_adc_iio_channel * c,
+        const unsigned char * scan, const size_t record, const size_t n,
+        int32_t * out, const size_t stride )
+{
+    const uint64_t mask = c->bits < 64 ? ( 1ULL << c->bits ) - 1 : ~0ULL;
+    const uint64_t sign = c->is_signed ? 1ULL << ( c->bits - 1 ) : 0;
+    const unsigned bytes = c->storage / 8;
+    size_t s, k;
+    for( k = 0; k < c->repeat; k++ ) {
+        const unsigned char * p = scan + c->offset + k * bytes;
+        for( s = 0; s < n; s++ ) {
+            uint64_t x = ( r2_adc_iio_load( p + s * record, bytes,
+                        c->big_endian ) >> c->shift ) & mask;
+            // sign-extend without relying on shifts of negative numbers
+            out[s * stride + k] = (int32_t)( (int64_t)( x ^ sign )
+                    - (int64_t)sign );
+        }
+    }
+}
+
+size_t r2_adc_iio_get_raw( struct r2_adc_iio * self, int32_t * raw,
+        int64_t * timestamp, const size_t max_scans )
+{
+    struct r2_buffer * b = self->buffer;
+    size_t n = b->position / self->record;
+    n = n < max_scans ? n : max_scans;
+    const unsigned char * scan = (const unsigned char *)b->data;
+    size_t m, s, column = 0;
+    for( m = 0; m < self->count; m++ ) {
+        const struct r2_adc_iio_channel * c = &self->channel[m];
+        if( (int)m == self->timestamp ) {
+            if( timestamp )
+                for( s = 0; s < n; s++ )
+                    timestamp[s] = (int64_t)r2_adc_iio_load( scan
+                            + s * self->record + c->offset, 8,
+                            c->big_endian );
+            continue;
+        }
+        r2_adc_iio_decode( c, scan, self->record, n, raw + column,
+                self->channels );
+        column += c->repeat;
+    }
+    r2_buffer_drop( b, n * self->record );
+    self->scans += n;
+    return n;
+}
+
+size_t r2_adc_iio_get_float( struct r2_adc_iio * self, float * out,
+        int64_t * timestamp, const size_t max_scans )
+{
+    size_t scans = 0;
+    while( scans < max_scans ) {
+        size_t left = max_scans - scans;
+        size_t n = r2_adc_iio_get_raw( self, self->raw,
+                timestamp ? timestamp + scans : NULL,
+                left < R2_ADC_ROWS ? left : R2_ADC_ROWS );
+        if( 0 == n )
+            break;
+        r2_adc_scale_f( self->raw, n, self->channels, self->scale_f,
+                self->offset_f, out + scans * self->channels );
+        scans += n;
+    }
+    return scans;
+}
+
+size_t r2_adc_iio_get_double( struct r2_adc_iio * self, double * out,
+        int64_t * timestamp, const size_t max_scans )
+{
+    size_t scans = 0;
+    while( scans < max_scans ) {
+        size_t left = max_scans - scans;
+        size_t n = r2_adc_iio_get_raw( self, self->raw,
+                timestamp ? timestamp + scans : NULL,
+                left < R2_ADC_ROWS ? left : R2_ADC_ROWS );
+        if( 0 == n )
+            break;
+        r2_adc_scale_d( self->raw, n, self->channels, self->scale,
+                self->offset, out + scans * self->channels );
+        scans += n;
+    }
+    return scans;
+}
+
+#endif // R2_ADC_IIO_I
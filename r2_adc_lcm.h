@@ -0,0 +1,359 @@
+// r2_adc_lcm.h
+// Bridge ADC samples to LCM in blocks
+//
+// Rows of scaled samples (as from r2_adc_get_float) are collected into
+// blocks and published as one message per block rather than per sample:
+//
+//     struct adc_t {
+//         int64_t utime; // host time of the read of the first sample
+//         int64_t utime_last; // and of the last
+//         int32_t channels;
+//         int32_t samples;
+//         int32_t dropped; // samples dropped since the previous message
+//         float data[samples][channels];
+//     }
+//
+// A message goes out when a block is full, or when its first sample has
+// waited max_latency, but never sooner than min_interval after the
+// previous one; until then, samples keep collecting in the same message.
+// Samples are encoded into the message buffer as they arrive, so
+// publishing only writes the header.
+//
+// A transport that refuses a message (e.g. because its consumer lags)
+// leaves the samples pending. The policy decides what happens to them:
+// R2_ADC_LCM_DROP discards them, while R2_ADC_LCM_MERGE keeps them to go
+// out with the next block. Either way, when the message reaches its
+// capacity the oldest block is dropped, and drops are reported in the
+// next message.
+//
+// As in r2_serial_lcm.h, messages go out through a transport (see
+// r2_transport.h). Define R2_ADC_LCM_FINGERPRINT to override the
+// fingerprint computed for the type above.
+
+#ifndef R2_ADC_LCM_H
+#define R2_ADC_LCM_H
+
+#include <inttypes.h> // for int64_t, uint64_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memcpy, memmove, strdup
+#include <sys/types.h> // for ssize_t
+
+#include "r2_fastmath.h"
+#include "r2_lcm.h"
+#include "r2_transport.h"
+
+// fingerprint, utime, utime_last, channels, samples and dropped
+#define R2_ADC_LCM_HEADER 36
+
+enum r2_adc_lcm_policy {
+    R2_ADC_LCM_DROP,
+    R2_ADC_LCM_MERGE
+};
+
+struct r2_adc_lcm {
+    char * channel;
+    struct r2_transport transport;
+    size_t channels;
+    size_t block; // samples per message
+    size_t capacity; // samples a message can collect
+    int64_t max_latency; // usec, 0 for none
+    int64_t min_interval; // usec between messages
+    enum r2_adc_lcm_policy policy;
+    uint64_t fingerprint;
+    unsigned char * message; // send buffer, collecting samples
+    size_t samples; // samples in the message
+    int64_t first; // host time of the first sample in the message
+    int64_t last; // and of the last
+    int64_t sent; // host time of the last message
+    size_t dropped; // samples dropped since the last message
+    size_t messages; // messages published
+    size_t lost; // samples dropped in all
+    size_t failures; // failed publishes
+};
+
+/*  Create a bridge publishing rows of channels samples on channel, block
+ *  samples per message, through transport.
+ *
+ *  Starts with no latency limit or minimum interval, and the drop policy
+ *  with room for four blocks.
+ */
+struct r2_adc_lcm * r2_adc_lcm_create( const size_t channels,
+        const size_t block, const char * channel,
+        const struct r2_transport transport );
+
+void r2_adc_lcm_destroy( struct r2_adc_lcm * self );
+
+/*  Publish a partial block once its first sample is max_latency usec old
+ *  (0 for no limit).
+ */
+void r2_adc_lcm_set_latency( struct r2_adc_lcm * self,
+        const int64_t max_latency );
+
+/*  Publish at most one message every min_interval usec.
+ */
+void r2_adc_lcm_set_interval( struct r2_adc_lcm * self,
+        const int64_t min_interval );
+
+/*  Set what happens to samples a failed publish leaves pending, and how
+ *  many blocks a message may collect; if fewer samples fit than are
+ *  pending, the oldest are dropped. Returns 0, or -1 if the message
+ *  buffer could not be grown.
+ */
+int r2_adc_lcm_set_policy( struct r2_adc_lcm * self,
+        const enum r2_adc_lcm_policy policy, const size_t blocks );
+
+/*  Add n rows of samples read at host time usec, and publish what falls
+ *  due.
+ *
+ *  Returns the number of messages published.
+ */
+size_t r2_adc_lcm_push( struct r2_adc_lcm * self, const float * rows,
+        const size_t n, const int64_t usec );
+
+/*  Publish a partial block whose latency has run out by now.
+ *
+ *  Returns the number of messages published.
+ */
+size_t r2_adc_lcm_poll( struct r2_adc_lcm * self, const int64_t now );
+
+/*  Publish whatever samples are pending, as allowed by the interval.
+ *
+ *  Returns the number of messages published.
+ */
+size_t r2_adc_lcm_flush( struct r2_adc_lcm * self, const int64_t now );
+
+/*  Decode a message, storing up to max samples in data.
+ *
+ *  Returns the number of samples in the message, or -1 if it is not an
+ *  adc_t message of this bridge's channels.
+ */
+ssize_t r2_adc_lcm_decode( const struct r2_adc_lcm * self,
+        const void * message, const size_t size, int64_t * utime,
+        int64_t * utime_last, size_t * dropped, float * data,
+        const size_t max );
+
+#endif // R2_ADC_LCM_H
+
+#ifndef R2_ADC_LCM_I
+#define R2_ADC_LCM_I
+
+struct r2_adc_lcm * r2_adc_lcm_create( const size_t channels,
+        const size_t block, const char * channel,
+        const struct r2_transport transport )
+{
+    if( 0 == channels || 0 == block ) {
+        fprintf( stderr, "r2_adc_lcm needs channels and a block size\n" );
+        return NULL;
+    }
+    struct r2_adc_lcm * self = calloc( 1, sizeof( struct r2_adc_lcm ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_adc_lcm\n" );
+        return NULL;
+    }
+    self->channels = channels;
+    self->block = block;
+    self->transport = transport;
+    self->channel = strdup( channel );
+    if( NULL == self->channel
+            || -1 == r2_adc_lcm_set_policy( self, R2_ADC_LCM_DROP, 4 ) ) {
+        fprintf( stderr, "could not allocate r2_adc_lcm\n" );
+        r2_adc_lcm_destroy( self );
+        return NULL;
+    }
+#ifdef R2_ADC_LCM_FINGERPRINT
+    self->fingerprint = R2_ADC_LCM_FINGERPRINT;
+#else
+    const struct r2_lcm_member adc[] = {
+        { "int64_t", "utime", { NULL } },
+        { "int64_t", "utime_last", { NULL } },
+        { "int32_t", "channels", { NULL } },
+        { "int32_t", "samples", { NULL } },
+        { "int32_t", "dropped", { NULL } },
+        { "float", "data", { "samples", "channels", NULL } } };
+    self->fingerprint = r2_lcm_fingerprint( adc, 6 );
+#endif
+    return self;
+}
+
+void r2_adc_lcm_destroy( struct r2_adc_lcm * self )
+{
+    if( self ) {
+        free( self->message );
+        free( self->channel );
+        free( self );
+    }
+}
+
+void r2_adc_lcm_set_latency( struct r2_adc_lcm * self,
+        const int64_t max_latency )
+{
+    self->max_latency = max_latency;
+}
+
+void r2_adc_lcm_set_interval( struct r2_adc_lcm * self,
+        const int64_t min_interval )
+{
+    self->min_interval = min_interval;
+}
+
+int r2_adc_lcm_set_policy( struct r2_adc_lcm * self,
+        const enum r2_adc_lcm_policy policy, const size_t blocks )
+{
+    size_t capacity = ( blocks ? blocks : 1 ) * self->block;
+    if( capacity > self->capacity ) {
+        unsigned char * m = realloc( self->message, R2_ADC_LCM_HEADER
+                + capacity * self->channels * sizeof( float ) );
+        if( NULL == m ) {
+            fprintf( stderr, "could not allocate r2_adc_lcm message\n" );
+            return -1;
+        }
+        self->message = m;
+    }
+    if( self->samples > capacity ) {
+        // keep the newest samples that fit, as r2_adc_lcm_push does
+        const size_t row = self->channels * sizeof( float );
+        size_t drop = self->samples - capacity;
+        unsigned char * data = self->message + R2_ADC_LCM_HEADER;
+        memmove( data, data + drop * row, capacity * row );
+        self->first += ( self->last - self->first ) * (int64_t)drop
+            / (int64_t)self->samples;
+        self->samples = capacity;
+        self->dropped += drop;
+        self->lost += drop;
+    }
+    self->capacity = capacity;
+    self->policy = policy;
+    return 0;
+}
+
+static R2_ALWAYS_INLINE void r2_adc_lcm_swap( const float * restrict x,
+        const size_t n, unsigned char * restrict out )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        uint32_t u;
+        memcpy( &u, &x[m], 4 );
+        out[4 * m] = (unsigned char)( u >> 24 );
+        out[4 * m + 1] = (unsigned char)( u >> 16 );
+        out[4 * m + 2] = (unsigned char)( u >> 8 );
+        out[4 * m + 3] = (unsigned char)u;
+    }
+}
+
+// Store n floats big-endian, in blocks of R2_FASTMATH_BLOCK, which the
+// compiler vectorizes, then the rest.
+R2_TARGET_CLONES
+void r2_adc_lcm_encode( const float * restrict x, const size_t n,
+        unsigned char * restrict out )
+{
+    size_t m;
+    for( m = 0; m + R2_FASTMATH_BLOCK <= n; m += R2_FASTMATH_BLOCK )
+        r2_adc_lcm_swap( x + m, R2_FASTMATH_BLOCK, out + 4 * m );
+    r2_adc_lcm_swap( x + m, n - m, out + 4 * m );
+}
+
+// Publish the pending samples if the interval allows; returns 1 if
+// published.
+size_t r2_adc_lcm_send( struct r2_adc_lcm * self, const int64_t now )
+{
+    if( self->messages && now - self->sent < self->min_interval )
+        return 0; // keep collecting
+    unsigned char * p = self->message;
+    p = r2_lcm_put_int64( p, (int64_t)self->fingerprint );
+    p = r2_lcm_put_int64( p, self->first );
+    p = r2_lcm_put_int64( p, self->last );
+    p = r2_lcm_put_int32( p, (int32_t)self->channels );
+    p = r2_lcm_put_int32( p, (int32_t)self->samples );
+    r2_lcm_put_int32( p, (int32_t)self->dropped );
+    if( 0 == r2_transport_publish( &self->transport, self->channel,
+                self->message, R2_ADC_LCM_HEADER
+                + self->samples * self->channels * sizeof( float ) ) ) {
+        self->messages++;
+        self->sent = now;
+        self->samples = 0;
+        self->dropped = 0;
+        return 1;
+    }
+    self->failures++;
+    if( R2_ADC_LCM_DROP == self->policy ) {
+        self->dropped += self->samples;
+        self->lost += self->samples;
+        self->samples = 0;
+    }
+    return 0;
+}
+
+size_t r2_adc_lcm_push( struct r2_adc_lcm * self, const float * rows,
+        const size_t n, const int64_t usec )
+{
+    const size_t channels = self->channels;
+    const size_t row = channels * sizeof( float );
+    unsigned char * data = self->message + R2_ADC_LCM_HEADER;
+    size_t used = 0, sent = 0;
+    while( used < n ) {
+        if( self->samples == self->capacity ) {
+            // full: drop the oldest block, moving its start time along
+            size_t b = self->block;
+            memmove( data, data + b * row, ( self->samples - b ) * row );
+            self->first += ( self->last - self->first ) * (int64_t)b
+                / (int64_t)self->samples;
+            self->samples -= b;
+            self->dropped += b;
+            self->lost += b;
+        }
+        // fill up to the next block boundary
+        size_t due = ( self->samples / self->block + 1 ) * self->block;
+        size_t take = due - self->samples;
+        take = take < n - used ? take : n - used;
+        if( 0 == self->samples )
+            self->first = usec;
+        self->last = usec;
+        r2_adc_lcm_encode( rows + used * channels, take * channels,
+                data + self->samples * row );
+        self->samples += take;
+        used += take;
+        if( self->samples == due )
+            sent += r2_adc_lcm_send( self, usec );
+    }
+    return sent;
+}
+
+size_t r2_adc_lcm_poll( struct r2_adc_lcm * self, const int64_t now )
+{
+    if( self->samples && self->max_latency
+            && now - self->first >= self->max_latency )
+        return r2_adc_lcm_send( self, now );
+    return 0;
+}
+
+size_t r2_adc_lcm_flush( struct r2_adc_lcm * self, const int64_t now )
+{
+    return self->samples ? r2_adc_lcm_send( self, now ) : 0;
+}
+
+ssize_t r2_adc_lcm_decode( const struct r2_adc_lcm * self,
+        const void * message, const size_t size, int64_t * utime,
+        int64_t * utime_last, size_t * dropped, float * data,
+        const size_t max )
+{
+    const unsigned char * p = message;
+    if( size < R2_ADC_LCM_HEADER
+            || (uint64_t)r2_lcm_get_int64( p ) != self->fingerprint
+            || r2_lcm_get_int32( p + 24 ) != (int32_t)self->channels )
+        return -1;
+    int32_t samples = r2_lcm_get_int32( p + 28 );
+    if( samples < 0 || size != R2_ADC_LCM_HEADER
+            + (size_t)samples * self->channels * sizeof( float ) )
+        return -1;
+    *utime = r2_lcm_get_int64( p + 8 );
+    *utime_last = r2_lcm_get_int64( p + 16 );
+    *dropped = r2_lcm_get_int32( p + 32 );
+    size_t m, n = ( (size_t)samples < max ? (size_t)samples : max )
+        * self->channels;
+    for( m = 0; m < n; m++ )
+        data[m] = r2_lcm_get_float( p + R2_ADC_LCM_HEADER + 4 * m );
+    return samples;
+}
+
+#endif // R2_ADC_LCM_I
@@ -0,0 +1,154 @@
+// r2_attitude_filter.h
+// Fixed-step attitude filter (Mahony's nonlinear complementary filter)
+// fusing gyro, accelerometer and, optionally, magnetometer samples
+//
+// The gyro rates are integrated into the attitude quaternion, and the
+// error between the measured and predicted directions of gravity (and of
+// the horizontal magnetic field) is fed back as a proportional correction
+// and, with ki > 0, as an integral one that estimates the gyro bias.
+//
+// Frames follow the nautical angles of r2_quaternion.h: the earth frame is
+// north-east-down, the body frame forward-right-down, and q rotates body
+// vectors into the earth frame. Gyro rates are in rad/s; accelerometer
+// samples are specific force, which points up (-z) at rest, and like
+// magnetometer samples may be in any unit since only their direction is
+// used.
+//
+// The filter lives in a caller-owned struct and never allocates, so it can
+// run in the thread that reads the sensor, at the sensor rate.
+
+#ifndef R2_ATTITUDE_FILTER_H
+#define R2_ATTITUDE_FILTER_H
+
+#include <stddef.h> // for size_t
+
+#include "r2_fastmath.h"
+#include "r2_quaternion.h"
+#include "r2_quaternion_algebra.h"
+
+struct r2_attitude_filter {
+    struct r2_qf_t q; // current attitude
+    struct r2_vf_t bias; // integral feedback, i.e. minus the gyro bias
+    float dt; // s per sample
+    float kp; // proportional gain, 1/s
+    float ki; // integral gain, 1/s^2
+};
+
+/*  Initialize a filter at the identity attitude for samples every dt
+ *  seconds.
+ *
+ *  kp sets how fast the attitude is pulled towards the accelerometer and
+ *  magnetometer (e.g. 1 for a time constant of about a second); ki how fast
+ *  gyro bias is learned (0 to disable; up to kp * kp / 4 for a critically
+ *  damped loop).
+ */
+void r2_attitude_filter_init( struct r2_attitude_filter * self,
+        const float dt, const float kp, const float ki );
+
+/*  Advance the filter by one sample.
+ *
+ *  accel and mag may be NULL (e.g. on a sample where the sensor had no new
+ *  reading); a zero vector is ignored too. Returns the updated attitude.
+ */
+struct r2_qf_t r2_attitude_filter_update( struct r2_attitude_filter * self,
+        const struct r2_vf_t gyro, const struct r2_vf_t * accel,
+        const struct r2_vf_t * mag );
+
+/*  Advance the filter by n samples.
+ *
+ *  accel and mag may be NULL if there are no such samples. If out is not
+ *  NULL, the attitude after each sample is stored in out[0..n).
+ */
+void r2_attitude_filter_update_n( struct r2_attitude_filter * self,
+        const struct r2_vf_t * gyro, const struct r2_vf_t * accel,
+        const struct r2_vf_t * mag, const size_t n, struct r2_qf_t * out );
+
+#endif // R2_ATTITUDE_FILTER_H
+
+#ifndef R2_ATTITUDE_FILTER_I
+#define R2_ATTITUDE_FILTER_I
+
+void r2_attitude_filter_init( struct r2_attitude_filter * self,
+        const float dt, const float kp, const float ki )
+{
+    struct r2_qf_t identity = { 1, 0, 0, 0 };
+    struct r2_vf_t zero = { 0, 0, 0 };
+    self->q = identity;
+    self->bias = zero;
+    self->dt = dt;
+    self->kp = kp;
+    self->ki = ki;
+}
+
+// Add to e the cross product of a measured direction m (not normalized)
+// and its predicted direction p (unit), i.e. the rotation that would
+// align them.
+static R2_ALWAYS_INLINE void r2_attitude_filter_error( struct r2_vf_t * e,
+        const struct r2_vf_t m, const struct r2_vf_t p )
+{
+    float n2 = m.x * m.x + m.y * m.y + m.z * m.z;
+    float s = n2 > 0 ? r2_fastmath_rsqrtf( n2 ) : 0;
+    e->x += s * ( m.y * p.z - m.z * p.y );
+    e->y += s * ( m.z * p.x - m.x * p.z );
+    e->z += s * ( m.x * p.y - m.y * p.x );
+}
+
+struct r2_qf_t r2_attitude_filter_update( struct r2_attitude_filter * self,
+        const struct r2_vf_t gyro, const struct r2_vf_t * accel,
+        const struct r2_vf_t * mag )
+{
+    const struct r2_qf_t q = self->q;
+    const struct r2_qf_t qc = r2_qf_conjugate( q );
+    struct r2_vf_t e = { 0, 0, 0 };
+
+    if( accel ) {
+        // up in the body frame
+        struct r2_vf_t up = { 0, 0, -1 };
+        r2_attitude_filter_error( &e, *accel, r2_qf_rotate( qc, up ) );
+    }
+    if( mag ) {
+        float n2 = mag->x * mag->x + mag->y * mag->y + mag->z * mag->z;
+        if( n2 > 0 ) {
+            // the field in the earth frame, turned to magnetic north so
+            // that only its heading is corrected, back in the body frame
+            struct r2_vf_t h = r2_qf_rotate( q, *mag );
+            struct r2_vf_t b = { r2_fastmath_sqrtf( h.x * h.x + h.y * h.y ),
+                0, h.z };
+            float s = r2_fastmath_rsqrtf( n2 );
+            b.x *= s;
+            b.z *= s;
+            r2_attitude_filter_error( &e, *mag, r2_qf_rotate( qc, b ) );
+        }
+    }
+
+    if( self->ki > 0 ) {
+        self->bias.x += self->ki * self->dt * e.x;
+        self->bias.y += self->ki * self->dt * e.y;
+        self->bias.z += self->ki * self->dt * e.z;
+    }
+    // q' = q + dt/2 q (0, w)
+    float hdt = 0.5f * self->dt;
+    struct r2_qf_t w = { 0,
+        hdt * ( gyro.x + self->bias.x + self->kp * e.x ),
+        hdt * ( gyro.y + self->bias.y + self->kp * e.y ),
+        hdt * ( gyro.z + self->bias.z + self->kp * e.z ) };
+    struct r2_qf_t dq = r2_qf_product( q, w );
+    struct r2_qf_t p = { q.h + dq.h, q.i + dq.i, q.j + dq.j, q.k + dq.k };
+    self->q = r2_qf_normalize( p );
+    return self->q;
+}
+
+void r2_attitude_filter_update_n( struct r2_attitude_filter * self,
+        const struct r2_vf_t * gyro, const struct r2_vf_t * accel,
+        const struct r2_vf_t * mag, const size_t n, struct r2_qf_t * out )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        struct r2_qf_t q = r2_attitude_filter_update( self, gyro[m],
+                accel ? &accel[m] : NULL, mag ? &mag[m] : NULL );
+        if( out )
+            out[m] = q;
+    }
+}
+
+#endif // R2_ATTITUDE_FILTER_I
@@ -0,0 +1,297 @@
+// r2_attitude_series.h
+// A time series of attitudes stored as structure-of-arrays
+//
+// Samples are kept in fixed-size chunks, each holding separate, 64-byte
+// aligned arrays of timestamps and of the h, i, j and k components, so bulk
+// kernels (r2_quaternion_batch.h) run over them directly without gathering
+// components out of struct r2_qf_t. Appending never moves existing
+// samples: a new chunk is linked at the end when the last one is full, and
+// dropping the oldest samples returns whole chunks to a spare list for
+// reuse, so a series that streams through a bounded window stops
+// allocating once it has reached its working size.
+//
+// To process samples directly, walk the chunks:
+//
+//     for( c = series->first; c; c = c->next )
+//         kernel( c->h + c->begin, ..., c->end - c->begin );
+
+#ifndef R2_ATTITUDE_SERIES_H
+#define R2_ATTITUDE_SERIES_H
+
+#include <inttypes.h> // for int64_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for posix_memalign, free, calloc
+#include <string.h> // for memcpy
+
+#include "r2_quaternion.h"
+#include "r2_quaternion_batch.h"
+
+// Samples per chunk; a multiple of R2_FASTMATH_BLOCK so that every array
+// in a chunk stays 64-byte aligned.
+#ifndef R2_ATTITUDE_SERIES_CHUNK
+#define R2_ATTITUDE_SERIES_CHUNK 1024
+#endif
+
+struct r2_attitude_chunk {
+    int64_t usec[R2_ATTITUDE_SERIES_CHUNK] __attribute__(( aligned( 64 ) ));
+    float h[R2_ATTITUDE_SERIES_CHUNK] __attribute__(( aligned( 64 ) ));
+    float i[R2_ATTITUDE_SERIES_CHUNK] __attribute__(( aligned( 64 ) ));
+    float j[R2_ATTITUDE_SERIES_CHUNK] __attribute__(( aligned( 64 ) ));
+    float k[R2_ATTITUDE_SERIES_CHUNK] __attribute__(( aligned( 64 ) ));
+    size_t begin; // first live sample
+    size_t end; // one past the last live sample
+    struct r2_attitude_chunk * next;
+};
+
+struct r2_attitude_series {
+    struct r2_attitude_chunk * first;
+    struct r2_attitude_chunk * last;
+    struct r2_attitude_chunk * spare; // dropped chunks, for reuse
+    size_t count;
+};
+
+struct r2_attitude_series * r2_attitude_series_create( void );
+
+/*  Free the series, its chunks and its spare chunks.
+ */
+void r2_attitude_series_destroy( struct r2_attitude_series * self );
+
+/*  Drop all samples, keeping the chunks as spares.
+ */
+void r2_attitude_series_clear( struct r2_attitude_series * self );
+
+/*  Append a sample.
+ *
+ *  Returns 0, or -1 if a new chunk was needed and could not be allocated.
+ */
+int r2_attitude_series_append( struct r2_attitude_series * self,
+        const int64_t usec, const struct r2_qf_t q );
+
+/*  Append n samples given as timestamps and quaternions.
+ */
+int r2_attitude_series_append_n( struct r2_attitude_series * self,
+        const int64_t * usec, const struct r2_qf_t * q, const size_t n );
+
+/*  Append n samples given as nautical angles, converting them straight
+ *  into the series' arrays.
+ */
+int r2_attitude_series_append_nf( struct r2_attitude_series * self,
+        const int64_t * usec, const float * roll, const float * pitch,
+        const float * yaw, const size_t n );
+
+/*  Sample index (0 is the oldest); index must be below self->count.
+ *
+ *  Linear in the number of chunks; walk the chunks to visit every sample.
+ */
+struct r2_qf_t r2_attitude_series_at( const struct r2_attitude_series * self,
+        const size_t index, int64_t * usec );
+
+/*  Drop the n oldest samples (all of them if n >= self->count).
+ */
+void r2_attitude_series_drop( struct r2_attitude_series * self, size_t n );
+
+/*  Normalize every sample to unit length, in place.
+ */
+void r2_attitude_series_normalize( struct r2_attitude_series * self );
+
+/*  Compose every sample with fixed rotations in place: q = l * q * r
+ *  (e.g. r is a sensor mounting rotation).
+ */
+void r2_attitude_series_compose( struct r2_attitude_series * self,
+        const struct r2_qf_t l, const struct r2_qf_t r );
+
+/*  Convert every sample to nautical angles, into arrays of self->count.
+ */
+void r2_attitude_series_to_nf( const struct r2_attitude_series * self,
+        float * roll, float * pitch, float * yaw );
+
+#endif // R2_ATTITUDE_SERIES_H
+
+#ifndef R2_ATTITUDE_SERIES_I
+#define R2_ATTITUDE_SERIES_I
+
+struct r2_attitude_series * r2_attitude_series_create( void )
+{
+    struct r2_attitude_series * self = calloc( 1,
+            sizeof( struct r2_attitude_series ) );
+    if( NULL == self )
+        fprintf( stderr, "could not allocate r2_attitude_series\n" );
+    return self;
+}
+
+void r2_attitude_series_free_chunks( struct r2_attitude_chunk * c )
+{
+    while( c ) {
+        struct r2_attitude_chunk * next = c->next;
+        free( c );
+        c = next;
+    }
+}
+
+void r2_attitude_series_destroy( struct r2_attitude_series * self )
+{
+    if( self ) {
+        r2_attitude_series_free_chunks( self->first );
+        r2_attitude_series_free_chunks( self->spare );
+        free( self );
+    }
+}
+
+void r2_attitude_series_clear( struct r2_attitude_series * self )
+{
+    r2_attitude_series_drop( self, self->count );
+}
+
+// Make sure the last chunk has room for at least one more sample.
+struct r2_attitude_chunk * r2_attitude_series_tail(
+        struct r2_attitude_series * self )
+{
+    if( self->last && ( self->last->end < R2_ATTITUDE_SERIES_CHUNK ) )
+        return self->last;
+
+    struct r2_attitude_chunk * c = self->spare;
+    if( c ) {
+        self->spare = c->next;
+    } else {
+        void * p;
+        if( posix_memalign( &p, 64, sizeof( struct r2_attitude_chunk ) ) ) {
+            fprintf( stderr, "could not allocate r2_attitude_chunk\n" );
+            return NULL;
+        }
+        c = p;
+    }
+    c->begin = 0;
+    c->end = 0;
+    c->next = NULL;
+    if( self->last )
+        self->last->next = c;
+    else
+        self->first = c;
+    self->last = c;
+    return c;
+}
+
+int r2_attitude_series_append( struct r2_attitude_series * self,
+        const int64_t usec, const struct r2_qf_t q )
+{
+    return r2_attitude_series_append_n( self, &usec, &q, 1 );
+}
+
+int r2_attitude_series_append_n( struct r2_attitude_series * self,
+        const int64_t * usec, const struct r2_qf_t * q, const size_t n )
+{
+    size_t done = 0;
+    while( done < n ) {
+        struct r2_attitude_chunk * c = r2_attitude_series_tail( self );
+        if( NULL == c )
+            return -1;
+        size_t len = R2_ATTITUDE_SERIES_CHUNK - c->end;
+        len = n - done < len ? n - done : len;
+        size_t m;
+        memcpy( c->usec + c->end, usec + done, len * sizeof( int64_t ) );
+        for( m = 0; m < len; m++ ) {
+            c->h[c->end + m] = q[done + m].h;
+            c->i[c->end + m] = q[done + m].i;
+            c->j[c->end + m] = q[done + m].j;
+            c->k[c->end + m] = q[done + m].k;
+        }
+        c->end += len;
+        self->count += len;
+        done += len;
+    }
+    return 0;
+}
+
+int r2_attitude_series_append_nf( struct r2_attitude_series * self,
+        const int64_t * usec, const float * roll, const float * pitch,
+        const float * yaw, const size_t n )
+{
+    size_t done = 0;
+    while( done < n ) {
+        struct r2_attitude_chunk * c = r2_attitude_series_tail( self );
+        if( NULL == c )
+            return -1;
+        size_t len = R2_ATTITUDE_SERIES_CHUNK - c->end;
+        len = n - done < len ? n - done : len;
+        memcpy( c->usec + c->end, usec + done, len * sizeof( int64_t ) );
+        r2_nf_to_qf_soa( roll + done, pitch + done, yaw + done,
+                c->h + c->end, c->i + c->end, c->j + c->end, c->k + c->end,
+                len );
+        c->end += len;
+        self->count += len;
+        done += len;
+    }
+    return 0;
+}
+
+struct r2_qf_t r2_attitude_series_at( const struct r2_attitude_series * self,
+        const size_t index, int64_t * usec )
+{
+    const struct r2_attitude_chunk * c = self->first;
+    size_t m = index;
+    while( m >= c->end - c->begin ) {
+        m -= c->end - c->begin;
+        c = c->next;
+    }
+    m += c->begin;
+    if( usec )
+        *usec = c->usec[m];
+    struct r2_qf_t q = { c->h[m], c->i[m], c->j[m], c->k[m] };
+    return q;
+}
+
+void r2_attitude_series_drop( struct r2_attitude_series * self, size_t n )
+{
+    n = n < self->count ? n : self->count;
+    self->count -= n;
+    while( n ) {
+        struct r2_attitude_chunk * c = self->first;
+        size_t live = c->end - c->begin;
+        if( n < live ) {
+            c->begin += n;
+            return;
+        }
+        n -= live;
+        // keep the last chunk in place so appending can continue into it
+        if( c == self->last ) {
+            c->begin = 0;
+            c->end = 0;
+            return;
+        }
+        self->first = c->next;
+        c->next = self->spare;
+        self->spare = c;
+    }
+}
+
+void r2_attitude_series_normalize( struct r2_attitude_series * self )
+{
+    struct r2_attitude_chunk * c;
+    for( c = self->first; c; c = c->next )
+        r2_qf_normalize_soa( c->h + c->begin, c->i + c->begin,
+                c->j + c->begin, c->k + c->begin, c->end - c->begin );
+}
+
+void r2_attitude_series_compose( struct r2_attitude_series * self,
+        const struct r2_qf_t l, const struct r2_qf_t r )
+{
+    struct r2_attitude_chunk * c;
+    for( c = self->first; c; c = c->next )
+        r2_qf_compose_soa( l, c->h + c->begin, c->i + c->begin,
+                c->j + c->begin, c->k + c->begin, r, c->end - c->begin );
+}
+
+void r2_attitude_series_to_nf( const struct r2_attitude_series * self,
+        float * roll, float * pitch, float * yaw )
+{
+    const struct r2_attitude_chunk * c;
+    size_t done = 0;
+    for( c = self->first; c; c = c->next ) {
+        size_t len = c->end - c->begin;
+        r2_qf_to_nf_soa( c->h + c->begin, c->i + c->begin, c->j + c->begin,
+                c->k + c->begin, roll + done, pitch + done, yaw + done, len );
+        done += len;
+    }
+}
+
+#endif // R2_ATTITUDE_SERIES_I
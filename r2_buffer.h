@@ -31,6 +31,10 @@ size_t r2_buffer_available_space( const struct r2_buffer * self );
 
 size_t r2_buffer_fill( struct r2_buffer * self, int fd );
 
+/*  Discard the first n bytes of data (e.g. after parsing them in place).
+ */
+void r2_buffer_drop( struct r2_buffer * self, size_t n );
+
 /*  Get a generic data frame from the buffer.
  *
  *  Uses frame_finder function pointed to by argument f to find the frame.
@@ -88,7 +92,7 @@ size_t r2_buffer_available_space( const struct r2_buffer * self )
 
 size_t r2_buffer_read_into( struct r2_buffer * self, int fd, size_t n )
 {
-    fprintf( STDERR, "r2_buffer_read_into not yet implemented" );
+    fprintf( stderr, "r2_buffer_read_into not yet implemented\n" );
     exit( EXIT_FAILURE );
 }
 
@@ -104,6 +108,14 @@ size_t r2_buffer_fill( struct r2_buffer * self, int fd )
     return bytes_read;
 }
 
+void r2_buffer_drop( struct r2_buffer * self, size_t n )
+{
+    if( n > self->position )
+        n = self->position;
+    self->position -= n;
+    memmove( self->data, self->data + n, self->position );
+}
+
 size_t r2_buffer_get_frame( struct r2_buffer * self, char * frame,
         frame_finder f )
 {
@@ -0,0 +1,469 @@
+// r2_capture.h
+// Record raw bytes from serial ports in an indexed binary capture file
+//
+// A capture file is a 32-byte file header followed by chunks, each a
+// 32-byte chunk header and the bytes read, padded to 8 bytes:
+//
+//     struct r2_capture_chunk {
+//         uint32_t magic;
+//         uint16_t port; // which port the bytes came from
+//         uint16_t flags; // 0, or how the bytes are compressed
+//         int64_t monotonic; // usec, CLOCK_MONOTONIC
+//         int64_t realtime; // usec, CLOCK_REALTIME
+//         uint32_t length; // bytes following
+//         uint32_t reserved; // 0, or the length before compression
+//     }
+//
+// in host byte order. Chunks are appended through a shared mapping of the
+// file, one large segment at a time: the next segment is allocated in the
+// file and mapped only when the current one fills, so writing a chunk is a
+// copy, with no syscall. The chunk's magic is written last, so a chunk
+// cut short by a crash is never taken for a whole one.
+//
+// Every R2_CAPTURE_INDEX_BYTES of chunks, the position and timestamps of
+// the next chunk are noted in a sparse index, written after the chunks
+// (with a trailer pointing at it) when the file is closed. A reader finds
+// the chunks at a given time with a binary search of the index and a short
+// scan. A file that was not closed (e.g. after a crash) has no index; the
+// reader rebuilds it by scanning the chunks once, up to the first one not
+// written completely.
+//
+// Seeking by realtime expects the clock not to step backwards during the
+// capture; the monotonic timestamps remain for measuring intervals.
+//
+// Chunks may be compressed, each on its own, by r2_capture_compress.h;
+// read them back through its decoder.
+
+#ifndef R2_CAPTURE_H
+#define R2_CAPTURE_H
+
+#include <fcntl.h> // for open, posix_fallocate
+#include <inttypes.h> // for int64_t, uint64_t
+#include <stdio.h> // for fprintf, perror
+#include <stdlib.h> // for calloc, free, realloc
+#include <stdatomic.h> // for atomic_thread_fence
+#include <string.h> // for memcpy, memset, strerror
+#include <sys/mman.h> // for mmap, munmap
+#include <sys/stat.h> // for fstat
+#include <time.h> // for clock_gettime
+#include <unistd.h> // for close, ftruncate, pwrite, sysconf
+
+#include "r2_epoch.h"
+
+#define R2_CAPTURE_MAGIC "r2capt\0\1"
+#define R2_CAPTURE_CHUNK_MAGIC 0x4b433252 // "R2CK"
+#define R2_CAPTURE_INDEX_MAGIC 0x58493252 // "R2IX"
+
+// bytes mapped at a time, by default
+#define R2_CAPTURE_SEGMENT ( 16 << 20 )
+
+// bytes of chunks between index marks
+#ifndef R2_CAPTURE_INDEX_BYTES
+#define R2_CAPTURE_INDEX_BYTES ( 1 << 20 )
+#endif
+
+struct r2_capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk; // size of a chunk header
+    int64_t monotonic; // when the capture started
+    int64_t realtime;
+};
+
+struct r2_capture_chunk {
+    uint32_t magic;
+    uint16_t port;
+    uint16_t flags;
+    int64_t monotonic;
+    int64_t realtime;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+// An entry of the sparse index: the chunk at offset.
+struct r2_capture_mark {
+    int64_t monotonic;
+    int64_t realtime;
+    uint64_t offset;
+};
+
+// At the end of a closed file, after the index.
+struct r2_capture_trailer {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t marks;
+    uint64_t offset; // of the index
+};
+
+struct r2_capture {
+    int fd;
+    size_t segment; // bytes mapped at a time
+    unsigned char * window; // the mapped segment
+    uint64_t base; // file offset of the window
+    uint64_t length; // bytes written
+    struct r2_capture_mark * index;
+    size_t marks;
+    size_t capacity; // of index
+    size_t chunks; // chunks written
+};
+
+struct r2_capture_reader {
+    const unsigned char * map; // the whole file
+    uint64_t size;
+    uint64_t end; // of the chunks
+    struct r2_capture_mark * index;
+    size_t marks;
+    uint64_t position; // of the next chunk
+};
+
+/*  Create (or truncate) the capture file at path, mapping segment bytes of
+ *  it at a time (0 for R2_CAPTURE_SEGMENT).
+ */
+struct r2_capture * r2_capture_create( const char * path, size_t segment );
+
+/*  Write the index and close the file.
+ */
+void r2_capture_destroy( struct r2_capture * self );
+
+/*  Append length bytes of data read from port, stamped now.
+ *
+ *  Returns 0, or -1 if the file could not be grown.
+ */
+int r2_capture_write( struct r2_capture * self, const uint16_t port,
+        const void * data, const size_t length );
+
+/*  Append a chunk with the header fields of chunk (but its magic) and
+ *  chunk->length bytes of data.
+ *
+ *  Returns 0, or -1 if the file could not be grown.
+ */
+int r2_capture_write_chunk( struct r2_capture * self,
+        const struct r2_capture_chunk * chunk, const void * data );
+
+/*  Open the capture file at path for reading, at its first chunk.
+ */
+struct r2_capture_reader * r2_capture_reader_open( const char * path );
+
+void r2_capture_reader_destroy( struct r2_capture_reader * self );
+
+/*  Read the next chunk; data points into the file.
+ *
+ *  Returns 1, or 0 at the end.
+ */
+int r2_capture_reader_next( struct r2_capture_reader * self,
+        struct r2_capture_chunk * chunk, const void ** data );
+
+/*  Go to the first chunk at or after realtime.
+ */
+void r2_capture_reader_seek( struct r2_capture_reader * self,
+        const int64_t realtime );
+
+void r2_capture_reader_rewind( struct r2_capture_reader * self );
+
+#endif // R2_CAPTURE_H
+
+#ifndef R2_CAPTURE_I
+#define R2_CAPTURE_I
+
+int64_t r2_capture_monotonic_now( void )
+{
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return r2_epoch_timespec_to_usec( t );
+}
+
+// Map the segment at base, allocating it in the file first so that
+// writing does not run out of space through the mapping.
+int r2_capture_map( struct r2_capture * self, const uint64_t base )
+{
+    if( self->window )
+        munmap( self->window, self->segment );
+    self->window = NULL;
+    int e = posix_fallocate( self->fd, (off_t)base, (off_t)self->segment );
+    if( e ) {
+        fprintf( stderr, "could not grow r2_capture file: %s\n",
+                strerror( e ) );
+        return -1;
+    }
+    void * p = mmap( NULL, self->segment, PROT_READ | PROT_WRITE, MAP_SHARED,
+            self->fd, (off_t)base );
+    if( MAP_FAILED == p ) {
+        perror( "could not map r2_capture file" );
+        return -1;
+    }
+    self->window = p;
+    self->base = base;
+    return 0;
+}
+
+// Copy n bytes (zeros if data is NULL) to the end of the file, moving the
+// window along.
+int r2_capture_put( struct r2_capture * self, const void * data, size_t n )
+{
+    const unsigned char * p = data;
+    while( n ) {
+        if( NULL == self->window
+                || self->length == self->base + self->segment ) {
+            if( -1 == r2_capture_map( self, self->length ) )
+                return -1;
+        }
+        unsigned char * w = self->window + ( self->length - self->base );
+        size_t room = self->base + self->segment - self->length;
+        size_t m = n < room ? n : room;
+        if( p ) {
+            memcpy( w, p, m );
+            p += m;
+        } else
+            memset( w, 0, m );
+        self->length += m;
+        n -= m;
+    }
+    return 0;
+}
+
+struct r2_capture * r2_capture_create( const char * path, size_t segment )
+{
+    struct r2_capture * self = calloc( 1, sizeof( struct r2_capture ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_capture\n" );
+        return NULL;
+    }
+    size_t page = (size_t)sysconf( _SC_PAGESIZE );
+    segment = segment ? segment : R2_CAPTURE_SEGMENT;
+    self->segment = ( segment + page - 1 ) / page * page;
+    self->fd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if( -1 == self->fd ) {
+        perror( "could not create r2_capture file" );
+        free( self );
+        return NULL;
+    }
+    struct r2_capture_header h = { R2_CAPTURE_MAGIC, 1,
+        sizeof( struct r2_capture_chunk ), r2_capture_monotonic_now(),
+        r2_epoch_usec_now() };
+    if( -1 == r2_capture_put( self, &h, sizeof( h ) ) ) {
+        close( self->fd );
+        free( self->index );
+        free( self );
+        return NULL;
+    }
+    return self;
+}
+
+void r2_capture_destroy( struct r2_capture * self )
+{
+    if( NULL == self )
+        return;
+    struct r2_capture_trailer t = { R2_CAPTURE_INDEX_MAGIC, 0, self->marks,
+        self->length };
+    if( -1 == r2_capture_put( self, self->index,
+                self->marks * sizeof( struct r2_capture_mark ) )
+            || -1 == r2_capture_put( self, &t, sizeof( t ) ) )
+        fprintf( stderr, "r2_capture: could not write the index\n" );
+    if( self->window )
+        munmap( self->window, self->segment );
+    // drop the unused rest of the last segment
+    if( -1 == ftruncate( self->fd, (off_t)self->length ) )
+        perror( "could not truncate r2_capture file" );
+    close( self->fd );
+    free( self->index );
+    free( self );
+}
+
+int r2_capture_write( struct r2_capture * self, const uint16_t port,
+        const void * data, const size_t length )
+{
+    struct r2_capture_chunk c = { R2_CAPTURE_CHUNK_MAGIC, port, 0,
+        r2_capture_monotonic_now(), r2_epoch_usec_now(),
+        (uint32_t)length, 0 };
+    return r2_capture_write_chunk( self, &c, data );
+}
+
+int r2_capture_write_chunk( struct r2_capture * self,
+        const struct r2_capture_chunk * chunk, const void * data )
+{
+    if( 0 == self->marks || self->length - self->index[self->marks - 1].offset
+            >= R2_CAPTURE_INDEX_BYTES ) {
+        if( self->marks == self->capacity ) {
+            size_t capacity = self->capacity ? 2 * self->capacity : 64;
+            struct r2_capture_mark * index = realloc( self->index,
+                    capacity * sizeof( struct r2_capture_mark ) );
+            if( NULL == index ) {
+                fprintf( stderr, "could not allocate r2_capture index\n" );
+                return -1;
+            }
+            self->index = index;
+            self->capacity = capacity;
+        }
+        struct r2_capture_mark m = { chunk->monotonic, chunk->realtime,
+            self->length };
+        self->index[self->marks++] = m;
+    }
+    // the magic goes in last, once the rest of the chunk is in place, so
+    // a writer that dies mid-copy leaves zeros where a reader stops
+    const uint64_t start = self->length;
+    const uint32_t magic = R2_CAPTURE_CHUNK_MAGIC;
+    struct r2_capture_chunk c = *chunk;
+    c.magic = 0;
+    if( -1 == r2_capture_put( self, &c, sizeof( c ) )
+            || -1 == r2_capture_put( self, data, c.length )
+            || -1 == r2_capture_put( self, NULL, -c.length & 7 ) )
+        return -1;
+    atomic_thread_fence( memory_order_release );
+    if( start >= self->base )
+        memcpy( self->window + ( start - self->base ), &magic,
+                sizeof( magic ) );
+    else if( sizeof( magic ) != pwrite( self->fd, &magic, sizeof( magic ),
+                (off_t)start ) ) {
+        // the chunk began in an earlier segment, no longer mapped
+        perror( "could not write r2_capture chunk" );
+        return -1;
+    }
+    self->chunks++;
+    return 0;
+}
+
+// The chunk at position, if it is whole and before the end.
+int r2_capture_reader_chunk( const struct r2_capture_reader * self,
+        const uint64_t position, const uint64_t end,
+        struct r2_capture_chunk * chunk )
+{
+    if( position + sizeof( *chunk ) > end )
+        return 0;
+    memcpy( chunk, self->map + position, sizeof( *chunk ) );
+    return R2_CAPTURE_CHUNK_MAGIC == chunk->magic
+        && chunk->length <= end - position - sizeof( *chunk );
+}
+
+// Read the index of a closed file, or rebuild it by scanning the chunks.
+int r2_capture_reader_index( struct r2_capture_reader * self )
+{
+    struct r2_capture_trailer t;
+    const size_t h = sizeof( struct r2_capture_header );
+    const size_t mark = sizeof( struct r2_capture_mark );
+    if( self->size >= h + sizeof( t ) ) {
+        memcpy( &t, self->map + self->size - sizeof( t ), sizeof( t ) );
+        if( R2_CAPTURE_INDEX_MAGIC == t.magic && t.offset >= h
+                && t.marks <= ( self->size - t.offset ) / mark
+                && t.offset + t.marks * mark + sizeof( t ) == self->size ) {
+            self->index = malloc( t.marks * mark + 1 );
+            if( NULL == self->index )
+                return -1;
+            memcpy( self->index, self->map + t.offset, t.marks * mark );
+            self->marks = t.marks;
+            self->end = t.offset;
+            return 0;
+        }
+    }
+    fprintf( stderr, "r2_capture: no index, scanning\n" );
+    struct r2_capture_chunk c;
+    size_t capacity = 0;
+    uint64_t p = h;
+    while( r2_capture_reader_chunk( self, p, self->size, &c ) ) {
+        if( 0 == self->marks || p - self->index[self->marks - 1].offset
+                >= R2_CAPTURE_INDEX_BYTES ) {
+            if( self->marks == capacity ) {
+                capacity = capacity ? 2 * capacity : 64;
+                struct r2_capture_mark * index = realloc( self->index,
+                        capacity * mark );
+                if( NULL == index )
+                    return -1;
+                self->index = index;
+            }
+            struct r2_capture_mark m = { c.monotonic, c.realtime, p };
+            self->index[self->marks++] = m;
+        }
+        p += sizeof( c ) + ( ( c.length + 7 ) & ~(uint64_t)7 );
+    }
+    self->end = p < self->size ? p : self->size;
+    return 0;
+}
+
+struct r2_capture_reader * r2_capture_reader_open( const char * path )
+{
+    struct r2_capture_reader * self = calloc( 1,
+            sizeof( struct r2_capture_reader ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_capture_reader\n" );
+        return NULL;
+    }
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    struct stat st;
+    if( -1 == fd || -1 == fstat( fd, &st ) ) {
+        perror( "could not open r2_capture file" );
+        if( -1 != fd )
+            close( fd );
+        free( self );
+        return NULL;
+    }
+    self->size = (uint64_t)st.st_size;
+    void * p = self->size < sizeof( struct r2_capture_header ) ? MAP_FAILED
+        : mmap( NULL, self->size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( MAP_FAILED == p
+            || 0 != memcmp( p, R2_CAPTURE_MAGIC, 8 ) ) {
+        fprintf( stderr, "r2_capture_reader_open: not a capture file\n" );
+        if( MAP_FAILED != p )
+            munmap( p, self->size );
+        free( self );
+        return NULL;
+    }
+    self->map = p;
+    if( -1 == r2_capture_reader_index( self ) ) {
+        fprintf( stderr, "could not allocate r2_capture_reader index\n" );
+        r2_capture_reader_destroy( self );
+        return NULL;
+    }
+    r2_capture_reader_rewind( self );
+    return self;
+}
+
+void r2_capture_reader_destroy( struct r2_capture_reader * self )
+{
+    if( self ) {
+        if( self->map )
+            munmap( (void *)self->map, self->size );
+        free( self->index );
+        free( self );
+    }
+}
+
+void r2_capture_reader_rewind( struct r2_capture_reader * self )
+{
+    self->position = sizeof( struct r2_capture_header );
+}
+
+int r2_capture_reader_next( struct r2_capture_reader * self,
+        struct r2_capture_chunk * chunk, const void ** data )
+{
+    if( !r2_capture_reader_chunk( self, self->position, self->end, chunk ) )
+        return 0;
+    *data = self->map + self->position + sizeof( *chunk );
+    self->position += sizeof( *chunk )
+        + ( ( chunk->length + 7 ) & ~(uint64_t)7 );
+    return 1;
+}
+
+void r2_capture_reader_seek( struct r2_capture_reader * self,
+        const int64_t realtime )
+{
+    // the last mark before realtime, then the chunks after it
+    size_t lo = 0, hi = self->marks;
+    while( lo < hi ) {
+        size_t mid = lo + ( hi - lo ) / 2;
+        if( self->index[mid].realtime < realtime )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if( 0 == lo ) {
+        r2_capture_reader_rewind( self );
+        return;
+    }
+    self->position = self->index[lo - 1].offset;
+    struct r2_capture_chunk c;
+    while( r2_capture_reader_chunk( self, self->position, self->end, &c )
+            && c.realtime < realtime )
+        self->position += sizeof( c ) + ( ( c.length + 7 ) & ~(uint64_t)7 );
+}
+
+#endif // R2_CAPTURE_I
@@ -0,0 +1,784 @@
+// r2_capture_compress.h
+// Compress capture chunks on a background thread
+//
+// A stage between the serial ports and an r2_capture: chunks are queued
+// (copied into a preallocated ring, under a mutex held only for the copy)
+// and a thread compresses each chunk on its own and appends it to the
+// capture. Every chunk can be decompressed by itself, so the capture's
+// time index still finds any chunk. A chunk that does not shrink is kept
+// as it is.
+//
+// The codecs are compiled in when available: zlib with R2_WITH_ZLIB, zstd
+// with R2_WITH_ZSTD and LZ4 with R2_WITH_LZ4 (link with -lz, -lzstd or
+// -llz4). R2_CAPTURE_NONE stores chunks as they are, and always works.
+//
+// Short chunks of a text stream compress poorly on their own, so the
+// first bytes of the stream are sampled to make a dictionary, written to
+// the capture as a chunk of its own (port R2_CAPTURE_DICTIONARY_PORT),
+// and used for every chunk after it. zstd trains the dictionary from the
+// samples (ZDICT_trainFromBuffer); zlib and LZ4 take the latest samples as
+// their preset dictionary. The dictionary is loaded once, and each chunk
+// starts from a copy of the loaded state.
+//
+// When the thread falls behind and the queue is full, writes are refused
+// (and counted) rather than blocking the caller, who keeps the bytes (e.g.
+// in its r2_buffer) and tries again; r2_capture_compress_backlog tells how
+// far behind the thread is.
+//
+// The header of a compressed chunk has the codec in flags
+// (R2_CAPTURE_CODEC), R2_CAPTURE_WITH_DICTIONARY if the dictionary was
+// used, and the length before compression in reserved. The decoder reads
+// any capture, compressed or not, giving back the chunks as they were.
+
+#ifndef R2_CAPTURE_COMPRESS_H
+#define R2_CAPTURE_COMPRESS_H
+
+#include <inttypes.h> // for uint64_t
+#include <pthread.h> // for pthread_create, pthread_mutex_lock
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free, malloc, realloc
+#include <string.h> // for memcpy, memset
+#include <sys/types.h> // for ssize_t
+
+#ifdef R2_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef R2_WITH_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+#ifdef R2_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#include "r2_capture.h"
+
+enum r2_capture_codec {
+    R2_CAPTURE_NONE,
+    R2_CAPTURE_ZLIB,
+    R2_CAPTURE_ZSTD,
+    R2_CAPTURE_LZ4
+};
+
+#define R2_CAPTURE_CODEC 0x0f // flags: the codec
+#define R2_CAPTURE_DICTIONARY 0x10 // flags: the chunk is the dictionary
+#define R2_CAPTURE_WITH_DICTIONARY 0x20 // flags: compressed with it
+#define R2_CAPTURE_DICTIONARY_PORT 0xffff
+
+// bytes of samples per byte of dictionary
+#define R2_CAPTURE_SAMPLES 16
+
+// zlib blocks kept for reuse, at least the five of a deflate stream
+#define R2_CAPTURE_ZBLOCKS 8
+
+struct r2_capture_compress {
+    struct r2_capture * capture; // written by the thread only
+    enum r2_capture_codec codec;
+    int level;
+    unsigned char * queue; // chunk headers and bytes
+    size_t capacity;
+    uint64_t head; // bytes queued
+    uint64_t tail; // bytes taken off the queue
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // something to compress
+    pthread_cond_t space; // something compressed
+    pthread_t thread;
+    int stop;
+    size_t dictionary; // size wanted, 0 for none
+    unsigned char * samples;
+    size_t sampled;
+    size_t * sizes; // of the samples
+    size_t count; // of samples
+    unsigned char * dict; // in use, when trained
+    size_t dict_size;
+    int trained;
+    unsigned char * out; // compressed chunk
+#ifdef R2_WITH_ZLIB
+    z_stream zlib;
+    z_stream zlib_dict; // with the dictionary set, copied for each chunk
+    void * zblocks[R2_CAPTURE_ZBLOCKS]; // freed by zlib, for reuse
+#endif
+#ifdef R2_WITH_ZSTD
+    ZSTD_CCtx * zstd;
+    ZSTD_CDict * cdict;
+#endif
+#ifdef R2_WITH_LZ4
+    LZ4_stream_t * lz4;
+    LZ4_stream_t * lz4_dict; // with the dictionary loaded, copied likewise
+#endif
+    size_t chunks; // written to the capture
+    uint64_t in; // bytes before compression
+    uint64_t written; // bytes after
+    size_t refused; // writes refused with the queue full
+    size_t errors; // chunks the capture could not take
+};
+
+struct r2_capture_decoder {
+    struct r2_capture_reader * reader;
+    unsigned char * dict;
+    size_t dict_size;
+    unsigned char * out; // decompressed chunk
+    size_t capacity;
+#ifdef R2_WITH_ZLIB
+    z_stream zlib;
+#endif
+#ifdef R2_WITH_ZSTD
+    ZSTD_DCtx * zstd;
+    ZSTD_DDict * ddict;
+#endif
+};
+
+/*  Start a thread compressing chunks with codec at level (the codec's own
+ *  scale; 0 for its default) into capture, through a queue of queue bytes
+ *  (which must hold the largest chunk), with a dictionary of up to
+ *  dictionary bytes (0 for none).
+ *
+ *  The capture belongs to the thread until r2_capture_compress_destroy.
+ */
+struct r2_capture_compress * r2_capture_compress_create(
+        struct r2_capture * capture, const enum r2_capture_codec codec,
+        const int level, const size_t queue, const size_t dictionary );
+
+/*  Compress what is queued, and stop the thread. The capture is left open.
+ */
+void r2_capture_compress_destroy( struct r2_capture_compress * self );
+
+/*  Queue length bytes of data read from port, stamped now.
+ *
+ *  Returns 0, or -1 if the queue is full (or the chunk larger than it).
+ */
+int r2_capture_compress_write( struct r2_capture_compress * self,
+        const uint16_t port, const void * data, const size_t length );
+
+/*  Queue a chunk, as r2_capture_write_chunk would write it.
+ *
+ *  Returns 0, or -1 if the queue is full (or the chunk larger than it).
+ */
+int r2_capture_compress_write_chunk( struct r2_capture_compress * self,
+        const struct r2_capture_chunk * chunk, const void * data );
+
+/*  Bytes queued and not compressed yet.
+ */
+size_t r2_capture_compress_backlog( struct r2_capture_compress * self );
+
+/*  Wait until everything queued is in the capture.
+ */
+void r2_capture_compress_flush( struct r2_capture_compress * self );
+
+/*  Read the capture file at path, compressed or not.
+ */
+struct r2_capture_decoder * r2_capture_decoder_create( const char * path );
+
+void r2_capture_decoder_destroy( struct r2_capture_decoder * self );
+
+/*  Read the next chunk (from the reader's position, see
+ *  r2_capture_reader_seek), decompressed; data is valid until the next.
+ *
+ *  Returns 1, 0 at the end, or -1 for a chunk that cannot be decompressed
+ *  (e.g. of a codec not compiled in).
+ */
+int r2_capture_decoder_next( struct r2_capture_decoder * self,
+        struct r2_capture_chunk * chunk, const void ** data );
+
+#endif // R2_CAPTURE_COMPRESS_H
+
+#ifndef R2_CAPTURE_COMPRESS_I
+#define R2_CAPTURE_COMPRESS_I
+
+// Bytes a chunk of length takes in the queue.
+size_t r2_capture_compress_entry( const size_t length )
+{
+    return sizeof( struct r2_capture_chunk ) + ( ( length + 7 ) & ~(size_t)7 );
+}
+
+// Compress n bytes into self->out, if they shrink; returns the compressed
+// length, or -1.
+ssize_t r2_capture_compress_encode( struct r2_capture_compress * self,
+        const unsigned char * data, const size_t n )
+{
+    // unused with no codec compiled in
+    (void)data; (void)n;
+    switch( self->codec ) {
+#ifdef R2_WITH_ZLIB
+    case R2_CAPTURE_ZLIB:
+        if( self->dict_size ) {
+            // hashing the dictionary again would cost more than the chunk
+            deflateEnd( &self->zlib );
+            if( Z_OK != deflateCopy( &self->zlib, &self->zlib_dict ) )
+                return -1;
+        } else
+            deflateReset( &self->zlib );
+        self->zlib.next_in = (Bytef *)data;
+        self->zlib.avail_in = (uInt)n;
+        self->zlib.next_out = self->out;
+        self->zlib.avail_out = (uInt)n;
+        if( Z_STREAM_END != deflate( &self->zlib, Z_FINISH ) )
+            return -1;
+        return (ssize_t)self->zlib.total_out;
+#endif
+#ifdef R2_WITH_ZSTD
+    case R2_CAPTURE_ZSTD: {
+        size_t r = ZSTD_compress2( self->zstd, self->out, n, data, n );
+        if( !ZSTD_isError( r ) )
+            return (ssize_t)r;
+        // a frame that did not fit leaves the context mid-frame
+        ZSTD_CCtx_reset( self->zstd, ZSTD_reset_session_only );
+        return -1;
+    }
+#endif
+#ifdef R2_WITH_LZ4
+    case R2_CAPTURE_LZ4: {
+        // copying the loaded stream is the documented way to reuse it
+        if( self->dict_size )
+            memcpy( self->lz4, self->lz4_dict, sizeof( LZ4_stream_t ) );
+        else
+            LZ4_resetStream_fast( self->lz4 );
+        int r = LZ4_compress_fast_continue( self->lz4, (const char *)data,
+                (char *)self->out, (int)n, (int)n,
+                self->level > 0 ? self->level : 1 );
+        return r > 0 ? r : -1;
+    }
+#endif
+    default:
+        return -1;
+    }
+}
+
+#ifdef R2_WITH_ZLIB
+// A zlib block, after its size.
+union r2_capture_zblock {
+    size_t size;
+    long double align;
+};
+
+// Allocate for zlib, reusing a block it freed of the same size: the copy of
+// the primed stream for each chunk then neither maps nor faults memory.
+voidpf r2_capture_compress_zalloc( voidpf opaque, uInt items, uInt size )
+{
+    struct r2_capture_compress * self = opaque;
+    const size_t n = (size_t)items * size;
+    union r2_capture_zblock * b;
+    size_t i;
+    for( i = 0; i < R2_CAPTURE_ZBLOCKS; i++ ) {
+        b = self->zblocks[i];
+        if( b && n == b->size ) {
+            self->zblocks[i] = NULL;
+            return b + 1;
+        }
+    }
+    b = malloc( sizeof( union r2_capture_zblock ) + n );
+    if( NULL == b )
+        return Z_NULL;
+    b->size = n;
+    return b + 1;
+}
+
+void r2_capture_compress_zfree( voidpf opaque, voidpf address )
+{
+    struct r2_capture_compress * self = opaque;
+    union r2_capture_zblock * b = (union r2_capture_zblock *)address - 1;
+    size_t i;
+    for( i = 0; i < R2_CAPTURE_ZBLOCKS; i++ ) {
+        if( NULL == self->zblocks[i] ) {
+            self->zblocks[i] = b;
+            return;
+        }
+    }
+    free( b );
+}
+
+// Raw deflate: no header or checksum on every chunk.
+int r2_capture_compress_deflate_init( struct r2_capture_compress * self,
+        z_stream * z )
+{
+    return deflateInit2( z, self->level ? self->level
+            : Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY );
+}
+#endif
+
+// Load the dictionary of size bytes into a state that each chunk starts
+// from, so that it is hashed once rather than for every chunk. Returns 0,
+// or -1.
+int r2_capture_compress_prime( struct r2_capture_compress * self,
+        const size_t size )
+{
+    (void)size; // unused with no codec compiled in
+    switch( self->codec ) {
+#ifdef R2_WITH_ZLIB
+    case R2_CAPTURE_ZLIB:
+        // the copies take the allocator of the primed stream
+        self->zlib_dict.zalloc = r2_capture_compress_zalloc;
+        self->zlib_dict.zfree = r2_capture_compress_zfree;
+        self->zlib_dict.opaque = self;
+        if( Z_OK != r2_capture_compress_deflate_init( self, &self->zlib_dict ) )
+            return -1;
+        return Z_OK == deflateSetDictionary( &self->zlib_dict, self->dict,
+                (uInt)size ) ? 0 : -1;
+#endif
+#ifdef R2_WITH_ZSTD
+    case R2_CAPTURE_ZSTD:
+        self->cdict = ZSTD_createCDict( self->dict, size, self->level );
+        return self->cdict ? 0 : -1;
+#endif
+#ifdef R2_WITH_LZ4
+    case R2_CAPTURE_LZ4:
+        self->lz4_dict = LZ4_createStream();
+        if( NULL == self->lz4_dict )
+            return -1;
+        LZ4_loadDict( self->lz4_dict, (const char *)self->dict, (int)size );
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+// Make the dictionary from the samples, and write it to the capture.
+void r2_capture_compress_train( struct r2_capture_compress * self,
+        const struct r2_capture_chunk * chunk )
+{
+    self->trained = 1;
+    size_t size = self->dictionary < self->sampled ? self->dictionary
+        : self->sampled;
+    self->dict = malloc( self->dictionary + 1 );
+    if( NULL == self->dict ) {
+        fprintf( stderr,
+                "could not allocate r2_capture_compress dictionary\n" );
+        return;
+    }
+#ifdef R2_WITH_ZSTD
+    if( R2_CAPTURE_ZSTD == self->codec ) {
+        size = ZDICT_trainFromBuffer( self->dict, self->dictionary,
+                self->samples, self->sizes, (unsigned)self->count );
+        if( ZDICT_isError( size ) ) {
+            fprintf( stderr, "r2_capture_compress: no dictionary: %s\n",
+                    ZDICT_getErrorName( size ) );
+            return;
+        }
+    } else
+#endif
+    // the latest samples, as a preset dictionary
+    memcpy( self->dict, self->samples + self->sampled - size, size );
+    if( -1 == r2_capture_compress_prime( self, size ) ) {
+        fprintf( stderr, "could not load r2_capture_compress dictionary\n" );
+        return;
+    }
+    struct r2_capture_chunk c = { 0, R2_CAPTURE_DICTIONARY_PORT,
+        (uint16_t)( self->codec | R2_CAPTURE_DICTIONARY ), chunk->monotonic,
+        chunk->realtime, (uint32_t)size, 0 };
+    // only chunks after the dictionary in the capture may use it
+    if( -1 == r2_capture_write_chunk( self->capture, &c, self->dict ) ) {
+        self->errors++;
+        return;
+    }
+    self->dict_size = size;
+#ifdef R2_WITH_ZSTD
+    if( self->cdict )
+        ZSTD_CCtx_refCDict( self->zstd, self->cdict );
+#endif
+}
+
+// Sample the bytes of a chunk for the dictionary, training it when there
+// are enough.
+void r2_capture_compress_sample( struct r2_capture_compress * self,
+        const struct r2_capture_chunk * chunk, const unsigned char * data )
+{
+    const size_t total = self->dictionary * R2_CAPTURE_SAMPLES;
+    size_t n = chunk->length < total - self->sampled ? chunk->length
+        : total - self->sampled;
+    memcpy( self->samples + self->sampled, data, n );
+    self->sampled += n;
+    self->sizes[self->count++] = n;
+    if( self->sampled == total || self->count == total / 8 )
+        r2_capture_compress_train( self, chunk );
+}
+
+// Compress a chunk and write it to the capture.
+void r2_capture_compress_chunk( struct r2_capture_compress * self,
+        const struct r2_capture_chunk * chunk, const unsigned char * data )
+{
+    struct r2_capture_chunk c = *chunk;
+    if( self->dictionary && !self->trained && c.length )
+        r2_capture_compress_sample( self, chunk, data );
+    ssize_t n = c.length ? r2_capture_compress_encode( self, data, c.length )
+        : -1;
+    c.reserved = c.length;
+    if( n >= 0 && (size_t)n < c.length ) {
+        c.flags = (uint16_t)( self->codec
+                | ( self->dict_size ? R2_CAPTURE_WITH_DICTIONARY : 0 ) );
+        c.length = (uint32_t)n;
+        data = self->out;
+    } else
+        c.flags = R2_CAPTURE_NONE;
+    if( -1 == r2_capture_write_chunk( self->capture, &c, data ) )
+        self->errors++;
+    else {
+        self->chunks++;
+        self->written += c.length;
+    }
+}
+
+void * r2_capture_compress_run( void * context )
+{
+    struct r2_capture_compress * self = context;
+    const size_t header = sizeof( struct r2_capture_chunk );
+    struct r2_capture_chunk c;
+    pthread_mutex_lock( &self->lock );
+    for( ;; ) {
+        while( self->head == self->tail && !self->stop )
+            pthread_cond_wait( &self->ready, &self->lock );
+        if( self->head == self->tail )
+            break; // stopped, with nothing left
+        size_t at = self->tail % self->capacity, skip = 0;
+        pthread_mutex_unlock( &self->lock );
+        // the entries wrap around where the next would not fit
+        if( self->capacity - at >= header )
+            memcpy( &c, self->queue + at, header );
+        if( self->capacity - at < header || 0 == c.magic ) {
+            skip = self->capacity - at;
+            at = 0;
+            memcpy( &c, self->queue, header );
+        }
+        r2_capture_compress_chunk( self, &c, self->queue + at + header );
+        pthread_mutex_lock( &self->lock );
+        self->tail += skip + r2_capture_compress_entry( c.length );
+        self->in += c.length;
+        pthread_cond_broadcast( &self->space );
+    }
+    pthread_mutex_unlock( &self->lock );
+    return NULL;
+}
+
+struct r2_capture_compress * r2_capture_compress_create(
+        struct r2_capture * capture, const enum r2_capture_codec codec,
+        const int level, const size_t queue, const size_t dictionary )
+{
+    struct r2_capture_compress * self = calloc( 1,
+            sizeof( struct r2_capture_compress ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_capture_compress\n" );
+        return NULL;
+    }
+    self->capture = capture;
+    self->codec = codec;
+    self->level = level;
+    self->capacity = ( queue + 7 ) & ~(size_t)7;
+    self->dictionary = R2_CAPTURE_NONE == codec ? 0 : dictionary;
+#ifdef R2_WITH_ZLIB
+    // zlib looks back 32 KiB at most
+    if( R2_CAPTURE_ZLIB == codec && self->dictionary > 32768 )
+        self->dictionary = 32768;
+#endif
+#ifdef R2_WITH_LZ4
+    if( R2_CAPTURE_LZ4 == codec && self->dictionary > 65536 )
+        self->dictionary = 65536;
+#endif
+    self->queue = malloc( self->capacity );
+    self->out = malloc( self->capacity );
+    int ok = self->queue && self->out;
+    if( self->dictionary ) {
+        self->samples = malloc( self->dictionary * R2_CAPTURE_SAMPLES );
+        self->sizes = malloc( self->dictionary * R2_CAPTURE_SAMPLES / 8
+                * sizeof( size_t ) );
+        ok = ok && self->samples && self->sizes;
+    }
+    switch( codec ) {
+    case R2_CAPTURE_NONE:
+        break;
+#ifdef R2_WITH_ZLIB
+    case R2_CAPTURE_ZLIB:
+        ok = ok && Z_OK == r2_capture_compress_deflate_init( self,
+                &self->zlib );
+        break;
+#endif
+#ifdef R2_WITH_ZSTD
+    case R2_CAPTURE_ZSTD:
+        // no length or dictionary id in every frame: the chunk header has
+        // the one, and a capture has a single dictionary
+        ok = ok && NULL != ( self->zstd = ZSTD_createCCtx() )
+            && !ZSTD_isError( ZSTD_CCtx_setParameter( self->zstd,
+                        ZSTD_c_compressionLevel, level ) )
+            && !ZSTD_isError( ZSTD_CCtx_setParameter( self->zstd,
+                        ZSTD_c_contentSizeFlag, 0 ) )
+            && !ZSTD_isError( ZSTD_CCtx_setParameter( self->zstd,
+                        ZSTD_c_dictIDFlag, 0 ) );
+        break;
+#endif
+#ifdef R2_WITH_LZ4
+    case R2_CAPTURE_LZ4:
+        ok = ok && NULL != ( self->lz4 = LZ4_createStream() );
+        break;
+#endif
+    default:
+        fprintf( stderr, "r2_capture_compress: codec %d not compiled in\n",
+                codec );
+        ok = 0;
+    }
+    if( !ok || pthread_mutex_init( &self->lock, NULL )
+            || pthread_cond_init( &self->ready, NULL )
+            || pthread_cond_init( &self->space, NULL )
+            || pthread_create( &self->thread, NULL, r2_capture_compress_run,
+                self ) ) {
+        fprintf( stderr, "could not create r2_capture_compress\n" );
+        self->thread = pthread_self(); // none to join
+        r2_capture_compress_destroy( self );
+        return NULL;
+    }
+    return self;
+}
+
+void r2_capture_compress_destroy( struct r2_capture_compress * self )
+{
+    if( NULL == self )
+        return;
+    if( !pthread_equal( self->thread, pthread_self() ) ) {
+        pthread_mutex_lock( &self->lock );
+        self->stop = 1;
+        pthread_cond_signal( &self->ready );
+        pthread_mutex_unlock( &self->lock );
+        pthread_join( self->thread, NULL );
+        pthread_cond_destroy( &self->space );
+        pthread_cond_destroy( &self->ready );
+        pthread_mutex_destroy( &self->lock );
+    }
+#ifdef R2_WITH_ZLIB
+    if( R2_CAPTURE_ZLIB == self->codec ) {
+        deflateEnd( &self->zlib );
+        deflateEnd( &self->zlib_dict ); // harmless if never initialized
+    }
+    size_t i;
+    for( i = 0; i < R2_CAPTURE_ZBLOCKS; i++ )
+        free( self->zblocks[i] );
+#endif
+#ifdef R2_WITH_ZSTD
+    ZSTD_freeCDict( self->cdict );
+    ZSTD_freeCCtx( self->zstd );
+#endif
+#ifdef R2_WITH_LZ4
+    LZ4_freeStream( self->lz4_dict );
+    LZ4_freeStream( self->lz4 );
+#endif
+    free( self->dict );
+    free( self->sizes );
+    free( self->samples );
+    free( self->out );
+    free( self->queue );
+    free( self );
+}
+
+int r2_capture_compress_write( struct r2_capture_compress * self,
+        const uint16_t port, const void * data, const size_t length )
+{
+    struct r2_capture_chunk c = { R2_CAPTURE_CHUNK_MAGIC, port, 0,
+        r2_capture_monotonic_now(), r2_epoch_usec_now(),
+        (uint32_t)length, 0 };
+    return r2_capture_compress_write_chunk( self, &c, data );
+}
+
+int r2_capture_compress_write_chunk( struct r2_capture_compress * self,
+        const struct r2_capture_chunk * chunk, const void * data )
+{
+    const size_t header = sizeof( struct r2_capture_chunk );
+    const size_t n = r2_capture_compress_entry( chunk->length );
+    pthread_mutex_lock( &self->lock );
+    size_t at = self->head % self->capacity;
+    size_t skip = self->capacity - at < n ? self->capacity - at : 0;
+    if( self->head + skip + n - self->tail > self->capacity ) {
+        self->refused++;
+        pthread_mutex_unlock( &self->lock );
+        return -1;
+    }
+    // the thread does not look past head, so the copy is safe from it;
+    // the lock is kept for the producer's sake only
+    if( skip >= 4 )
+        memset( self->queue + at, 0, 4 ); // magic 0: wrap around
+    at = skip ? 0 : at;
+    struct r2_capture_chunk c = *chunk;
+    c.magic = R2_CAPTURE_CHUNK_MAGIC;
+    memcpy( self->queue + at, &c, header );
+    memcpy( self->queue + at + header, data, c.length );
+    self->head += skip + n;
+    pthread_cond_signal( &self->ready );
+    pthread_mutex_unlock( &self->lock );
+    return 0;
+}
+
+size_t r2_capture_compress_backlog( struct r2_capture_compress * self )
+{
+    pthread_mutex_lock( &self->lock );
+    size_t n = self->head - self->tail;
+    pthread_mutex_unlock( &self->lock );
+    return n;
+}
+
+void r2_capture_compress_flush( struct r2_capture_compress * self )
+{
+    pthread_mutex_lock( &self->lock );
+    while( self->head != self->tail )
+        pthread_cond_wait( &self->space, &self->lock );
+    pthread_mutex_unlock( &self->lock );
+}
+
+struct r2_capture_decoder * r2_capture_decoder_create( const char * path )
+{
+    struct r2_capture_decoder * self = calloc( 1,
+            sizeof( struct r2_capture_decoder ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_capture_decoder\n" );
+        return NULL;
+    }
+    int ok = NULL != ( self->reader = r2_capture_reader_open( path ) );
+#ifdef R2_WITH_ZLIB
+    ok = ok && Z_OK == inflateInit2( &self->zlib, -15 );
+#endif
+#ifdef R2_WITH_ZSTD
+    ok = ok && NULL != ( self->zstd = ZSTD_createDCtx() );
+#endif
+    if( !ok ) {
+        r2_capture_decoder_destroy( self );
+        return NULL;
+    }
+    return self;
+}
+
+void r2_capture_decoder_destroy( struct r2_capture_decoder * self )
+{
+    if( NULL == self )
+        return;
+#ifdef R2_WITH_ZLIB
+    inflateEnd( &self->zlib );
+#endif
+#ifdef R2_WITH_ZSTD
+    ZSTD_freeDDict( self->ddict );
+    ZSTD_freeDCtx( self->zstd );
+#endif
+    r2_capture_reader_destroy( self->reader );
+    free( self->dict );
+    free( self->out );
+    free( self );
+}
+
+// Keep the dictionary of a dictionary chunk.
+int r2_capture_decoder_load( struct r2_capture_decoder * self,
+        const struct r2_capture_chunk * chunk, const void * data )
+{
+    unsigned char * dict = realloc( self->dict, chunk->length + 1 );
+    if( NULL == dict )
+        return -1;
+    memcpy( dict, data, chunk->length );
+    self->dict = dict;
+    self->dict_size = chunk->length;
+#ifdef R2_WITH_ZSTD
+    ZSTD_freeDDict( self->ddict );
+    self->ddict = ZSTD_createDDict( dict, chunk->length );
+#endif
+    return 0;
+}
+
+// Find the dictionary, from the start of the capture.
+int r2_capture_decoder_find( struct r2_capture_decoder * self )
+{
+    struct r2_capture_reader * reader = self->reader;
+    uint64_t position = reader->position;
+    struct r2_capture_chunk c;
+    const void * data;
+    int found = -1;
+    r2_capture_reader_rewind( reader );
+    while( reader->position < position
+            && r2_capture_reader_next( reader, &c, &data ) )
+        if( c.flags & R2_CAPTURE_DICTIONARY ) {
+            found = r2_capture_decoder_load( self, &c, data );
+            break;
+        }
+    reader->position = position;
+    return found;
+}
+
+// Decompress n bytes to size bytes in self->out; returns 0, or -1.
+int r2_capture_decoder_decode( struct r2_capture_decoder * self,
+        const int flags, const unsigned char * data, const size_t n,
+        const size_t size )
+{
+    const int dict = flags & R2_CAPTURE_WITH_DICTIONARY;
+    // unused with no codec compiled in
+    (void)self; (void)dict; (void)data; (void)n; (void)size;
+    switch( flags & R2_CAPTURE_CODEC ) {
+#ifdef R2_WITH_ZLIB
+    case R2_CAPTURE_ZLIB: {
+        inflateReset( &self->zlib );
+        if( dict )
+            inflateSetDictionary( &self->zlib, self->dict,
+                    (uInt)self->dict_size );
+        self->zlib.next_in = (Bytef *)data;
+        self->zlib.avail_in = (uInt)n;
+        self->zlib.next_out = self->out;
+        self->zlib.avail_out = (uInt)size;
+        int r = inflate( &self->zlib, Z_FINISH );
+        return Z_STREAM_END == r && size == self->zlib.total_out ? 0 : -1;
+    }
+#endif
+#ifdef R2_WITH_ZSTD
+    case R2_CAPTURE_ZSTD: {
+        size_t r = dict
+            ? ZSTD_decompress_usingDDict( self->zstd, self->out, size, data,
+                    n, self->ddict )
+            : ZSTD_decompressDCtx( self->zstd, self->out, size, data, n );
+        return !ZSTD_isError( r ) && size == r ? 0 : -1;
+    }
+#endif
+#ifdef R2_WITH_LZ4
+    case R2_CAPTURE_LZ4: {
+        int r = dict
+            ? LZ4_decompress_safe_usingDict( (const char *)data,
+                    (char *)self->out, (int)n, (int)size,
+                    (const char *)self->dict, (int)self->dict_size )
+            : LZ4_decompress_safe( (const char *)data, (char *)self->out,
+                    (int)n, (int)size );
+        return r >= 0 && size == (size_t)r ? 0 : -1;
+    }
+#endif
+    default:
+        fprintf( stderr, "r2_capture_decoder: codec %d not compiled in\n",
+                flags & R2_CAPTURE_CODEC );
+        return -1;
+    }
+}
+
+int r2_capture_decoder_next( struct r2_capture_decoder * self,
+        struct r2_capture_chunk * chunk, const void ** data )
+{
+    do {
+        if( !r2_capture_reader_next( self->reader, chunk, data ) )
+            return 0;
+        if( ( chunk->flags & R2_CAPTURE_DICTIONARY )
+                && -1 == r2_capture_decoder_load( self, chunk, *data ) )
+            return -1;
+    } while( chunk->flags & R2_CAPTURE_DICTIONARY );
+    if( R2_CAPTURE_NONE == ( chunk->flags & R2_CAPTURE_CODEC ) ) {
+        chunk->flags = 0;
+        chunk->reserved = 0;
+        return 1;
+    }
+    if( ( chunk->flags & R2_CAPTURE_WITH_DICTIONARY ) && 0 == self->dict_size
+            && -1 == r2_capture_decoder_find( self ) ) {
+        fprintf( stderr, "r2_capture_decoder: no dictionary\n" );
+        return -1;
+    }
+    if( chunk->reserved > self->capacity ) {
+        unsigned char * out = realloc( self->out, chunk->reserved );
+        if( NULL == out )
+            return -1;
+        self->out = out;
+        self->capacity = chunk->reserved;
+    }
+    if( -1 == r2_capture_decoder_decode( self, chunk->flags, *data,
+                chunk->length, chunk->reserved ) )
+        return -1;
+    chunk->length = chunk->reserved;
+    chunk->flags = 0;
+    chunk->reserved = 0;
+    *data = self->out;
+    return 1;
+}
+
+#endif // R2_CAPTURE_COMPRESS_I
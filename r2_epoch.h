@@ -5,8 +5,22 @@
 #define R2_EPOCH_H
 
 #include <inttypes.h> // for int64_t, PRId64
+#include <stddef.h> // for size_t
 #include <time.h> // for timespec, clock_gettime
 
+#define R2_EPOCH_NSEC_PER_USEC 1000
+#define R2_EPOCH_NSEC_PER_MSEC 1000000
+#define R2_EPOCH_NSEC_PER_SEC 1000000000
+#define R2_EPOCH_USEC_PER_MSEC 1000
+#define R2_EPOCH_USEC_PER_SEC 1000000
+#define R2_EPOCH_MSEC_PER_SEC 1000
+
+// conversions usable in constant expressions (e.g., static initializers)
+#define R2_EPOCH_SEC_TO_USEC( s ) ( (int64_t)( s ) * R2_EPOCH_USEC_PER_SEC )
+#define R2_EPOCH_MSEC_TO_USEC( ms ) ( (int64_t)( ms ) * R2_EPOCH_USEC_PER_MSEC )
+#define R2_EPOCH_TIMESPEC_TO_USEC( s, ns ) \
+    ( R2_EPOCH_SEC_TO_USEC( s ) + (int64_t)( ns ) / R2_EPOCH_NSEC_PER_USEC )
+
 struct timespec r2_epoch_timespec_now( void );
 int64_t r2_epoch_usec_now( void );
 int64_t r2_epoch_msec_now( void );
@@ -16,12 +30,67 @@ int64_t r2_epoch_sec_now( void );
 int64_t utime( void ) { return r2_epoch_usec_now(); }
 
 
-// TODO: conversion functions to/from timespec
+/*  Conversions from timespec.
+ *
+ *  The timespec is assumed to be normalized (0 <= tv_nsec < 1e9), as
+ *  returned by clock_gettime or r2_epoch_timespec_normalize. Sub-unit
+ *  remainders are truncated toward negative infinity.
+ */
+int64_t r2_epoch_timespec_to_nsec( const struct timespec t );
+int64_t r2_epoch_timespec_to_usec( const struct timespec t );
+int64_t r2_epoch_timespec_to_msec( const struct timespec t );
+double r2_epoch_timespec_to_fsec( const struct timespec t );
+
+/*  Conversions to timespec.
+ *
+ *  The result is always normalized, so negative inputs give a negative
+ *  tv_sec and a positive tv_nsec.
+ */
+struct timespec r2_epoch_nsec_to_timespec( const int64_t nsec );
+struct timespec r2_epoch_usec_to_timespec( const int64_t usec );
+struct timespec r2_epoch_msec_to_timespec( const int64_t msec );
+struct timespec r2_epoch_fsec_to_timespec( const double fsec );
+
+/*  Bring tv_nsec into [0, 1e9), carrying whole seconds into tv_sec.
+ */
+struct timespec r2_epoch_timespec_normalize( struct timespec t );
+
+struct timespec r2_epoch_timespec_add( const struct timespec a,
+        const struct timespec b );
+
+struct timespec r2_epoch_timespec_sub( const struct timespec a,
+        const struct timespec b );
+
+/*  Compare two normalized timespecs.
+ *
+ *  Returns -1, 0 or 1 as a is before, equal to or after b.
+ */
+int r2_epoch_timespec_cmp( const struct timespec a, const struct timespec b );
+
+/*  Batch conversions for post-processing arrays of timestamps.
+ *
+ *  The loops are branch-free so the compiler can vectorize them.
+ */
+void r2_epoch_timespec_to_usec_n( const struct timespec * t, int64_t * usec,
+        size_t n );
+void r2_epoch_usec_to_timespec_n( const int64_t * usec, struct timespec * t,
+        size_t n );
+void r2_epoch_usec_to_fsec_n( const int64_t * usec, double * fsec, size_t n );
 
 #endif // R2_EPOCH_H
 
 #ifndef R2_EPOCH_I
 #define R2_EPOCH_I
+
+// tv_nsec is in [0, 1e9) and fits in 32 bits, so division by the constant
+// can be done as a 32x32->64 multiply by the reciprocal and a shift; both
+// are exact over the whole range. (64-bit divisions by constants below are
+// strength-reduced in the same way by the compiler.)
+#define R2_EPOCH_NSEC_TO_USEC_32( ns ) \
+    ( (int64_t)( ( (uint64_t)(uint32_t)( ns ) * 274877907u ) >> 38 ) )
+#define R2_EPOCH_NSEC_TO_MSEC_32( ns ) \
+    ( (int64_t)( ( (uint64_t)(uint32_t)( ns ) * 1125899907u ) >> 50 ) )
+
 struct timespec r2_epoch_timespec_now( void ){
     struct timespec t;
     clock_gettime( CLOCK_REALTIME, &t );
@@ -30,14 +99,12 @@ struct timespec r2_epoch_timespec_now( void ){
 
 int64_t r2_epoch_usec_now( void )
 {
-    struct timespec t = r2_epoch_timespec_now();
-    return (int64_t)( t.tv_sec ) * 1000000 + (int64_t)( t.tv_nsec / 1000 );
+    return r2_epoch_timespec_to_usec( r2_epoch_timespec_now() );
 }
 
 int64_t r2_epoch_msec_now( void )
 {
-    struct timespec t = r2_epoch_timespec_now();
-    return (int64_t)( t.tv_sec ) * 1000 + (int64_t)( t.tv_nsec / 1000000 );
+    return r2_epoch_timespec_to_msec( r2_epoch_timespec_now() );
 }
 
 int64_t r2_epoch_sec_now( void )
@@ -46,4 +113,135 @@ int64_t r2_epoch_sec_now( void )
     return (int64_t)( t.tv_sec );
 }
 
+int64_t r2_epoch_timespec_to_nsec( const struct timespec t )
+{
+    return (int64_t)( t.tv_sec ) * R2_EPOCH_NSEC_PER_SEC
+        + (int64_t)( t.tv_nsec );
+}
+
+int64_t r2_epoch_timespec_to_usec( const struct timespec t )
+{
+    return (int64_t)( t.tv_sec ) * R2_EPOCH_USEC_PER_SEC
+        + R2_EPOCH_NSEC_TO_USEC_32( t.tv_nsec );
+}
+
+int64_t r2_epoch_timespec_to_msec( const struct timespec t )
+{
+    return (int64_t)( t.tv_sec ) * R2_EPOCH_MSEC_PER_SEC
+        + R2_EPOCH_NSEC_TO_MSEC_32( t.tv_nsec );
+}
+
+double r2_epoch_timespec_to_fsec( const struct timespec t )
+{
+    return (double)( t.tv_sec ) + (double)( t.tv_nsec ) * 1e-9;
+}
+
+// floor division and matching non-negative remainder, without a branch
+#define R2_EPOCH_FLOOR_DIV( x, d ) ( ( x ) / ( d ) - ( ( x ) % ( d ) < 0 ) )
+#define R2_EPOCH_FLOOR_MOD( x, d ) \
+    ( ( x ) % ( d ) + ( d ) * ( ( x ) % ( d ) < 0 ) )
+
+struct timespec r2_epoch_nsec_to_timespec( const int64_t nsec )
+{
+    struct timespec t;
+    t.tv_sec = (time_t)R2_EPOCH_FLOOR_DIV( nsec, R2_EPOCH_NSEC_PER_SEC );
+    t.tv_nsec = (long)R2_EPOCH_FLOOR_MOD( nsec, R2_EPOCH_NSEC_PER_SEC );
+    return t;
+}
+
+struct timespec r2_epoch_usec_to_timespec( const int64_t usec )
+{
+    struct timespec t;
+    t.tv_sec = (time_t)R2_EPOCH_FLOOR_DIV( usec, R2_EPOCH_USEC_PER_SEC );
+    t.tv_nsec = (long)R2_EPOCH_FLOOR_MOD( usec, R2_EPOCH_USEC_PER_SEC )
+        * R2_EPOCH_NSEC_PER_USEC;
+    return t;
+}
+
+struct timespec r2_epoch_msec_to_timespec( const int64_t msec )
+{
+    struct timespec t;
+    t.tv_sec = (time_t)R2_EPOCH_FLOOR_DIV( msec, R2_EPOCH_MSEC_PER_SEC );
+    t.tv_nsec = (long)R2_EPOCH_FLOOR_MOD( msec, R2_EPOCH_MSEC_PER_SEC )
+        * R2_EPOCH_NSEC_PER_MSEC;
+    return t;
+}
+
+struct timespec r2_epoch_fsec_to_timespec( const double fsec )
+{
+    // round to the nearest nanosecond, then split exactly in integers
+    double ns = fsec * 1e9;
+    return r2_epoch_nsec_to_timespec(
+            (int64_t)( ns + ( ns < 0 ? -0.5 : 0.5 ) ) );
+}
+
+struct timespec r2_epoch_timespec_normalize( struct timespec t )
+{
+    int64_t carry = R2_EPOCH_FLOOR_DIV( (int64_t)t.tv_nsec,
+            R2_EPOCH_NSEC_PER_SEC );
+    t.tv_sec += (time_t)carry;
+    t.tv_nsec -= (long)( carry * R2_EPOCH_NSEC_PER_SEC );
+    return t;
+}
+
+struct timespec r2_epoch_timespec_add( const struct timespec a,
+        const struct timespec b )
+{
+    struct timespec t;
+    t.tv_sec = a.tv_sec + b.tv_sec;
+    t.tv_nsec = a.tv_nsec + b.tv_nsec;
+    // for normalized inputs there is at most one second to carry
+    int carry = t.tv_nsec >= R2_EPOCH_NSEC_PER_SEC;
+    t.tv_sec += carry;
+    t.tv_nsec -= carry * R2_EPOCH_NSEC_PER_SEC;
+    return t;
+}
+
+struct timespec r2_epoch_timespec_sub( const struct timespec a,
+        const struct timespec b )
+{
+    struct timespec t;
+    t.tv_sec = a.tv_sec - b.tv_sec;
+    t.tv_nsec = a.tv_nsec - b.tv_nsec;
+    int borrow = t.tv_nsec < 0;
+    t.tv_sec -= borrow;
+    t.tv_nsec += borrow * R2_EPOCH_NSEC_PER_SEC;
+    return t;
+}
+
+int r2_epoch_timespec_cmp( const struct timespec a, const struct timespec b )
+{
+    int s = ( a.tv_sec > b.tv_sec ) - ( a.tv_sec < b.tv_sec );
+    int ns = ( a.tv_nsec > b.tv_nsec ) - ( a.tv_nsec < b.tv_nsec );
+    return s ? s : ns;
+}
+
+void r2_epoch_timespec_to_usec_n( const struct timespec * t, int64_t * usec,
+        size_t n )
+{
+    size_t i;
+    for( i = 0; i < n; i++ )
+        usec[i] = (int64_t)( t[i].tv_sec ) * R2_EPOCH_USEC_PER_SEC
+            + R2_EPOCH_NSEC_TO_USEC_32( t[i].tv_nsec );
+}
+
+void r2_epoch_usec_to_timespec_n( const int64_t * usec, struct timespec * t,
+        size_t n )
+{
+    size_t i;
+    for( i = 0; i < n; i++ ) {
+        t[i].tv_sec = (time_t)R2_EPOCH_FLOOR_DIV( usec[i],
+                R2_EPOCH_USEC_PER_SEC );
+        t[i].tv_nsec = (long)R2_EPOCH_FLOOR_MOD( usec[i],
+                R2_EPOCH_USEC_PER_SEC ) * R2_EPOCH_NSEC_PER_USEC;
+    }
+}
+
+void r2_epoch_usec_to_fsec_n( const int64_t * usec, double * fsec, size_t n )
+{
+    size_t i;
+    for( i = 0; i < n; i++ )
+        fsec[i] = (double)usec[i] * 1e-6;
+}
+
 #endif // R2_EPOCH_I
@@ -0,0 +1,195 @@
+// r2_epoch_format.h
+// Fast, fixed-width UTC timestamp formatting for Unix epoch microseconds
+
+#ifndef R2_EPOCH_FORMAT_H
+#define R2_EPOCH_FORMAT_H
+
+#include <inttypes.h> // for int64_t
+#include <string.h> // for memcpy
+
+#include "r2_buffer.h"
+#include "r2_epoch.h"
+
+// "YYYY-MM-DDTHH:MM:SS.ffffffZ"
+#define R2_EPOCH_ISO8601_LENGTH 27
+// "YYYYMMDDTHHMMSS.ffffffZ" (ISO-8601 basic format)
+#define R2_EPOCH_COMPACT_LENGTH 23
+
+/*  Formatter state.
+ *
+ *  Caches the rendered date and time of the most recently formatted second,
+ *  so consecutive log lines only have to render the sub-second digits.
+ *  Use one formatter per thread.
+ */
+struct r2_epoch_formatter {
+    int64_t sec;
+    char iso8601[20]; // "YYYY-MM-DDTHH:MM:SS"
+    char compact[16]; // "YYYYMMDDTHHMMSS"
+};
+
+void r2_epoch_formatter_init( struct r2_epoch_formatter * self );
+
+/*  Write usec as an extended ISO-8601 UTC timestamp.
+ *
+ *  Writes exactly R2_EPOCH_ISO8601_LENGTH characters to out, without a
+ *  terminating null, and returns the number of characters written. Years
+ *  outside 0000-9999 are not representable: nothing is written and 0 is
+ *  returned.
+ */
+size_t r2_epoch_format_iso8601( struct r2_epoch_formatter * self,
+        const int64_t usec, char * out );
+
+/*  Write usec as a basic (compact) ISO-8601 UTC timestamp.
+ *
+ *  Writes exactly R2_EPOCH_COMPACT_LENGTH characters to out, without a
+ *  terminating null, or nothing (returning 0) for years outside 0000-9999.
+ */
+size_t r2_epoch_format_compact( struct r2_epoch_formatter * self,
+        const int64_t usec, char * out );
+
+/*  Append a timestamp to the data in an r2_buffer.
+ *
+ *  Returns the number of bytes appended, or 0 if the buffer does not have
+ *  enough space left or the year is outside 0000-9999.
+ */
+size_t r2_epoch_format_iso8601_to_buffer( struct r2_epoch_formatter * self,
+        const int64_t usec, struct r2_buffer * buffer );
+
+size_t r2_epoch_format_compact_to_buffer( struct r2_epoch_formatter * self,
+        const int64_t usec, struct r2_buffer * buffer );
+
+#endif // R2_EPOCH_FORMAT_H
+
+#ifndef R2_EPOCH_FORMAT_I
+#define R2_EPOCH_FORMAT_I
+
+const char R2_EPOCH_DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+#define R2_EPOCH_PUT_PAIR( p, v ) \
+    memcpy( ( p ), R2_EPOCH_DIGIT_PAIRS + 2 * ( v ), 2 )
+
+void r2_epoch_formatter_init( struct r2_epoch_formatter * self )
+{
+    memset( self, 0, sizeof( struct r2_epoch_formatter ) );
+    self->sec = INT64_MIN;
+}
+
+// Render the date and time of day for sec into the cache, converting days
+// since the epoch to a proleptic Gregorian date without calling gmtime.
+// (Howard Hinnant's civil_from_days algorithm.) Returns 0, or -1 for a
+// year outside 0000-9999, leaving the cache as it was.
+int r2_epoch_formatter_update( struct r2_epoch_formatter * self,
+        const int64_t sec )
+{
+    int64_t days = R2_EPOCH_FLOOR_DIV( sec, (int64_t)86400 );
+    int64_t sod = sec - days * 86400;
+
+    int64_t z = days + 719468;
+    int64_t era = ( z >= 0 ? z : z - 146096 ) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+    int64_t doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+    int64_t mp = ( 5 * doy + 2 ) / 153;
+    int d = (int)( doy - ( 153 * mp + 2 ) / 5 + 1 );
+    int m = (int)( mp < 10 ? mp + 3 : mp - 9 );
+    int64_t year = yoe + era * 400 + ( m <= 2 );
+    if( year < 0 || year > 9999 )
+        return -1;
+    int y = (int)year;
+
+    int hh = (int)( sod / 3600 );
+    int mm = (int)( sod / 60 % 60 );
+    int ss = (int)( sod % 60 );
+
+    char * p = self->iso8601;
+    R2_EPOCH_PUT_PAIR( p, y / 100 % 100 );
+    R2_EPOCH_PUT_PAIR( p + 2, y % 100 );
+    p[4] = '-';
+    R2_EPOCH_PUT_PAIR( p + 5, m );
+    p[7] = '-';
+    R2_EPOCH_PUT_PAIR( p + 8, d );
+    p[10] = 'T';
+    R2_EPOCH_PUT_PAIR( p + 11, hh );
+    p[13] = ':';
+    R2_EPOCH_PUT_PAIR( p + 14, mm );
+    p[16] = ':';
+    R2_EPOCH_PUT_PAIR( p + 17, ss );
+
+    p = self->compact;
+    memcpy( p, self->iso8601, 4 );
+    memcpy( p + 4, self->iso8601 + 5, 2 );
+    memcpy( p + 6, self->iso8601 + 8, 3 ); // "DDT"
+    memcpy( p + 9, self->iso8601 + 11, 2 );
+    memcpy( p + 11, self->iso8601 + 14, 2 );
+    memcpy( p + 13, self->iso8601 + 17, 2 );
+
+    self->sec = sec;
+    return 0;
+}
+
+// Write ".ffffffZ" for the microseconds within the second.
+void r2_epoch_format_fraction( const int64_t usec, char * out )
+{
+    int f = (int)R2_EPOCH_FLOOR_MOD( usec, (int64_t)R2_EPOCH_USEC_PER_SEC );
+    out[0] = '.';
+    R2_EPOCH_PUT_PAIR( out + 1, f / 10000 );
+    R2_EPOCH_PUT_PAIR( out + 3, f / 100 % 100 );
+    R2_EPOCH_PUT_PAIR( out + 5, f % 100 );
+    out[7] = 'Z';
+}
+
+size_t r2_epoch_format_iso8601( struct r2_epoch_formatter * self,
+        const int64_t usec, char * out )
+{
+    int64_t sec = R2_EPOCH_FLOOR_DIV( usec, (int64_t)R2_EPOCH_USEC_PER_SEC );
+    if( sec != self->sec && r2_epoch_formatter_update( self, sec ) )
+        return 0;
+    memcpy( out, self->iso8601, 19 );
+    r2_epoch_format_fraction( usec, out + 19 );
+    return R2_EPOCH_ISO8601_LENGTH;
+}
+
+size_t r2_epoch_format_compact( struct r2_epoch_formatter * self,
+        const int64_t usec, char * out )
+{
+    int64_t sec = R2_EPOCH_FLOOR_DIV( usec, (int64_t)R2_EPOCH_USEC_PER_SEC );
+    if( sec != self->sec && r2_epoch_formatter_update( self, sec ) )
+        return 0;
+    memcpy( out, self->compact, 15 );
+    r2_epoch_format_fraction( usec, out + 15 );
+    return R2_EPOCH_COMPACT_LENGTH;
+}
+
+size_t r2_epoch_format_iso8601_to_buffer( struct r2_epoch_formatter * self,
+        const int64_t usec, struct r2_buffer * buffer )
+{
+    if( r2_buffer_available_space( buffer ) < R2_EPOCH_ISO8601_LENGTH )
+        return 0;
+    size_t n = r2_epoch_format_iso8601( self, usec,
+            buffer->data + buffer->position );
+    buffer->position += n;
+    return n;
+}
+
+size_t r2_epoch_format_compact_to_buffer( struct r2_epoch_formatter * self,
+        const int64_t usec, struct r2_buffer * buffer )
+{
+    if( r2_buffer_available_space( buffer ) < R2_EPOCH_COMPACT_LENGTH )
+        return 0;
+    size_t n = r2_epoch_format_compact( self, usec,
+            buffer->data + buffer->position );
+    buffer->position += n;
+    return n;
+}
+
+#endif // R2_EPOCH_FORMAT_I
@@ -0,0 +1,220 @@
+// r2_epoch_sync.h
+// Online estimate of the offset and drift between an instrument clock and
+// host epoch time, from (instrument time, host arrival time) pairs.
+//
+// Every sample arrives at the host some unknown, positive latency after it
+// was stamped by the instrument, so the lower envelope of host - instrument
+// tracks the true clock offset. The instrument timeline is split into
+// fixed-length blocks, the minimum delay within each block is kept in a
+// window of the most recent blocks, and a line is fit through those minima
+// to get offset and drift.
+
+#ifndef R2_EPOCH_SYNC_H
+#define R2_EPOCH_SYNC_H
+
+#include <inttypes.h> // for int64_t
+#include <math.h> // for llround
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+
+#include "r2_epoch.h"
+
+struct r2_epoch_sync_point {
+    int64_t instrument;
+    int64_t delay; // host - instrument
+};
+
+struct r2_epoch_sync {
+    int64_t block_usec;
+    size_t nblocks;
+    struct r2_epoch_sync_point * blocks; // ring of block minima
+    size_t head; // next slot to write in blocks
+    size_t count; // number of closed blocks in the ring
+    int64_t block_start; // instrument time the current block started
+    struct r2_epoch_sync_point current; // minimum of the current block
+    size_t samples; // samples in the current block
+    // fit: host = instrument + y0 + dy + drift * (instrument - x0)
+    int64_t x0;
+    int64_t y0;
+    double dy;
+    double drift;
+};
+
+/*  Create a clock synchronizer.
+ *
+ *  block_usec is the length of each minimum-filter block in instrument time;
+ *  it should span several samples so that at least one of them arrives with
+ *  near-minimal latency. nblocks is the number of blocks in the fitting
+ *  window; at least two closed blocks are needed before drift is estimated.
+ *
+ *  Returns NULL if block_usec is not positive or nblocks is 0.
+ */
+struct r2_epoch_sync * r2_epoch_sync_create( const int64_t block_usec,
+        const size_t nblocks );
+
+void r2_epoch_sync_destroy( struct r2_epoch_sync * self );
+
+void r2_epoch_sync_reset( struct r2_epoch_sync * self );
+
+/*  Add a sample.
+ *
+ *  Constant time per sample; refits the line over the window (linear in
+ *  nblocks) only when a block closes. If instrument time steps backwards
+ *  by more than one block, the instrument clock is assumed to have been
+ *  reset and the estimate starts over.
+ *
+ *  Returns 1 if the estimate was updated, otherwise 0.
+ */
+int r2_epoch_sync_update( struct r2_epoch_sync * self,
+        const int64_t instrument_usec, const int64_t host_usec );
+
+/*  Convert an instrument timestamp to host epoch microseconds.
+ *
+ *  Before the first block closes, uses the minimum delay seen so far.
+ */
+int64_t r2_epoch_sync_to_host( const struct r2_epoch_sync * self,
+        const int64_t instrument_usec );
+
+/*  Host time elapsed per unit instrument time, minus one
+ *  (e.g. 1e-6 when the instrument clock runs 1 ppm slow).
+ */
+double r2_epoch_sync_drift( const struct r2_epoch_sync * self );
+
+#endif // R2_EPOCH_SYNC_H
+
+#ifndef R2_EPOCH_SYNC_I
+#define R2_EPOCH_SYNC_I
+
+struct r2_epoch_sync * r2_epoch_sync_create( const int64_t block_usec,
+        const size_t nblocks )
+{
+    if( block_usec <= 0 || 0 == nblocks ) {
+        fprintf( stderr, "r2_epoch_sync needs a positive block length and"
+                " at least one block\n" );
+        return NULL;
+    }
+    struct r2_epoch_sync * self = calloc( 1, sizeof( struct r2_epoch_sync ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_epoch_sync\n" );
+        return NULL;
+    }
+    self->blocks = calloc( nblocks, sizeof( struct r2_epoch_sync_point ) );
+    if( NULL == self->blocks ) {
+        fprintf( stderr, "could not allocate %zu sync blocks\n", nblocks );
+        free( self );
+        return NULL;
+    }
+    self->block_usec = block_usec;
+    self->nblocks = nblocks;
+    r2_epoch_sync_reset( self );
+    return self;
+}
+
+void r2_epoch_sync_destroy( struct r2_epoch_sync * self )
+{
+    if( self ) {
+        free( self->blocks );
+        free( self );
+    }
+}
+
+void r2_epoch_sync_reset( struct r2_epoch_sync * self )
+{
+    self->head = 0;
+    self->count = 0;
+    self->samples = 0;
+    self->x0 = 0;
+    self->y0 = 0;
+    self->dy = 0;
+    self->drift = 0;
+}
+
+// Least-squares line through the block minima in the window, centered on
+// the first block so the sums stay well-conditioned.
+void r2_epoch_sync_fit( struct r2_epoch_sync * self )
+{
+    size_t i;
+    size_t first = ( self->head + self->nblocks - self->count )
+        % self->nblocks;
+    const struct r2_epoch_sync_point * p0 = &self->blocks[first];
+    double n = (double)self->count;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for( i = 0; i < self->count; i++ ) {
+        const struct r2_epoch_sync_point * p =
+            &self->blocks[( first + i ) % self->nblocks];
+        double x = (double)( p->instrument - p0->instrument );
+        double y = (double)( p->delay - p0->delay );
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double d = n * sxx - sx * sx;
+    self->x0 = p0->instrument;
+    self->y0 = p0->delay;
+    self->drift = ( d > 0 ) ? ( n * sxy - sx * sy ) / d : 0;
+    self->dy = ( sy - self->drift * sx ) / n;
+}
+
+int r2_epoch_sync_update( struct r2_epoch_sync * self,
+        const int64_t instrument_usec, const int64_t host_usec )
+{
+    struct r2_epoch_sync_point p = { instrument_usec,
+        host_usec - instrument_usec };
+
+    if( self->samples
+            && ( instrument_usec < self->block_start - self->block_usec ) ) {
+        r2_epoch_sync_reset( self );
+    }
+
+    if( 0 == self->samples ) {
+        self->block_start = instrument_usec;
+        self->current = p;
+        self->samples = 1;
+        if( 0 == self->count ) {
+            self->x0 = p.instrument;
+            self->y0 = p.delay;
+            return 1;
+        }
+        return 0;
+    }
+
+    if( instrument_usec - self->block_start < self->block_usec ) {
+        self->samples++;
+        if( p.delay < self->current.delay ) {
+            self->current = p;
+            if( 0 == self->count ) { // no fit yet; track the running minimum
+                self->x0 = p.instrument;
+                self->y0 = p.delay;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // close the current block and start a new one with this sample
+    self->blocks[self->head] = self->current;
+    self->head = ( self->head + 1 ) % self->nblocks;
+    if( self->count < self->nblocks )
+        self->count++;
+    r2_epoch_sync_fit( self );
+
+    self->block_start = instrument_usec;
+    self->current = p;
+    self->samples = 1;
+    return 1;
+}
+
+int64_t r2_epoch_sync_to_host( const struct r2_epoch_sync * self,
+        const int64_t instrument_usec )
+{
+    return instrument_usec + self->y0 + llround( self->dy
+            + self->drift * (double)( instrument_usec - self->x0 ) );
+}
+
+double r2_epoch_sync_drift( const struct r2_epoch_sync * self )
+{
+    return self->drift;
+}
+
+#endif // R2_EPOCH_SYNC_I
@@ -0,0 +1,168 @@
+// r2_fastmath.h
+// Branch-free single-precision approximations of the trigonometric
+// functions used for rotations, written so that loops calling them can be
+// vectorized by the compiler.
+//
+// Maximum absolute errors, measured against double-precision libm:
+//  r2_fastmath_sincosf    < 1.0e-7 for |x| <= 8 pi (about 1 ulp near 1)
+//  r2_fastmath_atan2f     < 3.6e-7 rad (about 1.5 ulp near pi)
+//  r2_fastmath_asinf      < 2.6e-7 rad
+// Accuracy of sin/cos degrades slowly with |x| because of the three-part
+// reduction by pi/2; the results are meaningless for |x| > 2^23.
+//
+// These are static and always inlined, unlike most of r2, so that they
+// inline into vectorized loops (including runtime-dispatched clones) in
+// other headers.
+
+#ifndef R2_FASTMATH_H
+#define R2_FASTMATH_H
+
+#include <stdint.h> // for int32_t
+#include <math.h> // for sqrtf, fabsf
+
+#define R2_FASTMATH_PI_F 3.14159265358979323846f
+#define R2_FASTMATH_PI_2_F 1.57079632679489661923f
+#define R2_FASTMATH_PI_4_F 0.78539816339744830962f
+
+// Batch kernels in r2 process arrays in blocks of this many elements, so
+// the inner loops have a constant trip count and vectorize even under the
+// cheap cost model of -O2.
+#ifndef R2_FASTMATH_BLOCK
+#define R2_FASTMATH_BLOCK 16
+#endif
+
+// Runtime dispatch: compile batch kernels once per instruction set and
+// let the loader pick the best one for the CPU (GNU ifunc). On other
+// targets (e.g. AArch64, where NEON is baseline) the kernels are simply
+// compiled for the target.
+#if defined( __GNUC__ ) && !defined( __clang__ ) && defined( __x86_64__ ) \
+    && defined( __linux__ ) && !defined( R2_NO_TARGET_CLONES )
+#define R2_TARGET_CLONES __attribute__(( target_clones( \
+        "arch=skylake-avx512", "arch=haswell", "default" ) ))
+#else
+#define R2_TARGET_CLONES
+#endif
+
+#if defined( __GNUC__ )
+#define R2_ALWAYS_INLINE inline __attribute__(( always_inline ))
+#else
+#define R2_ALWAYS_INLINE inline
+#endif
+
+#endif // R2_FASTMATH_H
+
+#ifndef R2_FASTMATH_I
+#define R2_FASTMATH_I
+
+/*  Sine and cosine of x together.
+ */
+static R2_ALWAYS_INLINE void r2_fastmath_sincosf( const float x, float * s,
+        float * c )
+{
+    // quadrant, and reduce to [-pi/4, pi/4] with pi/2 split in three parts
+    int32_t q = (int32_t)( x * 0.63661977236758134f
+            + ( x < 0 ? -0.5f : 0.5f ) );
+    float fq = (float)q;
+    float r = x - fq * 1.5703125f;
+    r = r - fq * 4.837512969970703125e-4f;
+    r = r - fq * 7.54978995489188216e-8f;
+
+    float z = r * r;
+    // Cephes sinf/cosf minimax polynomials on [-pi/4, pi/4]
+    float sr = ( ( -1.9515295891e-4f * z + 8.3321608736e-3f ) * z
+            - 1.6666654611e-1f ) * z * r + r;
+    float cr = ( ( 2.443315711809948e-5f * z - 1.388731625493765e-3f ) * z
+            + 4.166664568298827e-2f ) * z * z - 0.5f * z + 1.0f;
+
+    // swap and negate by quadrant with bit operations rather than selects:
+    // when only one of the results is used, GCC would otherwise move the
+    // other polynomial under a condition and the loop would not vectorize
+    union { float f; int32_t i; } us = { sr }, uc = { cr };
+    int32_t swap = -( q & 1 ) & ( us.i ^ uc.i );
+    us.i ^= swap;
+    uc.i ^= swap;
+    us.i ^= (int32_t)( (uint32_t)( q & 2 ) << 30 );
+    uc.i ^= (int32_t)( (uint32_t)( ( q + 1 ) & 2 ) << 30 );
+    *s = us.f;
+    *c = uc.f;
+}
+
+/*  Arctangent of a in [0, 1].
+ */
+static R2_ALWAYS_INLINE float r2_fastmath_atanf_unit( const float a )
+{
+    // atan(a) / a as a degree 7 polynomial in a^2, from Chebyshev
+    // interpolation on [0, 1] (|error| < 6.4e-8 before rounding). A single
+    // polynomial over the whole interval, rather than a reduction to
+    // [0, tan(pi/8)], keeps this free of conditionals.
+    float z = a * a;
+    float p = -4.559791987e-3f;
+    p = p * z + 2.378051860e-2f;
+    p = p * z - 5.882975315e-2f;
+    p = p * z + 9.868865458e-2f;
+    p = p * z - 1.400329018e-1f;
+    p = p * z + 1.996696183e-1f;
+    p = p * z - 3.333181266e-1f;
+    p = p * z + 9.999998820e-1f;
+    return p * a;
+}
+
+/*  Four-quadrant arctangent of y / x, in [-pi, pi].
+ */
+static R2_ALWAYS_INLINE float r2_fastmath_atan2f( const float y, const float x )
+{
+    float ax = fabsf( x );
+    float ay = fabsf( y );
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    float a = mn / ( mx > 1e-30f ? mx : 1e-30f );
+    float r = r2_fastmath_atanf_unit( a );
+    r = ( ay > ax ? -r : r ) + ( ay > ax ? R2_FASTMATH_PI_2_F : 0.0f );
+    r = ( x < 0 ? -r : r ) + ( x < 0 ? R2_FASTMATH_PI_F : 0.0f );
+    return y < 0 ? -r : r;
+}
+
+/*  Reciprocal square root of x > 0: the classic bit-level estimate refined
+ *  with three Newton-Raphson steps (relative error < 2e-7).
+ */
+static R2_ALWAYS_INLINE float r2_fastmath_rsqrtf( const float x )
+{
+    union { float f; int32_t i; } u = { x };
+    u.i = 0x5f375a86 - ( u.i >> 1 );
+    float r = u.f;
+    float hx = 0.5f * x;
+    r = r * ( 1.5f - hx * r * r );
+    r = r * ( 1.5f - hx * r * r );
+    r = r * ( 1.5f - hx * r * r );
+    return r;
+}
+
+/*  Square root of x >= 0 (0 gives 0).
+ *
+ *  With errno-setting math (the default), calls to sqrtf keep loops from
+ *  vectorizing, so unless built with -fno-math-errno this goes through
+ *  r2_fastmath_rsqrtf instead.
+ */
+static R2_ALWAYS_INLINE float r2_fastmath_sqrtf( const float x )
+{
+#if defined( __NO_MATH_ERRNO__ )
+    return sqrtf( x );
+#else
+    return x * r2_fastmath_rsqrtf( x );
+#endif
+}
+
+/*  Arcsine of x; x is clamped to [-1, 1] first, so rounding errors just
+ *  outside the domain give +/-pi/2 rather than NaN.
+ *
+ *  GCC does not if-convert the clamp at -O2, so loops calling this do not
+ *  vectorize; where cos(asin(x)) is known by other means, use atan2.
+ */
+static R2_ALWAYS_INLINE float r2_fastmath_asinf( float x )
+{
+    x = x > 1.0f ? 1.0f : ( x < -1.0f ? -1.0f : x );
+    return r2_fastmath_atan2f( x,
+            r2_fastmath_sqrtf( ( 1.0f - x ) * ( 1.0f + x ) ) );
+}
+
+#endif // R2_FASTMATH_I
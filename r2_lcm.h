@@ -0,0 +1,164 @@
+// r2_lcm.h
+// Encode LCM messages without LCM
+//
+// The bridges encode their messages straight into preallocated buffers, so
+// they need the LCM wire format but not the generated code: a message is
+// the 8-byte fingerprint of its type followed by its fields, big-endian,
+// with variable-length arrays as their elements back to back.
+//
+// The fingerprint is computed from a description of the type's members
+// with the same hash as lcm-gen, so it matches the generated code for the
+// same .lcm definition (for types of primitive members only).
+
+#ifndef R2_LCM_H
+#define R2_LCM_H
+
+#include <inttypes.h> // for int64_t, uint64_t
+#include <stddef.h> // for size_t
+#include <string.h> // for memcpy, strlen
+
+// Dimensions of an array member, as in the .lcm file: a number for a
+// fixed size, or the name of the member that holds the size.
+#define R2_LCM_MAX_DIMENSIONS 4
+
+struct r2_lcm_member {
+    const char * type; // primitive type, e.g. int64_t
+    const char * name;
+    const char * dimensions[R2_LCM_MAX_DIMENSIONS]; // NULL-terminated
+};
+
+/*  Fingerprint of a type with the given members, as lcm-gen computes it.
+ */
+uint64_t r2_lcm_fingerprint( const struct r2_lcm_member * members,
+        const size_t n );
+
+/*  Big-endian stores; return p past the value.
+ */
+unsigned char * r2_lcm_put_int64( unsigned char * p, const int64_t x );
+unsigned char * r2_lcm_put_int32( unsigned char * p, const int32_t x );
+unsigned char * r2_lcm_put_float( unsigned char * p, const float x );
+unsigned char * r2_lcm_put_double( unsigned char * p, const double x );
+
+/*  Big-endian loads.
+ */
+int64_t r2_lcm_get_int64( const unsigned char * p );
+int32_t r2_lcm_get_int32( const unsigned char * p );
+float r2_lcm_get_float( const unsigned char * p );
+double r2_lcm_get_double( const unsigned char * p );
+
+#endif // R2_LCM_H
+
+#ifndef R2_LCM_I
+#define R2_LCM_I
+
+// v = ((v << 8) ^ (v >> 55)) + c, on a signed 64-bit v whose right shift
+// is arithmetic, as in lcm-gen.
+uint64_t r2_lcm_hash_update( uint64_t v, const char c )
+{
+    uint64_t s = v >> 55;
+    if( v >> 63 )
+        s |= ~0ULL << 9;
+    return ( ( v << 8 ) ^ s ) + (uint64_t)(int64_t)c;
+}
+
+uint64_t r2_lcm_hash_string( uint64_t v, const char * s )
+{
+    v = r2_lcm_hash_update( v, (char)strlen( s ) );
+    for( ; *s; s++ )
+        v = r2_lcm_hash_update( v, *s );
+    return v;
+}
+
+uint64_t r2_lcm_fingerprint( const struct r2_lcm_member * members,
+        const size_t n )
+{
+    uint64_t v = 0x12345678;
+    size_t m;
+    int d, count;
+    for( m = 0; m < n; m++ ) {
+        v = r2_lcm_hash_string( v, members[m].name );
+        v = r2_lcm_hash_string( v, members[m].type );
+        for( count = 0; count < R2_LCM_MAX_DIMENSIONS
+                && members[m].dimensions[count]; count++ )
+            ;
+        v = r2_lcm_hash_update( v, (char)count );
+        for( d = 0; d < count; d++ ) {
+            const char * size = members[m].dimensions[d];
+            int variable = size[0] < '0' || size[0] > '9';
+            v = r2_lcm_hash_update( v, (char)variable );
+            v = r2_lcm_hash_string( v, size );
+        }
+    }
+    // the generated code rotates the hash left by one
+    return ( v << 1 ) + ( ( v >> 63 ) & 1 );
+}
+
+unsigned char * r2_lcm_put_int64( unsigned char * p, const int64_t x )
+{
+    uint64_t u = (uint64_t)x;
+    int b;
+    for( b = 0; b < 8; b++ )
+        p[b] = (unsigned char)( u >> ( 56 - 8 * b ) );
+    return p + 8;
+}
+
+unsigned char * r2_lcm_put_int32( unsigned char * p, const int32_t x )
+{
+    uint32_t u = (uint32_t)x;
+    int b;
+    for( b = 0; b < 4; b++ )
+        p[b] = (unsigned char)( u >> ( 24 - 8 * b ) );
+    return p + 4;
+}
+
+unsigned char * r2_lcm_put_float( unsigned char * p, const float x )
+{
+    int32_t i;
+    memcpy( &i, &x, 4 );
+    return r2_lcm_put_int32( p, i );
+}
+
+unsigned char * r2_lcm_put_double( unsigned char * p, const double x )
+{
+    int64_t i;
+    memcpy( &i, &x, 8 );
+    return r2_lcm_put_int64( p, i );
+}
+
+int64_t r2_lcm_get_int64( const unsigned char * p )
+{
+    uint64_t u = 0;
+    int b;
+    for( b = 0; b < 8; b++ )
+        u = u << 8 | p[b];
+    int64_t x;
+    memcpy( &x, &u, 8 );
+    return x;
+}
+
+int32_t r2_lcm_get_int32( const unsigned char * p )
+{
+    uint32_t u = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+        | (uint32_t)p[2] << 8 | p[3];
+    int32_t x;
+    memcpy( &x, &u, 4 );
+    return x;
+}
+
+float r2_lcm_get_float( const unsigned char * p )
+{
+    int32_t i = r2_lcm_get_int32( p );
+    float x;
+    memcpy( &x, &i, 4 );
+    return x;
+}
+
+double r2_lcm_get_double( const unsigned char * p )
+{
+    int64_t i = r2_lcm_get_int64( p );
+    double x;
+    memcpy( &x, &i, 8 );
+    return x;
+}
+
+#endif // R2_LCM_I
@@ -0,0 +1,528 @@
+// r2_nmea.h
+// Parse NMEA 0183 sentences in place, without allocating
+//
+// Sentences ($ or !, comma separated fields, *hh checksum, one per line)
+// accumulate in an r2_buffer and are parsed where they lie. One pass over
+// each sentence, eight characters at a time (SWAR, as in r2_adc.h),
+// XORs the characters into the checksum and finds the commas and the '*'
+// with a few bitwise operations, storing where each field starts and how
+// long it is. Nothing is copied or converted until a field is asked for.
+//
+// The address field gives the talker ("GP", "GN", ...) and the sentence
+// formatter ("GGA", "RMC", ...), which a perfect hash (one multiply and a
+// shift into a 32-entry table) turns into an enum r2_nmea_type, so
+// handlers can be dispatched by type whatever the talker. Proprietary
+// sentences ($P...) have their own type.
+//
+// Numbers, latitudes and longitudes (ddmm.mmmm and a hemisphere) and UTC
+// times and dates (hhmmss.ss, ddmmyy) are converted from their fields by
+// r2_number.h, a word at a time too, exactly and without sscanf.
+//
+// Sentences with a bad checksum, and malformed ones, are dropped and
+// counted. A sentence without a checksum is accepted, with checksum -1.
+
+#ifndef R2_NMEA_H
+#define R2_NMEA_H
+
+#include <inttypes.h> // for int64_t, uint64_t
+#include <stddef.h> // for size_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memchr, memcmp
+
+#include "r2_buffer.h"
+#include "r2_number.h"
+
+// Fields stored per sentence, counting the address field.
+#ifndef R2_NMEA_FIELDS
+#define R2_NMEA_FIELDS 40
+#endif
+
+enum r2_nmea_type {
+    R2_NMEA_UNKNOWN,
+    R2_NMEA_PROPRIETARY,
+    R2_NMEA_DBT, // depth below transducer
+    R2_NMEA_DPT, // depth
+    R2_NMEA_DTM, // datum
+    R2_NMEA_GGA, // fix
+    R2_NMEA_GLL, // position
+    R2_NMEA_GNS, // multi-constellation fix
+    R2_NMEA_GSA, // DOP and active satellites
+    R2_NMEA_GST, // pseudorange error statistics
+    R2_NMEA_GSV, // satellites in view
+    R2_NMEA_HDG, // heading, deviation and variation
+    R2_NMEA_HDM, // magnetic heading
+    R2_NMEA_HDT, // true heading
+    R2_NMEA_MTW, // water temperature
+    R2_NMEA_MWV, // wind speed and angle
+    R2_NMEA_RMC, // recommended minimum
+    R2_NMEA_ROT, // rate of turn
+    R2_NMEA_TXT, // text
+    R2_NMEA_VHW, // water speed and heading
+    R2_NMEA_VTG, // course and speed over ground
+    R2_NMEA_ZDA, // time and date
+    R2_NMEA_TYPES
+};
+
+// Where a field is in the sentence text.
+struct r2_nmea_field {
+    uint16_t offset;
+    uint16_t length;
+};
+
+struct r2_nmea_sentence {
+    const char * text; // from the $ or !, not terminated
+    size_t length; // up to the checksum, included
+    char talker[3]; // "GP", "P" for proprietary, "" if unknown
+    enum r2_nmea_type type;
+    int checksum; // as received, -1 if there was none
+    size_t fields; // including the address field (field 0)
+    struct r2_nmea_field field[R2_NMEA_FIELDS];
+};
+
+typedef void ( * r2_nmea_handler )( const struct r2_nmea_sentence * sentence,
+        void * context );
+
+struct r2_nmea {
+    struct r2_buffer * buffer;
+    size_t used; // bytes parsed, dropped at the next fill
+    r2_nmea_handler handler[R2_NMEA_TYPES];
+    void * context[R2_NMEA_TYPES];
+    size_t sentences; // parsed
+    size_t dropped; // bad checksum or malformed
+};
+
+/*  Create a reader with room to buffer size bytes.
+ */
+struct r2_nmea * r2_nmea_create( const size_t size );
+
+void r2_nmea_destroy( struct r2_nmea * self );
+
+/*  Call handler( sentence, context ) for sentences of type, from
+ *  r2_nmea_dispatch (NULL for none).
+ */
+void r2_nmea_set_handler( struct r2_nmea * self,
+        const enum r2_nmea_type type, r2_nmea_handler handler,
+        void * context );
+
+/*  Read whatever is available on fd into the buffer, first dropping the
+ *  sentences already parsed (which invalidates them).
+ *
+ *  Returns the number of bytes read, as r2_buffer_fill.
+ */
+size_t r2_nmea_fill( struct r2_nmea * self, int fd );
+
+/*  Parse the next complete sentence in the buffer. It points into the
+ *  buffer, and is valid until the next r2_nmea_fill.
+ *
+ *  Returns 1, or 0 if there is no complete sentence left.
+ */
+int r2_nmea_next( struct r2_nmea * self, struct r2_nmea_sentence * sentence );
+
+/*  Parse every complete sentence in the buffer, passing each to the
+ *  handler of its type.
+ *
+ *  Returns the number of sentences parsed.
+ */
+size_t r2_nmea_dispatch( struct r2_nmea * self );
+
+/*  Parse the sentence in line[0..length), after any leading junk and
+ *  before any trailing \r or spaces.
+ *
+ *  R2_NUMBER_PADDING bytes past the end of the line must be readable.
+ *  Returns 0, or -1 for a bad checksum or a malformed sentence.
+ */
+int r2_nmea_parse( const char * line, const size_t length,
+        struct r2_nmea_sentence * sentence );
+
+/*  The type of a three-letter sentence formatter, e.g. "GGA".
+ */
+enum r2_nmea_type r2_nmea_type( const char * formatter );
+
+/*  Field n of sentence, of *length characters; NULL if there is no such
+ *  field.
+ */
+const char * r2_nmea_field( const struct r2_nmea_sentence * sentence,
+        const size_t n, size_t * length );
+
+/*  The decimal number in field n as value / 10^scale, scale from 0 to 18.
+ *
+ *  Returns 0, or -1 if the field is missing, empty or not such a number.
+ */
+int r2_nmea_fixed( const struct r2_nmea_sentence * sentence, const size_t n,
+        int64_t * value, int * scale );
+
+/*  The number in field n, correctly rounded.
+ *
+ *  Returns 0, or -1 if the field is missing, empty or not a number.
+ */
+int r2_nmea_double( const struct r2_nmea_sentence * sentence, const size_t n,
+        double * x );
+
+/*  The latitude or longitude in field n (ddmm.mm or dddmm.mm), in degrees,
+ *  negative when field n + 1 is S or W.
+ *
+ *  Returns 0, or -1 if either field is missing, empty or invalid.
+ */
+int r2_nmea_degrees( const struct r2_nmea_sentence * sentence,
+        const size_t n, double * degrees );
+
+/*  The time of day in field n (hhmmss or hhmmss.ss), in usec since
+ *  midnight.
+ *
+ *  Returns 0, or -1 if the field is missing, empty or invalid.
+ */
+int r2_nmea_time( const struct r2_nmea_sentence * sentence, const size_t n,
+        int64_t * usec );
+
+/*  The date in field n (ddmmyy, years 1980 to 2079), in usec since the
+ *  epoch at midnight UTC; add r2_nmea_time for the time of a fix.
+ *
+ *  Returns 0, or -1 if the field is missing, empty or invalid.
+ */
+int r2_nmea_date( const struct r2_nmea_sentence * sentence, const size_t n,
+        int64_t * usec );
+
+#endif // R2_NMEA_H
+
+#ifndef R2_NMEA_I
+#define R2_NMEA_I
+
+struct r2_nmea * r2_nmea_create( const size_t size )
+{
+    struct r2_nmea * self = calloc( 1, sizeof( struct r2_nmea ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_nmea\n" );
+        return NULL;
+    }
+    self->buffer = r2_number_buffer_create( size );
+    if( NULL == self->buffer ) {
+        fprintf( stderr, "could not allocate r2_nmea\n" );
+        r2_nmea_destroy( self );
+        return NULL;
+    }
+    return self;
+}
+
+void r2_nmea_destroy( struct r2_nmea * self )
+{
+    if( self ) {
+        r2_number_buffer_destroy( self->buffer );
+        free( self );
+    }
+}
+
+void r2_nmea_set_handler( struct r2_nmea * self,
+        const enum r2_nmea_type type, r2_nmea_handler handler,
+        void * context )
+{
+    self->handler[type] = handler;
+    self->context[type] = context;
+}
+
+size_t r2_nmea_fill( struct r2_nmea * self, int fd )
+{
+    r2_buffer_drop( self->buffer, self->used );
+    self->used = 0;
+    return r2_buffer_fill( self->buffer, fd );
+}
+
+int r2_nmea_next( struct r2_nmea * self, struct r2_nmea_sentence * sentence )
+{
+    struct r2_buffer * b = self->buffer;
+    for( ;; ) {
+        char * line = b->data + self->used;
+        char * eol = memchr( line, '\n', b->position - self->used );
+        if( NULL == eol ) {
+            if( 0 == self->used && b->position == b->size ) {
+                fprintf( stderr, "r2_nmea buffer filled without any lines"
+                        " -- clearing\n" );
+                self->dropped++;
+                self->used = b->position;
+            }
+            return 0;
+        }
+        self->used = eol + 1 - b->data;
+        if( 0 == r2_nmea_parse( line, eol - line, sentence ) ) {
+            self->sentences++;
+            return 1;
+        }
+        // blank lines are not sentences, but not errors either
+        if( memchr( line, '$', eol - line ) || memchr( line, '!', eol - line ) )
+            self->dropped++;
+    }
+}
+
+size_t r2_nmea_dispatch( struct r2_nmea * self )
+{
+    struct r2_nmea_sentence s;
+    size_t n = 0;
+    while( r2_nmea_next( self, &s ) ) {
+        if( self->handler[s.type] )
+            self->handler[s.type]( &s, self->context[s.type] );
+        n++;
+    }
+    return n;
+}
+
+// 0x80 in each byte of x equal to c, else 0. Unlike the usual zero-byte
+// test, there are no false positives above a match.
+uint64_t r2_nmea_equal( const uint64_t x, const unsigned c )
+{
+    uint64_t y = x ^ ( c * R2_NUMBER_ONES );
+    uint64_t t = ( ( y & ( 0x7f * R2_NUMBER_ONES ) ) + 0x7f * R2_NUMBER_ONES )
+        | y;
+    return ~t & ( 0x80 * R2_NUMBER_ONES );
+}
+
+// Value of a hexadecimal digit, or -1.
+int r2_nmea_hex( const char c )
+{
+    if( c >= '0' && c <= '9' )
+        return c - '0';
+    if( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    if( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    return -1;
+}
+
+int r2_nmea_parse( const char * line, const size_t length,
+        struct r2_nmea_sentence * s )
+{
+    const char * end = line + length;
+    while( end > line && ( '\r' == end[-1] || ' ' == end[-1] ) )
+        end--;
+    const char * p = line;
+    while( p < end && '$' != *p && '!' != *p )
+        p++;
+    if( end - p < 2 || end - p > UINT16_MAX )
+        return -1;
+    s->text = p++;
+
+    // XOR the words into the checksum, and note the commas, up to the '*'
+    uint64_t sum = 0;
+    size_t fields = 0, start = 1;
+    const char * star = NULL;
+    for( ; p < end && NULL == star; p += 8 ) {
+        uint64_t x = r2_number_load( p );
+        size_t left = end - p;
+        uint64_t valid = left < 8 ? ( 1ULL << ( 8 * left ) ) - 1 : ~0ULL;
+        uint64_t stop = r2_nmea_equal( x, '*' ) & valid;
+        if( stop ) {
+            valid &= ( ( stop & -stop ) >> 7 ) - 1; // the bytes before it
+            star = p + ( __builtin_ctzll( stop ) >> 3 );
+        }
+        x &= valid;
+        sum ^= x;
+        uint64_t commas = r2_nmea_equal( x, ',' ) & valid;
+        for( ; commas; commas &= commas - 1 ) {
+            size_t at = p - s->text + ( __builtin_ctzll( commas ) >> 3 );
+            if( fields + 1 == R2_NMEA_FIELDS )
+                return -1;
+            s->field[fields].offset = (uint16_t)start;
+            s->field[fields].length = (uint16_t)( at - start );
+            fields++;
+            start = at + 1;
+        }
+    }
+    const char * last = star ? star : end;
+    s->field[fields].offset = (uint16_t)start;
+    s->field[fields].length = (uint16_t)( last - s->text - start );
+    s->fields = fields + 1;
+    s->length = end - s->text;
+
+    s->checksum = -1;
+    if( star ) {
+        sum ^= sum >> 32;
+        sum ^= sum >> 16;
+        sum ^= sum >> 8;
+        int hi = end - star == 3 ? r2_nmea_hex( star[1] ) : -1;
+        int lo = end - star == 3 ? r2_nmea_hex( star[2] ) : -1;
+        if( hi < 0 || lo < 0 || ( sum & 0xff ) != (uint64_t)( hi << 4 | lo ) )
+            return -1;
+        s->checksum = hi << 4 | lo;
+    }
+
+    // the address: talker and formatter
+    const char * a = s->text + 1;
+    const size_t n = s->field[0].length;
+    s->talker[0] = s->talker[1] = s->talker[2] = 0;
+    s->type = R2_NMEA_UNKNOWN;
+    if( 0 == n )
+        return -1;
+    if( 'P' == a[0] ) {
+        s->talker[0] = 'P';
+        s->type = R2_NMEA_PROPRIETARY;
+    } else if( 5 == n ) {
+        s->talker[0] = a[0];
+        s->talker[1] = a[1];
+        s->type = r2_nmea_type( a + 2 );
+    }
+    return 0;
+}
+
+// A perfect hash of the formatters known: the three letters as a 24-bit
+// key, times a multiplier found by search, top five bits. Formatters not
+// in the table land on an empty slot or one holding another formatter.
+enum r2_nmea_type r2_nmea_type( const char * f )
+{
+    static const struct {
+        char formatter[4];
+        enum r2_nmea_type type;
+    } table[32] = {
+        { "DTM", R2_NMEA_DTM }, { "GSV", R2_NMEA_GSV },
+        { "", R2_NMEA_UNKNOWN }, { "MWV", R2_NMEA_MWV },
+        { "ZDA", R2_NMEA_ZDA }, { "GGA", R2_NMEA_GGA },
+        { "", R2_NMEA_UNKNOWN }, { "", R2_NMEA_UNKNOWN },
+        { "", R2_NMEA_UNKNOWN }, { "GSA", R2_NMEA_GSA },
+        { "GNS", R2_NMEA_GNS }, { "RMC", R2_NMEA_RMC },
+        { "GLL", R2_NMEA_GLL }, { "", R2_NMEA_UNKNOWN },
+        { "", R2_NMEA_UNKNOWN }, { "HDG", R2_NMEA_HDG },
+        { "VHW", R2_NMEA_VHW }, { "", R2_NMEA_UNKNOWN },
+        { "", R2_NMEA_UNKNOWN }, { "", R2_NMEA_UNKNOWN },
+        { "MTW", R2_NMEA_MTW }, { "VTG", R2_NMEA_VTG },
+        { "", R2_NMEA_UNKNOWN }, { "", R2_NMEA_UNKNOWN },
+        { "DBT", R2_NMEA_DBT }, { "HDT", R2_NMEA_HDT },
+        { "", R2_NMEA_UNKNOWN }, { "HDM", R2_NMEA_HDM },
+        { "ROT", R2_NMEA_ROT }, { "DPT", R2_NMEA_DPT },
+        { "GST", R2_NMEA_GST }, { "TXT", R2_NMEA_TXT },
+    };
+    const unsigned char * u = (const unsigned char *)f;
+    uint32_t key = (uint32_t)u[0] | (uint32_t)u[1] << 8 | (uint32_t)u[2] << 16;
+    uint32_t h = ( key * 167823u ) >> 27;
+    return 0 == memcmp( table[h].formatter, f, 3 ) ? table[h].type
+        : R2_NMEA_UNKNOWN;
+}
+
+const char * r2_nmea_field( const struct r2_nmea_sentence * s,
+        const size_t n, size_t * length )
+{
+    if( n >= s->fields )
+        return NULL;
+    *length = s->field[n].length;
+    return s->text + s->field[n].offset;
+}
+
+int r2_nmea_fixed( const struct r2_nmea_sentence * s, const size_t n,
+        int64_t * value, int * scale )
+{
+    size_t length = 0;
+    const char * p = r2_nmea_field( s, n, &length );
+    struct r2_number number;
+    if( NULL == p || p + length != r2_number_parse( p, p + length, &number )
+            || 0 == length || number.dropped || number.exponent > 0
+            || number.exponent < -18 || number.mantissa > INT64_MAX )
+        return -1;
+    *value = number.negative ? -(int64_t)number.mantissa
+        : (int64_t)number.mantissa;
+    *scale = -number.exponent;
+    return 0;
+}
+
+int r2_nmea_double( const struct r2_nmea_sentence * s, const size_t n,
+        double * x )
+{
+    size_t length = 0;
+    const char * p = r2_nmea_field( s, n, &length );
+    if( NULL == p || 0 == length || p + length != r2_number_double( p,
+                p + length, x ) )
+        return -1;
+    return 0;
+}
+
+int r2_nmea_degrees( const struct r2_nmea_sentence * s, const size_t n,
+        double * degrees )
+{
+    static const int64_t power[17] = { 1, 10, 100, 1000, 10000, 100000,
+        1000000, 10000000, 100000000, 1000000000, 10000000000LL,
+        100000000000LL, 1000000000000LL, 10000000000000LL,
+        100000000000000LL, 1000000000000000LL, 10000000000000000LL };
+    int64_t v;
+    int scale;
+    size_t length;
+    const char * h = r2_nmea_field( s, n + 1, &length );
+    if( NULL == h || 1 != length || -1 == r2_nmea_fixed( s, n, &v, &scale )
+            || v < 0 )
+        return -1;
+    // digits past the 16th decimal are below what a double holds; dropping
+    // them keeps 100 * 10^scale within an int64_t
+    for( ; scale > 16; scale-- )
+        v /= 10;
+    // whole degrees, and minutes as a fixed-point number of the same scale
+    int64_t d = v / ( 100 * power[scale] );
+    int64_t minutes = v - d * 100 * power[scale];
+    if( minutes >= 60 * power[scale] )
+        return -1;
+    double x = (double)d + (double)minutes / ( 60.0 * (double)power[scale] );
+    switch( *h ) {
+    case 'N':
+    case 'E':
+        if( x > ( 'N' == *h ? 90 : 180 ) )
+            return -1;
+        *degrees = x;
+        return 0;
+    case 'S':
+    case 'W':
+        if( x > ( 'S' == *h ? 90 : 180 ) )
+            return -1;
+        *degrees = -x;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+int r2_nmea_time( const struct r2_nmea_sentence * s, const size_t n,
+        int64_t * usec )
+{
+    static const int64_t power[7] = { 1, 10, 100, 1000, 10000, 100000,
+        1000000 };
+    int64_t v;
+    int scale;
+    size_t length = 0;
+    const char * p = r2_nmea_field( s, n, &length );
+    if( -1 == r2_nmea_fixed( s, n, &v, &scale ) || scale > 6
+            || length - ( scale ? scale + 1 : 0 ) != 6
+            || *p < '0' || *p > '9' )
+        return -1;
+    int64_t whole = v / power[scale];
+    int64_t hours = whole / 10000, minutes = whole / 100 % 100;
+    int64_t seconds = whole % 100;
+    if( hours > 23 || minutes > 59 || seconds > 60 ) // leap second
+        return -1;
+    *usec = ( ( hours * 60 + minutes ) * 60 + seconds ) * 1000000
+        + ( v - whole * power[scale] ) * power[6 - scale];
+    return 0;
+}
+
+int r2_nmea_date( const struct r2_nmea_sentence * s, const size_t n,
+        int64_t * usec )
+{
+    int64_t v;
+    int scale;
+    size_t length = 0;
+    const char * p = r2_nmea_field( s, n, &length );
+    if( -1 == r2_nmea_fixed( s, n, &v, &scale ) || scale || 6 != length
+            || *p < '0' || *p > '9' )
+        return -1;
+    static const int days[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31,
+        30, 31 };
+    int64_t day = v / 10000, month = v / 100 % 100, year = v % 100;
+    year += year < 80 ? 2000 : 1900;
+    if( month < 1 || month > 12 || day < 1 || day > days[month - 1]
+            || ( 2 == month && 29 == day && ( year % 4
+                    || ( 0 == year % 100 && year % 400 ) ) ) )
+        return -1;
+    // days since the epoch (Howard Hinnant's days_from_civil algorithm)
+    year -= month <= 2;
+    int64_t era = year / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = ( 153 * ( month + ( month > 2 ? -3 : 9 ) ) + 2 ) / 5
+        + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    *usec = ( era * 146097 + doe - 719468 ) * 86400 * 1000000LL;
+    return 0;
+}
+
+#endif // R2_NMEA_I
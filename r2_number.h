@@ -0,0 +1,562 @@
+// r2_number.h
+// Parse the numbers of ASCII instrument lines, without strtod
+//
+// Lines of numbers separated by anything else (commas, spaces, tabs, units,
+// labels) are parsed in place, eight characters at a time: the characters
+// are loaded into a 64-bit integer, the run of digits is found with a few
+// bitwise operations and converted with three multiplies (SWAR, SIMD
+// within a register). The numbers of a line are stored straight into
+// columns supplied by the caller (one array per field, structure of
+// arrays), as double, float or int32_t.
+//
+// Numbers are decimal, with an optional sign just before them, an optional
+// point and an optional exponent: 42, -7, +.5, 3.25e-4, 1E6. The point is
+// always '.', whatever the locale. Up to 19 significant digits are kept.
+//
+// Conversion is exact (correctly rounded, as strtod). Most numbers from
+// instruments have few enough digits for Clinger's fast path: a mantissa
+// of at most 53 bits times or divided by an exact power of ten, one
+// correctly rounded operation. The others (long mantissas, large
+// exponents, or builds without strict IEEE double arithmetic) fall back to
+// strtod on a copy with the locale's decimal point. Floats take their own
+// fast path, or round the exact double unless it lies exactly halfway
+// between two floats.
+//
+// The word-at-a-time primitives are shared with r2_adc.h and r2_nmea.h.
+
+#ifndef R2_NUMBER_H
+#define R2_NUMBER_H
+
+#include <float.h> // for FLT_EVAL_METHOD, FLT_MIN
+#include <inttypes.h> // for int32_t, uint64_t
+#include <locale.h> // for localeconv
+#include <math.h> // for NAN
+#include <stddef.h> // for size_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for free, malloc, strtod, strtof
+#include <string.h> // for memchr, memcpy, strlen
+
+#include "r2_buffer.h"
+#include "r2_fastmath.h"
+
+// Bytes past the end of a line that the parsers may read (but ignore).
+#define R2_NUMBER_PADDING 8
+
+#define R2_NUMBER_ONES 0x0101010101010101ULL
+
+// A decimal number as parsed: mantissa * 10^exponent.
+struct r2_number {
+    uint64_t mantissa; // the first 19 significant digits
+    int exponent;
+    int negative;
+    int digits; // in the text, before any exponent
+    int dropped; // digits past the first 19 significant ones
+    int exact; // no non-zero digit was dropped
+};
+
+/*  Create a buffer of size bytes with R2_NUMBER_PADDING bytes of slack
+ *  past its end, for r2_number_rows_d and the like.
+ */
+struct r2_buffer * r2_number_buffer_create( const size_t size );
+
+/*  Free a buffer from r2_number_buffer_create (r2_buffer_destroy does not
+ *  free yet).
+ */
+void r2_number_buffer_destroy( struct r2_buffer * buffer );
+
+/*  Parse the number starting at p (a sign, a point or a digit), up to end,
+ *  into number.
+ *
+ *  R2_NUMBER_PADDING bytes past end must be readable. Returns the end of
+ *  the number, or p if there is none.
+ */
+const char * r2_number_parse( const char * p, const char * end,
+        struct r2_number * number );
+
+/*  The value of number, parsed from the text [p, end).
+ */
+double r2_number_to_double( const struct r2_number * number, const char * p,
+        const char * end );
+
+float r2_number_to_float( const struct r2_number * number, const char * p,
+        const char * end );
+
+/*  Parse the number at p, up to end, as r2_number_parse, into x.
+ *
+ *  Returns the end of the number, or p if there is none.
+ */
+const char * r2_number_double( const char * p, const char * end, double * x );
+
+const char * r2_number_float( const char * p, const char * end, float * x );
+
+/*  Parse the numbers in line[0..length), storing the first max of them in
+ *  columns[0][row], columns[1][row]...
+ *
+ *  R2_NUMBER_PADDING bytes past the end of the line must be readable.
+ *  Returns the number of numbers in the line, which may be more than max.
+ */
+size_t r2_number_fields_d( const char * line, const size_t length,
+        double * const * columns, const size_t max, const size_t row );
+
+size_t r2_number_fields_f( const char * line, const size_t length,
+        float * const * columns, const size_t max, const size_t row );
+
+/*  As r2_number_fields_d, truncating towards zero and saturating at the
+ *  int32_t range.
+ */
+size_t r2_number_fields_i( const char * line, const size_t length,
+        int32_t * const * columns, const size_t max, const size_t row );
+
+/*  Parse up to max_rows complete lines (terminated by \n) of buffer, which
+ *  must have R2_NUMBER_PADDING bytes of slack (see
+ *  r2_number_buffer_create), into rows 0, 1... of columns, and remove them
+ *  from the buffer. Lines with another number of numbers are dropped, and
+ *  counted in *dropped; blank lines are skipped.
+ *
+ *  Returns the number of rows stored.
+ */
+size_t r2_number_rows_d( struct r2_buffer * buffer, double * const * columns,
+        const size_t fields, const size_t max_rows, size_t * dropped );
+
+size_t r2_number_rows_f( struct r2_buffer * buffer, float * const * columns,
+        const size_t fields, const size_t max_rows, size_t * dropped );
+
+#endif // R2_NUMBER_H
+
+#ifndef R2_NUMBER_I
+#define R2_NUMBER_I
+
+// Clinger's fast path needs every operation rounded once, to double.
+#if defined( FLT_EVAL_METHOD ) && 0 == FLT_EVAL_METHOD \
+    && !defined( __FAST_MATH__ )
+#define R2_NUMBER_FAST_PATH 1
+#else
+#define R2_NUMBER_FAST_PATH 0
+#endif
+
+struct r2_buffer * r2_number_buffer_create( const size_t size )
+{
+    struct r2_buffer * buffer = r2_buffer_create( size + R2_NUMBER_PADDING );
+    if( NULL == buffer || NULL == buffer->data ) {
+        fprintf( stderr, "could not allocate r2_number buffer\n" );
+        if( buffer )
+            free( buffer );
+        return NULL;
+    }
+    buffer->size = size;
+    return buffer;
+}
+
+void r2_number_buffer_destroy( struct r2_buffer * buffer )
+{
+    if( buffer ) {
+        free( buffer->data );
+        free( buffer );
+    }
+}
+
+// Load 8 bytes as a little-endian word on any host (a single load on
+// little-endian ones).
+uint64_t r2_number_load( const char * p )
+{
+    const unsigned char * u = (const unsigned char *)p;
+    return (uint64_t)u[0] | (uint64_t)u[1] << 8 | (uint64_t)u[2] << 16
+        | (uint64_t)u[3] << 24 | (uint64_t)u[4] << 32 | (uint64_t)u[5] << 40
+        | (uint64_t)u[6] << 48 | (uint64_t)u[7] << 56;
+}
+
+// 0x80 in each byte of x within [lo, hi] (both below 0x80), else 0. The
+// sums stay within their bytes, so there are no carries between them.
+uint64_t r2_number_between( const uint64_t x, const unsigned lo,
+        const unsigned hi )
+{
+    uint64_t y = x & ( 0x7f * R2_NUMBER_ONES );
+    uint64_t ge = y + ( 0x80 - lo ) * R2_NUMBER_ONES;
+    uint64_t gt = y + ( 0x7f - hi ) * R2_NUMBER_ONES;
+    return ge & ~gt & ~x & ( 0x80 * R2_NUMBER_ONES );
+}
+
+// Number of leading bytes (up to 8) of x flagged in mask.
+size_t r2_number_run( const uint64_t mask )
+{
+    uint64_t other = ~mask & ( 0x80 * R2_NUMBER_ONES );
+    return other ? (size_t)__builtin_ctzll( other ) >> 3 : 8;
+}
+
+// Value of eight decimal digits, first digit in the lowest byte, already
+// less '0'.
+uint32_t r2_number_eight_digits( uint64_t v )
+{
+    v = v * 10 + ( v >> 8 ); // pairs
+    v = ( ( v & 0x000000ff000000ffULL ) * ( 100 + ( 1000000ULL << 32 ) )
+            + ( ( v >> 16 ) & 0x000000ff000000ffULL )
+            * ( 1 + ( 10000ULL << 32 ) ) ) >> 32;
+    return (uint32_t)v;
+}
+
+// Value of eight hexadecimal digits, first digit in the lowest byte.
+uint32_t r2_number_eight_hex( uint64_t x )
+{
+    // letters have bit 6 set, and their low nibble is 9 less than their value
+    uint64_t v = ( x & ( 0x0f * R2_NUMBER_ONES ) )
+        + ( ( x >> 6 ) & R2_NUMBER_ONES ) * 9;
+    v = ( ( v & 0x0f000f000f000f00ULL ) >> 8 )
+        | ( ( v & 0x000f000f000f000fULL ) << 4 );
+    v = ( ( v & 0x00ff000000ff0000ULL ) >> 16 )
+        | ( ( v & 0x000000ff000000ffULL ) << 8 );
+    v = ( ( v & 0x0000ffff00000000ULL ) >> 32 )
+        | ( ( v & 0x000000000000ffffULL ) << 16 );
+    return (uint32_t)v;
+}
+
+// Add the decimal digits at p, up to end, to the mantissa of number, eight
+// at a time while they fit in 19 digits, then one at a time, dropping
+// those that do not. Returns the end of the digits.
+const char * r2_number_digits( const char * p, const char * end,
+        struct r2_number * number )
+{
+    static const uint64_t power[9] = { 1, 10, 100, 1000, 10000, 100000,
+        1000000, 10000000, 100000000 };
+    // 10^(19 - n): below it, n more digits fit in 19
+    static const uint64_t room[9] = { 0, 1000000000000000000ULL,
+        100000000000000000ULL, 10000000000000000ULL, 1000000000000000ULL,
+        100000000000000ULL, 10000000000000ULL, 1000000000000ULL,
+        100000000000ULL };
+    uint64_t v = number->mantissa;
+    for( ;; ) {
+        uint64_t x = r2_number_load( p );
+        size_t n = r2_number_run( r2_number_between( x, '0', '9' ) );
+        size_t left = end - p;
+        n = n < left ? n : left;
+        if( 0 == n )
+            break;
+        number->digits += (int)n;
+        if( v < room[n] ) {
+            // shift the digits to the top, behind leading zeros
+            int shift = 8 * ( 8 - (int)n );
+            v = v * power[n] + r2_number_eight_digits(
+                    ( x - '0' * R2_NUMBER_ONES ) << shift );
+        } else {
+            size_t k;
+            for( k = 0; k < n; k++ ) {
+                if( v < room[1] ) {
+                    v = v * 10 + (uint64_t)( p[k] - '0' );
+                } else {
+                    number->dropped++;
+                    number->exact &= '0' == p[k];
+                }
+            }
+        }
+        p += n;
+        if( n < 8 )
+            break;
+    }
+    number->mantissa = v;
+    return p;
+}
+
+const char * r2_number_parse( const char * p, const char * end,
+        struct r2_number * number )
+{
+    const char * start = p;
+    number->mantissa = 0;
+    number->exponent = 0;
+    number->digits = 0;
+    number->dropped = 0;
+    number->exact = 1;
+    number->negative = p < end && '-' == *p;
+    p += p < end && ( '-' == *p || '+' == *p );
+    p = r2_number_digits( p, end, number );
+    // digits dropped before the point scale the mantissa up
+    int exponent = number->dropped;
+    if( p < end && '.' == *p ) {
+        int digits = number->digits, dropped = number->dropped;
+        p = r2_number_digits( p + 1, end, number );
+        exponent -= ( number->digits - digits )
+            - ( number->dropped - dropped );
+    }
+    if( 0 == number->digits )
+        return start;
+    if( end - p > 1 && 'e' == ( *p | 0x20 ) ) {
+        const char * q = p + 1;
+        int negative = '-' == *q;
+        q += '-' == *q || '+' == *q;
+        if( q < end && *q >= '0' && *q <= '9' ) {
+            int e = 0;
+            for( ; q < end && *q >= '0' && *q <= '9'; q++ )
+                e = e < 100000 ? e * 10 + ( *q - '0' ) : e;
+            exponent += negative ? -e : e;
+            p = q;
+        }
+    }
+    number->exponent = exponent;
+    return p;
+}
+
+// Copy [p, end) to text (of size n, or allocated when longer: free it if
+// it is not text), with the locale's decimal point for '.', for strtod.
+char * r2_number_text( const char * p, const char * end, char * text,
+        const size_t n )
+{
+    const char * point = localeconv()->decimal_point;
+    const size_t k = strlen( point );
+    const size_t size = ( end - p ) * ( k ? k : 1 ) + 1;
+    char * t = size <= n ? text : malloc( size );
+    if( NULL == t )
+        return NULL;
+    char * q = t;
+    for( ; p < end; p++ ) {
+        if( '.' == *p && k ) {
+            memcpy( q, point, k );
+            q += k;
+        } else
+            *q++ = *p;
+    }
+    *q = 0;
+    return t;
+}
+
+double r2_number_to_double( const struct r2_number * number, const char * p,
+        const char * end )
+{
+    static const double power[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+        1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        1e19, 1e20, 1e21, 1e22 };
+    static const uint64_t exact[16] = { 1ULL, 10ULL, 100ULL, 1000ULL,
+        10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+        1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+        10000000000000ULL, 100000000000000ULL, 1000000000000000ULL };
+    const uint64_t m = number->mantissa;
+    const int e = number->exponent;
+    if( R2_NUMBER_FAST_PATH && number->exact && m <= ( 1ULL << 53 ) ) {
+        double x = -1;
+        if( 0 == m )
+            x = 0;
+        else if( e >= -22 && e < 0 )
+            x = (double)m / power[-e];
+        else if( e >= 0 && e <= 22 )
+            x = (double)m * power[e];
+        else if( e > 22 && e <= 22 + 15 && m <= ( 1ULL << 53 ) / exact[e - 22] )
+            x = (double)( m * exact[e - 22] ) * 1e22; // still one rounding
+        if( x >= 0 )
+            return number->negative ? -x : x;
+    }
+    char buffer[64];
+    char * text = r2_number_text( p, end, buffer, sizeof( buffer ) );
+    if( NULL == text )
+        return NAN;
+    double x = strtod( text, NULL );
+    if( text != buffer )
+        free( text );
+    return x;
+}
+
+float r2_number_to_float( const struct r2_number * number, const char * p,
+        const char * end )
+{
+    static const float power[11] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+        1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    const uint64_t m = number->mantissa;
+    const int e = number->exponent;
+    if( R2_NUMBER_FAST_PATH && number->exact && m <= ( 1ULL << 24 ) ) {
+        float x = -1;
+        if( 0 == m )
+            x = 0;
+        else if( e >= -10 && e < 0 )
+            x = (float)m / power[-e];
+        else if( e >= 0 && e <= 10 )
+            x = (float)m * power[e];
+        if( x >= 0 )
+            return number->negative ? -x : x;
+    }
+    // the double is correctly rounded, so rounding it again gives the
+    // nearest float but when it lies exactly halfway between two normal
+    // floats, where the digits it came from decide
+    union { double d; uint64_t u; } x = { r2_number_to_double( number, p,
+            end ) };
+    if( ( x.u & 0x1fffffff ) != 0x10000000
+            && ( 0 == x.d || x.d >= FLT_MIN || x.d <= -FLT_MIN ) )
+        return (float)x.d;
+    char buffer[64];
+    char * text = r2_number_text( p, end, buffer, sizeof( buffer ) );
+    if( NULL == text )
+        return NAN;
+    float f = strtof( text, NULL );
+    if( text != buffer )
+        free( text );
+    return f;
+}
+
+const char * r2_number_double( const char * p, const char * end, double * x )
+{
+    struct r2_number number;
+    const char * q = r2_number_parse( p, end, &number );
+    if( q != p )
+        *x = r2_number_to_double( &number, p, q );
+    return q;
+}
+
+const char * r2_number_float( const char * p, const char * end, float * x )
+{
+    struct r2_number number;
+    const char * q = r2_number_parse( p, end, &number );
+    if( q != p )
+        *x = r2_number_to_float( &number, p, q );
+    return q;
+}
+
+// Find the next number at or after p, up to end, but not starting before
+// floor (the end of the previous one). Returns its start, or end.
+const char * r2_number_next( const char * p, const char * end,
+        const char * floor )
+{
+    while( p < end ) {
+        // skip to the next digit
+        uint64_t d = r2_number_between( r2_number_load( p ), '0', '9' );
+        if( 0 == d ) {
+            p += 8;
+            continue;
+        }
+        p += __builtin_ctzll( d ) >> 3;
+        if( p >= end )
+            break;
+        // and back to a point and a sign just before it
+        if( p > floor && '.' == p[-1] )
+            p--;
+        if( p > floor && ( '-' == p[-1] || '+' == p[-1] ) )
+            p--;
+        return p;
+    }
+    return end;
+}
+
+// Store number, parsed from [p, q), in columns[field][row], as the type of
+// columns.
+typedef void ( * r2_number_store )( const void * columns, const size_t field,
+        const size_t row, const struct r2_number * number, const char * p,
+        const char * q );
+
+static inline void r2_number_store_d( const void * columns,
+        const size_t field, const size_t row,
+        const struct r2_number * number, const char * p, const char * q )
+{
+    ( (double * const *)columns )[field][row] = r2_number_to_double( number,
+            p, q );
+}
+
+static inline void r2_number_store_f( const void * columns,
+        const size_t field, const size_t row,
+        const struct r2_number * number, const char * p, const char * q )
+{
+    ( (float * const *)columns )[field][row] = r2_number_to_float( number,
+            p, q );
+}
+
+static inline void r2_number_store_i( const void * columns,
+        const size_t field, const size_t row,
+        const struct r2_number * number, const char * p, const char * q )
+{
+    static const uint64_t power[10] = { 1, 10, 100, 1000, 10000, 100000,
+        1000000, 10000000, 100000000, 1000000000 };
+    ( void )p;
+    ( void )q;
+    // integers need no rounding: scale the mantissa, saturating
+    uint64_t m = number->mantissa;
+    int e = number->exponent;
+    if( e < 0 )
+        m = e > -19 ? ( e > -10 ? m / power[-e]
+                : m / power[9] / power[-e - 9] ) : 0;
+    for( ; e > 0 && 0 != m && m < ( 1ULL << 32 ); e-- )
+        m *= 10;
+    m = m < ( 1ULL << 32 ) ? m : ( 1ULL << 32 );
+    int64_t v = number->negative ? -(int64_t)m : (int64_t)m;
+    ( (int32_t * const *)columns )[field][row] = (int32_t)( v > INT32_MAX
+            ? INT32_MAX : ( v < INT32_MIN ? INT32_MIN : v ) );
+}
+
+// The loop of r2_number_fields_d and the like, inlined into each with its
+// store so that the call through the pointer goes away.
+static R2_ALWAYS_INLINE size_t r2_number_fields( const char * line,
+        const size_t length, const void * columns, const size_t max,
+        const size_t row, const r2_number_store store )
+{
+    const char * end = line + length;
+    const char * p = line, * floor = line;
+    struct r2_number number;
+    size_t n = 0;
+    while( ( p = r2_number_next( p, end, floor ) ) < end ) {
+        const char * q = r2_number_parse( p, end, &number );
+        if( n < max )
+            store( columns, n, row, &number, p, q );
+        n++;
+        floor = p = q;
+    }
+    return n;
+}
+
+size_t r2_number_fields_d( const char * line, const size_t length,
+        double * const * columns, const size_t max, const size_t row )
+{
+    return r2_number_fields( line, length, columns, max, row,
+            r2_number_store_d );
+}
+
+size_t r2_number_fields_f( const char * line, const size_t length,
+        float * const * columns, const size_t max, const size_t row )
+{
+    return r2_number_fields( line, length, columns, max, row,
+            r2_number_store_f );
+}
+
+size_t r2_number_fields_i( const char * line, const size_t length,
+        int32_t * const * columns, const size_t max, const size_t row )
+{
+    return r2_number_fields( line, length, columns, max, row,
+            r2_number_store_i );
+}
+
+// The loop of r2_number_rows_d and r2_number_rows_f.
+static R2_ALWAYS_INLINE size_t r2_number_rows( struct r2_buffer * b,
+        const void * columns, const size_t fields, const size_t max_rows,
+        size_t * dropped, const r2_number_store store )
+{
+    size_t used = 0;
+    size_t rows = 0;
+    while( rows < max_rows ) {
+        char * line = b->data + used;
+        char * eol = memchr( line, '\n', b->position - used );
+        if( NULL == eol )
+            break;
+        size_t n = r2_number_fields( line, eol - line, columns, fields, rows,
+                store );
+        if( n == fields )
+            rows++;
+        else if( n )
+            ( *dropped )++;
+        used = eol + 1 - b->data;
+    }
+    if( 0 == used && b->position == b->size ) {
+        fprintf( stderr,
+                "r2_number buffer filled without any lines -- clearing\n" );
+        ( *dropped )++;
+        used = b->position;
+    }
+    r2_buffer_drop( b, used );
+    return rows;
+}
+
+size_t r2_number_rows_d( struct r2_buffer * b, double * const * columns,
+        const size_t fields, const size_t max_rows, size_t * dropped )
+{
+    return r2_number_rows( b, columns, fields, max_rows, dropped,
+            r2_number_store_d );
+}
+
+size_t r2_number_rows_f( struct r2_buffer * b, float * const * columns,
+        const size_t fields, const size_t max_rows, size_t * dropped )
+{
+    return r2_number_rows( b, columns, fields, max_rows, dropped,
+            r2_number_store_f );
+}
+
+#endif // R2_NUMBER_I
@@ -1,11 +1,20 @@
 // r2_quaternion.h
 // convert from a quaternion to another representation of rotation
+//
+// The conversions are computed in single precision. Define
+// R2_QUATERNION_FAST before including this header to use the branch-free
+// approximations of r2_fastmath.h instead of libm (see there for error
+// bounds), e.g. in a control loop where their cost matters.
 
 #ifndef R2_QUATERNION_H
 #define R2_QUATERNION_H
 
 #include <math.h>
 
+#if defined( R2_QUATERNION_FAST )
+#include "r2_fastmath.h"
+#endif
+
 #ifndef R2_QUATERNION_STRUCT
 #define R2_QUATERNION_STRUCT
 // Quaternion q = q.h + q.i i + q.j j + q.k k;
@@ -54,12 +63,20 @@ struct r2_nf_t r2_quaternion_to_nautical_angle(const struct r2_qf_t qf){
 
 
 struct r2_qf_t r2_nf_to_qf(const struct r2_nf_t n){
-    float cy = cos(n.yaw * 0.5);
-    float sy = sin(n.yaw * 0.5);
-    float cp = cos(n.pitch * 0.5);
-    float sp = sin(n.pitch * 0.5);
-    float cr = cos(n.roll * 0.5);
-    float sr = sin(n.roll * 0.5);
+    float cy, sy, cp, sp, cr, sr;
+#if defined( R2_QUATERNION_FAST )
+    r2_fastmath_sincosf(n.yaw * 0.5f, &sy, &cy);
+    r2_fastmath_sincosf(n.pitch * 0.5f, &sp, &cp);
+    r2_fastmath_sincosf(n.roll * 0.5f, &sr, &cr);
+#else
+    // GCC and clang combine each sinf/cosf pair into one sincosf call
+    cy = cosf(n.yaw * 0.5f);
+    sy = sinf(n.yaw * 0.5f);
+    cp = cosf(n.pitch * 0.5f);
+    sp = sinf(n.pitch * 0.5f);
+    cr = cosf(n.roll * 0.5f);
+    sr = sinf(n.roll * 0.5f);
+#endif
 
     struct r2_qf_t q = { 0 };
     q.h = cr * cp * cy + sr * sp * sy;
@@ -86,13 +103,20 @@ struct r2_nf_t r2_qf_to_nf(const struct r2_qf_t q){
     float sy_cp = 2 * (q.h * q.k + q.i * q.j);
     float cy_cp = 1 - 2 * (q.j * q.j + q.k * q.k);
 
-    // TODO: limit sp to [-1,1]
-    // just in case it fell outside due to finite precision
+    // limit sp to [-1,1], in case it fell outside due to finite precision
+    // (asin would return NaN)
+    sp = sp > 1 ? 1 : (sp < -1 ? -1 : sp);
 
     struct r2_nf_t n = { 0 };
-    n.roll = atan2(sr_cp, cr_cp);
-    n.pitch = asin(sp);
-    n.yaw = atan2(sy_cp, cy_cp);
+#if defined( R2_QUATERNION_FAST )
+    n.roll = r2_fastmath_atan2f(sr_cp, cr_cp);
+    n.pitch = r2_fastmath_asinf(sp);
+    n.yaw = r2_fastmath_atan2f(sy_cp, cy_cp);
+#else
+    n.roll = atan2f(sr_cp, cr_cp);
+    n.pitch = asinf(sp);
+    n.yaw = atan2f(sy_cp, cy_cp);
+#endif
 
     return n;
 } // TODO: clearer implementation by composing rotations about axes with axis-angle representations
@@ -0,0 +1,354 @@
+// r2_quaternion_algebra.h
+// Quaternion algebra: normalization, conjugate and inverse, rotation of
+// vectors, rotation matrices, interpolation and angular distance
+//
+// Functions on struct r2_qf_t (single precision) use the approximations of
+// r2_fastmath.h; the r2_qd_ functions on struct r2_qd_t are the double
+// precision equivalents using libm. All of them are static and inlined,
+// and free of branches on the data, like r2_fastmath.h, so loops that call
+// them vectorize. r2_quaternion_batch.h has structure-of-arrays kernels for
+// the common bulk operations.
+//
+// Rotation quaternions are assumed to be of unit length, except where
+// stated. Products follow r2_qf_product: r2_qf_product( a, b ) rotates by b
+// first, then by a.
+
+#ifndef R2_QUATERNION_ALGEBRA_H
+#define R2_QUATERNION_ALGEBRA_H
+
+#include <math.h> // for sqrt, sin, atan2, fabs
+
+#include "r2_fastmath.h"
+#include "r2_quaternion.h"
+
+struct r2_qd_t {
+    double h;
+    double i;
+    double j;
+    double k;
+};
+
+// 3-vectors
+struct r2_vf_t {
+    float x;
+    float y;
+    float z;
+};
+
+struct r2_vd_t {
+    double x;
+    double y;
+    double z;
+};
+
+#endif // R2_QUATERNION_ALGEBRA_H
+
+#ifndef R2_QUATERNION_ALGEBRA_I
+#define R2_QUATERNION_ALGEBRA_I
+
+/*  Dot product of q and p, as 4-vectors.
+ */
+static R2_ALWAYS_INLINE float r2_qf_dot( const struct r2_qf_t q,
+        const struct r2_qf_t p )
+{
+    return q.h * p.h + q.i * p.i + q.j * p.j + q.k * p.k;
+}
+
+static R2_ALWAYS_INLINE float r2_qf_norm( const struct r2_qf_t q )
+{
+    return r2_fastmath_sqrtf( r2_qf_dot( q, q ) );
+}
+
+/*  q scaled to unit length, using the fast inverse square root (relative
+ *  error < 2e-7). The zero quaternion stays zero.
+ */
+static R2_ALWAYS_INLINE struct r2_qf_t r2_qf_normalize( const struct r2_qf_t q )
+{
+    float s = r2_fastmath_rsqrtf( r2_qf_dot( q, q ) );
+    struct r2_qf_t r = { q.h * s, q.i * s, q.j * s, q.k * s };
+    return r;
+}
+
+/*  Conjugate of q; for a unit quaternion, also its inverse (the opposite
+ *  rotation).
+ */
+static R2_ALWAYS_INLINE struct r2_qf_t r2_qf_conjugate( const struct r2_qf_t q )
+{
+    struct r2_qf_t r = { q.h, -q.i, -q.j, -q.k };
+    return r;
+}
+
+/*  Inverse of any non-zero q (the zero quaternion gives zero).
+ */
+static R2_ALWAYS_INLINE struct r2_qf_t r2_qf_inverse( const struct r2_qf_t q )
+{
+    float n2 = r2_qf_dot( q, q );
+    float s = 1.0f / ( n2 > 0 ? n2 : 1.0f );
+    struct r2_qf_t r = { q.h * s, -q.i * s, -q.j * s, -q.k * s };
+    return r;
+}
+
+/*  Rotate v by q, i.e. q v q*, without building a matrix (15 multiplies).
+ */
+static R2_ALWAYS_INLINE struct r2_vf_t r2_qf_rotate( const struct r2_qf_t q,
+        const struct r2_vf_t v )
+{
+    // t = 2 u x v; v' = v + h t + u x t, with u the vector part of q
+    float tx = 2 * ( q.j * v.z - q.k * v.y );
+    float ty = 2 * ( q.k * v.x - q.i * v.z );
+    float tz = 2 * ( q.i * v.y - q.j * v.x );
+    struct r2_vf_t r = {
+        v.x + q.h * tx + ( q.j * tz - q.k * ty ),
+        v.y + q.h * ty + ( q.k * tx - q.i * tz ),
+        v.z + q.h * tz + ( q.i * ty - q.j * tx ) };
+    return r;
+}
+
+/*  Rotation matrix of q, row-major: m * v rotates v as r2_qf_rotate.
+ */
+static R2_ALWAYS_INLINE void r2_qf_to_matrix( const struct r2_qf_t q,
+        float m[9] )
+{
+    float ii = q.i * q.i, jj = q.j * q.j, kk = q.k * q.k;
+    float ij = q.i * q.j, ik = q.i * q.k, jk = q.j * q.k;
+    float hi = q.h * q.i, hj = q.h * q.j, hk = q.h * q.k;
+    m[0] = 1 - 2 * ( jj + kk );
+    m[1] = 2 * ( ij - hk );
+    m[2] = 2 * ( ik + hj );
+    m[3] = 2 * ( ij + hk );
+    m[4] = 1 - 2 * ( ii + kk );
+    m[5] = 2 * ( jk - hi );
+    m[6] = 2 * ( ik - hj );
+    m[7] = 2 * ( jk + hi );
+    m[8] = 1 - 2 * ( ii + jj );
+}
+
+/*  Unit quaternion (with h >= 0) of a row-major rotation matrix.
+ */
+static R2_ALWAYS_INLINE struct r2_qf_t r2_qf_from_matrix( const float m[9] )
+{
+    // Shepperd's method: solve for the largest component first, for
+    // accuracy near half turns. All four candidates are computed and one is
+    // selected, rather than branching on which is largest.
+    float th = 1 + m[0] + m[4] + m[8];
+    float ti = 1 + m[0] - m[4] - m[8];
+    float tj = 1 - m[0] + m[4] - m[8];
+    float tk = 1 - m[0] - m[4] + m[8];
+    float hi = m[7] - m[5], hj = m[2] - m[6], hk = m[3] - m[1];
+    float ij = m[1] + m[3], ik = m[2] + m[6], jk = m[5] + m[7];
+    int ui = ti > th;
+    float t = ui ? ti : th;
+    float h = ui ? hi : th, i = ui ? ti : hi;
+    float j = ui ? ij : hj, k = ui ? ik : hk;
+    int uj = tj > t;
+    t = uj ? tj : t;
+    h = uj ? hj : h; i = uj ? ij : i; j = uj ? tj : j; k = uj ? jk : k;
+    int uk = tk > t;
+    t = uk ? tk : t;
+    h = uk ? hk : h; i = uk ? ik : i; j = uk ? jk : j; k = uk ? tk : k;
+    float s = 0.5f * r2_fastmath_rsqrtf( t );
+    s = h < 0 ? -s : s;
+    struct r2_qf_t q = { h * s, i * s, j * s, k * s };
+    return q;
+}
+
+/*  Normalized linear interpolation from a (t = 0) to b (t = 1), along the
+ *  shorter arc. Constant speed only for small angles, but much cheaper
+ *  than r2_qf_slerp.
+ */
+static R2_ALWAYS_INLINE struct r2_qf_t r2_qf_nlerp( const struct r2_qf_t a,
+        const struct r2_qf_t b, const float t )
+{
+    float wb = r2_qf_dot( a, b ) < 0 ? -t : t;
+    float wa = 1 - t;
+    struct r2_qf_t q = { wa * a.h + wb * b.h, wa * a.i + wb * b.i,
+        wa * a.j + wb * b.j, wa * a.k + wb * b.k };
+    return r2_qf_normalize( q );
+}
+
+/*  Spherical linear interpolation from a (t = 0) to b (t = 1), along the
+ *  shorter arc, at constant angular speed.
+ */
+static R2_ALWAYS_INLINE struct r2_qf_t r2_qf_slerp( const struct r2_qf_t a,
+        const struct r2_qf_t b, const float t )
+{
+    float d = r2_qf_dot( a, b );
+    float sign = d < 0 ? -1.0f : 1.0f;
+    d = fabsf( d );
+    // sin(theta), kept away from zero so that nearly parallel inputs need
+    // no special case: the weights then tend to 1 - t and t
+    float s = r2_fastmath_sqrtf( fabsf( 1 - d * d ) ) + 1e-30f;
+    float theta = r2_fastmath_atan2f( s, d );
+    float sa, ca, sb, cb;
+    r2_fastmath_sincosf( ( 1 - t ) * theta, &sa, &ca );
+    r2_fastmath_sincosf( t * theta, &sb, &cb );
+    float inv = 1.0f / s;
+    float wa = sa * inv;
+    float wb = sign * sb * inv;
+    struct r2_qf_t q = { wa * a.h + wb * b.h, wa * a.i + wb * b.i,
+        wa * a.j + wb * b.j, wa * a.k + wb * b.k };
+    return q;
+}
+
+/*  Angle in radians, in [0, pi], of the rotation from a to b.
+ */
+static R2_ALWAYS_INLINE float r2_qf_angle( const struct r2_qf_t a,
+        const struct r2_qf_t b )
+{
+    // a* b = (dot, v); the angle is 2 atan2(|v|, |dot|), which unlike
+    // 2 acos(|dot|) stays accurate for small angles
+    float vi = a.h * b.i - a.i * b.h - a.j * b.k + a.k * b.j;
+    float vj = a.h * b.j + a.i * b.k - a.j * b.h - a.k * b.i;
+    float vk = a.h * b.k - a.i * b.j + a.j * b.i - a.k * b.h;
+    float v = r2_fastmath_sqrtf( vi * vi + vj * vj + vk * vk );
+    return 2 * r2_fastmath_atan2f( v, fabsf( r2_qf_dot( a, b ) ) );
+}
+
+// double precision
+
+static inline struct r2_qd_t r2_qd_product( const struct r2_qd_t q1,
+        const struct r2_qd_t q2 )
+{
+    struct r2_qd_t q = {
+        q1.h * q2.h - q1.i * q2.i - q1.j * q2.j - q1.k * q2.k,
+        q1.h * q2.i + q1.i * q2.h + q1.j * q2.k - q1.k * q2.j,
+        q1.h * q2.j - q1.i * q2.k + q1.j * q2.h + q1.k * q2.i,
+        q1.h * q2.k + q1.i * q2.j - q1.j * q2.i + q1.k * q2.h };
+    return q;
+}
+
+static inline double r2_qd_dot( const struct r2_qd_t q, const struct r2_qd_t p )
+{
+    return q.h * p.h + q.i * p.i + q.j * p.j + q.k * p.k;
+}
+
+static inline double r2_qd_norm( const struct r2_qd_t q )
+{
+    return sqrt( r2_qd_dot( q, q ) );
+}
+
+static inline struct r2_qd_t r2_qd_normalize( const struct r2_qd_t q )
+{
+    double n = r2_qd_norm( q );
+    double s = 1.0 / ( n > 0 ? n : 1.0 );
+    struct r2_qd_t r = { q.h * s, q.i * s, q.j * s, q.k * s };
+    return r;
+}
+
+static inline struct r2_qd_t r2_qd_conjugate( const struct r2_qd_t q )
+{
+    struct r2_qd_t r = { q.h, -q.i, -q.j, -q.k };
+    return r;
+}
+
+static inline struct r2_qd_t r2_qd_inverse( const struct r2_qd_t q )
+{
+    double n2 = r2_qd_dot( q, q );
+    double s = 1.0 / ( n2 > 0 ? n2 : 1.0 );
+    struct r2_qd_t r = { q.h * s, -q.i * s, -q.j * s, -q.k * s };
+    return r;
+}
+
+static inline struct r2_vd_t r2_qd_rotate( const struct r2_qd_t q,
+        const struct r2_vd_t v )
+{
+    double tx = 2 * ( q.j * v.z - q.k * v.y );
+    double ty = 2 * ( q.k * v.x - q.i * v.z );
+    double tz = 2 * ( q.i * v.y - q.j * v.x );
+    struct r2_vd_t r = {
+        v.x + q.h * tx + ( q.j * tz - q.k * ty ),
+        v.y + q.h * ty + ( q.k * tx - q.i * tz ),
+        v.z + q.h * tz + ( q.i * ty - q.j * tx ) };
+    return r;
+}
+
+static inline void r2_qd_to_matrix( const struct r2_qd_t q, double m[9] )
+{
+    double ii = q.i * q.i, jj = q.j * q.j, kk = q.k * q.k;
+    double ij = q.i * q.j, ik = q.i * q.k, jk = q.j * q.k;
+    double hi = q.h * q.i, hj = q.h * q.j, hk = q.h * q.k;
+    m[0] = 1 - 2 * ( jj + kk );
+    m[1] = 2 * ( ij - hk );
+    m[2] = 2 * ( ik + hj );
+    m[3] = 2 * ( ij + hk );
+    m[4] = 1 - 2 * ( ii + kk );
+    m[5] = 2 * ( jk - hi );
+    m[6] = 2 * ( ik - hj );
+    m[7] = 2 * ( jk + hi );
+    m[8] = 1 - 2 * ( ii + jj );
+}
+
+static inline struct r2_qd_t r2_qd_from_matrix( const double m[9] )
+{
+    double th = 1 + m[0] + m[4] + m[8];
+    double ti = 1 + m[0] - m[4] - m[8];
+    double tj = 1 - m[0] + m[4] - m[8];
+    double tk = 1 - m[0] - m[4] + m[8];
+    double hi = m[7] - m[5], hj = m[2] - m[6], hk = m[3] - m[1];
+    double ij = m[1] + m[3], ik = m[2] + m[6], jk = m[5] + m[7];
+    int ui = ti > th;
+    double t = ui ? ti : th;
+    double h = ui ? hi : th, i = ui ? ti : hi;
+    double j = ui ? ij : hj, k = ui ? ik : hk;
+    int uj = tj > t;
+    t = uj ? tj : t;
+    h = uj ? hj : h; i = uj ? ij : i; j = uj ? tj : j; k = uj ? jk : k;
+    int uk = tk > t;
+    t = uk ? tk : t;
+    h = uk ? hk : h; i = uk ? ik : i; j = uk ? jk : j; k = uk ? tk : k;
+    double s = 0.5 / sqrt( t );
+    s = h < 0 ? -s : s;
+    struct r2_qd_t q = { h * s, i * s, j * s, k * s };
+    return q;
+}
+
+static inline struct r2_qd_t r2_qd_nlerp( const struct r2_qd_t a,
+        const struct r2_qd_t b, const double t )
+{
+    double wb = r2_qd_dot( a, b ) < 0 ? -t : t;
+    double wa = 1 - t;
+    struct r2_qd_t q = { wa * a.h + wb * b.h, wa * a.i + wb * b.i,
+        wa * a.j + wb * b.j, wa * a.k + wb * b.k };
+    return r2_qd_normalize( q );
+}
+
+static inline struct r2_qd_t r2_qd_slerp( const struct r2_qd_t a,
+        const struct r2_qd_t b, const double t )
+{
+    double d = r2_qd_dot( a, b );
+    double sign = d < 0 ? -1.0 : 1.0;
+    d = fabs( d );
+    double s = sqrt( fabs( 1 - d * d ) );
+    double theta = atan2( s, d );
+    int near = s < 1e-8;
+    double inv = 1.0 / ( near ? 1.0 : s );
+    double wa = near ? 1 - t : sin( ( 1 - t ) * theta ) * inv;
+    double wb = sign * ( near ? t : sin( t * theta ) * inv );
+    struct r2_qd_t q = { wa * a.h + wb * b.h, wa * a.i + wb * b.i,
+        wa * a.j + wb * b.j, wa * a.k + wb * b.k };
+    return q;
+}
+
+static inline double r2_qd_angle( const struct r2_qd_t a,
+        const struct r2_qd_t b )
+{
+    double vi = a.h * b.i - a.i * b.h - a.j * b.k + a.k * b.j;
+    double vj = a.h * b.j + a.i * b.k - a.j * b.h - a.k * b.i;
+    double vk = a.h * b.k - a.i * b.j + a.j * b.i - a.k * b.h;
+    return 2 * atan2( sqrt( vi * vi + vj * vj + vk * vk ),
+            fabs( r2_qd_dot( a, b ) ) );
+}
+
+static inline struct r2_qd_t r2_qf_to_qd( const struct r2_qf_t q )
+{
+    struct r2_qd_t r = { q.h, q.i, q.j, q.k };
+    return r;
+}
+
+static inline struct r2_qf_t r2_qd_to_qf( const struct r2_qd_t q )
+{
+    struct r2_qf_t r = { (float)q.h, (float)q.i, (float)q.j, (float)q.k };
+    return r;
+}
+
+#endif // R2_QUATERNION_ALGEBRA_I
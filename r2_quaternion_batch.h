@@ -0,0 +1,368 @@
+// r2_quaternion_batch.h
+// Convert arrays of quaternions to and from nautical angles
+//
+// Same conventions as r2_nf_to_qf and r2_qf_to_nf in r2_quaternion.h, but
+// computed in single precision with the approximations in r2_fastmath.h
+// (see there for error bounds), so that the loops vectorize. Each kernel
+// is compiled for AVX-512, AVX2 and baseline x86-64 and chosen at run time
+// (see R2_TARGET_CLONES); on AArch64 the baseline build uses NEON.
+//
+// Both structure-of-arrays (separate h, i, j, k arrays) and array-of-
+// structs (struct r2_qf_t, struct r2_nf_t) forms are provided; the AoS
+// forms transpose blocks of R2_FASTMATH_BLOCK elements through the stack
+// and run the SoA kernel on them. Output arrays must not overlap inputs.
+
+#ifndef R2_QUATERNION_BATCH_H
+#define R2_QUATERNION_BATCH_H
+
+#include <inttypes.h> // for int64_t
+#include <stddef.h> // for size_t
+
+#include "r2_fastmath.h"
+#include "r2_quaternion.h"
+#include "r2_quaternion_algebra.h"
+
+void r2_nf_to_qf_soa( const float * restrict roll,
+        const float * restrict pitch, const float * restrict yaw,
+        float * restrict h, float * restrict i, float * restrict j,
+        float * restrict k, const size_t n );
+
+void r2_qf_to_nf_soa( const float * restrict h, const float * restrict i,
+        const float * restrict j, const float * restrict k,
+        float * restrict roll, float * restrict pitch, float * restrict yaw,
+        const size_t n );
+
+void r2_nf_to_qf_n( const struct r2_nf_t * restrict nf,
+        struct r2_qf_t * restrict qf, const size_t n );
+
+void r2_qf_to_nf_n( const struct r2_qf_t * restrict qf,
+        struct r2_nf_t * restrict nf, const size_t n );
+
+/*  Scale quaternions to unit length in place (zero stays zero).
+ */
+void r2_qf_normalize_soa( float * restrict h, float * restrict i,
+        float * restrict j, float * restrict k, const size_t n );
+
+/*  Compose quaternions with fixed rotations in place: q = l * q * r
+ *  (as r2_qf_product). Pass the identity { 1, 0, 0, 0 } for either side
+ *  that is not needed.
+ */
+void r2_qf_compose_soa( const struct r2_qf_t l, float * restrict h,
+        float * restrict i, float * restrict j, float * restrict k,
+        const struct r2_qf_t r, const size_t n );
+
+/*  Rotate the vectors (x, y, z) by q in place.
+ */
+void r2_qf_rotate_soa( const struct r2_qf_t q, float * restrict x,
+        float * restrict y, float * restrict z, const size_t n );
+
+/*  Resample an attitude series onto other timestamps.
+ *
+ *  q[0..n) are attitudes at increasing times usec[0..n); out[m] is set to
+ *  the attitude at query time at[m], for m in [0, nat), interpolated with
+ *  r2_qf_slerp if slerp is non-zero, otherwise with the cheaper
+ *  r2_qf_nlerp. The query times must be non-decreasing too, so both arrays
+ *  are walked once, merged; queries outside the series get its first or
+ *  last attitude.
+ *
+ *  Returns 0, or -1 if the series is empty.
+ */
+int r2_qf_interpolate_n( const int64_t * usec, const struct r2_qf_t * q,
+        const size_t n, const int64_t * at, struct r2_qf_t * restrict out,
+        const size_t nat, const int slerp );
+
+#endif // R2_QUATERNION_BATCH_H
+
+#ifndef R2_QUATERNION_BATCH_I
+#define R2_QUATERNION_BATCH_I
+
+static R2_ALWAYS_INLINE void r2_nf_to_qf_block( const float * restrict roll,
+        const float * restrict pitch, const float * restrict yaw,
+        float * restrict h, float * restrict i, float * restrict j,
+        float * restrict k, const size_t n )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        float sy, cy, sp, cp, sr, cr;
+        r2_fastmath_sincosf( yaw[m] * 0.5f, &sy, &cy );
+        r2_fastmath_sincosf( pitch[m] * 0.5f, &sp, &cp );
+        r2_fastmath_sincosf( roll[m] * 0.5f, &sr, &cr );
+        h[m] = cr * cp * cy + sr * sp * sy;
+        i[m] = sr * cp * cy - cr * sp * sy;
+        j[m] = cr * sp * cy + sr * cp * sy;
+        k[m] = cr * cp * sy - sr * sp * cy;
+    }
+}
+
+static R2_ALWAYS_INLINE void r2_qf_to_nf_block( const float * restrict h,
+        const float * restrict i, const float * restrict j,
+        const float * restrict k, float * restrict roll,
+        float * restrict pitch, float * restrict yaw, const size_t n )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        float sr_cp = 2 * ( h[m] * i[m] + j[m] * k[m] );
+        float cr_cp = 1 - 2 * ( i[m] * i[m] + j[m] * j[m] );
+        float sp = 2 * ( h[m] * j[m] - k[m] * i[m] );
+        float sy_cp = 2 * ( h[m] * k[m] + i[m] * j[m] );
+        float cy_cp = 1 - 2 * ( j[m] * j[m] + k[m] * k[m] );
+        // asin(sp) as atan2 against cos(pitch) recovered from the roll
+        // terms: never outside the domain, so no clamp (and no branch)
+        float cp = r2_fastmath_sqrtf( sr_cp * sr_cp + cr_cp * cr_cp );
+        roll[m] = r2_fastmath_atan2f( sr_cp, cr_cp );
+        pitch[m] = r2_fastmath_atan2f( sp, cp );
+        yaw[m] = r2_fastmath_atan2f( sy_cp, cy_cp );
+    }
+}
+
+R2_TARGET_CLONES
+void r2_nf_to_qf_soa( const float * restrict roll,
+        const float * restrict pitch, const float * restrict yaw,
+        float * restrict h, float * restrict i, float * restrict j,
+        float * restrict k, const size_t n )
+{
+    size_t b;
+    for( b = 0; b + R2_FASTMATH_BLOCK <= n; b += R2_FASTMATH_BLOCK )
+        r2_nf_to_qf_block( roll + b, pitch + b, yaw + b,
+                h + b, i + b, j + b, k + b, R2_FASTMATH_BLOCK );
+    r2_nf_to_qf_block( roll + b, pitch + b, yaw + b,
+            h + b, i + b, j + b, k + b, n - b );
+}
+
+R2_TARGET_CLONES
+void r2_qf_to_nf_soa( const float * restrict h, const float * restrict i,
+        const float * restrict j, const float * restrict k,
+        float * restrict roll, float * restrict pitch, float * restrict yaw,
+        const size_t n )
+{
+    size_t b;
+    for( b = 0; b + R2_FASTMATH_BLOCK <= n; b += R2_FASTMATH_BLOCK )
+        r2_qf_to_nf_block( h + b, i + b, j + b, k + b,
+                roll + b, pitch + b, yaw + b, R2_FASTMATH_BLOCK );
+    r2_qf_to_nf_block( h + b, i + b, j + b, k + b,
+            roll + b, pitch + b, yaw + b, n - b );
+}
+
+R2_TARGET_CLONES
+void r2_nf_to_qf_n( const struct r2_nf_t * restrict nf,
+        struct r2_qf_t * restrict qf, const size_t n )
+{
+    float r[R2_FASTMATH_BLOCK], p[R2_FASTMATH_BLOCK], y[R2_FASTMATH_BLOCK];
+    float h[R2_FASTMATH_BLOCK], i[R2_FASTMATH_BLOCK];
+    float j[R2_FASTMATH_BLOCK], k[R2_FASTMATH_BLOCK];
+    size_t b, m;
+    for( b = 0; b < n; b += R2_FASTMATH_BLOCK ) {
+        size_t len = n - b < R2_FASTMATH_BLOCK ? n - b : R2_FASTMATH_BLOCK;
+        for( m = 0; m < len; m++ ) {
+            r[m] = nf[b + m].roll;
+            p[m] = nf[b + m].pitch;
+            y[m] = nf[b + m].yaw;
+        }
+        if( R2_FASTMATH_BLOCK == len )
+            r2_nf_to_qf_block( r, p, y, h, i, j, k, R2_FASTMATH_BLOCK );
+        else
+            r2_nf_to_qf_block( r, p, y, h, i, j, k, len );
+        for( m = 0; m < len; m++ ) {
+            qf[b + m].h = h[m];
+            qf[b + m].i = i[m];
+            qf[b + m].j = j[m];
+            qf[b + m].k = k[m];
+        }
+    }
+}
+
+R2_TARGET_CLONES
+void r2_qf_to_nf_n( const struct r2_qf_t * restrict qf,
+        struct r2_nf_t * restrict nf, const size_t n )
+{
+    float h[R2_FASTMATH_BLOCK], i[R2_FASTMATH_BLOCK];
+    float j[R2_FASTMATH_BLOCK], k[R2_FASTMATH_BLOCK];
+    float r[R2_FASTMATH_BLOCK], p[R2_FASTMATH_BLOCK], y[R2_FASTMATH_BLOCK];
+    size_t b, m;
+    for( b = 0; b < n; b += R2_FASTMATH_BLOCK ) {
+        size_t len = n - b < R2_FASTMATH_BLOCK ? n - b : R2_FASTMATH_BLOCK;
+        for( m = 0; m < len; m++ ) {
+            h[m] = qf[b + m].h;
+            i[m] = qf[b + m].i;
+            j[m] = qf[b + m].j;
+            k[m] = qf[b + m].k;
+        }
+        if( R2_FASTMATH_BLOCK == len )
+            r2_qf_to_nf_block( h, i, j, k, r, p, y, R2_FASTMATH_BLOCK );
+        else
+            r2_qf_to_nf_block( h, i, j, k, r, p, y, len );
+        for( m = 0; m < len; m++ ) {
+            nf[b + m].roll = r[m];
+            nf[b + m].pitch = p[m];
+            nf[b + m].yaw = y[m];
+        }
+    }
+}
+
+static R2_ALWAYS_INLINE void r2_qf_normalize_block( float * restrict h,
+        float * restrict i, float * restrict j, float * restrict k,
+        const size_t n )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        float s = r2_fastmath_rsqrtf( h[m] * h[m] + i[m] * i[m]
+                + j[m] * j[m] + k[m] * k[m] );
+        h[m] *= s;
+        i[m] *= s;
+        j[m] *= s;
+        k[m] *= s;
+    }
+}
+
+static R2_ALWAYS_INLINE void r2_qf_compose_block( const struct r2_qf_t l,
+        float * restrict h, float * restrict i, float * restrict j,
+        float * restrict k, const struct r2_qf_t r, const size_t n )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        // t = l * q
+        float th = l.h * h[m] - l.i * i[m] - l.j * j[m] - l.k * k[m];
+        float ti = l.h * i[m] + l.i * h[m] + l.j * k[m] - l.k * j[m];
+        float tj = l.h * j[m] - l.i * k[m] + l.j * h[m] + l.k * i[m];
+        float tk = l.h * k[m] + l.i * j[m] - l.j * i[m] + l.k * h[m];
+        // q = t * r
+        h[m] = th * r.h - ti * r.i - tj * r.j - tk * r.k;
+        i[m] = th * r.i + ti * r.h + tj * r.k - tk * r.j;
+        j[m] = th * r.j - ti * r.k + tj * r.h + tk * r.i;
+        k[m] = th * r.k + ti * r.j - tj * r.i + tk * r.h;
+    }
+}
+
+R2_TARGET_CLONES
+void r2_qf_normalize_soa( float * restrict h, float * restrict i,
+        float * restrict j, float * restrict k, const size_t n )
+{
+    size_t b;
+    for( b = 0; b + R2_FASTMATH_BLOCK <= n; b += R2_FASTMATH_BLOCK )
+        r2_qf_normalize_block( h + b, i + b, j + b, k + b, R2_FASTMATH_BLOCK );
+    r2_qf_normalize_block( h + b, i + b, j + b, k + b, n - b );
+}
+
+R2_TARGET_CLONES
+void r2_qf_compose_soa( const struct r2_qf_t l, float * restrict h,
+        float * restrict i, float * restrict j, float * restrict k,
+        const struct r2_qf_t r, const size_t n )
+{
+    size_t b;
+    for( b = 0; b + R2_FASTMATH_BLOCK <= n; b += R2_FASTMATH_BLOCK )
+        r2_qf_compose_block( l, h + b, i + b, j + b, k + b, r,
+                R2_FASTMATH_BLOCK );
+    r2_qf_compose_block( l, h + b, i + b, j + b, k + b, r, n - b );
+}
+
+static R2_ALWAYS_INLINE void r2_qf_rotate_block( const struct r2_qf_t q,
+        float * restrict x, float * restrict y, float * restrict z,
+        const size_t n )
+{
+    size_t m;
+    for( m = 0; m < n; m++ ) {
+        struct r2_vf_t v = { x[m], y[m], z[m] };
+        v = r2_qf_rotate( q, v );
+        x[m] = v.x;
+        y[m] = v.y;
+        z[m] = v.z;
+    }
+}
+
+R2_TARGET_CLONES
+void r2_qf_rotate_soa( const struct r2_qf_t q, float * restrict x,
+        float * restrict y, float * restrict z, const size_t n )
+{
+    size_t b;
+    for( b = 0; b + R2_FASTMATH_BLOCK <= n; b += R2_FASTMATH_BLOCK )
+        r2_qf_rotate_block( q, x + b, y + b, z + b, R2_FASTMATH_BLOCK );
+    r2_qf_rotate_block( q, x + b, y + b, z + b, n - b );
+}
+
+// Interpolate a block of quaternion pairs (a, b) at fractions w. The h,
+// i, j and k components of a, b and out are each a run of
+// R2_FASTMATH_BLOCK floats, one after the other.
+static R2_ALWAYS_INLINE void r2_qf_interpolate_block( const float * restrict a,
+        const float * restrict b, const float * restrict w,
+        float * restrict out, const int slerp )
+{
+    const size_t s = R2_FASTMATH_BLOCK;
+    size_t m;
+    if( slerp ) {
+        for( m = 0; m < s; m++ ) {
+            struct r2_qf_t qa = { a[m], a[s + m], a[2 * s + m],
+                a[3 * s + m] };
+            struct r2_qf_t qb = { b[m], b[s + m], b[2 * s + m],
+                b[3 * s + m] };
+            struct r2_qf_t q = r2_qf_slerp( qa, qb, w[m] );
+            out[m] = q.h;
+            out[s + m] = q.i;
+            out[2 * s + m] = q.j;
+            out[3 * s + m] = q.k;
+        }
+    } else {
+        for( m = 0; m < s; m++ ) {
+            struct r2_qf_t qa = { a[m], a[s + m], a[2 * s + m],
+                a[3 * s + m] };
+            struct r2_qf_t qb = { b[m], b[s + m], b[2 * s + m],
+                b[3 * s + m] };
+            struct r2_qf_t q = r2_qf_nlerp( qa, qb, w[m] );
+            out[m] = q.h;
+            out[s + m] = q.i;
+            out[2 * s + m] = q.j;
+            out[3 * s + m] = q.k;
+        }
+    }
+}
+
+R2_TARGET_CLONES
+int r2_qf_interpolate_n( const int64_t * usec, const struct r2_qf_t * q,
+        const size_t n, const int64_t * at, struct r2_qf_t * restrict out,
+        const size_t nat, const int slerp )
+{
+    if( 0 == n )
+        return -1;
+
+    // the merged walk (scalar, integer) gathers each query's bracketing
+    // pair and fraction into a block; the interpolation itself then runs
+    // vectorized over the block
+    // h, i, j and k blocks one after the other, as r2_qf_interpolate_block
+    // reads them
+    const size_t s = R2_FASTMATH_BLOCK;
+    float a[4 * R2_FASTMATH_BLOCK], b[4 * R2_FASTMATH_BLOCK];
+    float w[R2_FASTMATH_BLOCK], r[4 * R2_FASTMATH_BLOCK];
+    size_t idx = 0, base, m;
+    for( base = 0; base < nat; base += R2_FASTMATH_BLOCK ) {
+        size_t len = nat - base < R2_FASTMATH_BLOCK ? nat - base
+            : R2_FASTMATH_BLOCK;
+        for( m = 0; m < R2_FASTMATH_BLOCK; m++ ) {
+            // pad a partial last block by repeating its last query
+            int64_t t = at[base + ( m < len ? m : len - 1 )];
+            while( ( idx + 1 < n ) && ( usec[idx + 1] <= t ) )
+                idx++;
+            size_t next = idx + 1 < n ? idx + 1 : idx;
+            int64_t span = usec[next] - usec[idx];
+            float f = span > 0
+                ? (float)( (double)( t - usec[idx] ) / (double)span ) : 0;
+            w[m] = f < 0 ? 0 : f; // before the first sample
+            a[m] = q[idx].h;
+            a[s + m] = q[idx].i;
+            a[2 * s + m] = q[idx].j;
+            a[3 * s + m] = q[idx].k;
+            b[m] = q[next].h;
+            b[s + m] = q[next].i;
+            b[2 * s + m] = q[next].j;
+            b[3 * s + m] = q[next].k;
+        }
+        r2_qf_interpolate_block( a, b, w, r, slerp );
+        for( m = 0; m < len; m++ ) {
+            out[base + m].h = r[m];
+            out[base + m].i = r[s + m];
+            out[base + m].j = r[2 * s + m];
+            out[base + m].k = r[3 * s + m];
+        }
+    }
+    return 0;
+}
+
+#endif // R2_QUATERNION_BATCH_I
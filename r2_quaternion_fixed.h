@@ -0,0 +1,498 @@
+// r2_quaternion_fixed.h
+// Fixed-point quaternions and nautical angles, for targets without an FPU
+//
+// Quaternion components are Q1.31 (struct r2_qq31_t) or Q1.15
+// (struct r2_qq15_t) fractions. Angles are binary angles: a full turn is
+// 2^32 (or 2^16), so that the signed range is [-pi, pi) and wraps around
+// naturally, e.g. 0x40000000 is pi/2 in a struct r2_nq31_t.
+//
+// Everything is computed with integer arithmetic only, with rounding and
+// shifts of negative numbers spelled out, so results are bit-identical on
+// every platform and compiler. Trigonometry uses CORDIC by default; define
+// R2_FIXED_SINCOS_TABLE to compute sines and cosines from a 257-entry
+// quarter-wave table (1 KiB) with a short correction instead, which is
+// faster and about as accurate. The Q15 functions go through the Q31 ones
+// and round their results.
+//
+// Accuracy: Q31 results are within a few units in the last place of the
+// exact values (about 1e-8 for components, 1e-8 rad for angles).
+
+#ifndef R2_QUATERNION_FIXED_H
+#define R2_QUATERNION_FIXED_H
+
+#include <inttypes.h> // for int16_t, int32_t, int64_t, uint32_t
+#include <math.h> // for floor, M_PI (floating point conversions only)
+#include <stddef.h> // for NULL
+
+#include "r2_quaternion.h"
+
+// Quaternion q = q.h + q.i i + q.j j + q.k k, components in Q1.31
+struct r2_qq31_t {
+    int32_t h;
+    int32_t i;
+    int32_t j;
+    int32_t k;
+};
+
+// Components in Q1.15
+struct r2_qq15_t {
+    int16_t h;
+    int16_t i;
+    int16_t j;
+    int16_t k;
+};
+
+// Nautical angles as binary angles, 2^32 per turn
+struct r2_nq31_t {
+    int32_t roll;
+    int32_t pitch;
+    int32_t yaw;
+};
+
+// Nautical angles as binary angles, 2^16 per turn
+struct r2_nq15_t {
+    int16_t roll;
+    int16_t pitch;
+    int16_t yaw;
+};
+
+/*  Product of two Q1.31 numbers, rounded (-1 * -1 saturates).
+ */
+int32_t r2_q31_mul( const int32_t a, const int32_t b );
+
+/*  Sine and cosine, in Q1.31, of a binary angle (2^32 per turn).
+ */
+void r2_q31_sincos( const int32_t angle, int32_t * s, int32_t * c );
+
+/*  Four-quadrant arctangent of y / x as a binary angle (2^32 per turn);
+ *  x and y may have any common scale.
+ */
+int32_t r2_q31_atan2( const int64_t y, const int64_t x );
+
+struct r2_qq31_t r2_nq31_to_qq31( const struct r2_nq31_t n );
+
+struct r2_nq31_t r2_qq31_to_nq31( const struct r2_qq31_t q );
+
+/*  Product of quaternions as r2_qf_product, rounded to Q1.31.
+ */
+struct r2_qq31_t r2_qq31_product( const struct r2_qq31_t q1,
+        const struct r2_qq31_t q2 );
+
+struct r2_qq15_t r2_nq15_to_qq15( const struct r2_nq15_t n );
+
+struct r2_nq15_t r2_qq15_to_nq15( const struct r2_qq15_t q );
+
+struct r2_qq15_t r2_qq15_product( const struct r2_qq15_t q1,
+        const struct r2_qq15_t q2 );
+
+/*  Conversions to and from floating point, e.g. for the host side of a
+ *  link to a fixed-point target (these are not bit-identical).
+ */
+struct r2_qf_t r2_qq31_to_qf( const struct r2_qq31_t q );
+
+struct r2_qq31_t r2_qf_to_qq31( const struct r2_qf_t q );
+
+struct r2_nf_t r2_nq31_to_nf( const struct r2_nq31_t n );
+
+struct r2_nq31_t r2_nf_to_nq31( const struct r2_nf_t n );
+
+#endif // R2_QUATERNION_FIXED_H
+
+#ifndef R2_QUATERNION_FIXED_I
+#define R2_QUATERNION_FIXED_I
+
+// Arithmetic (flooring) right shift, which C leaves implementation-defined
+// for negative numbers.
+int64_t r2_fixed_asr( const int64_t x, const int n )
+{
+    return x >= 0 ? x >> n : ~( ~x >> n );
+}
+
+// Round a fixed-point number to n fewer fractional bits.
+int64_t r2_fixed_round( const int64_t x, const int n )
+{
+    return r2_fixed_asr( x + ( (int64_t)1 << ( n - 1 ) ), n );
+}
+
+int32_t r2_fixed_sat31( const int64_t x )
+{
+    return x > INT32_MAX ? INT32_MAX : ( x < INT32_MIN ? INT32_MIN
+            : (int32_t)x );
+}
+
+int16_t r2_fixed_sat15( const int64_t x )
+{
+    return x > INT16_MAX ? INT16_MAX : ( x < INT16_MIN ? INT16_MIN
+            : (int16_t)x );
+}
+
+// Reinterpret a binary angle computed modulo 2^32 as signed.
+int32_t r2_fixed_angle( const uint32_t u )
+{
+    return u <= INT32_MAX ? (int32_t)u : -(int32_t)( ~u ) - 1;
+}
+
+// CORDIC: atan(2^-i) as binary angles, and the gain of 31 iterations in
+// Q24.40
+const uint32_t r2_fixed_atan_table[31] = {
+    536870912, 316933406, 167458907, 85004756, 42667331, 21354465,
+    10679838, 5340245, 2670163, 1335087, 667544, 333772, 166886, 83443,
+    41722, 20861, 10430, 5215, 2608, 1304, 652, 326, 163, 81, 41, 20, 10, 5,
+    3, 1, 1 };
+#define R2_FIXED_CORDIC_GAIN_Q40 ( (int64_t)667681663043 )
+
+int32_t r2_q31_mul( const int32_t a, const int32_t b )
+{
+    return r2_fixed_sat31( r2_fixed_round( (int64_t)a * b, 31 ) );
+}
+
+#if defined( R2_FIXED_SINCOS_TABLE )
+
+// sin(k pi / 512) in Q1.31, k = 0 .. 256
+const uint32_t r2_fixed_sin_table[257] = {
+    0, 13176712, 26352928, 39528151, 52701887,
+    65873638, 79042909, 92209205, 105372028, 118530885,
+    131685278, 144834714, 157978697, 171116733, 184248325,
+    197372981, 210490206, 223599506, 236700388, 249792358,
+    262874923, 275947592, 289009871, 302061269, 315101295,
+    328129457, 341145265, 354148230, 367137861, 380113669,
+    393075166, 406021865, 418953276, 431868915, 444768294,
+    457650927, 470516330, 483364019, 496193509, 509004318,
+    521795963, 534567963, 547319836, 560051104, 572761285,
+    585449903, 598116479, 610760536, 623381598, 635979190,
+    648552838, 661102068, 673626408, 686125387, 698598533,
+    711045377, 723465451, 735858287, 748223418, 760560380,
+    772868706, 785147934, 797397602, 809617249, 821806413,
+    833964638, 846091463, 858186435, 870249095, 882278992,
+    894275671, 906238681, 918167572, 930061894, 941921200,
+    953745043, 965532978, 977284562, 988999351, 1000676905,
+    1012316784, 1023918550, 1035481766, 1047005996, 1058490808,
+    1069935768, 1081340445, 1092704411, 1104027237, 1115308496,
+    1126547765, 1137744621, 1148898640, 1160009405, 1171076495,
+    1182099496, 1193077991, 1204011567, 1214899813, 1225742318,
+    1236538675, 1247288478, 1257991320, 1268646800, 1279254516,
+    1289814068, 1300325060, 1310787095, 1321199781, 1331562723,
+    1341875533, 1352137822, 1362349204, 1372509294, 1382617710,
+    1392674072, 1402678000, 1412629117, 1422527051, 1432371426,
+    1442161874, 1451898025, 1461579514, 1471205974, 1480777044,
+    1490292364, 1499751576, 1509154322, 1518500250, 1527789007,
+    1537020244, 1546193612, 1555308768, 1564365367, 1573363068,
+    1582301533, 1591180426, 1599999411, 1608758157, 1617456335,
+    1626093616, 1634669676, 1643184191, 1651636841, 1660027308,
+    1668355276, 1676620432, 1684822463, 1692961062, 1701035922,
+    1709046739, 1716993211, 1724875040, 1732691928, 1740443581,
+    1748129707, 1755750017, 1763304224, 1770792044, 1778213194,
+    1785567396, 1792854372, 1800073849, 1807225553, 1814309216,
+    1821324572, 1828271356, 1835149306, 1841958164, 1848697674,
+    1855367581, 1861967634, 1868497586, 1874957189, 1881346202,
+    1887664383, 1893911494, 1900087301, 1906191570, 1912224073,
+    1918184581, 1924072871, 1929888720, 1935631910, 1941302225,
+    1946899451, 1952423377, 1957873796, 1963250501, 1968553292,
+    1973781967, 1978936331, 1984016189, 1989021350, 1993951625,
+    1998806829, 2003586779, 2008291295, 2012920201, 2017473321,
+    2021950484, 2026351522, 2030676269, 2034924562, 2039096241,
+    2043191150, 2047209133, 2051150040, 2055013723, 2058800036,
+    2062508835, 2066139983, 2069693342, 2073168777, 2076566160,
+    2079885360, 2083126254, 2086288720, 2089372638, 2092377892,
+    2095304370, 2098151960, 2100920556, 2103610054, 2106220352,
+    2108751352, 2111202959, 2113575080, 2115867626, 2118080511,
+    2120213651, 2122266967, 2124240380, 2126133817, 2127947206,
+    2129680480, 2131333572, 2132906420, 2134398966, 2135811153,
+    2137142927, 2138394240, 2139565043, 2140655293, 2141664948,
+    2142593971, 2143442326, 2144209982, 2144896910, 2145503083,
+    2146028480, 2146473080, 2146836866, 2147119825, 2147321946,
+    2147443222, 2147483648 };
+
+void r2_q31_sincos( const int32_t angle, int32_t * s, int32_t * c )
+{
+    uint32_t u = (uint32_t)angle;
+    uint32_t quadrant = u >> 30;
+    uint32_t index = ( u >> 22 ) & 0xff;
+    // the rest, d < pi / 512, in Q1.31 radians (pi in Q8.24 is 52707179)
+    int64_t d = ( (int64_t)( u & 0x3fffff ) * 52707179 ) >> 24;
+    int64_t d2 = ( d * d ) >> 31;
+    int64_t cd = ( (int64_t)1 << 31 ) - ( d2 >> 1 ); // cos d
+    int64_t sd = d - ( ( d2 * d ) >> 31 ) / 6; // sin d
+    int64_t sa = r2_fixed_sin_table[index];
+    int64_t ca = r2_fixed_sin_table[256 - index];
+    int64_t sv = r2_fixed_round( sa * cd + ca * sd, 31 );
+    int64_t cv = r2_fixed_round( ca * cd - sa * sd, 31 );
+    switch( quadrant ) {
+        case 0: *s = r2_fixed_sat31( sv ); *c = r2_fixed_sat31( cv ); break;
+        case 1: *s = r2_fixed_sat31( cv ); *c = r2_fixed_sat31( -sv ); break;
+        case 2: *s = r2_fixed_sat31( -sv ); *c = r2_fixed_sat31( -cv ); break;
+        default: *s = r2_fixed_sat31( -cv ); *c = r2_fixed_sat31( sv ); break;
+    }
+}
+
+#else
+
+void r2_q31_sincos( const int32_t angle, int32_t * s, int32_t * c )
+{
+    // nearest quarter turn, and the rest in [-pi/4, pi/4)
+    uint32_t u = (uint32_t)angle;
+    uint32_t quadrant = ( u + 0x20000000 ) >> 30;
+    int64_t z = r2_fixed_angle( u - ( quadrant << 30 ) );
+    int64_t x = R2_FIXED_CORDIC_GAIN_Q40;
+    int64_t y = 0;
+    int i;
+    for( i = 0; i < 31; i++ ) {
+        int64_t dx = r2_fixed_asr( y, i );
+        int64_t dy = r2_fixed_asr( x, i );
+        if( z >= 0 ) {
+            x -= dx;
+            y += dy;
+            z -= r2_fixed_atan_table[i];
+        } else {
+            x += dx;
+            y -= dy;
+            z += r2_fixed_atan_table[i];
+        }
+    }
+    x = r2_fixed_round( x, 9 );
+    y = r2_fixed_round( y, 9 );
+    switch( quadrant & 3 ) {
+        case 0: *s = r2_fixed_sat31( y ); *c = r2_fixed_sat31( x ); break;
+        case 1: *s = r2_fixed_sat31( x ); *c = r2_fixed_sat31( -y ); break;
+        case 2: *s = r2_fixed_sat31( -y ); *c = r2_fixed_sat31( -x ); break;
+        default: *s = r2_fixed_sat31( -x ); *c = r2_fixed_sat31( y ); break;
+    }
+}
+
+#endif // R2_FIXED_SINCOS_TABLE
+
+// CORDIC vectoring: the binary angle of (x, y), and its length in the
+// units of x and y if mag is not NULL. |x| and |y| must be below 2^61.
+int32_t r2_fixed_vector( int64_t y, int64_t x, int64_t * mag )
+{
+    int64_t ax = x < 0 ? -x : x;
+    int64_t ay = y < 0 ? -y : y;
+    int64_t m = ax > ay ? ax : ay;
+    if( 0 == m ) {
+        if( mag )
+            *mag = 0;
+        return 0;
+    }
+    // scale to [2^40, 2^41) for full precision without overflow
+    int shift = 0;
+    while( m >= (int64_t)1 << 41 ) {
+        m >>= 1;
+        shift++;
+    }
+    while( m < (int64_t)1 << 40 ) {
+        m <<= 1;
+        shift--;
+    }
+    if( shift > 0 ) {
+        x = r2_fixed_asr( x, shift );
+        y = r2_fixed_asr( y, shift );
+    } else {
+        x *= (int64_t)1 << -shift;
+        y *= (int64_t)1 << -shift;
+    }
+
+    uint32_t angle = 0;
+    if( x < 0 ) { // rotate by pi into the right half plane
+        angle = 0x80000000u;
+        x = -x;
+        y = -y;
+    }
+    int64_t z = 0;
+    int i;
+    for( i = 0; i < 31; i++ ) {
+        int64_t dx = r2_fixed_asr( y, i );
+        int64_t dy = r2_fixed_asr( x, i );
+        if( y > 0 ) {
+            x += dx;
+            y -= dy;
+            z += r2_fixed_atan_table[i];
+        } else {
+            x -= dx;
+            y += dy;
+            z -= r2_fixed_atan_table[i];
+        }
+    }
+    if( mag ) {
+        // x is now the length divided by the CORDIC gain, below 2^42; the
+        // gain is split in two so the products fit in 64 bits
+        const int64_t khi = R2_FIXED_CORDIC_GAIN_Q40 >> 20;
+        const int64_t klo = R2_FIXED_CORDIC_GAIN_Q40 & 0xfffff;
+        int64_t length = r2_fixed_round( x * khi + ( ( x * klo ) >> 20 ),
+                20 );
+        if( shift > 0 )
+            *mag = length * ( (int64_t)1 << shift );
+        else if( shift < 0 )
+            *mag = r2_fixed_round( length, -shift );
+        else
+            *mag = length;
+    }
+    return r2_fixed_angle( angle + (uint32_t)z );
+}
+
+int32_t r2_q31_atan2( const int64_t y, const int64_t x )
+{
+    return r2_fixed_vector( y, x, NULL );
+}
+
+struct r2_qq31_t r2_nq31_to_qq31( const struct r2_nq31_t n )
+{
+    int32_t cy, sy, cp, sp, cr, sr;
+    r2_q31_sincos( (int32_t)r2_fixed_asr( n.yaw, 1 ), &sy, &cy );
+    r2_q31_sincos( (int32_t)r2_fixed_asr( n.pitch, 1 ), &sp, &cp );
+    r2_q31_sincos( (int32_t)r2_fixed_asr( n.roll, 1 ), &sr, &cr );
+
+    int64_t cc = r2_fixed_round( (int64_t)cr * cp, 31 );
+    int64_t ss = r2_fixed_round( (int64_t)sr * sp, 31 );
+    int64_t sc = r2_fixed_round( (int64_t)sr * cp, 31 );
+    int64_t cs = r2_fixed_round( (int64_t)cr * sp, 31 );
+    struct r2_qq31_t q;
+    q.h = r2_fixed_sat31( r2_fixed_round( cc * cy + ss * sy, 31 ) );
+    q.i = r2_fixed_sat31( r2_fixed_round( sc * cy - cs * sy, 31 ) );
+    q.j = r2_fixed_sat31( r2_fixed_round( cs * cy + sc * sy, 31 ) );
+    q.k = r2_fixed_sat31( r2_fixed_round( cc * sy - ss * cy, 31 ) );
+    return q;
+}
+
+struct r2_nq31_t r2_qq31_to_nq31( const struct r2_qq31_t q )
+{
+    // the terms of r2_qf_to_nf in Q3.60
+    const int64_t one = (int64_t)1 << 60;
+    int64_t h = q.h, i = q.i, j = q.j, k = q.k;
+    int64_t sr_cp = r2_fixed_asr( h * i, 1 ) + r2_fixed_asr( j * k, 1 );
+    int64_t cr_cp = one - r2_fixed_asr( i * i, 1 ) - r2_fixed_asr( j * j, 1 );
+    int64_t sp = r2_fixed_asr( h * j, 1 ) - r2_fixed_asr( k * i, 1 );
+    int64_t sy_cp = r2_fixed_asr( h * k, 1 ) + r2_fixed_asr( i * j, 1 );
+    int64_t cy_cp = one - r2_fixed_asr( j * j, 1 ) - r2_fixed_asr( k * k, 1 );
+
+    // pitch from the sine and the length of the roll terms (its cosine),
+    // which needs neither a square root nor a clamp to [-1, 1]
+    struct r2_nq31_t n;
+    int64_t cp;
+    n.roll = r2_fixed_vector( sr_cp, cr_cp, &cp );
+    n.pitch = r2_fixed_vector( sp, cp, NULL );
+    n.yaw = r2_fixed_vector( sy_cp, cy_cp, NULL );
+    return n;
+}
+
+struct r2_qq31_t r2_qq31_product( const struct r2_qq31_t q1,
+        const struct r2_qq31_t q2 )
+{
+    // each product in Q3.60, so that four of them cannot overflow
+    int64_t h1 = q1.h, i1 = q1.i, j1 = q1.j, k1 = q1.k;
+    int64_t h2 = q2.h, i2 = q2.i, j2 = q2.j, k2 = q2.k;
+    struct r2_qq31_t q;
+    q.h = r2_fixed_sat31( r2_fixed_round( r2_fixed_asr( h1 * h2, 2 )
+                - r2_fixed_asr( i1 * i2, 2 ) - r2_fixed_asr( j1 * j2, 2 )
+                - r2_fixed_asr( k1 * k2, 2 ), 29 ) );
+    q.i = r2_fixed_sat31( r2_fixed_round( r2_fixed_asr( h1 * i2, 2 )
+                + r2_fixed_asr( i1 * h2, 2 ) + r2_fixed_asr( j1 * k2, 2 )
+                - r2_fixed_asr( k1 * j2, 2 ), 29 ) );
+    q.j = r2_fixed_sat31( r2_fixed_round( r2_fixed_asr( h1 * j2, 2 )
+                - r2_fixed_asr( i1 * k2, 2 ) + r2_fixed_asr( j1 * h2, 2 )
+                + r2_fixed_asr( k1 * i2, 2 ), 29 ) );
+    q.k = r2_fixed_sat31( r2_fixed_round( r2_fixed_asr( h1 * k2, 2 )
+                + r2_fixed_asr( i1 * j2, 2 ) - r2_fixed_asr( j1 * i2, 2 )
+                + r2_fixed_asr( k1 * h2, 2 ), 29 ) );
+    return q;
+}
+
+// Binary angles and components between 16 and 32 bits.
+int16_t r2_fixed_angle16( const int32_t a )
+{
+    int64_t r = r2_fixed_round( a, 16 );
+    return (int16_t)( r > INT16_MAX ? r - 65536 : r ); // pi wraps to -pi
+}
+
+struct r2_qq15_t r2_nq15_to_qq15( const struct r2_nq15_t n )
+{
+    struct r2_nq31_t n31 = { n.roll * 65536, n.pitch * 65536,
+        n.yaw * 65536 };
+    struct r2_qq31_t q31 = r2_nq31_to_qq31( n31 );
+    struct r2_qq15_t q = {
+        r2_fixed_sat15( r2_fixed_round( q31.h, 16 ) ),
+        r2_fixed_sat15( r2_fixed_round( q31.i, 16 ) ),
+        r2_fixed_sat15( r2_fixed_round( q31.j, 16 ) ),
+        r2_fixed_sat15( r2_fixed_round( q31.k, 16 ) ) };
+    return q;
+}
+
+struct r2_nq15_t r2_qq15_to_nq15( const struct r2_qq15_t q )
+{
+    struct r2_qq31_t q31 = { q.h * 65536, q.i * 65536, q.j * 65536,
+        q.k * 65536 };
+    struct r2_nq31_t n31 = r2_qq31_to_nq31( q31 );
+    struct r2_nq15_t n = { r2_fixed_angle16( n31.roll ),
+        r2_fixed_angle16( n31.pitch ), r2_fixed_angle16( n31.yaw ) };
+    return n;
+}
+
+struct r2_qq15_t r2_qq15_product( const struct r2_qq15_t q1,
+        const struct r2_qq15_t q2 )
+{
+    // 16 x 16 bit products, each in Q3.28 so four fit in 32 bits
+    int32_t h1 = q1.h, i1 = q1.i, j1 = q1.j, k1 = q1.k;
+    int32_t h2 = q2.h, i2 = q2.i, j2 = q2.j, k2 = q2.k;
+    struct r2_qq15_t q;
+    q.h = r2_fixed_sat15( r2_fixed_round( r2_fixed_asr( h1 * h2, 2 )
+                - r2_fixed_asr( i1 * i2, 2 ) - r2_fixed_asr( j1 * j2, 2 )
+                - r2_fixed_asr( k1 * k2, 2 ), 13 ) );
+    q.i = r2_fixed_sat15( r2_fixed_round( r2_fixed_asr( h1 * i2, 2 )
+                + r2_fixed_asr( i1 * h2, 2 ) + r2_fixed_asr( j1 * k2, 2 )
+                - r2_fixed_asr( k1 * j2, 2 ), 13 ) );
+    q.j = r2_fixed_sat15( r2_fixed_round( r2_fixed_asr( h1 * j2, 2 )
+                - r2_fixed_asr( i1 * k2, 2 ) + r2_fixed_asr( j1 * h2, 2 )
+                + r2_fixed_asr( k1 * i2, 2 ), 13 ) );
+    q.k = r2_fixed_sat15( r2_fixed_round( r2_fixed_asr( h1 * k2, 2 )
+                + r2_fixed_asr( i1 * j2, 2 ) - r2_fixed_asr( j1 * i2, 2 )
+                + r2_fixed_asr( k1 * h2, 2 ), 13 ) );
+    return q;
+}
+
+struct r2_qf_t r2_qq31_to_qf( const struct r2_qq31_t q )
+{
+    const double s = 1.0 / 2147483648.0;
+    struct r2_qf_t f = { (float)( q.h * s ), (float)( q.i * s ),
+        (float)( q.j * s ), (float)( q.k * s ) };
+    return f;
+}
+
+int32_t r2_fixed_from_double( const double x )
+{
+    double r = floor( x + 0.5 );
+    return r >= 2147483647.0 ? INT32_MAX : ( r <= -2147483648.0 ? INT32_MIN
+            : (int32_t)r );
+}
+
+struct r2_qq31_t r2_qf_to_qq31( const struct r2_qf_t q )
+{
+    struct r2_qq31_t f = { r2_fixed_from_double( q.h * 2147483648.0 ),
+        r2_fixed_from_double( q.i * 2147483648.0 ),
+        r2_fixed_from_double( q.j * 2147483648.0 ),
+        r2_fixed_from_double( q.k * 2147483648.0 ) };
+    return f;
+}
+
+struct r2_nf_t r2_nq31_to_nf( const struct r2_nq31_t n )
+{
+    const double s = M_PI / 2147483648.0;
+    struct r2_nf_t f = { (float)( n.roll * s ), (float)( n.pitch * s ),
+        (float)( n.yaw * s ) };
+    return f;
+}
+
+// radians to a binary angle, wrapping around
+int32_t r2_fixed_from_radians( const double x )
+{
+    double t = x / ( 2 * M_PI );
+    t -= floor( t + 0.5 ); // [-0.5, 0.5)
+    return r2_fixed_angle( (uint32_t)(int64_t)floor( t * 4294967296.0 + 0.5 ) );
+}
+
+struct r2_nq31_t r2_nf_to_nq31( const struct r2_nf_t n )
+{
+    struct r2_nq31_t f = { r2_fixed_from_radians( n.roll ),
+        r2_fixed_from_radians( n.pitch ), r2_fixed_from_radians( n.yaw ) };
+    return f;
+}
+
+#endif // R2_QUATERNION_FIXED_I
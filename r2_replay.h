@@ -0,0 +1,252 @@
+// r2_replay.h
+// Replay a capture file through the same code as live serial data
+//
+// The chunks of one port (or all) are read back from an r2_capture file
+// (decompressed, if they were compressed) and delivered, one chunk at a
+// time, straight into an r2_buffer (in place of r2_buffer_fill) or written
+// to a file descriptor: the write end of a pipe, or the master of a
+// pseudo-terminal whose other end is opened like the serial device was
+// (see r2_replay_pty).
+//
+// Chunks are paced by their monotonic timestamps: at real time (speed 1),
+// scaled (e.g. 100 for a hundred times faster), or as fast as possible
+// (speed 0). A fill never mixes bytes of two chunks, so parsers see the
+// same boundaries as they did live, and the header of the chunk being
+// delivered (port and timestamps) is in self->chunk. Replaying as fast as
+// possible is deterministic.
+
+#ifndef R2_REPLAY_H
+#define R2_REPLAY_H
+
+#include <errno.h> // for EINTR
+#include <fcntl.h> // for open
+#include <stdio.h> // for fprintf, snprintf
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memcpy
+#include <sys/ioctl.h> // for ioctl, TIOCGPTN, TIOCSPTLCK
+#include <sys/types.h> // for ssize_t
+#include <termios.h> // for tcgetattr, cfmakeraw, tcsetattr
+#include <time.h> // for clock_nanosleep
+#include <unistd.h> // for write, close
+
+#include "r2_buffer.h"
+#include "r2_capture.h"
+#include "r2_capture_compress.h"
+#include "r2_epoch.h"
+
+struct r2_replay {
+    struct r2_capture_decoder * decoder;
+    int port; // to replay, -1 for all
+    double speed; // 1 for real time, 0 for as fast as possible
+    int started; // pacing
+    int64_t start; // monotonic timestamp of the first chunk paced
+    int64_t origin; // host monotonic time it was delivered
+    struct r2_capture_chunk chunk; // the chunk being delivered
+    const unsigned char * data; // its bytes not delivered yet
+    size_t left;
+    size_t chunks; // chunks delivered
+    uint64_t bytes; // bytes delivered
+};
+
+/*  Replay the chunks of port (-1 for all ports) in the capture file at
+ *  path, speed times faster than real time (0 for as fast as possible).
+ */
+struct r2_replay * r2_replay_create( const char * path, const int port,
+        const double speed );
+
+void r2_replay_destroy( struct r2_replay * self );
+
+/*  Change the speed, from the next chunk on.
+ */
+void r2_replay_set_speed( struct r2_replay * self, const double speed );
+
+/*  Go to the first chunk at or after realtime.
+ */
+void r2_replay_seek( struct r2_replay * self, const int64_t realtime );
+
+/*  Take the next chunk when it is due; data points to its bytes.
+ *
+ *  Returns 1, or 0 at the end of the capture.
+ */
+int r2_replay_next( struct r2_replay * self, struct r2_capture_chunk * chunk,
+        const void ** data );
+
+/*  Append the rest of the current chunk, or the next chunk when it is due,
+ *  to buffer, as much as fits.
+ *
+ *  Returns the number of bytes appended, 0 at the end of the capture (or
+ *  if the buffer is full).
+ */
+size_t r2_replay_fill( struct r2_replay * self, struct r2_buffer * buffer );
+
+/*  Write the rest of the current chunk, or the next chunk when it is due,
+ *  to fd.
+ *
+ *  Returns the number of bytes written, 0 at the end of the capture, or -1
+ *  on error (e.g. EAGAIN on a full non-blocking pipe; nothing is lost).
+ */
+ssize_t r2_replay_write( struct r2_replay * self, const int fd );
+
+/*  Open a pseudo-terminal in raw mode, storing the path of its slave in
+ *  path (of size n), to be opened like the serial device.
+ *
+ *  Returns the master file descriptor, for r2_replay_write, or -1.
+ */
+int r2_replay_pty( char * path, const size_t n );
+
+#endif // R2_REPLAY_H
+
+#ifndef R2_REPLAY_I
+#define R2_REPLAY_I
+
+struct r2_replay * r2_replay_create( const char * path, const int port,
+        const double speed )
+{
+    struct r2_replay * self = calloc( 1, sizeof( struct r2_replay ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_replay\n" );
+        return NULL;
+    }
+    self->decoder = r2_capture_decoder_create( path );
+    if( NULL == self->decoder ) {
+        free( self );
+        return NULL;
+    }
+    self->port = port;
+    self->speed = speed;
+    return self;
+}
+
+void r2_replay_destroy( struct r2_replay * self )
+{
+    if( self ) {
+        r2_capture_decoder_destroy( self->decoder );
+        free( self );
+    }
+}
+
+void r2_replay_set_speed( struct r2_replay * self, const double speed )
+{
+    self->speed = speed;
+    self->started = 0;
+}
+
+void r2_replay_seek( struct r2_replay * self, const int64_t realtime )
+{
+    r2_capture_reader_seek( self->decoder->reader, realtime );
+    self->left = 0;
+    self->started = 0;
+}
+
+// Sleep until the current chunk is due.
+void r2_replay_wait( struct r2_replay * self )
+{
+    if( self->speed <= 0 )
+        return;
+    int64_t now = r2_capture_monotonic_now();
+    if( !self->started ) {
+        self->started = 1;
+        self->start = self->chunk.monotonic;
+        self->origin = now;
+        return;
+    }
+    int64_t due = self->origin
+        + (int64_t)( ( self->chunk.monotonic - self->start ) / self->speed );
+    if( due <= now )
+        return;
+    struct timespec t = r2_epoch_usec_to_timespec( due );
+    while( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &t,
+                NULL ) )
+        ;
+}
+
+// Take the next chunk of the port when it is due, all of it pending;
+// returns 0 at the end (or at a chunk that cannot be decompressed).
+int r2_replay_advance( struct r2_replay * self )
+{
+    const void * p;
+    do {
+        if( 1 != r2_capture_decoder_next( self->decoder, &self->chunk,
+                    &p ) ) {
+            self->left = 0;
+            return 0;
+        }
+    } while( self->port >= 0 && self->chunk.port != self->port );
+    r2_replay_wait( self );
+    self->data = p;
+    self->left = self->chunk.length;
+    self->chunks++;
+    return 1;
+}
+
+int r2_replay_next( struct r2_replay * self, struct r2_capture_chunk * chunk,
+        const void ** data )
+{
+    if( !r2_replay_advance( self ) )
+        return 0;
+    *chunk = self->chunk;
+    *data = self->data;
+    self->bytes += self->left;
+    self->left = 0;
+    return 1;
+}
+
+// Make the rest of the current chunk, or the next one with bytes,
+// pending; returns 0 at the end.
+int r2_replay_pending( struct r2_replay * self )
+{
+    while( 0 == self->left )
+        if( !r2_replay_advance( self ) )
+            return 0;
+    return 1;
+}
+
+size_t r2_replay_fill( struct r2_replay * self, struct r2_buffer * buffer )
+{
+    if( !r2_replay_pending( self ) )
+        return 0;
+    size_t room = buffer->size - buffer->position;
+    size_t n = self->left < room ? self->left : room;
+    memcpy( buffer->data + buffer->position, self->data, n );
+    buffer->position += n;
+    self->data += n;
+    self->left -= n;
+    self->bytes += n;
+    return n;
+}
+
+ssize_t r2_replay_write( struct r2_replay * self, const int fd )
+{
+    if( !r2_replay_pending( self ) )
+        return 0;
+    ssize_t n = write( fd, self->data, self->left );
+    if( n > 0 ) {
+        self->data += n;
+        self->left -= (size_t)n;
+        self->bytes += (uint64_t)n;
+    }
+    return n;
+}
+
+int r2_replay_pty( char * path, const size_t n )
+{
+    int fd = open( "/dev/ptmx", O_RDWR | O_NOCTTY | O_CLOEXEC );
+    unsigned int pty;
+    int unlock = 0;
+    struct termios tio;
+    if( -1 == fd || -1 == ioctl( fd, TIOCGPTN, &pty )
+            || -1 == ioctl( fd, TIOCSPTLCK, &unlock )
+            || -1 == tcgetattr( fd, &tio ) ) {
+        perror( "could not open r2_replay pty" );
+        if( -1 != fd )
+            close( fd );
+        return -1;
+    }
+    // no echo or line editing: the bytes go through as they are
+    cfmakeraw( &tio );
+    tcsetattr( fd, TCSANOW, &tio );
+    snprintf( path, n, "/dev/pts/%u", pty );
+    return fd;
+}
+
+#endif // R2_REPLAY_I
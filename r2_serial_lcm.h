@@ -0,0 +1,245 @@
+// r2_serial_lcm.h
+// Bridge frames from a serial port to LCM raw messages
+//
+// Frames (by default lines, terminator included) are taken from the serial
+// port's buffer and published as raw messages stamped with the host time
+// of the read that completed them:
+//
+//     struct raw_t {
+//         int64_t utime;
+//         int32_t length;
+//         byte data[length];
+//     }
+//
+// Messages are encoded straight from the buffer into one send buffer
+// allocated up front, so publishing does not allocate or copy through
+// intermediate messages. When batching is allowed, consecutive frames
+// that are ready together go out as one message with their data back to
+// back (the subscriber splits them with the same framer).
+//
+// Messages go out through a transport (see r2_transport.h): an lcm_t, a
+// shared-memory ring for consumers on the same host, or a callback of
+// one's own (e.g. in tests). The fingerprint is computed as lcm-gen would
+// for the type above; define R2_SERIAL_LCM_FINGERPRINT to override it.
+
+#ifndef R2_SERIAL_LCM_H
+#define R2_SERIAL_LCM_H
+
+#include <inttypes.h> // for int64_t, uint64_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memchr, memcpy, strdup
+
+#include "r2_buffer.h"
+#include "r2_epoch.h"
+#include "r2_lcm.h"
+#include "r2_serial_port.h"
+#include "r2_transport.h"
+
+// fingerprint, utime and length
+#define R2_SERIAL_LCM_HEADER 20
+
+/*  Length of the first complete frame in data[0..size), or 0 if there is
+ *  none yet.
+ */
+typedef size_t ( * r2_serial_lcm_framer )( const char * data,
+        const size_t size );
+
+struct r2_serial_lcm {
+    struct r2_serial_port * port;
+    char * channel;
+    struct r2_transport transport;
+    r2_serial_lcm_framer framer;
+    size_t batch; // frames per message, at most
+    uint64_t fingerprint;
+    unsigned char * message; // send buffer
+    size_t capacity;
+    int64_t usec; // host time of the last read
+    size_t frames; // frames published
+    size_t messages; // messages published
+    size_t dropped; // bytes dropped without a frame
+    size_t errors; // failed publishes
+};
+
+/*  Create a bridge publishing the frames of port on channel through
+ *  transport.
+ *
+ *  Frames are lines, one per message; see r2_serial_lcm_set_framer and
+ *  r2_serial_lcm_set_batch. The port is not owned by the bridge.
+ */
+struct r2_serial_lcm * r2_serial_lcm_create( struct r2_serial_port * port,
+        const char * channel, const struct r2_transport transport );
+
+void r2_serial_lcm_destroy( struct r2_serial_lcm * self );
+
+void r2_serial_lcm_set_framer( struct r2_serial_lcm * self,
+        r2_serial_lcm_framer framer );
+
+/*  Allow up to batch frames per message (1, the default, for none).
+ */
+void r2_serial_lcm_set_batch( struct r2_serial_lcm * self,
+        const size_t batch );
+
+/*  Read what is available on the port (when its fd is readable) and
+ *  publish the frames it completes.
+ *
+ *  Returns the number of messages published, or -1 on a read error.
+ */
+int r2_serial_lcm_handle( struct r2_serial_lcm * self );
+
+/*  Publish the complete frames in the port's buffer, stamped usec.
+ *
+ *  Returns the number of messages published.
+ */
+size_t r2_serial_lcm_publish( struct r2_serial_lcm * self,
+        const int64_t usec );
+
+/*  Decode a raw message; data and length point into it.
+ *
+ *  Returns 0, or -1 if it is not a raw message.
+ */
+int r2_serial_lcm_decode( const struct r2_serial_lcm * self,
+        const void * message, const size_t size, int64_t * usec,
+        const char ** data, size_t * length );
+
+/*  Frame at the first \n.
+ */
+size_t r2_serial_lcm_line( const char * data, const size_t size );
+
+#endif // R2_SERIAL_LCM_H
+
+#ifndef R2_SERIAL_LCM_I
+#define R2_SERIAL_LCM_I
+
+struct r2_serial_lcm * r2_serial_lcm_create( struct r2_serial_port * port,
+        const char * channel, const struct r2_transport transport )
+{
+    struct r2_serial_lcm * self = calloc( 1, sizeof( struct r2_serial_lcm ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_serial_lcm\n" );
+        return NULL;
+    }
+    self->port = port;
+    self->transport = transport;
+    self->framer = r2_serial_lcm_line;
+    self->batch = 1;
+    // a message holds at most a full buffer of frames
+    self->capacity = R2_SERIAL_LCM_HEADER + port->buffer->size;
+    self->message = calloc( self->capacity, 1 );
+    self->channel = strdup( channel );
+    if( NULL == self->message || NULL == self->channel ) {
+        fprintf( stderr, "could not allocate r2_serial_lcm\n" );
+        r2_serial_lcm_destroy( self );
+        return NULL;
+    }
+#ifdef R2_SERIAL_LCM_FINGERPRINT
+    self->fingerprint = R2_SERIAL_LCM_FINGERPRINT;
+#else
+    const struct r2_lcm_member raw[] = {
+        { "int64_t", "utime", { NULL } },
+        { "int32_t", "length", { NULL } },
+        { "byte", "data", { "length", NULL } } };
+    self->fingerprint = r2_lcm_fingerprint( raw, 3 );
+#endif
+    return self;
+}
+
+void r2_serial_lcm_destroy( struct r2_serial_lcm * self )
+{
+    if( self ) {
+        free( self->channel );
+        free( self->message );
+        free( self );
+    }
+}
+
+void r2_serial_lcm_set_framer( struct r2_serial_lcm * self,
+        r2_serial_lcm_framer framer )
+{
+    self->framer = framer;
+}
+
+void r2_serial_lcm_set_batch( struct r2_serial_lcm * self,
+        const size_t batch )
+{
+    self->batch = batch ? batch : 1;
+}
+
+size_t r2_serial_lcm_line( const char * data, const size_t size )
+{
+    const char * eol = memchr( data, '\n', size );
+    return eol ? (size_t)( eol - data ) + 1 : 0;
+}
+
+int r2_serial_lcm_handle( struct r2_serial_lcm * self )
+{
+    size_t n = r2_buffer_fill( self->port->buffer, self->port->fd );
+    if( (size_t)-1 == n )
+        return -1;
+    self->usec = r2_epoch_usec_now();
+    return (int)r2_serial_lcm_publish( self, self->usec );
+}
+
+// Publish the frames copied to the message so far.
+void r2_serial_lcm_send( struct r2_serial_lcm * self, const int64_t usec,
+        const size_t length )
+{
+    unsigned char * p = self->message;
+    p = r2_lcm_put_int64( p, (int64_t)self->fingerprint );
+    p = r2_lcm_put_int64( p, usec );
+    r2_lcm_put_int32( p, (int32_t)length );
+    if( r2_transport_publish( &self->transport, self->channel,
+                self->message, R2_SERIAL_LCM_HEADER + length ) )
+        self->errors++;
+    else
+        self->messages++;
+}
+
+size_t r2_serial_lcm_publish( struct r2_serial_lcm * self,
+        const int64_t usec )
+{
+    struct r2_buffer * b = self->port->buffer;
+    size_t used = 0, length = 0, count = 0, sent = self->messages;
+    size_t n;
+    while( 0 != ( n = self->framer( b->data + used, b->position - used ) ) ) {
+        memcpy( self->message + R2_SERIAL_LCM_HEADER + length,
+                b->data + used, n );
+        used += n;
+        length += n;
+        self->frames++;
+        if( ++count == self->batch ) {
+            r2_serial_lcm_send( self, usec, length );
+            length = 0;
+            count = 0;
+        }
+    }
+    if( count )
+        r2_serial_lcm_send( self, usec, length );
+    if( 0 == used && b->position == b->size ) {
+        fprintf( stderr, "r2_serial_lcm buffer filled without a frame"
+                " -- clearing\n" );
+        self->dropped += b->position;
+        used = b->position;
+    }
+    r2_buffer_drop( b, used );
+    return self->messages - sent;
+}
+
+int r2_serial_lcm_decode( const struct r2_serial_lcm * self,
+        const void * message, const size_t size, int64_t * usec,
+        const char ** data, size_t * length )
+{
+    const unsigned char * p = message;
+    if( size < R2_SERIAL_LCM_HEADER
+            || (uint64_t)r2_lcm_get_int64( p ) != self->fingerprint )
+        return -1;
+    int32_t n = r2_lcm_get_int32( p + 16 );
+    if( n < 0 || (size_t)n != size - R2_SERIAL_LCM_HEADER )
+        return -1;
+    *usec = r2_lcm_get_int64( p + 8 );
+    *data = (const char *)p + R2_SERIAL_LCM_HEADER;
+    *length = n;
+    return 0;
+}
+
+#endif // R2_SERIAL_LCM_I
@@ -0,0 +1,293 @@
+// r2_shm_ring.h
+// Broadcast messages to other processes through a shared-memory ring
+//
+// One producer appends records (a channel name and a message) to a ring in
+// a memfd; any number of consumers map the same memfd and read every
+// record at their own pace, with no syscall or kernel copy per message.
+// Consumers only touch the kernel to sleep when the ring is empty: the
+// producer bumps a futex word on each record and wakes it only when a
+// consumer is waiting.
+//
+// The producer never waits for consumers. A consumer that falls more than
+// the ring's size behind has its unread records overwritten; it notices
+// (from the producer's reservation counter, checked after copying each
+// record out), counts an overrun, and skips to the next record written.
+//
+// Each record is an 8-byte header (channel length, message length), the
+// channel, a NUL and the message, padded to 8 bytes. Records do not wrap
+// around the end of the ring; a padding record fills the rest instead.
+//
+// The memfd reaches consumers by inheritance across fork, over a Unix
+// socket (SCM_RIGHTS), or by opening /proc/<pid>/fd/<fd>.
+
+#ifndef R2_SHM_RING_H
+#define R2_SHM_RING_H
+
+#include <inttypes.h> // for uint32_t, uint64_t
+#include <limits.h> // for INT_MAX
+#include <linux/futex.h> // for FUTEX_WAIT, FUTEX_WAKE
+#include <linux/memfd.h> // for MFD_CLOEXEC
+#include <stdatomic.h> // for atomic_load_explicit, atomic_store_explicit
+#include <stdio.h> // for fprintf, stderr, perror
+#include <stdlib.h> // for calloc, free, malloc
+#include <string.h> // for memcpy, strlen
+#include <sys/mman.h> // for mmap, munmap
+#include <sys/stat.h> // for fstat
+#include <sys/syscall.h> // for SYS_futex, SYS_memfd_create
+#include <time.h> // for struct timespec
+#include <unistd.h> // for close, dup, ftruncate, syscall
+
+#define R2_SHM_RING_MAGIC 0x72327368 // "r2sh"
+#define R2_SHM_RING_PAD UINT32_MAX // channel length of a padding record
+
+// Shared at the start of the memfd, the records following at
+// R2_SHM_RING_DATA.
+struct r2_shm_ring_header {
+    uint32_t magic;
+    _Atomic uint32_t futex; // bumped on every record
+    uint64_t size; // bytes of records, a power of two
+    _Atomic uint64_t reserved; // end of the record being written
+    _Atomic uint64_t head; // end of the last record written
+    _Atomic uint32_t waiters; // consumers sleeping on futex
+};
+
+#define R2_SHM_RING_DATA 64
+
+struct r2_shm_ring {
+    int fd;
+    struct r2_shm_ring_header * header; // mapped
+    unsigned char * data; // mapped records
+    size_t size;
+    uint64_t tail; // consumer: next record to read
+    unsigned char * copy; // consumer: the record last read
+    size_t records; // records written or read
+    size_t overruns; // consumer: times records were overwritten unread
+};
+
+/*  Create a ring in a new memfd named name, for size bytes of records
+ *  (rounded up to a power of two); the caller is the producer.
+ */
+struct r2_shm_ring * r2_shm_ring_create( const char * name, size_t size );
+
+/*  Map the ring in memfd fd (which is duplicated) as a consumer, starting
+ *  at the newest record.
+ */
+struct r2_shm_ring * r2_shm_ring_open( const int fd );
+
+void r2_shm_ring_destroy( struct r2_shm_ring * self );
+
+/*  Producer: append a message on channel, waking sleeping consumers.
+ *
+ *  Returns 0, or -1 if the record would not fit in the ring.
+ */
+int r2_shm_ring_write( struct r2_shm_ring * self, const char * channel,
+        const void * data, const size_t length );
+
+/*  Consumer: read the next record; channel and data point into a copy
+ *  that is valid until the next read.
+ *
+ *  Returns 1, or 0 if there is no record yet.
+ */
+int r2_shm_ring_read( struct r2_shm_ring * self, const char ** channel,
+        const void ** data, size_t * length );
+
+/*  Consumer: sleep until there is a record to read, or for timeout_ms
+ *  (-1 for no limit).
+ *
+ *  Returns 1 if there is a record, or 0 on timeout.
+ */
+int r2_shm_ring_wait( struct r2_shm_ring * self, const int timeout_ms );
+
+#endif // R2_SHM_RING_H
+
+#ifndef R2_SHM_RING_I
+#define R2_SHM_RING_I
+
+// Bytes of a record of a channel of clength and a message of length.
+size_t r2_shm_ring_record( const size_t clength, const size_t length )
+{
+    return 8 + ( ( clength + 1 + length + 7 ) & ~(size_t)7 );
+}
+
+// Map size bytes of records in fd.
+struct r2_shm_ring * r2_shm_ring_map( const int fd, const size_t size )
+{
+    struct r2_shm_ring * self = calloc( 1, sizeof( struct r2_shm_ring ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_shm_ring\n" );
+        return NULL;
+    }
+    self->fd = fd;
+    self->size = size;
+    void * p = mmap( NULL, R2_SHM_RING_DATA + size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0 );
+    if( MAP_FAILED == p ) {
+        perror( "could not map r2_shm_ring" );
+        free( self );
+        return NULL;
+    }
+    self->header = p;
+    self->data = (unsigned char *)p + R2_SHM_RING_DATA;
+    return self;
+}
+
+struct r2_shm_ring * r2_shm_ring_create( const char * name, size_t size )
+{
+    size_t s = 4096;
+    while( s < size )
+        s <<= 1;
+    int fd = (int)syscall( SYS_memfd_create, name, MFD_CLOEXEC );
+    if( -1 == fd ) {
+        perror( "could not create r2_shm_ring memfd" );
+        return NULL;
+    }
+    if( -1 == ftruncate( fd, R2_SHM_RING_DATA + s ) ) {
+        perror( "could not size r2_shm_ring memfd" );
+        close( fd );
+        return NULL;
+    }
+    struct r2_shm_ring * self = r2_shm_ring_map( fd, s );
+    if( NULL == self ) {
+        close( fd );
+        return NULL;
+    }
+    // the memfd comes zeroed, so only the constants need setting
+    self->header->size = s;
+    self->header->magic = R2_SHM_RING_MAGIC;
+    return self;
+}
+
+struct r2_shm_ring * r2_shm_ring_open( const int fd )
+{
+    struct stat st;
+    struct r2_shm_ring_header h;
+    if( -1 == fstat( fd, &st ) || st.st_size < R2_SHM_RING_DATA
+            || sizeof( h ) != pread( fd, &h, sizeof( h ), 0 )
+            || R2_SHM_RING_MAGIC != h.magic
+            || 0 == h.size || 0 != ( h.size & ( h.size - 1 ) )
+            || h.size > (uint64_t)st.st_size - R2_SHM_RING_DATA ) {
+        fprintf( stderr, "r2_shm_ring_open: not a ring\n" );
+        return NULL;
+    }
+    int d = dup( fd );
+    if( -1 == d ) {
+        perror( "could not duplicate r2_shm_ring memfd" );
+        return NULL;
+    }
+    struct r2_shm_ring * self = r2_shm_ring_map( d, h.size );
+    if( NULL == self ) {
+        close( d );
+        return NULL;
+    }
+    self->copy = malloc( self->size );
+    if( NULL == self->copy ) {
+        fprintf( stderr, "could not allocate r2_shm_ring\n" );
+        r2_shm_ring_destroy( self );
+        return NULL;
+    }
+    self->tail = atomic_load_explicit( &self->header->head,
+            memory_order_acquire );
+    return self;
+}
+
+void r2_shm_ring_destroy( struct r2_shm_ring * self )
+{
+    if( self ) {
+        munmap( self->header, R2_SHM_RING_DATA + self->size );
+        close( self->fd );
+        free( self->copy );
+        free( self );
+    }
+}
+
+int r2_shm_ring_write( struct r2_shm_ring * self, const char * channel,
+        const void * data, const size_t length )
+{
+    struct r2_shm_ring_header * h = self->header;
+    const size_t clength = strlen( channel );
+    const size_t n = r2_shm_ring_record( clength, length );
+    if( n > self->size )
+        return -1;
+    uint64_t head = atomic_load_explicit( &h->head, memory_order_relaxed );
+    size_t at = head & ( self->size - 1 );
+    size_t pad = at + n > self->size ? self->size - at : 0;
+    // claim the bytes before overwriting them, for consumers to check
+    atomic_store_explicit( &h->reserved, head + pad + n,
+            memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+    uint32_t lengths[2];
+    if( pad ) {
+        lengths[0] = R2_SHM_RING_PAD;
+        lengths[1] = 0;
+        memcpy( self->data + at, lengths, 8 );
+        at = 0;
+    }
+    lengths[0] = (uint32_t)clength;
+    lengths[1] = (uint32_t)length;
+    unsigned char * p = self->data + at;
+    memcpy( p, lengths, 8 );
+    memcpy( p + 8, channel, clength + 1 );
+    memcpy( p + 8 + clength + 1, data, length );
+    atomic_store_explicit( &h->head, head + pad + n, memory_order_release );
+    self->records++;
+    atomic_fetch_add( &h->futex, 1 );
+    if( atomic_load( &h->waiters ) )
+        syscall( SYS_futex, &h->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+    return 0;
+}
+
+int r2_shm_ring_read( struct r2_shm_ring * self, const char ** channel,
+        const void ** data, size_t * length )
+{
+    struct r2_shm_ring_header * h = self->header;
+    for( ;; ) {
+        uint64_t head = atomic_load_explicit( &h->head, memory_order_acquire );
+        if( head == self->tail )
+            return 0;
+        size_t at = self->tail & ( self->size - 1 );
+        uint32_t lengths[2];
+        memcpy( lengths, self->data + at, 8 );
+        size_t n = R2_SHM_RING_PAD == lengths[0] ? self->size - at
+            : r2_shm_ring_record( lengths[0], lengths[1] );
+        // a torn header may not make sense; the check below tells
+        int sane = head - self->tail <= self->size && n <= self->size - at;
+        if( sane && R2_SHM_RING_PAD != lengths[0] )
+            memcpy( self->copy, self->data + at, n );
+        atomic_thread_fence( memory_order_acquire );
+        uint64_t reserved = atomic_load_explicit( &h->reserved,
+                memory_order_relaxed );
+        if( !sane || reserved - self->tail > self->size ) {
+            // overwritten while unread: skip what is there
+            self->overruns++;
+            self->tail = atomic_load_explicit( &h->head,
+                    memory_order_acquire );
+            continue;
+        }
+        self->tail += n;
+        if( R2_SHM_RING_PAD != lengths[0] ) {
+            *channel = (const char *)self->copy + 8;
+            *data = self->copy + 8 + lengths[0] + 1;
+            *length = lengths[1];
+            self->records++;
+            return 1;
+        }
+    }
+}
+
+int r2_shm_ring_wait( struct r2_shm_ring * self, const int timeout_ms )
+{
+    struct r2_shm_ring_header * h = self->header;
+    struct timespec timeout = { timeout_ms / 1000,
+        ( timeout_ms % 1000 ) * 1000000L };
+    // announce the waiter before looking, so the producer either sees it
+    // or has already moved the futex word on
+    atomic_fetch_add( &h->waiters, 1 );
+    uint32_t futex = atomic_load( &h->futex );
+    if( atomic_load( &h->head ) == self->tail )
+        syscall( SYS_futex, &h->futex, FUTEX_WAIT, futex,
+                timeout_ms < 0 ? NULL : &timeout, NULL, 0 );
+    atomic_fetch_sub( &h->waiters, 1 );
+    return atomic_load( &h->head ) != self->tail;
+}
+
+#endif // R2_SHM_RING_I
@@ -0,0 +1,343 @@
+// r2_timer_wheel.h
+// Hierarchical timer wheel: any number of software timers on one timerfd
+//
+// Time is counted in ticks of a fixed length. Level 0 of the wheel has one
+// slot per tick; each higher level has slots R2_TIMER_WHEEL_SLOTS times as
+// long. A timer is kept in the lowest level whose current rotation contains
+// its expiry (or, on the top level, whose next 64 slots do), and is moved
+// (cascaded) down a level when the wheel reaches the start of its slot.
+// Timers beyond the top level are parked in its furthest slot and re-filed
+// when that slot comes around.
+//
+// The timerfd is only re-armed when the nearest event changes, so adding a
+// timer that expires after the nearest one costs no syscall.
+
+#ifndef R2_TIMER_WHEEL_H
+#define R2_TIMER_WHEEL_H
+
+#include <inttypes.h> // for int64_t, uint64_t
+#include <stdio.h> // for fprintf, perror, stderr
+#include <stdlib.h> // for calloc, free
+#include <time.h> // for clock_gettime
+#include <unistd.h> // for close
+#include <sys/timerfd.h>
+
+#include "r2_timerfd.h"
+
+#define R2_TIMER_WHEEL_LEVELS 4
+#define R2_TIMER_WHEEL_BITS 6
+#define R2_TIMER_WHEEL_SLOTS ( 1 << R2_TIMER_WHEEL_BITS )
+#define R2_TIMER_WHEEL_MASK ( R2_TIMER_WHEEL_SLOTS - 1 )
+
+struct r2_timer;
+
+typedef void ( * r2_timer_callback )( struct r2_timer * timer, void * data );
+
+/*  A software timer.
+ *
+ *  Owned by the caller (e.g. embedded in a per-port struct); the wheel only
+ *  links it into a slot while it is pending.
+ */
+struct r2_timer {
+    struct r2_timer * next;
+    struct r2_timer ** pprev; // NULL when not pending
+    uint64_t expires; // tick
+    unsigned char level;
+    unsigned char slot;
+    r2_timer_callback callback;
+    void * data;
+};
+
+struct r2_timer_wheel {
+    int fd;
+    int clock;
+    int64_t tick_nsec;
+    int64_t origin_nsec; // clock time at tick 0
+    uint64_t tick; // last tick processed
+    uint64_t armed; // tick the timerfd is armed for, or 0 if disarmed
+    size_t pending;
+    uint64_t occupied[R2_TIMER_WHEEL_LEVELS]; // one bit per non-empty slot
+    struct r2_timer * slots[R2_TIMER_WHEEL_LEVELS][R2_TIMER_WHEEL_SLOTS];
+};
+
+/*  Create a timer wheel on a new non-blocking timerfd.
+ *
+ *  Timers are rounded up to a whole number of ticks of tick_usec. With the
+ *  default 4 levels of 64 slots, timers up to 2^24 ticks out are filed
+ *  directly; later ones are re-filed as the wheel turns.
+ *
+ *  Returns NULL if tick_usec is not positive.
+ */
+struct r2_timer_wheel * r2_timer_wheel_create( const int clock,
+        const int64_t tick_usec );
+
+void r2_timer_wheel_destroy( struct r2_timer_wheel * self );
+
+void r2_timer_init( struct r2_timer * timer, r2_timer_callback callback,
+        void * data );
+
+int r2_timer_pending( const struct r2_timer * timer );
+
+/*  Start (or restart) a timer to expire usec from now.
+ *
+ *  Returns 0, or -1 if the timerfd could not be re-armed.
+ */
+int r2_timer_wheel_add( struct r2_timer_wheel * self, struct r2_timer * timer,
+        const int64_t usec );
+
+/*  Stop a pending timer; does nothing if it is not pending.
+ *
+ *  The timerfd is left armed, which at worst costs one early wakeup.
+ */
+void r2_timer_wheel_cancel( struct r2_timer_wheel * self,
+        struct r2_timer * timer );
+
+/*  Run the callbacks of all expired timers and re-arm the timerfd.
+ *
+ *  Call when self->fd is readable. Callbacks may add or cancel timers,
+ *  including the one being called.
+ *
+ *  Returns the number of timers that expired, or -1 on error.
+ */
+int r2_timer_wheel_dispatch( struct r2_timer_wheel * self );
+
+#endif // R2_TIMER_WHEEL_H
+
+#ifndef R2_TIMER_WHEEL_I
+#define R2_TIMER_WHEEL_I
+
+int64_t r2_timer_wheel_clock_nsec( const struct r2_timer_wheel * self )
+{
+    struct timespec t;
+    clock_gettime( self->clock, &t );
+    return (int64_t)t.tv_sec * 1000000000 + (int64_t)t.tv_nsec;
+}
+
+struct r2_timer_wheel * r2_timer_wheel_create( const int clock,
+        const int64_t tick_usec )
+{
+    if( tick_usec <= 0 ) {
+        fprintf( stderr, "r2_timer_wheel needs a positive tick\n" );
+        return NULL;
+    }
+    struct r2_timer_wheel * self = calloc( 1,
+            sizeof( struct r2_timer_wheel ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_timer_wheel\n" );
+        return NULL;
+    }
+    self->fd = r2_timerfd_new( clock, TFD_NONBLOCK | TFD_CLOEXEC );
+    if( -1 == self->fd ) {
+        free( self );
+        return NULL;
+    }
+    self->clock = clock;
+    self->tick_nsec = tick_usec * 1000;
+    self->origin_nsec = r2_timer_wheel_clock_nsec( self );
+    return self;
+}
+
+void r2_timer_wheel_destroy( struct r2_timer_wheel * self )
+{
+    if( self ) {
+        close( self->fd );
+        free( self );
+    }
+}
+
+void r2_timer_init( struct r2_timer * timer, r2_timer_callback callback,
+        void * data )
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->data = data;
+}
+
+int r2_timer_pending( const struct r2_timer * timer )
+{
+    return NULL != timer->pprev;
+}
+
+// File a timer in the lowest level whose current rotation contains it.
+void r2_timer_wheel_insert( struct r2_timer_wheel * self,
+        struct r2_timer * timer )
+{
+    int level;
+    unsigned int slot;
+    for( level = 0; level < R2_TIMER_WHEEL_LEVELS - 1; level++ ) {
+        int shift = R2_TIMER_WHEEL_BITS * ( level + 1 );
+        if( ( timer->expires >> shift ) == ( self->tick >> shift ) )
+            break;
+    }
+    int shift = R2_TIMER_WHEEL_BITS * level;
+    if( ( level < R2_TIMER_WHEEL_LEVELS - 1 ) || ( ( timer->expires >> shift )
+                - ( self->tick >> shift ) < R2_TIMER_WHEEL_SLOTS ) ) {
+        slot = ( timer->expires >> shift ) & R2_TIMER_WHEEL_MASK;
+    } else { // beyond the horizon: park in the slot visited last
+        slot = ( ( self->tick >> shift ) - 1 ) & R2_TIMER_WHEEL_MASK;
+    }
+
+    struct r2_timer ** head = &self->slots[level][slot];
+    timer->next = *head;
+    if( timer->next )
+        timer->next->pprev = &timer->next;
+    *head = timer;
+    timer->pprev = head;
+    timer->level = (unsigned char)level;
+    timer->slot = (unsigned char)slot;
+    self->occupied[level] |= (uint64_t)1 << slot;
+}
+
+void r2_timer_wheel_unlink( struct r2_timer_wheel * self,
+        struct r2_timer * timer )
+{
+    *timer->pprev = timer->next;
+    if( timer->next )
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+    if( NULL == self->slots[timer->level][timer->slot] )
+        self->occupied[timer->level] &= ~( (uint64_t)1 << timer->slot );
+}
+
+// Detach the whole list of a slot so it can be walked while callbacks and
+// re-filing modify the wheel.
+struct r2_timer * r2_timer_wheel_take( struct r2_timer_wheel * self,
+        const int level, const unsigned int slot, struct r2_timer ** list )
+{
+    *list = self->slots[level][slot];
+    self->slots[level][slot] = NULL;
+    self->occupied[level] &= ~( (uint64_t)1 << slot );
+    if( *list )
+        ( *list )->pprev = list;
+    return *list;
+}
+
+// Earliest tick after self->tick at which the wheel has work to do: either
+// a level 0 expiry, or the start of a higher-level slot to cascade. 0 if
+// there are no pending timers.
+uint64_t r2_timer_wheel_next( const struct r2_timer_wheel * self )
+{
+    uint64_t next = 0;
+    int level;
+    for( level = 0; level < R2_TIMER_WHEEL_LEVELS; level++ ) {
+        uint64_t occupied = self->occupied[level];
+        if( 0 == occupied )
+            continue;
+        int shift = R2_TIMER_WHEEL_BITS * level;
+        unsigned int s = ( ( self->tick >> shift ) + 1 ) & R2_TIMER_WHEEL_MASK;
+        uint64_t rotated = s ? ( occupied >> s ) | ( occupied << ( 64 - s ) )
+            : occupied;
+        uint64_t at = ( ( self->tick >> shift ) + 1
+                + (uint64_t)__builtin_ctzll( rotated ) ) << shift;
+        if( 0 == next || at < next )
+            next = at;
+    }
+    return next;
+}
+
+int r2_timer_wheel_rearm( struct r2_timer_wheel * self )
+{
+    uint64_t next = self->pending ? r2_timer_wheel_next( self ) : 0;
+    if( next == self->armed )
+        return 0;
+
+    int64_t at = next ? self->origin_nsec + (int64_t)next * self->tick_nsec
+        : 0;
+    if( -1 == r2_timerfd_arm_abs_nsec( self->fd, at, 0 ) ) {
+        fprintf( stderr, "failed to arm timer wheel\n" );
+        self->armed = 0;
+        return -1;
+    }
+    self->armed = next;
+    return 0;
+}
+
+int r2_timer_wheel_add( struct r2_timer_wheel * self, struct r2_timer * timer,
+        const int64_t usec )
+{
+    if( timer->pprev )
+        r2_timer_wheel_unlink( self, timer );
+    else
+        self->pending++;
+
+    int64_t at = r2_timer_wheel_clock_nsec( self ) - self->origin_nsec
+        + usec * 1000;
+    uint64_t expires = at > 0
+        ? (uint64_t)( ( at + self->tick_nsec - 1 ) / self->tick_nsec ) : 0;
+    timer->expires = expires > self->tick ? expires : self->tick + 1;
+    r2_timer_wheel_insert( self, timer );
+
+    if( self->armed && self->armed <= timer->expires )
+        return 0;
+    return r2_timer_wheel_rearm( self );
+}
+
+void r2_timer_wheel_cancel( struct r2_timer_wheel * self,
+        struct r2_timer * timer )
+{
+    if( timer->pprev ) {
+        r2_timer_wheel_unlink( self, timer );
+        self->pending--;
+    }
+}
+
+// Process every tick with work up to and including tick `to`.
+int r2_timer_wheel_advance( struct r2_timer_wheel * self, const uint64_t to )
+{
+    int fired = 0;
+    while( self->tick < to ) {
+        uint64_t next = self->pending ? r2_timer_wheel_next( self ) : 0;
+        if( 0 == next || next > to ) {
+            self->tick = to;
+            break;
+        }
+        self->tick = next;
+
+        struct r2_timer * list;
+        struct r2_timer * timer;
+        int level;
+        for( level = R2_TIMER_WHEEL_LEVELS - 1; level > 0; level-- ) {
+            int shift = R2_TIMER_WHEEL_BITS * level;
+            if( next & ( ( (uint64_t)1 << shift ) - 1 ) )
+                continue;
+            r2_timer_wheel_take( self, level,
+                    ( next >> shift ) & R2_TIMER_WHEEL_MASK, &list );
+            while( ( timer = list ) ) {
+                list = timer->next;
+                r2_timer_wheel_insert( self, timer );
+            }
+        }
+
+        r2_timer_wheel_take( self, 0, next & R2_TIMER_WHEEL_MASK, &list );
+        while( ( timer = list ) ) {
+            r2_timer_wheel_unlink( self, timer );
+            self->pending--;
+            fired++;
+            if( timer->callback )
+                timer->callback( timer, timer->data );
+        }
+    }
+    return fired;
+}
+
+int r2_timer_wheel_dispatch( struct r2_timer_wheel * self )
+{
+    int64_t expirations = r2_timerfd_expirations( self->fd );
+    if( -1 == expirations )
+        return -1;
+    if( expirations )
+        self->armed = 0; // a one-shot timerfd is disarmed once it fires
+
+    int64_t now = r2_timer_wheel_clock_nsec( self ) - self->origin_nsec;
+    int fired = r2_timer_wheel_advance( self,
+            now > 0 ? (uint64_t)( now / self->tick_nsec ) : 0 );
+
+    if( -1 == r2_timer_wheel_rearm( self ) )
+        return -1;
+    return fired;
+}
+
+#endif // R2_TIMER_WHEEL_I
@@ -4,13 +4,68 @@
 #ifndef R2_TIMERFD_H
 #define R2_TIMERFD_H
 
+#include <errno.h> // for errno, EAGAIN
+#include <inttypes.h> // for int64_t
+#include <stdio.h> // for fprintf, perror, stderr
+#include <stdlib.h> // for exit
 #include <time.h>
+#include <unistd.h> // for read
+#include <sys/prctl.h> // for prctl, PR_SET_TIMERSLACK
 #include <sys/timerfd.h>
 
+#include "r2_epoch.h"
+
 int r2_timerfd_new( int clock, int flags );
 
 void r2_timerfd_arm( const int fd, const time_t t, const time_t ti );
 
+/*  Arm a timer with nanosecond resolution.
+ *
+ *  flags is passed to timerfd_settime, so TFD_TIMER_ABSTIME makes t an
+ *  absolute time on the timer's clock. A zero t disarms the timer; a zero
+ *  ti makes it one-shot.
+ *
+ *  Returns 0, or -1 on error.
+ */
+int r2_timerfd_arm_timespec( const int fd, const int flags,
+        const struct timespec t, const struct timespec ti );
+
+/*  Arm a timer to expire t ns from now, then every ti ns.
+ */
+int r2_timerfd_arm_nsec( const int fd, const int64_t t, const int64_t ti );
+
+/*  Arm a timer to expire at absolute time t ns on its clock, then every
+ *  ti ns. Because the interval is kept by the kernel from an absolute
+ *  start, a periodic schedule armed this way does not drift.
+ */
+int r2_timerfd_arm_abs_nsec( const int fd, const int64_t t, const int64_t ti );
+
+/*  Arm a periodic timer phase-aligned to its clock.
+ *
+ *  The timer fires at every whole multiple of period_nsec on clock (which
+ *  must be the clock the timer was created with), e.g. on each 5 ms
+ *  boundary of CLOCK_REALTIME for a 200 Hz loop aligned to the second.
+ *  Returns -1 if period_nsec is not positive.
+ */
+int r2_timerfd_arm_aligned( const int fd, const int clock,
+        const int64_t period_nsec );
+
+/*  Read the number of expirations since the last read.
+ *
+ *  More than one means expirations were missed (count - 1 of them).
+ *  Returns 0 if the timer has not expired (non-blocking timer), or -1 on
+ *  error.
+ */
+int64_t r2_timerfd_expirations( const int fd );
+
+/*  Set the calling thread's timer slack (PR_SET_TIMERSLACK).
+ *
+ *  Lets the kernel delay the thread's poll/select/sleep timeouts by up to
+ *  slack_nsec to batch wakeups; 0 restores the default.
+ *  Returns 0, or -1 on error.
+ */
+int r2_timerfd_timerslack( const unsigned long slack_nsec );
+
 int r2_timerfd_armed( const int fd );
 
 int64_t r2_timerfd_usec_remaining( const int fd );
@@ -31,13 +86,68 @@ int r2_timerfd_new( int clock, int flags ) {
 
 
 void r2_timerfd_arm( const int fd, const time_t t, const time_t ti ) {
-    struct itimerspec its = { { ti, 0 }, { t, 0 } };
-    if( -1 == timerfd_settime( fd, 0, &its, NULL ) ) {
+    struct timespec value = { t, 0 };
+    struct timespec interval = { ti, 0 };
+    if( -1 == r2_timerfd_arm_timespec( fd, 0, value, interval ) )
+        exit( EXIT_FAILURE );
+}
+
+int r2_timerfd_arm_timespec( const int fd, const int flags,
+        const struct timespec t, const struct timespec ti ) {
+    struct itimerspec its = { ti, t };
+    if( -1 == timerfd_settime( fd, flags, &its, NULL ) ) {
         perror( "timerfd_settime" );
         fprintf( stderr, "failed to set timer %d: ", fd );
-        fprintf( stderr, "%ld s, interval %ld s\n", t, ti );
-        exit( EXIT_FAILURE );
+        fprintf( stderr, "%ld.%09ld s, interval %ld.%09ld s\n",
+                (long)t.tv_sec, t.tv_nsec, (long)ti.tv_sec, ti.tv_nsec );
+        return -1;
+    }
+    return 0;
+}
+
+int r2_timerfd_arm_nsec( const int fd, const int64_t t, const int64_t ti ) {
+    return r2_timerfd_arm_timespec( fd, 0, r2_epoch_nsec_to_timespec( t ),
+            r2_epoch_nsec_to_timespec( ti ) );
+}
+
+int r2_timerfd_arm_abs_nsec( const int fd, const int64_t t, const int64_t ti ) {
+    return r2_timerfd_arm_timespec( fd, TFD_TIMER_ABSTIME,
+            r2_epoch_nsec_to_timespec( t ), r2_epoch_nsec_to_timespec( ti ) );
+}
+
+int r2_timerfd_arm_aligned( const int fd, const int clock,
+        const int64_t period_nsec ) {
+    if( period_nsec <= 0 ) {
+        fprintf( stderr, "r2_timerfd_arm_aligned needs a positive period\n" );
+        return -1;
+    }
+    struct timespec now;
+    if( -1 == clock_gettime( clock, &now ) ) {
+        perror( "clock_gettime" );
+        return -1;
+    }
+    int64_t t = r2_epoch_timespec_to_nsec( now );
+    t = ( t / period_nsec + 1 ) * period_nsec;
+    return r2_timerfd_arm_abs_nsec( fd, t, period_nsec );
+}
+
+int64_t r2_timerfd_expirations( const int fd ) {
+    uint64_t expirations = 0;
+    if( -1 == read( fd, &expirations, sizeof( expirations ) ) ) {
+        if( EAGAIN == errno )
+            return 0;
+        perror( "read timerfd" );
+        return -1;
+    }
+    return (int64_t)expirations;
+}
+
+int r2_timerfd_timerslack( const unsigned long slack_nsec ) {
+    if( -1 == prctl( PR_SET_TIMERSLACK, slack_nsec, 0, 0, 0 ) ) {
+        perror( "prctl PR_SET_TIMERSLACK" );
+        return -1;
     }
+    return 0;
 }
 
 int r2_timerfd_armed( const int fd ) {
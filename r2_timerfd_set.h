@@ -0,0 +1,336 @@
+// r2_timerfd_set.h
+// A set of timerfds whose deadlines are tracked in user space
+//
+// The set keeps each timer's absolute deadline and interval, and a cached
+// "now" that is refreshed once per event loop iteration, so asking whether a
+// timer is armed or how long it has left is a memory read instead of a
+// timerfd_gettime syscall. The kernel is only touched when a deadline
+// actually changes, or to acknowledge an expiration.
+//
+// Unlike r2_timerfd_arm, nothing here exits on error: functions return -1
+// and leave the timer's tracked state unchanged.
+//
+// In coalescing mode, a timer with a tolerance (slack) may be delayed by up
+// to that much so that it expires together with another armed timer, and
+// the process wakes up once for both. If no other timer expires within the
+// window, the expiry is rounded to the coarsest power-of-two nanosecond
+// boundary within it, so that independent timers tend to land on the same
+// instants (as the kernel does with its own timer slack). Periodic timers
+// with slack are then re-armed from r2_timerfd_set_expire for each period,
+// so they can join other timers' wakeups as their phases drift apart.
+
+#ifndef R2_TIMERFD_SET_H
+#define R2_TIMERFD_SET_H
+
+#include <inttypes.h> // for int64_t
+#include <stdio.h> // for fprintf, stderr
+#include <stdlib.h> // for calloc, free
+#include <unistd.h> // for close
+#include <sys/timerfd.h>
+
+#include "r2_epoch.h"
+#include "r2_timerfd.h"
+
+struct r2_timerfd_set_timer {
+    int fd;
+    int64_t deadline; // absolute ns it fires at on the set's clock, or 0
+    int64_t interval; // ns, 0 for one-shot
+    int64_t slack; // ns the expiry may be delayed to share a wakeup
+    int64_t nominal; // requested expiry, deadline - slack <= nominal
+    int rearm; // periodic, but re-armed in user space for each period
+};
+
+struct r2_timerfd_set {
+    int clock;
+    int64_t now; // ns, as of the last r2_timerfd_set_now
+    size_t size;
+    size_t count;
+    struct r2_timerfd_set_timer * timers;
+    int coalesce;
+    int64_t last_wakeup; // expiry time of the last acknowledged expiration
+    int64_t wakeups; // expirations acknowledged at distinct times
+    int64_t wakeups_saved; // expirations that shared an earlier wakeup
+};
+
+/*  Create an empty set with room for size timers on clock.
+ */
+struct r2_timerfd_set * r2_timerfd_set_create( const int clock,
+        const size_t size );
+
+/*  Close all the timers in the set and free it.
+ */
+void r2_timerfd_set_destroy( struct r2_timerfd_set * self );
+
+/*  Add a new (non-blocking, disarmed) timer to the set.
+ *
+ *  Returns the index of the timer in self->timers, or -1 if the set is
+ *  full or the timerfd could not be created.
+ */
+int r2_timerfd_set_add( struct r2_timerfd_set * self );
+
+/*  Refresh the cached time. Call once per event loop iteration.
+ */
+int64_t r2_timerfd_set_now( struct r2_timerfd_set * self );
+
+/*  Arm timer i to expire nsec after the cached time, then every
+ *  interval_nsec (0 for one-shot).
+ *
+ *  Returns 0, or -1 on error.
+ */
+int r2_timerfd_set_arm( struct r2_timerfd_set * self, const size_t i,
+        const int64_t nsec, const int64_t interval_nsec );
+
+/*  Arm timer i to expire at absolute time deadline on the set's clock.
+ *
+ *  No syscall is made if the timer is already armed identically.
+ */
+int r2_timerfd_set_arm_abs( struct r2_timerfd_set * self, const size_t i,
+        const int64_t deadline, const int64_t interval_nsec );
+
+int r2_timerfd_set_disarm( struct r2_timerfd_set * self, const size_t i );
+
+/*  Set how long timer i may be delayed to share a wakeup with another
+ *  timer in coalescing mode. Takes effect the next time it is armed.
+ */
+void r2_timerfd_set_slack( struct r2_timerfd_set * self, const size_t i,
+        const int64_t slack_nsec );
+
+/*  Enable or disable coalescing of expirations into shared wakeups.
+ *
+ *  self->wakeups and self->wakeups_saved count the distinct and shared
+ *  expiration times acknowledged by r2_timerfd_set_expire.
+ */
+void r2_timerfd_set_coalesce( struct r2_timerfd_set * self, const int on );
+
+/*  Whether timer i is armed, as of the cached time.
+ */
+int r2_timerfd_set_armed( const struct r2_timerfd_set * self,
+        const size_t i );
+
+/*  Time until timer i next expires, as of the cached time; 0 if it is not
+ *  armed or has already expired.
+ */
+int64_t r2_timerfd_set_nsec_remaining( const struct r2_timerfd_set * self,
+        const size_t i );
+
+int64_t r2_timerfd_set_usec_remaining( const struct r2_timerfd_set * self,
+        const size_t i );
+
+/*  Acknowledge expirations of timer i (when its fd is readable).
+ *
+ *  Advances the tracked deadline past the expirations read.
+ *  Returns the number of expirations (see r2_timerfd_expirations), or -1
+ *  on error.
+ */
+int64_t r2_timerfd_set_expire( struct r2_timerfd_set * self, const size_t i );
+
+#endif // R2_TIMERFD_SET_H
+
+#ifndef R2_TIMERFD_SET_I
+#define R2_TIMERFD_SET_I
+
+struct r2_timerfd_set * r2_timerfd_set_create( const int clock,
+        const size_t size )
+{
+    struct r2_timerfd_set * self = calloc( 1, sizeof( struct r2_timerfd_set ) );
+    if( NULL == self ) {
+        fprintf( stderr, "could not allocate r2_timerfd_set\n" );
+        return NULL;
+    }
+    self->timers = calloc( size, sizeof( struct r2_timerfd_set_timer ) );
+    if( NULL == self->timers ) {
+        fprintf( stderr, "could not allocate %zu timers\n", size );
+        free( self );
+        return NULL;
+    }
+    self->clock = clock;
+    self->size = size;
+    r2_timerfd_set_now( self );
+    return self;
+}
+
+void r2_timerfd_set_destroy( struct r2_timerfd_set * self )
+{
+    if( self ) {
+        size_t i;
+        for( i = 0; i < self->count; i++ )
+            close( self->timers[i].fd );
+        free( self->timers );
+        free( self );
+    }
+}
+
+int r2_timerfd_set_add( struct r2_timerfd_set * self )
+{
+    if( self->count == self->size ) {
+        fprintf( stderr, "r2_timerfd_set full (%zu timers)\n", self->size );
+        return -1;
+    }
+    int fd = r2_timerfd_new( self->clock, TFD_NONBLOCK | TFD_CLOEXEC );
+    if( -1 == fd )
+        return -1;
+    struct r2_timerfd_set_timer * timer = &self->timers[self->count];
+    timer->fd = fd;
+    timer->deadline = 0;
+    timer->interval = 0;
+    timer->slack = 0;
+    timer->nominal = 0;
+    timer->rearm = 0;
+    return (int)self->count++;
+}
+
+int64_t r2_timerfd_set_now( struct r2_timerfd_set * self )
+{
+    struct timespec t;
+    clock_gettime( self->clock, &t );
+    self->now = r2_epoch_timespec_to_nsec( t );
+    return self->now;
+}
+
+int r2_timerfd_set_arm( struct r2_timerfd_set * self, const size_t i,
+        const int64_t nsec, const int64_t interval_nsec )
+{
+    return r2_timerfd_set_arm_abs( self, i, self->now + nsec, interval_nsec );
+}
+
+// Expiry for timer i within its tolerance window from a nominal expiry:
+// the earliest expiry of another armed timer in the window, or else the
+// coarsest power-of-two boundary in the window.
+int64_t r2_timerfd_set_coalesced( const struct r2_timerfd_set * self,
+        const size_t i, const int64_t nominal )
+{
+    int64_t latest = nominal + self->timers[i].slack;
+    int64_t best = 0;
+    size_t j;
+    for( j = 0; j < self->count; j++ ) {
+        if( ( j == i ) || !r2_timerfd_set_armed( self, j ) )
+            continue;
+        int64_t t = self->now + r2_timerfd_set_nsec_remaining( self, j );
+        if( ( t >= nominal ) && ( t <= latest ) && ( !best || t < best ) )
+            best = t;
+    }
+    if( best )
+        return best;
+
+    // a window of slack + 1 ns always contains a multiple of the largest
+    // power of two not above it; twice that may fit too
+    int k = 63 - __builtin_clzll( (uint64_t)self->timers[i].slack + 1 );
+    int64_t grid = (int64_t)1 << ( k + 1 );
+    if( latest - latest % grid < nominal )
+        grid >>= 1;
+    return latest - latest % grid;
+}
+
+int r2_timerfd_set_arm_abs( struct r2_timerfd_set * self, const size_t i,
+        const int64_t deadline, const int64_t interval_nsec )
+{
+    struct r2_timerfd_set_timer * timer = &self->timers[i];
+    int64_t at = deadline;
+    int rearm = 0;
+    if( self->coalesce && ( timer->slack > 0 ) ) {
+        at = r2_timerfd_set_coalesced( self, i, deadline );
+        rearm = ( 0 != interval_nsec );
+    }
+    if( ( at == timer->deadline ) && ( interval_nsec == timer->interval )
+            && ( rearm == timer->rearm ) && r2_timerfd_set_armed( self, i ) )
+        return 0;
+    if( -1 == r2_timerfd_arm_abs_nsec( timer->fd, at,
+                rearm ? 0 : interval_nsec ) )
+        return -1;
+    timer->deadline = at;
+    timer->nominal = deadline;
+    timer->interval = interval_nsec;
+    timer->rearm = rearm;
+    return 0;
+}
+
+int r2_timerfd_set_disarm( struct r2_timerfd_set * self, const size_t i )
+{
+    struct r2_timerfd_set_timer * timer = &self->timers[i];
+    if( 0 == timer->deadline )
+        return 0;
+    if( -1 == r2_timerfd_arm_nsec( timer->fd, 0, 0 ) )
+        return -1;
+    timer->deadline = 0;
+    timer->interval = 0;
+    timer->rearm = 0;
+    return 0;
+}
+
+void r2_timerfd_set_slack( struct r2_timerfd_set * self, const size_t i,
+        const int64_t slack_nsec )
+{
+    self->timers[i].slack = slack_nsec;
+}
+
+void r2_timerfd_set_coalesce( struct r2_timerfd_set * self, const int on )
+{
+    self->coalesce = on;
+}
+
+int r2_timerfd_set_armed( const struct r2_timerfd_set * self,
+        const size_t i )
+{
+    const struct r2_timerfd_set_timer * timer = &self->timers[i];
+    return ( 0 != timer->deadline )
+        && ( ( timer->deadline > self->now ) || ( 0 != timer->interval ) );
+}
+
+int64_t r2_timerfd_set_nsec_remaining( const struct r2_timerfd_set * self,
+        const size_t i )
+{
+    const struct r2_timerfd_set_timer * timer = &self->timers[i];
+    if( 0 == timer->deadline )
+        return 0;
+    int64_t remaining = timer->deadline - self->now;
+    if( ( remaining < 0 ) && timer->interval ) {
+        // periodic: expirations not yet acknowledged; find the next one
+        remaining = timer->interval - ( -remaining ) % timer->interval;
+    }
+    return remaining > 0 ? remaining : 0;
+}
+
+int64_t r2_timerfd_set_usec_remaining( const struct r2_timerfd_set * self,
+        const size_t i )
+{
+    return r2_timerfd_set_nsec_remaining( self, i ) / R2_EPOCH_NSEC_PER_USEC;
+}
+
+int64_t r2_timerfd_set_expire( struct r2_timerfd_set * self, const size_t i )
+{
+    struct r2_timerfd_set_timer * timer = &self->timers[i];
+    int64_t expirations = r2_timerfd_expirations( timer->fd );
+    if( expirations <= 0 )
+        return expirations;
+
+    int64_t fired = timer->deadline;
+    if( timer->interval && !timer->rearm )
+        fired += ( expirations - 1 ) * timer->interval;
+    if( fired == self->last_wakeup ) {
+        self->wakeups_saved++;
+    } else {
+        self->last_wakeup = fired;
+        self->wakeups++;
+    }
+
+    if( 0 == timer->interval ) {
+        timer->deadline = 0;
+    } else if( !timer->rearm ) {
+        timer->deadline = fired + timer->interval;
+        timer->nominal = timer->deadline;
+    } else {
+        int64_t next = timer->nominal + timer->interval;
+        if( next <= self->now ) // skip periods missed entirely
+            next += ( ( self->now - next ) / timer->interval + 1 )
+                * timer->interval;
+        int64_t deadline = timer->deadline;
+        timer->deadline = 0; // so the re-arm below is not skipped
+        if( -1 == r2_timerfd_set_arm_abs( self, i, next, timer->interval ) ) {
+            timer->deadline = deadline;
+            return -1;
+        }
+    }
+    return expirations;
+}
+
+#endif // R2_TIMERFD_SET_I
@@ -0,0 +1,99 @@
+// r2_transport.h
+// Where the bridges publish their messages
+//
+// The bridges (r2_serial_lcm.h, r2_adc_lcm.h) encode LCM messages and hand
+// them to a transport: a publish function and its context. Two are
+// provided:
+//
+//  - r2_transport_shm publishes into an r2_shm_ring, for consumers on the
+//    same host, which then read messages with no syscall or kernel copy;
+//  - r2_transport_lcm (built with R2_WITH_LCM) publishes on an lcm_t, over
+//    LCM's UDP multicast.
+//
+// Either way the messages are the same LCM encoding, so consumers decode
+// them the same way. Other transports only need a publish function.
+
+#ifndef R2_TRANSPORT_H
+#define R2_TRANSPORT_H
+
+#include <stddef.h> // for size_t
+
+#ifdef R2_WITH_LCM
+#include <lcm/lcm.h>
+#endif
+
+#include "r2_shm_ring.h"
+
+/*  Publish size bytes of an encoded message on channel; returns 0 on
+ *  success, or non-zero if the message could not be sent (e.g. because
+ *  the consumer lags behind).
+ */
+typedef int ( * r2_transport_publisher )( void * context,
+        const char * channel, const void * data, const size_t size );
+
+struct r2_transport {
+    r2_transport_publisher publish;
+    void * context; // passed to publish
+};
+
+/*  Publish through the transport.
+ */
+int r2_transport_publish( const struct r2_transport * self,
+        const char * channel, const void * data, const size_t size );
+
+/*  A transport publishing into ring, as its producer. The ring never
+ *  refuses a message that fits; consumers that lag lose messages instead.
+ */
+struct r2_transport r2_transport_shm( struct r2_shm_ring * ring );
+
+int r2_transport_shm_publish( void * context, const char * channel,
+        const void * data, const size_t size );
+
+#ifdef R2_WITH_LCM
+/*  A transport publishing on lcm.
+ */
+struct r2_transport r2_transport_lcm( lcm_t * lcm );
+
+int r2_transport_lcm_publish( void * context, const char * channel,
+        const void * data, const size_t size );
+#endif
+
+#endif // R2_TRANSPORT_H
+
+#ifndef R2_TRANSPORT_I
+#define R2_TRANSPORT_I
+
+int r2_transport_publish( const struct r2_transport * self,
+        const char * channel, const void * data, const size_t size )
+{
+    return self->publish( self->context, channel, data, size );
+}
+
+struct r2_transport r2_transport_shm( struct r2_shm_ring * ring )
+{
+    struct r2_transport t = { r2_transport_shm_publish, ring };
+    return t;
+}
+
+int r2_transport_shm_publish( void * context, const char * channel,
+        const void * data, const size_t size )
+{
+    return r2_shm_ring_write( (struct r2_shm_ring *)context, channel, data,
+            size );
+}
+
+#ifdef R2_WITH_LCM
+struct r2_transport r2_transport_lcm( lcm_t * lcm )
+{
+    struct r2_transport t = { r2_transport_lcm_publish, lcm };
+    return t;
+}
+
+int r2_transport_lcm_publish( void * context, const char * channel,
+        const void * data, const size_t size )
+{
+    return lcm_publish( (lcm_t *)context, channel, data, (unsigned int)size );
+}
+#endif
+
+#endif // R2_TRANSPORT_I
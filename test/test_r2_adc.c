@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r2_adc.h"
+
+#define CHANNELS 16
+#define ROWS 1000
+
+static size_t parse( const char * s, const int base, int32_t * values,
+        const size_t max )
+{
+    static char line[256];
+    memset( line, 'x', sizeof( line ) ); // junk in the padding
+    memcpy( line, s, strlen( s ) );
+    return r2_adc_parse( line, strlen( s ), base, values, max );
+}
+
+int main( void ){
+    int32_t v[8];
+
+    // separators, signs and runs of digits across word boundaries
+    assert( 5 == parse( "1,-22\t333 +4444 123456789", 10, v, 8 ) );
+    assert( 1 == v[0] && -22 == v[1] && 333 == v[2] && 4444 == v[3]
+            && 123456789 == v[4] );
+    assert( 3 == parse( "a=00000000000000000042 b=-7 c=0\r", 10, v, 8 ) );
+    assert( 42 == v[0] && -7 == v[1] && 0 == v[2] );
+    assert( 2 == parse( "99999999999 -2147483649", 10, v, 8 ) );
+    assert( INT32_MAX == v[0] && INT32_MIN == v[1] );
+    assert( 0 == parse( "", 10, v, 8 ) );
+    assert( 0 == parse( "   ,  \t ; ", 10, v, 8 ) );
+    assert( 3 == parse( "1 2 3", 10, v, 2 ) ); // counted, not stored
+    assert( 1 == v[0] && 2 == v[1] );
+
+    assert( 4 == parse( "0x1A2b ffffffff 0X7fffffff deadbeef", 16, v, 8 ) );
+    assert( 0x1a2b == v[0] && -1 == v[1] && INT32_MAX == v[2]
+            && (int32_t)0xdeadbeef == v[3] );
+    assert( 2 == parse( "123456789abcdef0 0", 16, v, 8 ) ); // low 32 bits
+    assert( (int32_t)0x9abcdef0 == v[0] && 0 == v[1] );
+
+    // random values agree with strtol
+    char s[64];
+    int n;
+    srand( 40 );
+    for( n = 0; n < 100000; n++ ) {
+        long a = rand() - RAND_MAX / 2, b = rand() >> ( rand() % 31 );
+        int w = rand() % 12;
+        snprintf( s, sizeof( s ), "%0*ld %ld;%ld", w, a, b,
+                (long)( a & 0xffff ) );
+        assert( 3 == parse( s, 10, v, 3 ) );
+        assert( a == v[0] && b == v[1] && ( a & 0xffff ) == v[2] );
+        snprintf( s, sizeof( s ), "%0*lX,%lx", w, b, (long)( a & 0xffff ) );
+        assert( 2 == parse( s, 16, v, 2 ) );
+        assert( b == v[0] && ( a & 0xffff ) == v[1] );
+    }
+
+    // stream rows of 16 channels through a pipe, in odd-sized pieces
+    static char text[ROWS * CHANNELS * 12];
+    static int32_t truth[ROWS][CHANNELS], raw[ROWS][CHANNELS];
+    static float f[ROWS][CHANNELS];
+    static double d[ROWS][CHANNELS];
+    size_t length = 0;
+    int r, c;
+    for( r = 0; r < ROWS; r++ ) {
+        for( c = 0; c < CHANNELS; c++ ) {
+            truth[r][c] = ( rand() % 65536 ) - 32768;
+            length += sprintf( text + length, "%d%s", truth[r][c],
+                    c + 1 < CHANNELS ? " " : "\r\n" );
+        }
+        if( 10 == r ) // a short line, and a blank one
+            length += sprintf( text + length, "1 2 3\n\n" );
+    }
+    struct r2_adc * adc = r2_adc_create( CHANNELS, 10, 1000 );
+    for( c = 0; c < CHANNELS; c++ )
+        r2_adc_set_scale( adc, c, 10.0 / 32768, c );
+    int fd[2];
+    assert( 0 == pipe( fd ) );
+    size_t written = 0, rows = 0;
+    while( rows < ROWS ) {
+        if( written < length ) {
+            size_t piece = 1 + rand() % 300;
+            piece = piece < length - written ? piece : length - written;
+            assert( piece == (size_t)write( fd[1], text + written, piece ) );
+            written += piece;
+            r2_adc_fill( adc, fd[0] );
+        }
+        size_t got;
+        if( rows % 2 )
+            got = r2_adc_get_raw( adc, raw[rows], ROWS - rows );
+        else
+            got = r2_adc_get_float( adc, f[rows], ROWS - rows );
+        for( r = rows; r < (int)( rows + got ); r++ )
+            for( c = 0; c < CHANNELS; c++ ) {
+                if( rows % 2 )
+                    assert( truth[r][c] == raw[r][c] );
+                else
+                    assert( fabsf( f[r][c] - ( truth[r][c] * 10.0f / 32768
+                                    + c ) ) < 1e-5f );
+            }
+        rows += got;
+    }
+    assert( ROWS == adc->rows && 1 == adc->dropped );
+    assert( 0 == adc->buffer->position );
+
+    // the kernels on their own
+    r2_adc_scale_d( &truth[0][0], ROWS, CHANNELS, adc->scale, adc->offset,
+            &d[0][0] );
+    for( r = 0; r < ROWS; r++ )
+        for( c = 0; c < CHANNELS; c++ )
+            assert( d[r][c] == truth[r][c] * ( 10.0 / 32768 ) + c );
+
+    // a buffer full of junk without any line is cleared
+    memset( text, 'z', 1000 );
+    assert( 1000 == write( fd[1], text, 1000 ) );
+    r2_adc_fill( adc, fd[0] );
+    assert( 0 == r2_adc_get_double( adc, &d[0][0], ROWS ) );
+    assert( 0 == adc->buffer->position && 2 == adc->dropped );
+
+    close( fd[0] );
+    close( fd[1] );
+    r2_adc_destroy( adc );
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "r2_adc_filter.h"
+
+#define CHANNELS 19 // a block of 16 and three more
+#define ROWS 5000
+#define TAPS 61
+#define FACTOR 4
+
+// gain of a FIR filter at f cycles per sample
+static double response( const float * h, const size_t taps, const double f )
+{
+    double re = 0, im = 0;
+    size_t k;
+    for( k = 0; k < taps; k++ ) {
+        re += h[k] * cos( 2 * M_PI * f * k );
+        im -= h[k] * sin( 2 * M_PI * f * k );
+    }
+    return sqrt( re * re + im * im );
+}
+
+int main( void ){
+    static float in[ROWS][CHANNELS], out[ROWS][CHANNELS], again[ROWS][CHANNELS];
+    static int32_t raw[ROWS][CHANNELS];
+    float h[TAPS];
+    size_t r, c, k, n;
+    srand( 42 );
+    for( r = 0; r < ROWS; r++ )
+        for( c = 0; c < CHANNELS; c++ ) {
+            raw[r][c] = rand() % 65536 - 32768;
+            in[r][c] = raw[r][c];
+        }
+
+    // the low-pass design
+    r2_adc_fir_lowpass( h, TAPS, 0.1 );
+    double sum = 0;
+    for( k = 0; k < TAPS; k++ ) {
+        sum += h[k];
+        assert( h[k] == h[TAPS - 1 - k] );
+    }
+    assert( fabs( sum - 1 ) < 1e-6 );
+    assert( fabs( response( h, TAPS, 0.02 ) - 1 ) < 1e-3 );
+    assert( response( h, TAPS, 0.1 + 5.5 / TAPS ) < 2e-4 );
+    assert( response( h, TAPS, 0.4 ) < 2e-4 );
+
+    // decimation agrees with the direct form, fed in one go or in blocks
+    // of any size
+    struct r2_adc_fir * fir = r2_adc_fir_create( CHANNELS, h, TAPS, FACTOR );
+    n = r2_adc_fir_process( fir, &in[0][0], ROWS, &out[0][0] );
+    assert( ROWS / FACTOR == n );
+    double e = 0;
+    for( r = 0; r < n; r++ )
+        for( c = 0; c < CHANNELS; c++ ) {
+            double y = 0;
+            for( k = 0; k < TAPS && k <= r * FACTOR; k++ )
+                y += h[k] * (double)in[r * FACTOR - k][c];
+            e = fabs( out[r][c] - y ) > e ? fabs( out[r][c] - y ) : e;
+        }
+    printf( "fir error %.3g\n", e );
+    assert( e < 1e-2 ); // of samples up to 32768
+
+    r2_adc_fir_reset( fir );
+    size_t used = 0, m = 0;
+    while( used < ROWS ) {
+        size_t take = rand() % 700;
+        take = take < ROWS - used ? take : ROWS - used;
+        m += r2_adc_fir_process( fir, &in[used][0], take, &again[m][0] );
+        used += take;
+    }
+    assert( n == m );
+    assert( 0 == memcmp( out, again, n * sizeof( out[0] ) ) );
+
+    // decimating by more than the taps skips rows
+    r2_adc_fir_destroy( fir );
+    fir = r2_adc_fir_create( CHANNELS, h, 3, 10 );
+    n = r2_adc_fir_process( fir, &in[0][0], 995, &out[0][0] );
+    n += r2_adc_fir_process( fir, &in[995][0], 6, &out[n][0] );
+    assert( 101 == n );
+    assert( out[100][5] == h[0] * in[1000][5] + h[1] * in[999][5]
+            + h[2] * in[998][5] );
+    r2_adc_fir_destroy( fir );
+
+    // CIC: a boxcar of factor rows, order times over, then decimated
+    unsigned order = 4;
+    size_t factor = 25;
+    struct r2_adc_cic * cic = r2_adc_cic_create( CHANNELS, order, factor );
+    assert( cic );
+    used = 0;
+    m = 0;
+    while( used < ROWS ) {
+        size_t take = rand() % 300;
+        take = take < ROWS - used ? take : ROWS - used;
+        m += r2_adc_cic_process( cic, &raw[used][0], take, &out[m][0] );
+        used += take;
+    }
+    assert( ROWS / factor == m );
+    static double box[ROWS][CHANNELS];
+    for( r = 0; r < ROWS; r++ )
+        for( c = 0; c < CHANNELS; c++ )
+            box[r][c] = raw[r][c];
+    unsigned s;
+    for( s = 0; s < order; s++ )
+        for( c = 0; c < CHANNELS; c++ )
+            for( r = ROWS; r-- > 0; ) {
+                double y = 0;
+                for( k = 0; k < factor && k <= r; k++ )
+                    y += box[r - k][c];
+                box[r][c] = y / factor;
+            }
+    e = 0;
+    for( r = 0; r < m; r++ )
+        for( c = 0; c < CHANNELS; c++ ) {
+            double d = fabs( out[r][c] - box[r * factor + factor - 1][c] );
+            e = d > e ? d : e;
+        }
+    printf( "cic error %.3g\n", e );
+    assert( e < 1e-2 );
+
+    // the integrators wrap around over a long run of large values, but
+    // the output does not
+    int32_t big[CHANNELS];
+    float y[CHANNELS];
+    for( c = 0; c < CHANNELS; c++ )
+        big[c] = INT32_MAX - c;
+    for( r = 0; r < 100000; r++ )
+        if( r2_adc_cic_process( cic, big, 1, y ) && r > 1000 )
+            for( c = 0; c < CHANNELS; c++ )
+                assert( y[c] == (float)( INT32_MAX - c ) );
+    for( c = 0; c < CHANNELS; c++ )
+        big[c] = INT32_MIN;
+    for( r = 0; r < 1000; r++ )
+        r2_adc_cic_process( cic, big, 1, y );
+    assert( y[0] == (float)INT32_MIN );
+    r2_adc_cic_destroy( cic );
+
+    assert( NULL == r2_adc_cic_create( CHANNELS, 5, 100 ) ); // 33 bits
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "r2_adc_iio.h"
+
+#define SCANS 1000
+
+static char device[64];
+
+static void put( const char * name, const char * text )
+{
+    char path[256];
+    snprintf( path, sizeof( path ), "%s/%s", device, name );
+    FILE * f = fopen( path, "w" );
+    assert( f );
+    fputs( text, f );
+    fclose( f );
+}
+
+static void element( const char * name, const int en, const int index,
+        const char * type )
+{
+    char file[128], text[32];
+    snprintf( file, sizeof( file ), "scan_elements/%s_en", name );
+    snprintf( text, sizeof( text ), "%d\n", en );
+    put( file, text );
+    snprintf( file, sizeof( file ), "scan_elements/%s_index", name );
+    snprintf( text, sizeof( text ), "%d\n", index );
+    put( file, text );
+    snprintf( file, sizeof( file ), "scan_elements/%s_type", name );
+    put( file, type );
+}
+
+int main( void ){
+    // a fake sysfs directory of a device with three enabled voltage
+    // channels in different formats, one disabled, and a timestamp
+    char path[128];
+    snprintf( device, sizeof( device ), "/tmp/r2_adc_iio_XXXXXX" );
+    assert( mkdtemp( device ) );
+    snprintf( path, sizeof( path ), "%s/scan_elements", device );
+    assert( 0 == mkdir( path, 0700 ) );
+    snprintf( path, sizeof( path ), "%s/buffer", device );
+    assert( 0 == mkdir( path, 0700 ) );
+    put( "buffer/length", "2\n" );
+    put( "buffer/enable", "0\n" );
+    element( "in_timestamp", 1, 4, "le:s64/64>>0\n" );
+    element( "in_voltage3", 1, 3, "le:s24/32>>0\n" );
+    element( "in_voltage2", 0, 2, "le:u16/16>>0\n" );
+    element( "in_voltage1", 1, 1, "be:u10/16>>2\n" );
+    element( "in_voltage0", 1, 0, "le:s12/16>>4\n" );
+    put( "in_voltage_scale", "0.5\n" ); // shared by type
+    put( "in_voltage0_offset", "-10\n" );
+    put( "in_voltage3_scale", "0.001\n" );
+
+    struct r2_adc_iio * adc = r2_adc_iio_create( device, 1000 );
+    assert( adc );
+    assert( 4 == adc->count && 3 == adc->channels && 3 == adc->timestamp );
+    assert( 0 == adc->channel[0].offset && 2 == adc->channel[1].offset
+            && 4 == adc->channel[2].offset && 8 == adc->channel[3].offset );
+    assert( 16 == adc->record && 992 == adc->buffer->size );
+    assert( 0.5 == adc->scale[0] && -5 == adc->offset[0] );
+    assert( 0.5 == adc->scale[1] && 0 == adc->offset[1] );
+    assert( 0.001 == adc->scale[2] );
+
+    assert( 0 == r2_adc_iio_enable( adc, 4096, 1 ) );
+    char text[16];
+    assert( 4 == r2_adc_iio_read_file( device, "buffer/length", text, 16 ) );
+    assert( 0 == strcmp( "4096", text ) );
+    assert( 1 == r2_adc_iio_read_file( device, "buffer/enable", text, 16 ) );
+    assert( 0 == strcmp( "1", text ) );
+
+    // synthetic scans, with junk in the bits outside each sample
+    static unsigned char data[SCANS * 16];
+    static int32_t truth[SCANS][3], raw[SCANS][3];
+    static int64_t stamp[SCANS], ts[SCANS];
+    static float f[SCANS][3];
+    static double d[SCANS][3];
+    int s, c;
+    srand( 41 );
+    for( s = 0; s < SCANS; s++ ) {
+        unsigned char * p = data + 16 * s;
+        truth[s][0] = rand() % 4096 - 2048;
+        truth[s][1] = rand() % 1024;
+        truth[s][2] = rand() % ( 1 << 24 ) - ( 1 << 23 );
+        stamp[s] = 1700000000000000000LL + s * 1000000LL;
+        uint16_t a = (uint16_t)( ( (uint32_t)truth[s][0] << 4 )
+                | ( rand() & 0xf ) );
+        p[0] = a & 0xff;
+        p[1] = a >> 8;
+        uint16_t b = (uint16_t)( truth[s][1] << 2 | 0x8003 );
+        p[2] = b >> 8;
+        p[3] = b & 0xff;
+        uint32_t x = ( (uint32_t)truth[s][2] & 0xffffff ) | 0x5a000000;
+        for( c = 0; c < 4; c++ )
+            p[4 + c] = ( x >> ( 8 * c ) ) & 0xff;
+        for( c = 0; c < 8; c++ )
+            p[8 + c] = ( (uint64_t)stamp[s] >> ( 8 * c ) ) & 0xff;
+    }
+
+    int fd[2];
+    assert( 0 == pipe( fd ) );
+    size_t written = 0, scans = 0;
+    while( scans < SCANS ) {
+        if( written < sizeof( data ) ) {
+            size_t piece = 1 + rand() % 200;
+            piece = piece < sizeof( data ) - written
+                ? piece : sizeof( data ) - written;
+            assert( piece == (size_t)write( fd[1], data + written, piece ) );
+            written += piece;
+            r2_adc_iio_fill( adc, fd[0] );
+        }
+        size_t got;
+        switch( scans % 3 ) {
+        case 0:
+            got = r2_adc_iio_get_raw( adc, raw[scans], ts + scans,
+                    SCANS - scans );
+            break;
+        case 1:
+            got = r2_adc_iio_get_float( adc, f[scans], ts + scans,
+                    SCANS - scans );
+            break;
+        default:
+            got = r2_adc_iio_get_double( adc, d[scans], ts + scans,
+                    SCANS - scans );
+        }
+        for( s = scans; s < (int)( scans + got ); s++ ) {
+            assert( stamp[s] == ts[s] );
+            for( c = 0; c < 3; c++ ) {
+                double e = ( truth[s][c] + ( 0 == c ? -10 : 0 ) )
+                    * ( 2 == c ? 0.001 : 0.5 );
+                if( 0 == scans % 3 )
+                    assert( truth[s][c] == raw[s][c] );
+                else if( 1 == scans % 3 )
+                    assert( fabs( f[s][c] - e ) < 1e-6 * fabs( e ) + 1e-6 );
+                else
+                    assert( fabs( d[s][c] - e ) < 1e-9 );
+            }
+        }
+        scans += got;
+    }
+    assert( SCANS == adc->scans && 0 == adc->buffer->position );
+
+    close( fd[0] );
+    close( fd[1] );
+    r2_adc_iio_destroy( adc );
+
+    // a 64-bit channel that is not the timestamp is a sample
+    element( "in_count5", 1, 5, "le:s40/64>>0\n" );
+    adc = r2_adc_iio_create( device, 1000 );
+    assert( adc );
+    assert( 5 == adc->count && 4 == adc->channels && 3 == adc->timestamp );
+    assert( 16 == adc->channel[4].offset && 24 == adc->record );
+    unsigned char scan[24];
+    memcpy( scan, data, 16 );
+    int64_t count = -12345;
+    for( c = 0; c < 8; c++ )
+        scan[16 + c] = ( ( c < 5 ? (uint64_t)count : 0xa5 ) >> ( 8 * c ) )
+            & 0xff; // junk above the 40 bits
+    assert( 0 == pipe( fd ) );
+    assert( 24 == write( fd[1], scan, 24 ) );
+    r2_adc_iio_fill( adc, fd[0] );
+    int32_t sample[4];
+    assert( 1 == r2_adc_iio_get_raw( adc, sample, ts, 1 ) );
+    assert( truth[0][0] == sample[0] && truth[0][2] == sample[2]
+            && count == sample[3] && stamp[0] == ts[0] );
+    close( fd[0] );
+    close( fd[1] );
+    r2_adc_iio_destroy( adc );
+
+    // nothing enabled
+    element( "in_count5", 0, 5, "le:s40/64>>0\n" );
+    element( "in_timestamp", 0, 4, "le:s64/64>>0\n" );
+    element( "in_voltage3", 0, 3, "le:s24/32>>0\n" );
+    element( "in_voltage1", 0, 1, "be:u10/16>>2\n" );
+    element( "in_voltage0", 0, 0, "le:s12/16>>4\n" );
+    assert( NULL == r2_adc_iio_create( device, 1000 ) );
+
+    char command[128];
+    snprintf( command, sizeof( command ), "rm -r %s", device );
+    assert( 0 == system( command ) );
+    exit( EXIT_SUCCESS );
+}
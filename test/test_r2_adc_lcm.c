@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "r2_adc_lcm.h"
+
+#define CHANNELS 16
+#define RATE 1000 // samples per second
+#define ROWS 10000 // ten seconds
+#define BLOCK 10
+
+// an in-process stand-in for LCM: keep the messages published
+static unsigned char store[1 << 21];
+static size_t stored, count, offset[2 * ROWS], size[2 * ROWS];
+static int fail;
+
+static int publish( void * context, const char * channel, const void * data,
+        const size_t n )
+{
+    assert( 0 == strcmp( "ADC", channel ) );
+    assert( &stored == context );
+    if( fail )
+        return -1;
+    memcpy( store + stored, data, n );
+    offset[count] = stored;
+    size[count++] = n;
+    stored += n;
+    return 0;
+}
+
+static void reset( void )
+{
+    count = stored = 0;
+}
+
+int main( void ){
+    static float in[ROWS][CHANNELS], out[ROWS][CHANNELS];
+    size_t r, c, m, dropped;
+    int64_t utime, last;
+    ssize_t n;
+    srand( 42 );
+    for( r = 0; r < ROWS; r++ )
+        for( c = 0; c < CHANNELS; c++ )
+            in[r][c] = (float)( rand() % 65536 - 32768 ) / 7;
+
+    struct r2_transport transport = { publish, &stored };
+    struct r2_adc_lcm * bridge = r2_adc_lcm_create( CHANNELS, BLOCK, "ADC",
+            transport );
+    assert( bridge );
+    assert( NULL == r2_adc_lcm_create( CHANNELS, 0, "ADC", transport ) );
+
+    // 1 kHz read in chunks of any size: 100 messages per second, holding
+    // every sample in order
+    size_t used = 0, sent = 0;
+    while( used < ROWS ) {
+        size_t take = rand() % 37;
+        take = take < ROWS - used ? take : ROWS - used;
+        sent += r2_adc_lcm_push( bridge, &in[used][0], take,
+                (int64_t)( used + take ) * 1000000 / RATE );
+        used += take;
+    }
+    assert( ROWS / BLOCK == count && count == sent
+            && count == bridge->messages );
+    for( m = 0, r = 0; m < count; m++ ) {
+        n = r2_adc_lcm_decode( bridge, store + offset[m], size[m], &utime,
+                &last, &dropped, &out[r][0], ROWS - r );
+        assert( BLOCK == n && 0 == dropped );
+        assert( utime <= last && last >= (int64_t)( r + BLOCK ) * 1000 );
+        r += BLOCK;
+    }
+    assert( 0 == memcmp( in, out, sizeof( in ) ) );
+    assert( -1 == r2_adc_lcm_decode( bridge, store, size[0] - 1, &utime,
+                &last, &dropped, &out[0][0], ROWS ) );
+
+    // a partial block goes out once its latency runs out
+    reset();
+    r2_adc_lcm_set_latency( bridge, 20000 );
+    assert( 0 == r2_adc_lcm_push( bridge, &in[0][0], 3, 11000000 ) );
+    assert( 0 == r2_adc_lcm_poll( bridge, 11010000 ) );
+    assert( 1 == r2_adc_lcm_poll( bridge, 11020000 ) );
+    assert( 3 == r2_adc_lcm_decode( bridge, store, size[0], &utime, &last,
+                &dropped, &out[0][0], ROWS ) );
+    assert( 11000000 == utime && 0 == memcmp( in, out, 3 * sizeof( in[0] ) ) );
+    assert( 0 == r2_adc_lcm_poll( bridge, 11100000 ) );
+
+    // the minimum interval merges blocks that come too fast
+    reset();
+    r2_adc_lcm_set_interval( bridge, 25000 );
+    for( r = 0; r < 95; r++ )
+        r2_adc_lcm_push( bridge, &in[r][0], 1, 12000000 + r * 1000 );
+    assert( 1 == r2_adc_lcm_flush( bridge, 12200000 ) );
+    for( m = 0, r = 0; m < count; m++ ) {
+        n = r2_adc_lcm_decode( bridge, store + offset[m], size[m], &utime,
+                &last, &dropped, &out[r][0], ROWS - r );
+        assert( n > 0 && 0 == dropped );
+        assert( 0 == n % BLOCK || m == count - 1 ); // but the flushed rest
+        r += n;
+    }
+    assert( 95 == r && 0 == memcmp( in, out, 95 * sizeof( in[0] ) ) );
+    assert( count <= 5 ); // instead of 10
+    r2_adc_lcm_set_interval( bridge, 0 );
+    r2_adc_lcm_set_latency( bridge, 0 );
+
+    // a lagging consumer under the drop policy: blocks are lost, and the
+    // loss is reported with the next message
+    reset();
+    fail = 1;
+    assert( 0 == r2_adc_lcm_push( bridge, &in[0][0], 25, 13000000 ) );
+    assert( 2 == bridge->failures && 20 == bridge->lost );
+    fail = 0;
+    assert( 1 == r2_adc_lcm_push( bridge, &in[25][0], 5, 13001000 ) );
+    assert( BLOCK == r2_adc_lcm_decode( bridge, store, size[0], &utime, &last,
+                &dropped, &out[0][0], ROWS ) );
+    assert( 20 == dropped && 0 == memcmp( in[20], out, sizeof( out[0] ) ) );
+
+    // under the merge policy, samples wait for the next message, until
+    // the oldest block has to make room
+    reset();
+    assert( 0 == r2_adc_lcm_set_policy( bridge, R2_ADC_LCM_MERGE, 3 ) );
+    fail = 1;
+    r2_adc_lcm_push( bridge, &in[0][0], 25, 14000000 );
+    assert( 25 == bridge->samples && 20 == bridge->lost );
+    fail = 0;
+    assert( 1 == r2_adc_lcm_push( bridge, &in[25][0], 5, 14001000 ) );
+    assert( 30 == r2_adc_lcm_decode( bridge, store, size[0], &utime, &last,
+                &dropped, &out[0][0], ROWS ) );
+    assert( 0 == dropped && 0 == memcmp( in, out, 30 * sizeof( in[0] ) ) );
+    assert( 14000000 == utime && 14001000 == last );
+
+    reset();
+    fail = 1;
+    r2_adc_lcm_push( bridge, &in[0][0], 40, 15000000 );
+    assert( 30 == bridge->samples && 30 == bridge->lost );
+    fail = 0;
+    assert( 1 == r2_adc_lcm_flush( bridge, 15001000 ) );
+    assert( 30 == r2_adc_lcm_decode( bridge, store, size[0], &utime, &last,
+                &dropped, &out[0][0], ROWS ) );
+    assert( 10 == dropped && 0 == memcmp( in[10], out, 30 * sizeof( in[0] ) ) );
+
+    // shrinking the message keeps the newest pending samples
+    reset();
+    fail = 1;
+    r2_adc_lcm_push( bridge, &in[0][0], 25, 16000000 );
+    assert( 25 == bridge->samples && 30 == bridge->lost );
+    assert( 0 == r2_adc_lcm_set_policy( bridge, R2_ADC_LCM_MERGE, 1 ) );
+    assert( BLOCK == bridge->samples && 45 == bridge->lost );
+    fail = 0;
+    assert( 1 == r2_adc_lcm_flush( bridge, 16001000 ) );
+    assert( BLOCK == r2_adc_lcm_decode( bridge, store, size[0], &utime, &last,
+                &dropped, &out[0][0], ROWS ) );
+    assert( 15 == dropped && 0 == memcmp( in[15], out, 10 * sizeof( in[0] ) ) );
+
+    r2_adc_lcm_destroy( bridge );
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_attitude_filter.h"
+
+#define RATE 1000
+#define N ( 30 * RATE )
+
+int main( void ){
+    static struct r2_vf_t gyro[N], accel[N], mag[N];
+    static struct r2_qf_t out[N];
+    struct r2_attitude_filter f;
+    size_t m;
+
+    // at rest, tilted and turned; the gyro has a constant bias
+    struct r2_nf_t truth = { 0.3f, -0.2f, 1.0f };
+    struct r2_qf_t q = r2_nf_to_qf( truth );
+    struct r2_vf_t up = { 0, 0, -9.81f };
+    struct r2_vf_t field = { 0.4f, 0, 0.3f }; // dipping north
+    struct r2_vf_t bias = { 0.01f, -0.02f, 0.005f };
+    for( m = 0; m < N; m++ ) {
+        gyro[m] = bias;
+        accel[m] = r2_qf_rotate( r2_qf_conjugate( q ), up );
+        mag[m] = r2_qf_rotate( r2_qf_conjugate( q ), field );
+    }
+
+    r2_attitude_filter_init( &f, 1.0f / RATE, 2.0f, 0.5f );
+    r2_attitude_filter_update_n( &f, gyro, accel, mag, N, out );
+    struct r2_nf_t a = r2_qf_to_nf( f.q );
+    printf( "roll %.4f pitch %.4f yaw %.4f\n", a.roll, a.pitch, a.yaw );
+    assert( fabsf( a.roll - truth.roll ) < 1e-3f );
+    assert( fabsf( a.pitch - truth.pitch ) < 1e-3f );
+    assert( fabsf( a.yaw - truth.yaw ) < 1e-3f );
+    assert( r2_qf_angle( out[N - 1], f.q ) == 0 );
+    // the integral term has learned the bias
+    assert( fabsf( f.bias.x + bias.x ) < 1e-3f );
+    assert( fabsf( f.bias.y + bias.y ) < 1e-3f );
+    assert( fabsf( f.bias.z + bias.z ) < 1e-3f );
+
+    // without a magnetometer the heading is left to the gyro, while the
+    // tilt still converges
+    r2_attitude_filter_init( &f, 1.0f / RATE, 2.0f, 0 );
+    struct r2_vf_t zero = { 0, 0, 0 };
+    for( m = 0; m < N; m++ )
+        gyro[m] = zero;
+    r2_attitude_filter_update_n( &f, gyro, accel, NULL, N, NULL );
+    a = r2_qf_to_nf( f.q );
+    assert( fabsf( a.yaw ) < 0.5f );
+    struct r2_vf_t down = r2_qf_rotate( f.q, accel[0] );
+    assert( fabsf( down.x ) < 1e-3f && fabsf( down.y ) < 1e-3f );
+
+    // turning at a constant rate about the vertical: the filter follows the
+    // gyro without lagging behind the accelerometer and magnetometer
+    r2_attitude_filter_init( &f, 1.0f / RATE, 2.0f, 0.5f );
+    struct r2_qf_t level = { 1, 0, 0, 0 };
+    f.q = level;
+    for( m = 0; m < N; m++ ) {
+        struct r2_nf_t turn = { 0, 0, (float)( 0.5 * m / RATE ) };
+        q = r2_nf_to_qf( turn );
+        gyro[m].x = 0;
+        gyro[m].y = 0;
+        gyro[m].z = 0.5f;
+        accel[m] = r2_qf_rotate( r2_qf_conjugate( q ), up );
+        mag[m] = r2_qf_rotate( r2_qf_conjugate( q ), field );
+        struct r2_qf_t p = r2_attitude_filter_update( &f, gyro[m],
+                &accel[m], &mag[m] );
+        assert( r2_qf_angle( p, q ) < 2e-3f );
+    }
+
+    // missing samples are skipped
+    r2_attitude_filter_init( &f, 1.0f / RATE, 2.0f, 0 );
+    r2_attitude_filter_update( &f, zero, &zero, &zero );
+    assert( fabsf( f.q.h - 1 ) < 1e-6f && f.q.i == 0 && f.q.j == 0
+            && f.q.k == 0 );
+
+    exit( EXIT_SUCCESS );
+}
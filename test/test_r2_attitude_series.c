@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_attitude_series.h"
+
+#define N ( 2 * R2_ATTITUDE_SERIES_CHUNK + 100 )
+
+int main( void ){
+    static int64_t usec[N];
+    static float roll[N], pitch[N], yaw[N], out[3][N];
+    struct r2_attitude_series * s = r2_attitude_series_create();
+    assert( NULL != s );
+    size_t m;
+
+    for( m = 0; m < N; m++ ) {
+        usec[m] = 1000 * (int64_t)m;
+        roll[m] = 0.001f * m;
+        pitch[m] = 0.5f;
+        yaw[m] = -1.0f;
+    }
+    assert( 0 == r2_attitude_series_append_nf( s, usec, roll, pitch, yaw, N ) );
+    assert( N == s->count );
+
+    // every array in every chunk is 64-byte aligned
+    struct r2_attitude_chunk * c;
+    for( c = s->first; c; c = c->next ) {
+        assert( 0 == (uintptr_t)c->usec % 64 );
+        assert( 0 == (uintptr_t)c->h % 64 && 0 == (uintptr_t)c->i % 64 );
+        assert( 0 == (uintptr_t)c->j % 64 && 0 == (uintptr_t)c->k % 64 );
+    }
+
+    int64_t t;
+    struct r2_qf_t q = r2_attitude_series_at( s, N - 1, &t );
+    assert( t == 1000 * ( N - 1 ) );
+    assert( fabsf( q.h * q.h + q.i * q.i + q.j * q.j + q.k * q.k - 1 )
+            < 1e-6f );
+
+    // scale, normalize back, and round trip to angles
+    struct r2_qf_t two = { 2, 0, 0, 0 };
+    struct r2_qf_t one = { 1, 0, 0, 0 };
+    r2_attitude_series_compose( s, two, one );
+    q = r2_attitude_series_at( s, 5, NULL );
+    assert( fabsf( q.h * q.h + q.i * q.i + q.j * q.j + q.k * q.k - 4 )
+            < 1e-5f );
+    r2_attitude_series_normalize( s );
+    r2_attitude_series_to_nf( s, out[0], out[1], out[2] );
+    for( m = 0; m < N; m++ ) {
+        assert( fabsf( out[0][m] - roll[m] ) < 1e-5f );
+        assert( fabsf( out[1][m] - pitch[m] ) < 1e-5f );
+        assert( fabsf( out[2][m] - yaw[m] ) < 1e-5f );
+    }
+
+    // composing with a rotation about z adds to the yaw
+    struct r2_qf_t z = { cosf( 0.25f ), 0, 0, sinf( 0.25f ) };
+    r2_attitude_series_compose( s, z, one );
+    r2_attitude_series_to_nf( s, out[0], out[1], out[2] );
+    assert( fabsf( out[2][0] - ( yaw[0] + 0.5f ) ) < 1e-5f );
+
+    // streaming: drop the oldest samples and append more without allocating
+    r2_attitude_series_drop( s, R2_ATTITUDE_SERIES_CHUNK + 10 );
+    assert( N - R2_ATTITUDE_SERIES_CHUNK - 10 == s->count );
+    r2_attitude_series_at( s, 0, &t );
+    assert( t == 1000 * ( R2_ATTITUDE_SERIES_CHUNK + 10 ) );
+    assert( NULL != s->spare );
+    struct r2_attitude_chunk * spare = s->spare;
+    assert( 0 == r2_attitude_series_append( s, 7, one ) );
+    assert( 0 == r2_attitude_series_append_n( s, usec, &one, 1 ) );
+    for( m = 0; s->count < N; m++ )
+        assert( 0 == r2_attitude_series_append( s, 8, one ) );
+    for( c = s->first; c->next; c = c->next )
+        ;
+    assert( c == spare ); // the dropped chunk was reused
+    q = r2_attitude_series_at( s, N - 1, &t );
+    assert( 8 == t && 1 == q.h );
+
+    r2_attitude_series_clear( s );
+    assert( 0 == s->count );
+    r2_attitude_series_normalize( s );
+    assert( 0 == r2_attitude_series_append( s, 9, one ) );
+    r2_attitude_series_at( s, 0, &t );
+    assert( 9 == t );
+
+    r2_attitude_series_destroy( s );
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,129 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define R2_CAPTURE_INDEX_BYTES 4096 // many marks for a small file
+#include "r2_capture.h"
+
+#define CHUNKS 5000
+
+static unsigned char bytes[1024];
+
+// the realtime of chunk m
+static int64_t when( const size_t m )
+{
+    return 1000000000 + (int64_t)m * 1000;
+}
+
+// write chunks [from, to) of random lengths, the length of chunk m in
+// lengths[m]
+static void write_chunks( struct r2_capture * capture, size_t from,
+        const size_t to, uint32_t * lengths )
+{
+    for( ; from < to; from++ ) {
+        struct r2_capture_chunk c = { 0, (uint16_t)( from % 3 ), 0,
+            (int64_t)from * 1000, when( from ), rand() % 300, 0 };
+        lengths[from] = c.length;
+        assert( 0 == r2_capture_write_chunk( capture, &c,
+                    bytes + from % 500 ) );
+    }
+}
+
+// read chunks [from, to) and compare them with what was written
+static void check_chunks( struct r2_capture_reader * reader, size_t from,
+        const size_t to, const uint32_t * lengths )
+{
+    struct r2_capture_chunk c;
+    const void * data;
+    for( ; from < to; from++ ) {
+        assert( 1 == r2_capture_reader_next( reader, &c, &data ) );
+        assert( from % 3 == c.port && 0 == c.flags );
+        assert( (int64_t)from * 1000 == c.monotonic
+                && when( from ) == c.realtime );
+        assert( lengths[from] == c.length );
+        assert( 0 == memcmp( bytes + from % 500, data, c.length ) );
+    }
+}
+
+int main( void ){
+    static uint32_t lengths[CHUNKS];
+    size_t m;
+    for( m = 0; m < sizeof( bytes ); m++ )
+        bytes[m] = (unsigned char)( m * 13 );
+    char dir[] = "/tmp/test_r2_captureXXXXXX", path[64];
+    assert( mkdtemp( dir ) );
+    snprintf( path, sizeof( path ), "%s/capture", dir );
+
+    // a capture in segments of a page, so chunks straddle them
+    struct r2_capture * capture = r2_capture_create( path, 1 );
+    assert( capture && 4096 == capture->segment );
+    write_chunks( capture, 0, CHUNKS, lengths );
+    assert( CHUNKS == capture->chunks && capture->marks > 100 );
+
+    // while it is being written, the file has no index and is read by
+    // scanning it, up to the last chunk written
+    struct r2_capture_reader * reader = r2_capture_reader_open( path );
+    assert( reader && reader->marks == capture->marks );
+    check_chunks( reader, 0, CHUNKS, lengths );
+    struct r2_capture_chunk c;
+    const void * data;
+    assert( 0 == r2_capture_reader_next( reader, &c, &data ) );
+    r2_capture_reader_destroy( reader );
+
+    // a writer that dies copying a chunk (here, on a fault in the data)
+    // leaves nothing a reader takes for a chunk
+    unsigned char * trap = mmap( NULL, 8192, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    assert( MAP_FAILED != trap );
+    memset( trap, 0x5a, 4096 );
+    assert( 0 == mprotect( trap + 4096, 4096, PROT_NONE ) );
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        r2_capture_write( capture, 3, trap + 4000, 200 );
+        _exit( EXIT_SUCCESS );
+    }
+    int status;
+    assert( pid == waitpid( pid, &status, 0 ) );
+    assert( !WIFEXITED( status ) || EXIT_SUCCESS != WEXITSTATUS( status ) );
+    reader = r2_capture_reader_open( path );
+    check_chunks( reader, 0, CHUNKS, lengths );
+    assert( 0 == r2_capture_reader_next( reader, &c, &data ) );
+    r2_capture_reader_destroy( reader );
+    munmap( trap, 8192 );
+
+    int64_t before = r2_epoch_usec_now();
+    assert( 0 == r2_capture_write( capture, 7, "last", 4 ) );
+    r2_capture_destroy( capture );
+
+    // closed, it has its index
+    reader = r2_capture_reader_open( path );
+    assert( reader && reader->marks > 100 );
+    check_chunks( reader, 0, CHUNKS, lengths );
+    assert( 1 == r2_capture_reader_next( reader, &c, &data ) );
+    assert( 7 == c.port && 4 == c.length && 0 == memcmp( "last", data, 4 ) );
+    assert( c.realtime >= before && c.realtime <= r2_epoch_usec_now() );
+    assert( 0 == r2_capture_reader_next( reader, &c, &data ) );
+
+    // seeking to a time finds the first chunk at or after it
+    for( m = 0; m < 1000; m++ ) {
+        size_t k = rand() % CHUNKS;
+        r2_capture_reader_seek( reader, when( k ) - ( m % 2 ) * 500 );
+        check_chunks( reader, k, k + 1 < CHUNKS ? k + 1 : CHUNKS, lengths );
+    }
+    r2_capture_reader_seek( reader, 0 );
+    check_chunks( reader, 0, 10, lengths );
+    r2_capture_reader_seek( reader, INT64_MAX );
+    assert( 0 == r2_capture_reader_next( reader, &c, &data ) );
+    r2_capture_reader_rewind( reader );
+    check_chunks( reader, 0, 1, lengths );
+    r2_capture_reader_destroy( reader );
+
+    assert( NULL == r2_capture_reader_open( "/dev/null" ) );
+    unlink( path );
+    rmdir( dir );
+    exit( EXIT_SUCCESS );
+}
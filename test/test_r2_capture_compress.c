@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r2_capture_compress.h"
+#include "r2_replay.h"
+
+#define LINES 20000
+
+#if defined( R2_WITH_ZSTD )
+#define CODEC R2_CAPTURE_ZSTD
+#elif defined( R2_WITH_LZ4 )
+#define CODEC R2_CAPTURE_LZ4
+#elif defined( R2_WITH_ZLIB )
+#define CODEC R2_CAPTURE_ZLIB
+#else
+#define CODEC R2_CAPTURE_NONE
+#endif
+
+// the line m of an NMEA-like stream, its length returned
+static int line( char * s, const size_t m )
+{
+    return sprintf( s, "$GPGGA,%06zu.00,4807.%03zu,N,01131.%03zu,E,1,08,0.9,"
+            "545.4,M,46.9,M,,*%02zX\r\n", m, m % 1000, ( m * 7 ) % 1000,
+            m % 256 );
+}
+
+// the realtime of line m
+static int64_t when( const size_t m )
+{
+    return 1000000000 + (int64_t)m * 1000;
+}
+
+int main( void ){
+    char dir[] = "/tmp/test_r2_capture_compressXXXXXX", path[64];
+    assert( mkdtemp( dir ) );
+    snprintf( path, sizeof( path ), "%s/capture", dir );
+
+    // lines through a small queue, so the thread falls behind at times
+    struct r2_capture * capture = r2_capture_create( path, 0 );
+    struct r2_capture_compress * stage = r2_capture_compress_create( capture,
+            CODEC, 0, 4096, 2048 );
+    assert( stage );
+    char s[128];
+    size_t m, total = 0;
+    for( m = 0; m < LINES; m++ ) {
+        int n = line( s, m );
+        struct r2_capture_chunk c = { 0, (uint16_t)( m % 2 ), 0,
+            (int64_t)m * 1000, when( m ), (uint32_t)n, 0 };
+        // refused, the caller keeps the bytes and tries again
+        while( -1 == r2_capture_compress_write_chunk( stage, &c, s ) )
+            r2_capture_compress_flush( stage );
+        total += n;
+    }
+    // a chunk larger than the queue never fits
+    static char big[8192];
+    size_t refused = stage->refused;
+    assert( -1 == r2_capture_compress_write( stage, 0, big, sizeof( big ) ) );
+    assert( refused + 1 == stage->refused );
+    r2_capture_compress_flush( stage );
+    assert( 0 == r2_capture_compress_backlog( stage ) );
+    assert( total == stage->in && 0 == stage->errors );
+    assert( LINES == stage->chunks );
+    uint64_t written = stage->written;
+    r2_capture_compress_destroy( stage );
+    r2_capture_destroy( capture );
+
+    // read back as they were
+    struct r2_capture_decoder * decoder = r2_capture_decoder_create( path );
+    assert( decoder );
+    struct r2_capture_chunk c;
+    const void * data;
+    for( m = 0; m < LINES; m++ ) {
+        int n = line( s, m );
+        assert( 1 == r2_capture_decoder_next( decoder, &c, &data ) );
+        assert( m % 2 == c.port && 0 == c.flags && 0 == c.reserved );
+        assert( when( m ) == c.realtime && (uint32_t)n == c.length );
+        assert( 0 == memcmp( s, data, n ) );
+    }
+    assert( 0 == r2_capture_decoder_next( decoder, &c, &data ) );
+#if defined( R2_WITH_ZSTD ) || defined( R2_WITH_LZ4 ) \
+    || defined( R2_WITH_ZLIB )
+    // short lines compress well with the dictionary (zlib best, with the
+    // least framing)
+    assert( decoder->dict_size > 0 && decoder->dict_size <= 2048 );
+    assert( written < total / ( R2_CAPTURE_ZLIB == CODEC ? 3 : 2 ) );
+#else
+    assert( written == total );
+#endif
+    r2_capture_decoder_destroy( decoder );
+
+    // a seek into the middle finds the dictionary on its own
+    decoder = r2_capture_decoder_create( path );
+    r2_capture_reader_seek( decoder->reader, when( LINES / 2 ) );
+    for( m = LINES / 2; m < LINES / 2 + 100; m++ ) {
+        int n = line( s, m );
+        assert( 1 == r2_capture_decoder_next( decoder, &c, &data ) );
+        assert( when( m ) == c.realtime && (uint32_t)n == c.length );
+        assert( 0 == memcmp( s, data, n ) );
+    }
+    r2_capture_decoder_destroy( decoder );
+
+    // and replays like any capture
+    struct r2_replay * replay = r2_replay_create( path, 1, 0 );
+    assert( replay );
+    for( m = 1; r2_replay_next( replay, &c, &data ); m += 2 ) {
+        int n = line( s, m );
+        assert( (uint32_t)n == c.length && 0 == memcmp( s, data, n ) );
+    }
+    assert( LINES + 1 == m );
+    r2_replay_destroy( replay );
+
+    unlink( path );
+    rmdir( dir );
+    exit( EXIT_SUCCESS );
+}
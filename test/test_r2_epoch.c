@@ -11,5 +11,42 @@ int main( void ){
             r2_epoch_msec_now() );
     printf( "%" PRId64 " seconds since 1970-01-01 00:00:00\n",
             r2_epoch_sec_now() );
+
+    struct timespec t = { 1500000000, 123456789 };
+    assert( r2_epoch_timespec_to_nsec( t ) == 1500000000123456789 );
+    assert( r2_epoch_timespec_to_usec( t ) == 1500000000123456 );
+    assert( r2_epoch_timespec_to_msec( t ) == 1500000000123 );
+    assert( R2_EPOCH_TIMESPEC_TO_USEC( 1500000000, 123456789 )
+            == 1500000000123456 );
+
+    struct timespec u = r2_epoch_usec_to_timespec( -1 );
+    assert( u.tv_sec == -1 && u.tv_nsec == 999999000 );
+    assert( r2_epoch_timespec_to_usec( u ) == -1 );
+    u = r2_epoch_msec_to_timespec( 2500 );
+    assert( u.tv_sec == 2 && u.tv_nsec == 500000000 );
+    u = r2_epoch_fsec_to_timespec( -0.25 );
+    assert( u.tv_sec == -1 && u.tv_nsec == 750000000 );
+
+    struct timespec n = { 3, -1 };
+    n = r2_epoch_timespec_normalize( n );
+    assert( n.tv_sec == 2 && n.tv_nsec == 999999999 );
+
+    struct timespec a = { 1, 600000000 }, b = { 2, 700000000 };
+    struct timespec s = r2_epoch_timespec_add( a, b );
+    assert( s.tv_sec == 4 && s.tv_nsec == 300000000 );
+    s = r2_epoch_timespec_sub( a, b );
+    assert( s.tv_sec == -2 && s.tv_nsec == 900000000 );
+    assert( r2_epoch_timespec_cmp( a, b ) < 0 );
+    assert( r2_epoch_timespec_cmp( b, a ) > 0 );
+    assert( r2_epoch_timespec_cmp( a, a ) == 0 );
+
+    struct timespec ts[3] = { { 0, 999 }, { -1, 1000 }, { 7, 999999999 } };
+    int64_t us[3];
+    r2_epoch_timespec_to_usec_n( ts, us, 3 );
+    assert( us[0] == 0 && us[1] == -999999 && us[2] == 7999999 );
+    r2_epoch_usec_to_timespec_n( us, ts, 3 );
+    assert( ts[1].tv_sec == -1 && ts[1].tv_nsec == 1000 );
+    assert( ts[2].tv_sec == 7 && ts[2].tv_nsec == 999999000 );
+
     exit( EXIT_SUCCESS );
 }
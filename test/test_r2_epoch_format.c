@@ -0,0 +1,64 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "r2_epoch_format.h"
+
+int main( void ){
+    struct r2_epoch_formatter f;
+    r2_epoch_formatter_init( &f );
+
+    char s[R2_EPOCH_ISO8601_LENGTH + 1] = { 0 };
+    char c[R2_EPOCH_COMPACT_LENGTH + 1] = { 0 };
+
+    r2_epoch_format_iso8601( &f, 0, s );
+    assert( 0 == strcmp( s, "1970-01-01T00:00:00.000000Z" ) );
+    r2_epoch_format_iso8601( &f, -1, s );
+    assert( 0 == strcmp( s, "1969-12-31T23:59:59.999999Z" ) );
+    r2_epoch_format_compact( &f, 951782400000001, c ); // leap day
+    assert( 0 == strcmp( c, "20000229T000000.000001Z" ) );
+
+    // compare against gmtime + strftime over a spread of seconds
+    int64_t usec;
+    for( usec = -86400000000LL * 1000; usec < 4102444800000000LL;
+            usec += 12345678901LL ) {
+        time_t t = (time_t)R2_EPOCH_FLOOR_DIV( usec, (int64_t)1000000 );
+        char e[32];
+        strftime( e, sizeof( e ), "%Y-%m-%dT%H:%M:%S", gmtime( &t ) );
+        snprintf( e + 19, sizeof( e ) - 19, ".%06dZ",
+                (int)R2_EPOCH_FLOOR_MOD( usec, (int64_t)1000000 ) );
+        r2_epoch_format_iso8601( &f, usec, s );
+        if( strcmp( s, e ) ) {
+            fprintf( stderr, "%" PRId64 ": %s != %s\n", usec, s, e );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    // years outside 0000-9999 are refused, and the cache kept
+    memset( s, 0, sizeof( s ) );
+    assert( 0 == r2_epoch_format_iso8601( &f, -62167219200000001LL, s ) );
+    assert( 0 == r2_epoch_format_compact( &f, 253402300800000000LL, c ) );
+    assert( 0 == s[0] );
+    assert( R2_EPOCH_ISO8601_LENGTH
+            == r2_epoch_format_iso8601( &f, -62167219200000000LL, s ) );
+    assert( 0 == strcmp( s, "0000-01-01T00:00:00.000000Z" ) );
+    assert( R2_EPOCH_COMPACT_LENGTH
+            == r2_epoch_format_compact( &f, 253402300799999999LL, c ) );
+    assert( 0 == strcmp( c, "99991231T235959.999999Z" ) );
+    assert( 0 == r2_epoch_format_iso8601( &f, INT64_MIN, s ) );
+    assert( 0 == r2_epoch_format_iso8601( &f, INT64_MAX, s ) );
+
+    struct r2_buffer * b = r2_buffer_create( 32 );
+    assert( R2_EPOCH_ISO8601_LENGTH
+            == r2_epoch_format_iso8601_to_buffer( &f, 0, b ) );
+    assert( 0 == r2_epoch_format_compact_to_buffer( &f, 0, b ) );
+    assert( R2_EPOCH_ISO8601_LENGTH == r2_buffer_available_data( b ) );
+    assert( 0 == memcmp( b->data, "1970-01-01T00:00:00.000000Z",
+            R2_EPOCH_ISO8601_LENGTH ) );
+    b->position = 0;
+    assert( 0 == r2_epoch_format_iso8601_to_buffer( &f, INT64_MAX, b ) );
+    assert( 0 == b->position );
+
+    exit( EXIT_SUCCESS );
+}
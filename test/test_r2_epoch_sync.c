@@ -0,0 +1,43 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_epoch_sync.h"
+
+int main( void ){
+    assert( NULL == r2_epoch_sync_create( 1000000, 0 ) );
+    assert( NULL == r2_epoch_sync_create( 0, 60 ) );
+    struct r2_epoch_sync * s = r2_epoch_sync_create( 1000000, 60 );
+    assert( NULL != s );
+
+    // instrument clock starts at zero and runs 50 ppm fast; host receives
+    // each sample 2 ms plus a random 0-40 ms after it was stamped
+    const int64_t offset = 1500000000000000;
+    const double rate = 1.0 / ( 1.0 + 50e-6 );
+    const int64_t floor_latency = 2000;
+    srand( 26 );
+    int64_t i;
+    for( i = 0; i < 60000; i++ ) {
+        int64_t instrument = i * 10000;
+        int64_t host = offset + (int64_t)( instrument * rate )
+            + floor_latency + rand() % 40000;
+        r2_epoch_sync_update( s, instrument, host );
+    }
+
+    double drift = r2_epoch_sync_drift( s );
+    printf( "drift %.3f ppm\n", drift * 1e6 );
+    assert( drift < -45e-6 && drift > -55e-6 );
+
+    int64_t instrument = 600000000;
+    int64_t expected = offset + (int64_t)( instrument * rate ) + floor_latency;
+    int64_t error = r2_epoch_sync_to_host( s, instrument ) - expected;
+    printf( "error %" PRId64 " usec\n", error );
+    assert( error > -1000 && error < 1000 );
+
+    // instrument clock reset: estimate starts over from the new samples
+    r2_epoch_sync_update( s, 0, offset + 1000000 );
+    assert( r2_epoch_sync_to_host( s, 0 ) == offset + 1000000 );
+
+    r2_epoch_sync_destroy( s );
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r2_nmea.h"
+
+#define SENTENCES 2000
+
+static struct r2_nmea_sentence s;
+
+static int parse( const char * text )
+{
+    static char line[1024];
+    memset( line, 'x', sizeof( line ) ); // junk in the padding
+    memcpy( line, text, strlen( text ) );
+    return r2_nmea_parse( line, strlen( text ), &s );
+}
+
+// field n compared with text
+static int field_is( const size_t n, const char * text )
+{
+    size_t length;
+    const char * p = r2_nmea_field( &s, n, &length );
+    return p && length == strlen( text ) && 0 == memcmp( p, text, length );
+}
+
+static int checksum( const char * text )
+{
+    int sum = 0;
+    for( ; *text; text++ )
+        sum ^= *text;
+    return sum;
+}
+
+struct counts {
+    size_t gga;
+    size_t rmc;
+    double latitude;
+};
+
+static void on_gga( const struct r2_nmea_sentence * sentence, void * context )
+{
+    struct counts * counts = context;
+    assert( R2_NMEA_GGA == sentence->type );
+    assert( 0 == r2_nmea_degrees( sentence, 2, &counts->latitude ) );
+    counts->gga++;
+}
+
+static void on_rmc( const struct r2_nmea_sentence * sentence, void * context )
+{
+    struct counts * counts = context;
+    assert( R2_NMEA_RMC == sentence->type );
+    counts->rmc++;
+}
+
+int main( void ){
+    // fields, talker and type
+    assert( 0 == parse( "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,"
+                "545.4,M,46.9,M,,*47\r" ) );
+    assert( R2_NMEA_GGA == s.type && 0 == strcmp( "GP", s.talker ) );
+    assert( 0x47 == s.checksum && 15 == s.fields );
+    assert( field_is( 0, "GPGGA" ) && field_is( 1, "123519" )
+            && field_is( 9, "545.4" ) && field_is( 13, "" )
+            && field_is( 14, "" ) );
+    size_t length;
+    assert( NULL == r2_nmea_field( &s, 15, &length ) );
+    double x;
+    int64_t t;
+    assert( 0 == r2_nmea_degrees( &s, 2, &x )
+            && fabs( x - ( 48 + 7.038 / 60 ) ) < 1e-12 );
+    assert( 0 == r2_nmea_degrees( &s, 4, &x )
+            && fabs( x - ( 11 + 31.0 / 60 ) ) < 1e-12 );
+    assert( 0 == r2_nmea_time( &s, 1, &t )
+            && ( ( 12 * 60 + 35 ) * 60 + 19 ) * 1000000LL == t );
+    assert( 0 == r2_nmea_double( &s, 9, &x ) && 545.4 == x );
+    assert( -1 == r2_nmea_double( &s, 13, &x ) ); // empty
+    assert( -1 == r2_nmea_double( &s, 3, &x ) ); // N
+    assert( -1 == r2_nmea_degrees( &s, 13, &x ) );
+    assert( 0 == parse( "$GPGLL,0.00000000000000001,N,"
+                "07.03800000000000001,W" ) ); // more decimals than fit
+    assert( 0 == r2_nmea_degrees( &s, 1, &x ) && 0 == x );
+    assert( 0 == r2_nmea_degrees( &s, 3, &x )
+            && fabs( x + 7.038 / 60 ) < 1e-15 );
+
+    assert( 0 == parse( "junk$GNRMC,000000.50,A,3345.1234,S,15112.5,W,0.0,,"
+                "290224,,,A*5D  " ) );
+    assert( R2_NMEA_RMC == s.type && 0 == strcmp( "GN", s.talker ) );
+    assert( '$' == s.text[0] && 13 == s.fields && field_is( 12, "A" ) );
+    assert( 0 == r2_nmea_time( &s, 1, &t ) && 500000 == t );
+    assert( 0 == r2_nmea_degrees( &s, 3, &x )
+            && fabs( x + ( 33 + 45.1234 / 60 ) ) < 1e-12 );
+    assert( 0 == r2_nmea_degrees( &s, 5, &x )
+            && fabs( x + ( 151 + 12.5 / 60 ) ) < 1e-12 );
+    assert( 0 == r2_nmea_date( &s, 9, &t ) && 1709164800000000LL == t );
+    assert( 0 == parse( "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,"
+                "230394,003.1,W*6a" ) ); // lower case checksum
+    assert( 0 == r2_nmea_date( &s, 9, &t ) && 764380800000000LL == t );
+
+    // proprietary, without a checksum, AIS
+    assert( 0 == parse( "$PGRME,15.0,M,45.0,M,25.0,M*1C" ) );
+    assert( R2_NMEA_PROPRIETARY == s.type && 0 == strcmp( "P", s.talker ) );
+    assert( 0 == parse( "$IIHDT,274.07,T" ) );
+    assert( R2_NMEA_HDT == s.type && -1 == s.checksum && field_is( 2, "T" ) );
+    assert( 0 == parse( "!AIVDM,1,1,,B,177KQJ5000G?tO`K>RA1wUbN0TKH,0*5C" ) );
+    assert( R2_NMEA_UNKNOWN == s.type && 0 == strcmp( "AI", s.talker ) );
+    assert( field_is( 6, "0" ) );
+
+    // malformed, or with a bad checksum
+    assert( -1 == parse( "$GPGGA,123519,4807.038,N*48" ) );
+    assert( -1 == parse( "$GPGGA,123519,4807.038,N*4" ) );
+    assert( -1 == parse( "$GPGGA,123519,4807.038,N*4G" ) );
+    assert( -1 == parse( "$GPGGA,123519,4807.038,N*477" ) );
+    assert( -1 == parse( "" ) && -1 == parse( "GPGGA,1" )
+            && -1 == parse( "$" ) );
+    assert( -1 == parse( "$,1,2" ) );
+    char many[256] = "$GPGSV";
+    for( length = 0; length < R2_NMEA_FIELDS; length++ )
+        strcat( many, ",1" );
+    assert( -1 == parse( many ) );
+
+    // invalid fields
+    assert( 0 == parse( "$GPZDA,246060,6161.0,N,18100.0,E,1x,-1,+1,310299,"
+                "999999.5,1234567890123456789" ) );
+    assert( -1 == r2_nmea_time( &s, 1, &t ) ); // 24h
+    assert( -1 == r2_nmea_degrees( &s, 2, &x ) ); // 61 minutes
+    assert( -1 == r2_nmea_degrees( &s, 4, &x ) ); // 181 degrees
+    assert( -1 == r2_nmea_double( &s, 6, &x ) ); // 1x
+    assert( 0 == r2_nmea_double( &s, 7, &x ) && -1 == x );
+    assert( 0 == r2_nmea_double( &s, 8, &x ) && 1 == x );
+    assert( -1 == r2_nmea_time( &s, 8, &t ) ); // +1
+    assert( -1 == r2_nmea_date( &s, 9, &t ) ); // 31 February is not
+    assert( -1 == r2_nmea_time( &s, 10, &t ) ); // 99 hours
+    assert( 0 == r2_nmea_double( &s, 11, &x ) // 19 digits, still exact
+            && 1234567890123456789.0 == x );
+    int64_t v;
+    int scale;
+    assert( 0 == r2_nmea_fixed( &s, 11, &v, &scale )
+            && 1234567890123456789LL == v && 0 == scale );
+
+    // every formatter in the perfect hash, and others not
+    static const char * known[] = { "DBT", "DPT", "DTM", "GGA", "GLL", "GNS",
+        "GSA", "GST", "GSV", "HDG", "HDM", "HDT", "MTW", "MWV", "RMC", "ROT",
+        "TXT", "VHW", "VTG", "ZDA" };
+    int k;
+    for( k = 0; k < (int)( sizeof( known ) / sizeof( known[0] ) ); k++ )
+        assert( R2_NMEA_DBT + k == (int)r2_nmea_type( known[k] ) );
+    assert( R2_NMEA_UNKNOWN == r2_nmea_type( "VDM" )
+            && R2_NMEA_UNKNOWN == r2_nmea_type( "gga" )
+            && R2_NMEA_UNKNOWN == r2_nmea_type( "\0\0\0" ) );
+
+    // random sentences agree with a character at a time parse, and numbers
+    // with strtod
+    char text[1024], body[1000];
+    srand( 49 );
+    for( k = 0; k < 100000; k++ ) {
+        int n = sprintf( body, "GP%s", known[rand() % 20] ), f, fields = 1;
+        int m = rand() % 20;
+        double value[20];
+        for( f = 0; f < m; f++ ) {
+            double v = ( rand() - RAND_MAX / 2 ) / pow( 10, rand() % 8 );
+            n += sprintf( body + n, ",%.*f", rand() % 9, v );
+            value[f] = strtod( strrchr( body, ',' ) + 1, NULL );
+            fields++;
+        }
+        if( rand() % 2 )
+            sprintf( text, "$%s*%02X\r", body, checksum( body ) );
+        else
+            sprintf( text, "$%s", body );
+        assert( 0 == parse( text ) && fields == (int)s.fields );
+        for( f = 0; f < m; f++ ) {
+            assert( 0 == r2_nmea_double( &s, f + 1, &x ) );
+            assert( value[f] == x );
+        }
+        // one character changed is caught by the checksum
+        if( strchr( text, '*' ) ) {
+            char * c = text + 1 + rand() % strlen( body );
+            *c ^= 1 << ( rand() % 6 );
+            assert( -1 == parse( text ) );
+        }
+    }
+
+    // stream sentences through a pipe, in odd-sized pieces, to handlers
+    static char stream[SENTENCES * 100];
+    size_t total = 0, n;
+    for( n = 0; n < SENTENCES; n++ ) {
+        if( n % 2 )
+            sprintf( body, "GPGGA,%06zu,%02zu%02zu.%03zu,N,01131.000,E,1,08,"
+                    "0.9,545.4,M,46.9,M,,", n % 240000, n % 90, n % 60,
+                    n % 1000 );
+        else
+            sprintf( body, "GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,"
+                    "230394,003.1,W" );
+        total += sprintf( stream + total, "$%s*%02X\r\n", body,
+                n == 100 ? 0 : checksum( body ) ); // one bad
+        if( 10 == n ) // a blank line, and a sentence the handlers ignore
+            total += sprintf( stream + total, "\r\n$GPZDA,1*55\r\n" );
+    }
+    struct r2_nmea * nmea = r2_nmea_create( 300 );
+    struct counts counts = { 0, 0, 0 };
+    r2_nmea_set_handler( nmea, R2_NMEA_GGA, on_gga, &counts );
+    r2_nmea_set_handler( nmea, R2_NMEA_RMC, on_rmc, &counts );
+    int fd[2];
+    assert( 0 == pipe( fd ) );
+    size_t written = 0, parsed = 0;
+    while( written < total ) {
+        size_t piece = 1 + rand() % 97;
+        piece = piece < total - written ? piece : total - written;
+        assert( piece == (size_t)write( fd[1], stream + written, piece ) );
+        written += piece;
+        assert( piece == r2_nmea_fill( nmea, fd[0] ) );
+        parsed += r2_nmea_dispatch( nmea );
+    }
+    assert( SENTENCES == parsed && SENTENCES == nmea->sentences );
+    assert( 1 == nmea->dropped );
+    assert( SENTENCES / 2 == counts.gga && SENTENCES / 2 - 1 == counts.rmc );
+    assert( fabs( counts.latitude - ( 19 + 19.999 / 60 ) ) < 1e-12 );
+    close( fd[0] );
+    close( fd[1] );
+    r2_nmea_destroy( nmea );
+    exit( EXIT_SUCCESS );
+}
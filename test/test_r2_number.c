@@ -0,0 +1,200 @@
+#include <assert.h>
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r2_number.h"
+
+#define FIELDS 3
+#define ROWS 1000
+
+static char line[512];
+
+// the text in a line with junk in the padding
+static const char * pad( const char * s )
+{
+    memset( line, '7', sizeof( line ) ); // digits, to be ignored
+    memcpy( line, s, strlen( s ) );
+    return line;
+}
+
+// parse s, which must be all one number, as strtod does
+static void check( const char * s )
+{
+    double x = 1, y = strtod( s, NULL );
+    float f = 1, g = strtof( s, NULL );
+    const char * p = pad( s );
+    assert( p + strlen( s ) == r2_number_double( p, p + strlen( s ), &x ) );
+    assert( 0 == memcmp( &x, &y, sizeof( x ) ) ); // bit for bit, and -0
+    assert( p + strlen( s ) == r2_number_float( p, p + strlen( s ), &f ) );
+    assert( 0 == memcmp( &f, &g, sizeof( f ) ) );
+}
+
+// the length of the number at the start of s
+static size_t length( const char * s )
+{
+    double x;
+    const char * p = pad( s );
+    return r2_number_double( p, p + strlen( s ), &x ) - p;
+}
+
+int main( void ){
+    // the grammar
+    check( "42" );
+    check( "-7" );
+    check( "+.5" );
+    check( "3.25e-4" );
+    check( "1E6" );
+    check( "-0" );
+    check( "0.000" );
+    check( "5." );
+    check( "00000000000000000000000000001.5" );
+    assert( 1 == length( "5e" ) && 1 == length( "5e+" )
+            && 3 == length( "5e3x" ) );
+    assert( 2 == length( "5.e" ) && 3 == length( "1.5.3" ) );
+    assert( 0 == length( "." ) && 0 == length( "-" ) && 0 == length( "e5" )
+            && 0 == length( "-.e1" ) && 0 == length( "" ) );
+
+    // long mantissas, large and small exponents, and halfway cases, which
+    // leave the fast paths
+    check( "0.1000000000000000055511151231257827021181583404541015625" );
+    check( "9007199254740993" ); // 2^53 + 1, halfway
+    check( "9007199254740993.0000000000000000000001" );
+    check( "123456789012345678901234567890" );
+    check( "1e23" );
+    check( "8.5e37" );
+    check( "1.7976931348623157e308" );
+    check( "1e309" );
+    check( "4.9406564584124654e-324" );
+    check( "2.2250738585072011e-308" );
+    check( "1e-400" );
+    check( "1.000000059604644775390625" ); // 1 + 2^-24: float tie, to even
+    check( "1.000000059604644775390625000000001" ); // just above it
+    check( "1.0000000596046447753906249999" ); // just below it
+    check( "3.4028235677973366e38" ); // float overflow threshold
+    check( "1e-45" );
+    check( "1.401298464324817e-45" );
+    check( "7.006492321624085e-46" ); // float subnormal tie
+
+    // random numbers agree with strtod and strtof, bit for bit
+    char s[128];
+    int k;
+    srand( 50 );
+    for( k = 0; k < 200000; k++ ) {
+        union { double d; uint64_t u; } x;
+        do
+            x.u = (uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ rand();
+        while( isnan( x.d ) || isinf( x.d ) );
+        switch( k % 4 ) {
+        case 0:
+            snprintf( s, sizeof( s ), "%.17g", x.d );
+            break;
+        case 1:
+            snprintf( s, sizeof( s ), "%.*e", rand() % 20, x.d );
+            break;
+        case 2: // as instruments print them
+            snprintf( s, sizeof( s ), "%.*f", rand() % 8,
+                    ( rand() - RAND_MAX / 2 ) / pow( 10, rand() % 6 ) );
+            break;
+        default: // ties between floats
+            snprintf( s, sizeof( s ), "%.*g", 10 + rand() % 20,
+                    (double)(float)( rand() / 1e3 )
+                    * ( 1 + ldexp( 1, -24 ) ) );
+        }
+        check( s );
+    }
+
+    // whatever the locale
+    if( setlocale( LC_NUMERIC, "de_DE.UTF-8" ) ) {
+        double x;
+        const char * p = pad( "1.25000000000000000000000001" );
+        r2_number_double( p, p + 28, &x );
+        assert( 1.25 == x );
+        setlocale( LC_NUMERIC, "C" );
+    }
+
+    // fields of a line into columns
+    static double d[8][4];
+    static float f[8][4];
+    static int32_t i[8][4];
+    double * dc[8];
+    float * fc[8];
+    int32_t * ic[8];
+    for( k = 0; k < 8; k++ ) {
+        dc[k] = d[k];
+        fc[k] = f[k];
+        ic[k] = i[k];
+    }
+    const char * text = "T=12.5,C=-3.25e1 P 1000dbar;.5,,1e3x-2";
+    assert( 6 == r2_number_fields_d( pad( text ), strlen( text ), dc, 8, 2 ) );
+    assert( 12.5 == d[0][2] && -32.5 == d[1][2] && 1000 == d[2][2]
+            && 0.5 == d[3][2] && 1000 == d[4][2] && -2 == d[5][2] );
+    assert( 6 == r2_number_fields_f( pad( text ), strlen( text ), fc, 3, 1 ) );
+    assert( 12.5f == f[0][1] && -32.5f == f[1][1] && 1000 == f[2][1]
+            && 0 == f[3][1] ); // counted, not stored
+    text = "2.7 -2.7 1e3 99999999999 -1e20 5e-30 12345678901234567890e-10";
+    assert( 7 == r2_number_fields_i( pad( text ), strlen( text ), ic, 8, 0 ) );
+    assert( 2 == i[0][0] && -2 == i[1][0] && 1000 == i[2][0]
+            && INT32_MAX == i[3][0] && INT32_MIN == i[4][0] && 0 == i[5][0]
+            && 1234567890 == i[6][0] );
+    assert( 0 == r2_number_fields_d( pad( "" ), 0, dc, 8, 0 ) );
+    assert( 0 == r2_number_fields_d( pad( " ,;\t " ), 5, dc, 8, 0 ) );
+
+    // stream CTD-like rows through a pipe, in odd-sized pieces
+    static char stream[ROWS * 64];
+    static double truth[FIELDS][ROWS], got[FIELDS][ROWS];
+    static float got_f[FIELDS][ROWS];
+    size_t total = 0;
+    int r, c;
+    for( r = 0; r < ROWS; r++ ) {
+        for( c = 0; c < FIELDS; c++ ) {
+            int n = sprintf( stream + total, "%.4f%s",
+                    ( rand() % 2000000 - 1000000 ) / 1e4,
+                    c + 1 < FIELDS ? ", " : "\r\n" );
+            truth[c][r] = strtod( stream + total, NULL );
+            total += n;
+        }
+        if( 10 == r ) // a short line, and a blank one
+            total += sprintf( stream + total, "1, 2\n\n" );
+    }
+    struct r2_buffer * buffer = r2_number_buffer_create( 200 );
+    double * columns[FIELDS] = { got[0], got[1], got[2] };
+    int fd[2];
+    assert( 0 == pipe( fd ) );
+    size_t written = 0, rows = 0, dropped = 0;
+    while( written < total ) {
+        size_t piece = 1 + rand() % 97;
+        piece = piece < total - written ? piece : total - written;
+        assert( piece == (size_t)write( fd[1], stream + written, piece ) );
+        written += piece;
+        assert( piece == r2_buffer_fill( buffer, fd[0] ) );
+        for( c = 0; c < FIELDS; c++ )
+            columns[c] = got[c] + rows;
+        rows += r2_number_rows_d( buffer, columns, FIELDS, ROWS - rows,
+                &dropped );
+    }
+    assert( ROWS == rows && 1 == dropped );
+    assert( 0 == memcmp( truth, got, sizeof( got ) ) );
+
+    // the same rows as floats, from a buffer holding them all
+    r2_number_buffer_destroy( buffer );
+    buffer = r2_number_buffer_create( total );
+    memcpy( buffer->data, stream, total );
+    buffer->position = total;
+    float * columns_f[FIELDS] = { got_f[0], got_f[1], got_f[2] };
+    dropped = 0;
+    assert( ROWS == r2_number_rows_f( buffer, columns_f, FIELDS, ROWS + 1,
+                &dropped ) );
+    assert( 1 == dropped && 0 == buffer->position );
+    for( r = 0; r < ROWS; r++ )
+        for( c = 0; c < FIELDS; c++ )
+            assert( (float)truth[c][r] == got_f[c][r] );
+
+    close( fd[0] );
+    close( fd[1] );
+    r2_number_buffer_destroy( buffer );
+    exit( EXIT_SUCCESS );
+}
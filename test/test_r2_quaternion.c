@@ -0,0 +1,147 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_quaternion_batch.h"
+
+#define N 1003 // not a multiple of R2_FASTMATH_BLOCK, to cover the tail
+
+static double uniform( const double lo, const double hi )
+{
+    return lo + ( hi - lo ) * rand() / (double)RAND_MAX;
+}
+
+int main( void ){
+    static struct r2_nf_t nf[N], nf2[N];
+    static struct r2_qf_t qf[N];
+    static double q[N][4];
+    static float h[N], i[N], j[N], k[N], roll[N], pitch[N], yaw[N];
+    double e, e_q = 0, e_roll = 0, e_pitch = 0, e_yaw = 0;
+    size_t m;
+
+    srand( 33 );
+    for( m = 0; m < N; m++ ) {
+        nf[m].roll = (float)uniform( -M_PI, M_PI );
+        nf[m].pitch = (float)uniform( -1.5, 1.5 );
+        nf[m].yaw = (float)uniform( -M_PI, M_PI );
+        double cy = cos( nf[m].yaw * 0.5 ), sy = sin( nf[m].yaw * 0.5 );
+        double cp = cos( nf[m].pitch * 0.5 ), sp = sin( nf[m].pitch * 0.5 );
+        double cr = cos( nf[m].roll * 0.5 ), sr = sin( nf[m].roll * 0.5 );
+        q[m][0] = cr * cp * cy + sr * sp * sy;
+        q[m][1] = sr * cp * cy - cr * sp * sy;
+        q[m][2] = cr * sp * cy + sr * cp * sy;
+        q[m][3] = cr * cp * sy - sr * sp * cy;
+    }
+
+    // angles to quaternions, against double precision
+    r2_nf_to_qf_n( nf, qf, N );
+    for( m = 0; m < N; m++ ) {
+        e = fabs( qf[m].h - q[m][0] ); e_q = e > e_q ? e : e_q;
+        e = fabs( qf[m].i - q[m][1] ); e_q = e > e_q ? e : e_q;
+        e = fabs( qf[m].j - q[m][2] ); e_q = e > e_q ? e : e_q;
+        e = fabs( qf[m].k - q[m][3] ); e_q = e > e_q ? e : e_q;
+    }
+    printf( "nf to qf max error %.3g\n", e_q );
+    assert( e_q < 5e-7 );
+
+    // the single conversions agree with the batch ones to within the
+    // accuracy of either
+    for( m = 0; m < N; m++ ) {
+        struct r2_qf_t one = r2_nf_to_qf( nf[m] );
+        assert( fabs( one.h - q[m][0] ) < 5e-7 && fabs( one.i - q[m][1] ) < 5e-7
+                && fabs( one.j - q[m][2] ) < 5e-7
+                && fabs( one.k - q[m][3] ) < 5e-7 );
+        struct r2_nf_t back = r2_qf_to_nf( one );
+        assert( fabsf( back.pitch - nf[m].pitch ) < 5e-6f );
+    }
+
+    // and back: the angles are recovered up to float rounding of the
+    // quaternion, which is amplified in pitch near +/-pi/2
+    r2_qf_to_nf_n( qf, nf2, N );
+    for( m = 0; m < N; m++ ) {
+        e = fabs( nf2[m].roll - nf[m].roll );
+        e = e > M_PI ? 2 * M_PI - e : e;
+        e_roll = e > e_roll ? e : e_roll;
+        e = fabs( nf2[m].pitch - nf[m].pitch );
+        e_pitch = e > e_pitch ? e : e_pitch;
+        e = fabs( nf2[m].yaw - nf[m].yaw );
+        e = e > M_PI ? 2 * M_PI - e : e;
+        e_yaw = e > e_yaw ? e : e_yaw;
+    }
+    printf( "qf to nf max error roll %.3g pitch %.3g yaw %.3g\n",
+            e_roll, e_pitch, e_yaw );
+    assert( e_roll < 5e-6 && e_pitch < 5e-6 && e_yaw < 5e-6 );
+
+    // the structure-of-arrays forms agree exactly with the AoS ones
+    for( m = 0; m < N; m++ ) {
+        roll[m] = nf[m].roll;
+        pitch[m] = nf[m].pitch;
+        yaw[m] = nf[m].yaw;
+    }
+    r2_nf_to_qf_soa( roll, pitch, yaw, h, i, j, k, N );
+    for( m = 0; m < N; m++ )
+        assert( h[m] == qf[m].h && i[m] == qf[m].i
+                && j[m] == qf[m].j && k[m] == qf[m].k );
+    r2_qf_to_nf_soa( h, i, j, k, roll, pitch, yaw, N );
+    for( m = 0; m < N; m++ )
+        assert( roll[m] == nf2[m].roll && pitch[m] == nf2[m].pitch
+                && yaw[m] == nf2[m].yaw );
+
+    // pitch stays finite at the poles, where rounding can push the sine of
+    // the pitch past 1
+    struct r2_qf_t pole = { 0.70710678f, 0, 0.70710678f, 0 };
+    r2_qf_to_nf_n( &pole, nf2, 1 );
+    assert( fabsf( nf2[0].pitch - (float)M_PI_2 ) < 1e-3f );
+    assert( fabsf( r2_qf_to_nf( pole ).pitch - (float)M_PI_2 ) < 1e-3f );
+
+    // resampling a rotation about z at constant rate onto other times
+    static int64_t t[N], at[N];
+    for( m = 0; m < N; m++ ) {
+        t[m] = 1000000 + 10000 * (int64_t)m;
+        struct r2_nf_t z = { 0, 0, 1e-3f * m };
+        qf[m] = r2_nf_to_qf( z );
+        at[m] = 1000000 - 5000 + 9973 * (int64_t)m; // from before the start
+    }
+    at[N - 1] = t[N - 1] + 1; // and past the end
+    int slerp;
+    for( slerp = 0; slerp < 2; slerp++ ) {
+        struct r2_qf_t out[N];
+        assert( 0 == r2_qf_interpolate_n( t, qf, N, at, out, N, slerp ) );
+        r2_qf_to_nf_n( out, nf2, N );
+        for( m = 0; m < N; m++ ) {
+            double expected = 1e-3 * ( at[m] - t[0] ) / 10000.0;
+            expected = expected < 0 ? 0 : expected;
+            expected = expected > 1e-3 * ( N - 1 ) ? 1e-3 * ( N - 1 )
+                : expected;
+            assert( fabs( nf2[m].yaw - expected ) < 2e-6 );
+        }
+    }
+    struct r2_qf_t single[3];
+    assert( -1 == r2_qf_interpolate_n( t, qf, 0, at, single, 3, 1 ) );
+    assert( 0 == r2_qf_interpolate_n( t, qf + 5, 1, at, single, 3, 1 ) );
+    for( m = 0; m < 3; m++ )
+        assert( fabsf( single[m].h - qf[5].h ) < 1e-6f
+                && fabsf( single[m].k - qf[5].k ) < 1e-6f );
+
+    // fast math primitives against libm
+    double e_sc = 0, e_at = 0, e_as = 0;
+    for( m = 0; m < 100000; m++ ) {
+        float x = (float)uniform( -8 * M_PI, 8 * M_PI );
+        float s, c;
+        r2_fastmath_sincosf( x, &s, &c );
+        e = fabs( s - sin( x ) ); e_sc = e > e_sc ? e : e_sc;
+        e = fabs( c - cos( x ) ); e_sc = e > e_sc ? e : e_sc;
+        float y = (float)uniform( -1, 1 ), z = (float)uniform( -1, 1 );
+        e = fabs( r2_fastmath_atan2f( y, z ) - atan2( y, z ) );
+        e_at = e > e_at ? e : e_at;
+        e = fabs( r2_fastmath_asinf( y ) - asin( y ) );
+        e_as = e > e_as ? e : e_as;
+    }
+    printf( "sincos %.3g atan2 %.3g asin %.3g\n", e_sc, e_at, e_as );
+    assert( e_sc < 1e-7 && e_at < 3.6e-7 && e_as < 2.6e-7 );
+    assert( r2_fastmath_asinf( 1.0000001f ) == r2_fastmath_asinf( 1.0f ) );
+    assert( r2_fastmath_atan2f( 0, 0 ) == 0 );
+
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_quaternion_algebra.h"
+#include "r2_quaternion_batch.h"
+
+static double uniform( const double lo, const double hi )
+{
+    return lo + ( hi - lo ) * rand() / (double)RAND_MAX;
+}
+
+static struct r2_qd_t random_qd( void )
+{
+    struct r2_qd_t q = { uniform( -1, 1 ), uniform( -1, 1 ),
+        uniform( -1, 1 ), uniform( -1, 1 ) };
+    return r2_qd_normalize( q );
+}
+
+static double max_error[4];
+
+// angle between rotations, keeping track of the largest seen per check
+static double qd_distance( const struct r2_qd_t a, const struct r2_qd_t b,
+        const int check )
+{
+    double e = r2_qd_angle( a, b );
+    max_error[check] = e > max_error[check] ? e : max_error[check];
+    return e;
+}
+
+int main( void ){
+    int n;
+    srand( 36 );
+    for( n = 0; n < 10000; n++ ) {
+        struct r2_qd_t a = random_qd(), b = random_qd();
+        struct r2_qf_t af = r2_qd_to_qf( a ), bf = r2_qd_to_qf( b );
+        struct r2_vd_t v = { uniform( -1, 1 ), uniform( -1, 1 ),
+            uniform( -1, 1 ) };
+        struct r2_vf_t vf = { (float)v.x, (float)v.y, (float)v.z };
+
+        // rotation of a vector agrees with the sandwich product and with
+        // the rotation matrix
+        struct r2_qd_t p = { 0, v.x, v.y, v.z };
+        p = r2_qd_product( r2_qd_product( a, p ), r2_qd_conjugate( a ) );
+        struct r2_vd_t r = r2_qd_rotate( a, v );
+        assert( fabs( r.x - p.i ) < 1e-12 && fabs( r.y - p.j ) < 1e-12
+                && fabs( r.z - p.k ) < 1e-12 );
+        double m[9];
+        r2_qd_to_matrix( a, m );
+        assert( fabs( m[0] * v.x + m[1] * v.y + m[2] * v.z - r.x ) < 1e-12 );
+        assert( fabs( m[3] * v.x + m[4] * v.y + m[5] * v.z - r.y ) < 1e-12 );
+        assert( fabs( m[6] * v.x + m[7] * v.y + m[8] * v.z - r.z ) < 1e-12 );
+        struct r2_vf_t rf = r2_qf_rotate( af, vf );
+        assert( fabs( rf.x - r.x ) < 1e-6 && fabs( rf.y - r.y ) < 1e-6
+                && fabs( rf.z - r.z ) < 1e-6 );
+
+        // and back from the matrix
+        assert( qd_distance( r2_qd_from_matrix( m ), a, 3 ) < 1e-12 );
+        float mf[9];
+        r2_qf_to_matrix( af, mf );
+        assert( qd_distance( r2_qf_to_qd( r2_qf_from_matrix( mf ) ), a, 0 )
+                < 1e-6 );
+        assert( r2_qf_from_matrix( mf ).h >= 0 );
+
+        // inverse
+        struct r2_qd_t s = { 2 * a.h, 2 * a.i, 2 * a.j, 2 * a.k };
+        struct r2_qd_t e = r2_qd_product( s, r2_qd_inverse( s ) );
+        assert( fabs( e.h - 1 ) < 1e-12 && fabs( e.i ) < 1e-12 );
+        struct r2_qf_t ef = r2_qf_product( af, r2_qf_inverse( af ) );
+        assert( fabsf( ef.h - 1 ) < 1e-6f && fabsf( ef.k ) < 1e-6f );
+        assert( fabsf( r2_qf_norm( r2_qf_normalize( bf ) ) - 1 ) < 5e-7f );
+
+        // slerp moves at constant speed along the shorter arc; nlerp
+        // stays close to it
+        double angle = r2_qd_angle( a, b );
+        double t = uniform( 0, 1 );
+        struct r2_qd_t c = r2_qd_slerp( a, b, t );
+        assert( fabs( r2_qd_norm( c ) - 1 ) < 1e-12 );
+        assert( fabs( r2_qd_angle( a, c ) - t * angle ) < 1e-9 );
+        assert( fabs( r2_qd_angle( c, b ) - ( 1 - t ) * angle ) < 1e-9 );
+        struct r2_qf_t cf = r2_qf_slerp( af, bf, (float)t );
+        assert( qd_distance( r2_qf_to_qd( cf ), c, 1 ) < 1e-6 );
+        assert( fabs( r2_qf_angle( af, bf ) - angle ) < 2e-6 );
+        struct r2_qf_t nf = r2_qf_nlerp( af, bf, (float)t );
+        assert( qd_distance( r2_qf_to_qd( nf ), c, 3 ) < 0.2 );
+        assert( qd_distance( r2_qd_nlerp( a, b, t ), r2_qf_to_qd( nf ), 2 )
+                < 1e-6 );
+    }
+    printf( "max error from matrix %.3g slerp %.3g nlerp %.3g\n",
+            max_error[0], max_error[1], max_error[2] );
+
+    // half turns, where the matrix trace is -1
+    double m[9];
+    struct r2_qd_t half = { 0, M_SQRT1_2, -M_SQRT1_2, 0 };
+    r2_qd_to_matrix( half, m );
+    assert( qd_distance( r2_qd_from_matrix( m ), half, 3 ) < 1e-12 );
+
+    // interpolating between equal or opposite quaternions
+    struct r2_qf_t one = { 1, 0, 0, 0 }, minus = { -1, 0, 0, 0 };
+    struct r2_qf_t q = r2_qf_slerp( one, one, 0.3f );
+    assert( fabsf( q.h - 1 ) < 1e-6f );
+    q = r2_qf_slerp( one, minus, 0.3f );
+    assert( fabsf( q.h - 1 ) < 1e-6f );
+    assert( 0 == r2_qf_angle( one, minus ) );
+
+    // small angles are resolved well below the float acos limit
+    struct r2_qf_t tiny = { cosf( 1e-5f ), sinf( 1e-5f ), 0, 0 };
+    assert( fabsf( r2_qf_angle( one, tiny ) - 2e-5f ) < 1e-9f );
+
+    // the batch rotation agrees with the single one
+    float x[20], y[20], z[20];
+    struct r2_qf_t a = r2_qd_to_qf( random_qd() );
+    for( n = 0; n < 20; n++ ) {
+        x[n] = n;
+        y[n] = 1;
+        z[n] = -n;
+    }
+    r2_qf_rotate_soa( a, x, y, z, 20 );
+    for( n = 0; n < 20; n++ ) {
+        struct r2_vf_t v = { n, 1, -n };
+        v = r2_qf_rotate( a, v );
+        assert( v.x == x[n] && v.y == y[n] && v.z == z[n] );
+    }
+
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_quaternion_fixed.h"
+
+#define Q31 2147483648.0
+
+static double uniform( const double lo, const double hi )
+{
+    return lo + ( hi - lo ) * rand() / (double)RAND_MAX;
+}
+
+// difference of binary angles, in radians
+static double angle_error( const int32_t a, const int32_t b )
+{
+    return fabs( (double)r2_fixed_angle( (uint32_t)a - (uint32_t)b ) )
+        * M_PI / Q31;
+}
+
+int main( void ){
+    // results are pinned to the bit, as on any other platform
+    struct r2_nq31_t a = { 0x12345678, -0x0abcdef0, -0x70000000 };
+    struct r2_qq31_t q = r2_nq31_to_qq31( a );
+    struct r2_nq31_t b = r2_qq31_to_nq31( q );
+    struct r2_qq31_t p = r2_qq31_product( q, q );
+    int32_t s, c;
+    r2_q31_sincos( 0x2aaaaaab, &s, &c ); // 60 degrees
+#if defined( R2_FIXED_SINCOS_TABLE )
+    assert( 466311325 == q.h && -177848159 == q.i
+            && -516263422 == q.j && -2023877933 == q.k );
+    assert( 305419898 == b.roll && -180150000 == b.pitch
+            && -1879048194 == b.yaw );
+    assert( -1944971049 == p.h && -77237012 == p.i
+            && -224206113 == p.j && -878942386 == p.k );
+    assert( 1859775394 == s && 1073741823 == c );
+#else
+    assert( 466311326 == q.h && -177848153 == q.i
+            && -516263415 == q.j && -2023877932 == q.k );
+    assert( 305419892 == b.roll && -180149994 == b.pitch
+            && -1879048190 == b.yaw );
+    assert( -1944971043 == p.h && -77237010 == p.i
+            && -224206110 == p.j && -878942387 == p.k );
+    assert( 1859775391 == s && 1073741828 == c );
+#endif
+    assert( -1707608634 == r2_q31_atan2( -3, -4 ) );
+
+    struct r2_nq15_t a15 = { 0x1234, -0x0abc, -0x7000 };
+    struct r2_qq15_t q15 = r2_nq15_to_qq15( a15 );
+    assert( 7115 == q15.h && -2713 == q15.i
+            && -7877 == q15.j && -30882 == q15.k );
+    struct r2_nq15_t b15 = r2_qq15_to_nq15( q15 );
+    assert( 4660 == b15.roll && -2748 == b15.pitch && -28672 == b15.yaw );
+    struct r2_qq15_t p15 = r2_qq15_product( q15, q15 );
+    assert( -29678 == p15.h && -1178 == p15.i
+            && -3421 == p15.j && -13411 == p15.k );
+
+    // accuracy against double precision libm
+    double e, e_sc = 0, e_at = 0, e_q = 0, e_n = 0, e_p = 0;
+    int n, m;
+    srand( 39 );
+    for( n = 0; n < 100000; n++ ) {
+        int32_t x = r2_fixed_from_radians( uniform( -M_PI, M_PI ) );
+        r2_q31_sincos( x, &s, &c );
+        e = fabs( s / Q31 - sin( x * M_PI / Q31 ) ); e_sc = e > e_sc ? e : e_sc;
+        e = fabs( c / Q31 - cos( x * M_PI / Q31 ) ); e_sc = e > e_sc ? e : e_sc;
+
+        int64_t y = (int64_t)uniform( -1e15, 1e15 );
+        int64_t z = (int64_t)uniform( -1e15, 1e15 );
+        e = angle_error( r2_q31_atan2( y, z ),
+                r2_fixed_from_radians( atan2( (double)y, (double)z ) ) );
+        e_at = e > e_at ? e : e_at;
+
+        struct r2_nf_t nf = { uniform( -M_PI, M_PI ), uniform( -1.4, 1.4 ),
+            uniform( -M_PI, M_PI ) };
+        a = r2_nf_to_nq31( nf );
+        q = r2_nq31_to_qq31( a );
+        double r = a.roll * M_PI / Q31 / 2, t = a.pitch * M_PI / Q31 / 2;
+        double w = a.yaw * M_PI / Q31 / 2;
+        double qd[4] = {
+            cos( r ) * cos( t ) * cos( w ) + sin( r ) * sin( t ) * sin( w ),
+            sin( r ) * cos( t ) * cos( w ) - cos( r ) * sin( t ) * sin( w ),
+            cos( r ) * sin( t ) * cos( w ) + sin( r ) * cos( t ) * sin( w ),
+            cos( r ) * cos( t ) * sin( w ) - sin( r ) * sin( t ) * cos( w ) };
+        int32_t qi[4] = { q.h, q.i, q.j, q.k };
+        for( m = 0; m < 4; m++ ) {
+            e = fabs( qi[m] / Q31 - qd[m] );
+            e_q = e > e_q ? e : e_q;
+        }
+
+        b = r2_qq31_to_nq31( q );
+        e = angle_error( b.roll, a.roll ); e_n = e > e_n ? e : e_n;
+        e = angle_error( b.pitch, a.pitch ); e_n = e > e_n ? e : e_n;
+        e = angle_error( b.yaw, a.yaw ); e_n = e > e_n ? e : e_n;
+
+        struct r2_qf_t pf = r2_qf_product( r2_qq31_to_qf( q ),
+                r2_qq31_to_qf( r2_nq31_to_qq31( b ) ) );
+        p = r2_qq31_product( q, r2_nq31_to_qq31( b ) );
+        e = fabs( p.h / Q31 - pf.h ) + fabs( p.k / Q31 - pf.k );
+        e_p = e > e_p ? e : e_p;
+    }
+    printf( "sincos %.3g atan2 %.3g nq to qq %.3g qq to nq %.3g product %.3g\n",
+            e_sc, e_at, e_q, e_n, e_p );
+    assert( e_sc < 2e-8 && e_at < 2e-8 && e_q < 3e-8 && e_n < 1e-7 );
+    assert( e_p < 1e-6 ); // float reference
+
+    // binary angles wrap around at pi
+    assert( -0x40000000 == r2_fixed_from_radians( 3 * M_PI / 2 ) );
+    assert( INT32_MIN == r2_fixed_from_radians( M_PI ) );
+    assert( INT32_MIN == r2_fixed_from_radians( -M_PI ) );
+    struct r2_nf_t wrap = { 3 * M_PI / 2, 0, (float)-M_PI };
+    a = r2_nf_to_nq31( wrap );
+    assert( angle_error( a.roll, -0x40000000 ) < 1e-6 );
+    assert( angle_error( a.yaw, INT32_MIN ) < 1e-6 );
+    assert( fabsf( r2_nq31_to_nf( a ).roll + (float)M_PI_2 ) < 1e-6f );
+
+    // Q15 is the Q31 result, rounded
+    a15.roll = 0x4000; // a quarter turn about x
+    a15.pitch = 0;
+    a15.yaw = 0;
+    q15 = r2_nq15_to_qq15( a15 );
+    assert( 23170 == q15.h && 23170 == q15.i && 0 == q15.j && 0 == q15.k );
+    a15.roll = INT16_MIN; // and a half turn, which fills the whole range
+    q15 = r2_nq15_to_qq15( a15 );
+    assert( 0 == q15.h && INT16_MIN == q15.i && 0 == q15.j && 0 == q15.k );
+    b15 = r2_qq15_to_nq15( q15 );
+    assert( INT16_MIN == b15.roll && 0 == b15.pitch && 0 == b15.yaw );
+
+    exit( EXIT_SUCCESS );
+}
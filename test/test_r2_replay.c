@@ -0,0 +1,116 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r2_replay.h"
+
+#define CHUNKS 100 // 50 of each port, 2 ms apart
+
+static char text[CHUNKS][64];
+
+int main( void ){
+    char dir[] = "/tmp/test_r2_replayXXXXXX", path[64];
+    assert( mkdtemp( dir ) );
+    snprintf( path, sizeof( path ), "%s/capture", dir );
+
+    // lines of two ports, each line split across two chunks
+    struct r2_capture * capture = r2_capture_create( path, 0 );
+    size_t m, total = 0;
+    for( m = 0; m < CHUNKS; m++ ) {
+        int n = sprintf( text[m], "%s,%zu", m % 2 ? "$B" : "$A", m );
+        if( m % 4 > 1 )
+            n += sprintf( text[m] + n, "\r\n" );
+        struct r2_capture_chunk c = { 0, (uint16_t)( m % 2 ), 0,
+            (int64_t)m * 1000, 1000000000 + (int64_t)m * 1000,
+            (uint32_t)n, 0 };
+        assert( 0 == r2_capture_write_chunk( capture, &c, text[m] ) );
+        total += m % 2 ? n : 0;
+    }
+    r2_capture_destroy( capture );
+
+    // as fast as possible into a buffer, chunk by chunk
+    struct r2_replay * replay = r2_replay_create( path, 1, 0 );
+    assert( replay );
+    struct r2_buffer * buffer = r2_buffer_create( 8 );
+    char lines[4096];
+    size_t n, length = 0;
+    for( m = 1; m < CHUNKS; m += 2 ) {
+        size_t got = 0;
+        while( got < strlen( text[m] ) ) {
+            // a small buffer takes a chunk in pieces
+            n = r2_replay_fill( replay, buffer );
+            assert( n > 0 && n <= 8 );
+            assert( (int64_t)m * 1000 == replay->chunk.monotonic );
+            assert( 0 == memcmp( text[m] + got, buffer->data, n ) );
+            memcpy( lines + length, buffer->data, n );
+            length += n;
+            got += n;
+            r2_buffer_drop( buffer, n );
+        }
+        assert( got == strlen( text[m] ) ); // never into the next chunk
+    }
+    assert( 0 == r2_replay_fill( replay, buffer ) );
+    assert( total == length && total == replay->bytes
+            && CHUNKS / 2 == replay->chunks );
+    lines[length] = 0;
+    assert( 0 == strncmp( "$B,1$B,3\r\n$B,5$B,7\r\n", lines, 20 ) );
+
+    // at real time and ten times faster: the 98 ms of port 0, no chunk
+    // early (how late depends on the load of the machine)
+    struct r2_capture_chunk c;
+    const void * data;
+    double speed;
+    int64_t t0;
+    for( speed = 1; speed <= 10; speed *= 10 ) {
+        r2_replay_destroy( replay );
+        replay = r2_replay_create( path, 0, speed );
+        t0 = r2_capture_monotonic_now();
+        for( m = 0; r2_replay_next( replay, &c, &data ); m += 2 ) {
+            int64_t late = r2_capture_monotonic_now() - t0
+                - (int64_t)( c.monotonic / speed );
+            assert( late >= 0 );
+            assert( c.length == strlen( text[m] )
+                    && 0 == memcmp( text[m], data, c.length ) );
+        }
+        assert( CHUNKS == m );
+    }
+
+    // from a time on, through a pipe
+    r2_replay_set_speed( replay, 0 );
+    r2_replay_seek( replay, 1000000000 + 50000 );
+    int fd[2];
+    assert( 0 == pipe( fd ) );
+    for( m = 50; ( n = r2_replay_write( replay, fd[1] ) ) > 0; m += 2 ) {
+        assert( n == strlen( text[m] ) );
+        assert( n == (size_t)read( fd[0], lines, sizeof( lines ) ) );
+        assert( 0 == memcmp( text[m], lines, n ) );
+    }
+    assert( CHUNKS == m );
+    close( fd[0] );
+    close( fd[1] );
+
+    // or a pseudo-terminal, read like a serial device
+    char pts[64];
+    int master = r2_replay_pty( pts, sizeof( pts ) );
+    assert( -1 != master );
+    int slave = open( pts, O_RDONLY | O_NOCTTY );
+    assert( -1 != slave );
+    r2_replay_seek( replay, 0 );
+    assert( 4 == r2_replay_write( replay, master ) );
+    assert( 6 == r2_replay_write( replay, master ) );
+    assert( 10 == read( slave, lines, sizeof( lines ) ) );
+    assert( 0 == memcmp( "$A,0$A,2\r\n", lines, 10 ) ); // raw: no \r\n mapping
+    close( slave );
+    close( master );
+
+    r2_replay_destroy( replay );
+    free( buffer->data ); // r2_buffer_destroy does not free
+    free( buffer );
+    assert( NULL == r2_replay_create( "/dev/null", 0, 0 ) );
+    unlink( path );
+    rmdir( dir );
+    exit( EXIT_SUCCESS );
+}
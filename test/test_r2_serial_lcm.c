@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "r2_serial_lcm.h"
+
+#define LINES 500
+
+// an in-process stand-in for LCM: keep the messages published
+static unsigned char store[1 << 20];
+static size_t stored, count, offset[4 * LINES], size[4 * LINES];
+static int fail;
+
+static int publish( void * context, const char * channel, const void * data,
+        const size_t n )
+{
+    assert( 0 == strcmp( "SERIAL", channel ) );
+    assert( &stored == context );
+    if( fail )
+        return -1;
+    memcpy( store + stored, data, n );
+    offset[count] = stored;
+    size[count++] = n;
+    stored += n;
+    return 0;
+}
+
+// fixed 5-byte frames
+static size_t five( const char * data, const size_t n )
+{
+    (void)data;
+    return n >= 5 ? 5 : 0;
+}
+
+int main( void ){
+    // lcm-gen's hash, on the type of LCM's own example (exlcm/example_t)
+    const struct r2_lcm_member example[] = {
+        { "int64_t", "timestamp", { NULL } },
+        { "double", "position", { "3", NULL } },
+        { "double", "orientation", { "4", NULL } },
+        { "int32_t", "num_ranges", { NULL } },
+        { "int16_t", "ranges", { "num_ranges", NULL } },
+        { "string", "name", { NULL } },
+        { "boolean", "enabled", { NULL } } };
+    uint64_t hash = 0x1baa9e29b0fbaa8bULL;
+    assert( ( hash << 1 | hash >> 63 ) == r2_lcm_fingerprint( example, 7 ) );
+
+    unsigned char b[8];
+    r2_lcm_put_int64( b, -2 );
+    assert( 0xff == b[0] && 0xfe == b[7] && -2 == r2_lcm_get_int64( b ) );
+    r2_lcm_put_double( b, 1.5 );
+    assert( 0x3f == b[0] && 0xf8 == b[1] && 1.5 == r2_lcm_get_double( b ) );
+    r2_lcm_put_float( b, -2.0f );
+    assert( 0xc0 == b[0] && -2.0f == r2_lcm_get_float( b ) );
+
+    // a serial port stood in for by a pipe
+    int fd[2];
+    assert( 0 == pipe( fd ) );
+    struct r2_serial_port port = { fd[0], r2_buffer_create( 256 ) };
+    struct r2_transport transport = { publish, &stored };
+    struct r2_serial_lcm * bridge = r2_serial_lcm_create( &port, "SERIAL",
+            transport );
+    assert( bridge );
+
+    static char text[LINES * 40];
+    size_t length = 0, written = 0;
+    int n;
+    for( n = 0; n < LINES; n++ )
+        length += sprintf( text + length, "$LINE,%d,%*d\r\n", n, n % 17, n );
+    int64_t before = r2_epoch_usec_now();
+    while( written < length ) {
+        size_t piece = 1 + rand() % 100;
+        piece = piece < length - written ? piece : length - written;
+        assert( piece == (size_t)write( fd[1], text + written, piece ) );
+        written += piece;
+        assert( r2_serial_lcm_handle( bridge ) >= 0 );
+    }
+    assert( LINES == count && LINES == bridge->frames
+            && LINES == bridge->messages );
+
+    // every message holds one line, in order, stamped with the read time
+    size_t m, l, at = 0;
+    int64_t usec;
+    const char * data;
+    for( m = 0; m < count; m++ ) {
+        assert( 0 == r2_serial_lcm_decode( bridge, store + offset[m], size[m],
+                    &usec, &data, &l ) );
+        assert( usec >= before && usec <= r2_epoch_usec_now() );
+        assert( '\n' == data[l - 1] );
+        assert( 0 == memcmp( text + at, data, l ) );
+        at += l;
+    }
+    assert( length == at );
+    assert( -1 == r2_serial_lcm_decode( bridge, store, size[0] - 1, &usec,
+                &data, &l ) );
+
+    // batches of up to four frames ready at the same time
+    r2_serial_lcm_set_batch( bridge, 4 );
+    count = stored = 0;
+    assert( 150 == write( fd[1], text, 150 ) ); // some lines and a piece
+    assert( 0 < r2_serial_lcm_handle( bridge ) );
+    size_t lines = bridge->frames - LINES;
+    assert( lines > 4 && ( lines + 3 ) / 4 == count );
+    assert( 0 == r2_serial_lcm_decode( bridge, store, size[0], &usec, &data,
+                &l ) );
+    assert( 0 == memcmp( text, data, l ) );
+    for( n = 0; l--; )
+        n += '\n' == data[l];
+    assert( 4 == n );
+
+    // other framing; a failing publisher
+    r2_buffer_drop( port.buffer, port.buffer->position );
+    r2_serial_lcm_set_batch( bridge, 1 );
+    r2_serial_lcm_set_framer( bridge, five );
+    fail = 1;
+    assert( 12 == write( fd[1], "abcdefghijkl", 12 ) );
+    assert( 0 == r2_serial_lcm_handle( bridge ) );
+    assert( 2 == bridge->errors && 2 == port.buffer->position );
+
+    // a full buffer without a frame is dropped
+    r2_serial_lcm_set_framer( bridge, r2_serial_lcm_line );
+    memset( text, 'x', 254 );
+    assert( 254 == write( fd[1], text, 254 ) );
+    r2_serial_lcm_handle( bridge );
+    assert( 0 == port.buffer->position && 256 == bridge->dropped );
+
+    r2_serial_lcm_destroy( bridge );
+    close( fd[0] );
+    close( fd[1] );
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "r2_adc_lcm.h"
+#include "r2_shm_ring.h"
+#include "r2_transport.h"
+
+#define RECORDS 200000
+
+int main( void ){
+    struct r2_shm_ring * ring = r2_shm_ring_create( "test", 1000 );
+    assert( ring && 4096 == ring->size );
+    struct r2_shm_ring * reader = r2_shm_ring_open( ring->fd );
+    assert( reader );
+    assert( NULL == r2_shm_ring_open( STDIN_FILENO ) );
+    ring->header->size = 3000; // fits in the file, but is no power of two
+    assert( NULL == r2_shm_ring_open( ring->fd ) );
+    ring->header->size = 0;
+    assert( NULL == r2_shm_ring_open( ring->fd ) );
+    ring->header->size = ring->size;
+
+    const char * channel;
+    const void * data;
+    size_t length;
+    assert( 0 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( 0 == r2_shm_ring_write( ring, "A", "hello", 5 ) );
+    assert( 0 == r2_shm_ring_write( ring, "BB", "", 0 ) );
+    assert( 1 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( 0 == strcmp( "A", channel ) && 5 == length
+            && 0 == memcmp( "hello", data, 5 ) );
+    assert( 1 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( 0 == strcmp( "BB", channel ) && 0 == length );
+    assert( 0 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( -1 == r2_shm_ring_write( ring, "A", "", 5000 ) );
+
+    // records of all sizes, wrapping around many times
+    static unsigned char message[4096];
+    size_t m, n;
+    for( m = 0; m < sizeof( message ); m++ )
+        message[m] = (unsigned char)( m * 7 );
+    for( m = 0; m < 10000; m++ ) {
+        n = rand() % 1500;
+        assert( 0 == r2_shm_ring_write( ring, "WRAP", message + m % 100, n ) );
+        assert( 1 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+        assert( n == length && 0 == memcmp( message + m % 100, data, n ) );
+    }
+    assert( 0 == reader->overruns && 10002 == reader->records );
+
+    // a consumer left behind skips to what comes next
+    for( m = 0; m < 10; m++ )
+        r2_shm_ring_write( ring, "A", message, 1000 );
+    assert( 0 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( 1 == reader->overruns );
+    r2_shm_ring_write( ring, "A", "next", 4 );
+    assert( 1 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( 0 == memcmp( "next", data, 4 ) );
+
+    // waiting times out on an empty ring
+    assert( 0 == r2_shm_ring_wait( reader, 10 ) );
+    r2_shm_ring_write( ring, "A", "", 0 );
+    assert( 1 == r2_shm_ring_wait( reader, -1 ) );
+    r2_shm_ring_read( reader, &channel, &data, &length );
+
+    // the bridges publish into the ring, decoded on the other side as
+    // they are over LCM
+    struct r2_adc_lcm * adc = r2_adc_lcm_create( 3, 2, "ADC",
+            r2_transport_shm( ring ) );
+    float rows[2][3] = { { 1, 2, 3 }, { 4, 5, 6 } }, out[2][3];
+    int64_t utime, last;
+    assert( 1 == r2_adc_lcm_push( adc, &rows[0][0], 2, 1000 ) );
+    assert( 1 == r2_shm_ring_read( reader, &channel, &data, &length ) );
+    assert( 0 == strcmp( "ADC", channel ) );
+    assert( 2 == r2_adc_lcm_decode( adc, data, length, &utime, &last, &m,
+                &out[0][0], 2 ) );
+    assert( 0 == memcmp( rows, out, sizeof( rows ) ) );
+    r2_adc_lcm_destroy( adc );
+    r2_shm_ring_destroy( reader );
+
+    // another process reads sequence numbers as fast as they come: the
+    // ones it gets are whole and in order, though it may be overrun (the
+    // writer waits for it to be ready, and ends with a last record next to
+    // each stop, so it reads at least one however loaded the machine is)
+    int got[2];
+    assert( 0 == pipe( got ) );
+    pid_t child = fork();
+    assert( -1 != child );
+    if( 0 == child ) {
+        reader = r2_shm_ring_open( ring->fd );
+        if( 1 != write( got[1], "", 1 ) )
+            _exit( EXIT_FAILURE );
+        uint64_t seq, next = 0;
+        for( ;; ) {
+            r2_shm_ring_wait( reader, -1 );
+            while( r2_shm_ring_read( reader, &channel, &data, &length ) ) {
+                if( 0 == strcmp( "STOP", channel ) ) {
+                    printf( "%zu records read, %zu overruns\n",
+                            reader->records, reader->overruns );
+                    fflush( stdout );
+                    _exit( reader->records > 1 ? EXIT_SUCCESS : EXIT_FAILURE );
+                }
+                if( sizeof( seq ) != length )
+                    _exit( EXIT_FAILURE );
+                memcpy( &seq, data, sizeof( seq ) );
+                if( seq < next )
+                    _exit( EXIT_FAILURE );
+                next = seq + 1;
+            }
+        }
+    }
+    uint64_t seq;
+    char c;
+    assert( 1 == read( got[0], &c, 1 ) );
+    for( seq = 0; seq < RECORDS; seq++ )
+        r2_shm_ring_write( ring, "SEQ", &seq, sizeof( seq ) );
+    int status;
+    while( 0 == waitpid( child, &status, WNOHANG ) ) {
+        // again, in case it was overrun
+        r2_shm_ring_write( ring, "SEQ", &seq, sizeof( seq ) );
+        seq++;
+        r2_shm_ring_write( ring, "STOP", "", 0 );
+        usleep( 1000 );
+    }
+    assert( WIFEXITED( status ) && EXIT_SUCCESS == WEXITSTATUS( status ) );
+    close( got[0] );
+    close( got[1] );
+
+    r2_shm_ring_destroy( ring );
+    exit( EXIT_SUCCESS );
+}
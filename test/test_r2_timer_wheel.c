@@ -0,0 +1,77 @@
+#include <assert.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_timer_wheel.h"
+
+#define N 8
+
+int order[N];
+int fired = 0;
+
+void record( struct r2_timer * timer, void * data )
+{
+    (void)timer;
+    order[fired++] = *(int *)data;
+}
+
+int repeats = 0;
+
+void repeat( struct r2_timer * timer, void * data )
+{
+    struct r2_timer_wheel * wheel = data;
+    if( ++repeats < 5 )
+        r2_timer_wheel_add( wheel, timer, 2000 );
+}
+
+int main( void ){
+    assert( NULL == r2_timer_wheel_create( CLOCK_MONOTONIC, 0 ) );
+    struct r2_timer_wheel * w = r2_timer_wheel_create( CLOCK_MONOTONIC, 1000 );
+    assert( NULL != w );
+
+    // deterministic part: drive the wheel by tick rather than by the clock,
+    // with timers on every level and one beyond the horizon
+    int64_t usec[N] = { 3000, 1000, 64000, 65000, 5000000, 300000000,
+        20000000000, 40000000000 };
+    int id[N] = { 1, 0, 2, 3, 4, 5, 6, 7 };
+    struct r2_timer t[N];
+    int i;
+    for( i = 0; i < N; i++ ) {
+        r2_timer_init( &t[i], record, &id[i] );
+        assert( 0 == r2_timer_wheel_add( w, &t[i], usec[i] ) );
+    }
+    assert( w->pending == N );
+    r2_timer_wheel_cancel( w, &t[3] );
+    assert( !r2_timer_pending( &t[3] ) );
+    assert( w->pending == N - 1 );
+
+    r2_timer_wheel_advance( w, 50000000 );
+    assert( fired == N - 1 );
+    assert( w->pending == 0 );
+    int expected[N - 1] = { 0, 1, 2, 4, 5, 6, 7 };
+    for( i = 0; i < N - 1; i++ )
+        assert( order[i] == expected[i] );
+
+    r2_timer_wheel_destroy( w );
+
+    // real time: a timer that re-adds itself from its callback, and a
+    // one-shot, on the same timerfd
+    w = r2_timer_wheel_create( CLOCK_MONOTONIC, 1000 );
+    struct r2_timer periodic, once;
+    r2_timer_init( &periodic, repeat, w );
+    r2_timer_init( &once, record, &id[0] );
+    fired = 0;
+    r2_timer_wheel_add( w, &periodic, 2000 );
+    r2_timer_wheel_add( w, &once, 5000 );
+    struct pollfd p = { w->fd, POLLIN, 0 };
+    while( r2_timer_pending( &periodic ) || r2_timer_pending( &once ) ) {
+        assert( 1 == poll( &p, 1, 1000 ) );
+        assert( r2_timer_wheel_dispatch( w ) >= 0 );
+    }
+    assert( repeats == 5 );
+    assert( fired == 1 );
+    r2_timer_wheel_destroy( w );
+
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,47 @@
+#include <assert.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/prctl.h>
+
+#include "r2_timerfd.h"
+
+int main( void ){
+    // sub-second one-shot
+    int fd = r2_timerfd_new( CLOCK_MONOTONIC, TFD_NONBLOCK );
+    assert( -1 != fd );
+    assert( 0 == r2_timerfd_arm_nsec( fd, 5000000, 0 ) );
+    assert( r2_timerfd_armed( fd ) );
+    assert( r2_timerfd_usec_remaining( fd ) <= 5000 );
+    assert( 0 == r2_timerfd_expirations( fd ) );
+    struct pollfd p = { fd, POLLIN, 0 };
+    assert( 1 == poll( &p, 1, 1000 ) );
+    assert( 1 == r2_timerfd_expirations( fd ) );
+    assert( !r2_timerfd_armed( fd ) );
+    close( fd );
+
+    // 200 Hz, aligned to 5 ms boundaries of the realtime clock; missed
+    // expirations show up in the count
+    fd = r2_timerfd_new( CLOCK_REALTIME, TFD_NONBLOCK );
+    assert( -1 == r2_timerfd_arm_aligned( fd, CLOCK_REALTIME, 0 ) );
+    assert( 0 == r2_timerfd_arm_aligned( fd, CLOCK_REALTIME, 5000000 ) );
+    p.fd = fd;
+    assert( 1 == poll( &p, 1, 1000 ) );
+    int64_t late = r2_epoch_timespec_to_nsec( r2_epoch_timespec_now() )
+        % 5000000;
+    printf( "woke %" PRId64 " ns after the 5 ms boundary\n", late );
+    assert( r2_timerfd_expirations( fd ) >= 1 );
+    struct timespec nap = { 0, 22000000 };
+    nanosleep( &nap, NULL );
+    assert( r2_timerfd_expirations( fd ) >= 4 );
+    close( fd );
+
+    // the process's timer slack
+    int slack = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+    assert( 0 == r2_timerfd_timerslack( 1000 ) );
+    assert( 1000 == prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 ) );
+    assert( 0 == r2_timerfd_timerslack( slack ) );
+    assert( slack == prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 ) );
+
+    exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,124 @@
+#include <assert.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "r2_timerfd_set.h"
+
+#define N 8
+
+// wait for the fd of timer i to become readable
+static void wait_for( struct r2_timerfd_set * s, const int i )
+{
+    struct pollfd p = { s->timers[i].fd, POLLIN, 0 };
+    assert( 1 == poll( &p, 1, 1000 ) );
+    r2_timerfd_set_now( s );
+}
+
+// arming, disarming and the cached queries, without coalescing
+static void basics( void )
+{
+    struct r2_timerfd_set * s = r2_timerfd_set_create( CLOCK_MONOTONIC, 2 );
+    assert( NULL != s );
+    assert( 0 == r2_timerfd_set_add( s ) && 1 == r2_timerfd_set_add( s ) );
+    assert( -1 == r2_timerfd_set_add( s ) ); // full
+    assert( !r2_timerfd_set_armed( s, 0 ) );
+    assert( 0 == r2_timerfd_set_nsec_remaining( s, 0 ) );
+    assert( 0 == r2_timerfd_set_disarm( s, 0 ) ); // already
+    assert( 0 == r2_timerfd_set_expire( s, 0 ) ); // nothing to read
+
+    // one-shot
+    assert( 0 == r2_timerfd_set_arm( s, 0, 2000000, 0 ) );
+    int64_t deadline = s->timers[0].deadline;
+    assert( s->now + 2000000 == deadline );
+    assert( r2_timerfd_set_armed( s, 0 ) );
+    assert( 2000000 == r2_timerfd_set_nsec_remaining( s, 0 ) );
+    assert( 2000 == r2_timerfd_set_usec_remaining( s, 0 ) );
+    assert( 0 == r2_timerfd_set_expire( s, 0 ) ); // not yet
+    assert( deadline == s->timers[0].deadline );
+    wait_for( s, 0 );
+    assert( !r2_timerfd_set_armed( s, 0 ) ); // past its deadline
+    assert( 0 == r2_timerfd_set_nsec_remaining( s, 0 ) );
+    assert( 1 == r2_timerfd_set_expire( s, 0 ) );
+    assert( 0 == s->timers[0].deadline && 1 == s->wakeups );
+
+    // periodic, with expirations left unread for a while
+    assert( 0 == r2_timerfd_set_arm( s, 1, 1000000, 1000000 ) );
+    struct timespec nap = { 0, 5500000 };
+    nanosleep( &nap, NULL );
+    r2_timerfd_set_now( s );
+    assert( r2_timerfd_set_armed( s, 1 ) );
+    assert( r2_timerfd_set_nsec_remaining( s, 1 ) <= 1000000 );
+    assert( r2_timerfd_set_expire( s, 1 ) >= 5 );
+    assert( s->timers[1].deadline > s->now );
+    assert( 1000000 == s->timers[1].interval );
+    assert( 0 == r2_timerfd_set_disarm( s, 1 ) );
+    assert( !r2_timerfd_set_armed( s, 1 ) && 0 == s->timers[1].interval );
+
+    // errors leave the tracked state as it was
+    assert( 0 == r2_timerfd_set_arm( s, 0, 1000000000, 0 ) );
+    deadline = s->timers[0].deadline;
+    assert( -1 == r2_timerfd_set_arm_abs( s, 0, -1000000000, 0 ) );
+    assert( deadline == s->timers[0].deadline && r2_timerfd_set_armed( s, 0 ) );
+    int fd = s->timers[0].fd;
+    s->timers[0].fd = -1;
+    assert( -1 == r2_timerfd_set_expire( s, 0 ) );
+    assert( -1 == r2_timerfd_set_disarm( s, 0 ) );
+    s->timers[0].fd = fd;
+    assert( deadline == s->timers[0].deadline );
+    r2_timerfd_set_destroy( s );
+}
+
+// run N periodic timers with staggered phases for about 200 ms, and return
+// the number of distinct wakeups
+int64_t run( int coalesce )
+{
+    struct r2_timerfd_set * s = r2_timerfd_set_create( CLOCK_MONOTONIC, N );
+    assert( NULL != s );
+    r2_timerfd_set_coalesce( s, coalesce );
+    struct pollfd p[N];
+    int i;
+    for( i = 0; i < N; i++ ) {
+        assert( i == r2_timerfd_set_add( s ) );
+        r2_timerfd_set_slack( s, i, 8000000 );
+        assert( 0 == r2_timerfd_set_arm( s, i, 1000000 + i * 1000000,
+                    10000000 ) );
+        assert( r2_timerfd_set_armed( s, i ) );
+        assert( r2_timerfd_set_usec_remaining( s, i ) <= 9000 + i * 1000 );
+        p[i].fd = s->timers[i].fd;
+        p[i].events = POLLIN;
+    }
+    int64_t end = s->now + 200000000;
+    while( r2_timerfd_set_now( s ) < end ) {
+        assert( poll( p, N, 1000 ) > 0 );
+        r2_timerfd_set_now( s );
+        for( i = 0; i < N; i++ ) {
+            if( p[i].revents & POLLIN ) {
+                int64_t nominal = s->timers[i].nominal;
+                assert( r2_timerfd_set_expire( s, i ) >= 1 );
+                // never early, and never later than the slack allows
+                assert( s->timers[i].deadline >= s->timers[i].nominal );
+                assert( s->timers[i].deadline
+                        <= s->timers[i].nominal + s->timers[i].slack );
+                assert( s->timers[i].nominal > nominal );
+            }
+        }
+    }
+    int64_t wakeups = s->wakeups;
+    printf( "coalesce %d: %" PRId64 " wakeups, %" PRId64 " saved\n",
+            coalesce, s->wakeups, s->wakeups_saved );
+    for( i = 0; i < N; i++ ) {
+        assert( 0 == r2_timerfd_set_disarm( s, i ) );
+        assert( !r2_timerfd_set_armed( s, i ) );
+    }
+    r2_timerfd_set_destroy( s );
+    return wakeups;
+}
+
+int main( void ){
+    basics();
+    int64_t plain = run( 0 );
+    int64_t coalesced = run( 1 );
+    assert( coalesced * 2 < plain );
+    exit( EXIT_SUCCESS );
+}